@@ -11,8 +11,16 @@
 
 #include "spif.h"
 
+extern void spif_port_stm32l4xx_qspi_get(spif_port_spi_ops_t *ops);
+extern void spif_port_stm32l4xx_plat_get(spif_port_plat_ops_t *ops);
+
+static spif_dev_t s_qspi_flash;
+
 int main(void)
 {
+    spif_port_spi_ops_t spi_ops = {0};
+    spif_port_plat_ops_t plat_ops = {0};
+
     HAL_Init();
 
     bsp_clock_init();
@@ -20,7 +28,9 @@ int main(void)
     bsp_uart_init(115200);
     bsp_button_init();
 
-    spif_init();
+    spif_port_stm32l4xx_qspi_get(&spi_ops);
+    spif_port_stm32l4xx_plat_get(&plat_ops);
+    spif_init(&s_qspi_flash, &spi_ops, &plat_ops);
 
     while (1) {
         bsp_delay_us(1);
@@ -8,10 +8,221 @@
 #define __SPIF_H__
 
 #include <stdint.h>
+#include "spif_port.h"
 
 /* SPIF status code */
 #define SPIF_SUCCESS  (0)
 #define SPIF_FAIL     (-1)
+#define SPIF_BUSY     (-2) /* an asynchronous operation is still in flight */
+#define SPIF_TIMEOUT  (-3) /* the flash did not become idle in its maximum operation time, or the bus lock stayed taken */
+
+/* SPIF asynchronous operation state */
+#define SPIF_ASYNC_IDLE        0
+#define SPIF_ASYNC_RUNNING     1 /* data phase running (DMA) */
+#define SPIF_ASYNC_PROGRAMMING 2 /* data sent, flash busy programming */
+#define SPIF_ASYNC_DONE        3
+
+/* SPIF read mode, ordered from slowest to fastest for short random reads */
+typedef enum {
+    SPIF_READ_MODE_NORMAL      = 0, /* 0x03, 1-1-1, no dummy */
+    SPIF_READ_MODE_FAST        = 1, /* 0x0B, 1-1-1 */
+    SPIF_READ_MODE_QUAD_OUTPUT = 2, /* 0x6B, 1-1-4, QSPI only */
+    SPIF_READ_MODE_QUAD_IO     = 3, /* 0xEB, 1-4-4, QSPI only */
+    SPIF_READ_MODE_QUAD_IO_DTR = 4, /* 0xED, 1-4D-4D, QSPI with SPIF_PORT_CAP_QSPI_DDR only */
+    SPIF_READ_MODE_QPI         = 5, /* 0xEB, 4-4-4, QSPI only, every command moves to 4 lines */
+} spif_read_mode_t;
+
+/**
+ * @brief completion callback of an asynchronous operation
+ * @note read: called from the port's completion context (usually the DMA/QSPI interrupt)
+ *       page program, erase: called from spif_async_poll(), with the bus lock held: no spif calls in it
+ */
+typedef void (*spif_async_cb_t)(int result, void *arg);
+
+typedef struct spif_async_s {
+    struct spif_dev_s *dev;
+    volatile uint8_t state; /* see SPIF asynchronous operation state */
+    uint8_t op;
+    uint32_t timeout_ms;    /* maximum time of the operation, bounds spif_async_wait() */
+    int result;             /* valid once state is SPIF_ASYNC_DONE */
+    spif_async_cb_t cb;
+    void *arg;
+} spif_async_t;
+
+/* SPIF write mode */
+typedef enum {
+    SPIF_WRITE_MODE_PROGRAM = 0, /* program only, the range must be erased */
+    SPIF_WRITE_MODE_ERASE   = 1, /* read-modify-write, erase every sector the range touches */
+    SPIF_WRITE_MODE_DIFF    = 2, /* compare first, skip unchanged pages, erase a sector only if a bit goes 0 -> 1 */
+} spif_write_mode_t;
+
+/* one buffer of spif_writev() */
+typedef struct spif_iov_s {
+    const void *buf;
+    uint32_t size;
+} spif_iov_t;
+
+#define SPIF_IOV_MAX           8
+
+#define SPIF_ERASE_TYPE_MAX    4
+
+/* erase plan of spif_erase_range(), types are in ascending size */
+typedef struct {
+    uint32_t size[SPIF_ERASE_TYPE_MAX];  /* erase size of each type, 0: unused */
+    uint32_t count[SPIF_ERASE_TYPE_MAX]; /* number of erases of each type */
+    uint8_t chip_erase;                  /* 1: one chip erase replaces all of the above */
+    uint32_t time_ms;                    /* estimated duration from the typical erase times */
+} spif_erase_plan_t;
+
+/* read cache statistics, counted per cache line touched */
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t prefetches;  /* lines read ahead on sequential access */
+    uint32_t bypasses;    /* reads of a line or more, sent to the flash directly */
+    uint32_t invalidates; /* lines dropped after a failed program/erase */
+} spif_cache_stats_t;
+
+/* SPIF_WRITE_MODE_DIFF statistics */
+typedef struct {
+    uint32_t pages_skipped;    /* already holding the new data */
+    uint32_t pages_programmed;
+    uint32_t erases;           /* sectors where some bit had to go from 0 to 1 */
+    uint32_t erases_avoided;   /* sectors written without an erase */
+} spif_write_stats_t;
+
+/* bus lock statistics, hold time in us (0 without plat_ops.timestamp) */
+typedef struct {
+    uint32_t locks;
+    uint32_t contended;      /* the try lock failed, the caller had to wait */
+    uint32_t timeouts;       /* gave up after SPIF_LOCK_TIMEOUT_MS */
+    uint32_t busy;           /* refused, an asynchronous operation owns the flash */
+    uint32_t wait_max_us;
+    uint64_t hold_total_us;
+    uint32_t hold_max_us;
+    const char *hold_max_caller; /* API call of hold_max_us */
+} spif_lock_stats_t;
+
+/* wait for the bus lock of the port before an API call gives up with SPIF_TIMEOUT */
+#ifndef SPIF_LOCK_TIMEOUT_MS
+#define SPIF_LOCK_TIMEOUT_MS   5000
+#endif
+
+/* spif_write() read-modify-write buffer, must hold one sector, dual-flash doubles the sector: 8K */
+#ifndef SPIF_RMW_BUF_SIZE
+#define SPIF_RMW_BUF_SIZE      (4 * 1024)
+#endif
+
+/* read cache, set SPIF_CACHE_ENABLE to 1 (or -D it) to use it */
+#ifndef SPIF_CACHE_ENABLE
+#define SPIF_CACHE_ENABLE      0
+#endif
+
+#ifndef SPIF_CACHE_LINE_SIZE
+#define SPIF_CACHE_LINE_SIZE   1024 /* power of 2, one page to one sector */
+#endif
+
+#ifndef SPIF_CACHE_LINES
+#define SPIF_CACHE_LINES       8
+#endif
+
+typedef struct spif_erase_type_s {
+    uint32_t size;   /* unit: Byte, 0: unused */
+    uint8_t cmd;
+    uint32_t typ_ms; /* typical erase time */
+    uint32_t max_ms; /* maximum erase time, used as timeout */
+} spif_erase_type_t;
+
+typedef struct spif_flash_info_s {
+    char *name;
+
+    uint8_t mf_id;  /* Manufacturer ID */
+    uint8_t mt_id;  /* Memory Type ID */
+    uint8_t cap_id; /* Capacity ID */
+
+    uint32_t chip_size;   /* unit: Byte */
+    uint32_t block_size;  /* unit: Byte */
+    uint32_t sector_size; /* unit: Byte */
+    uint32_t page_size;   /* unit: Byte */
+
+    uint8_t read_mode;       /* fastest read mode supported, see spif_read_mode_t */
+    uint8_t qe_type;         /* see SPIF_QE_xxx */
+    uint8_t fast_read_dummy; /* dummy cycles of 0x0B */
+    uint8_t quad_out_dummy;  /* dummy cycles of 0x6B */
+    uint8_t quad_io_dummy;   /* dummy cycles of 0xEB, mode bits excluded */
+
+    /* QPI (4-4-4), enter opcode 0: not supported */
+    uint8_t qpi_enter_cmd;   /* sent in SPI mode, Quad Enable set first */
+    uint8_t qpi_exit_cmd;    /* sent in QPI mode */
+    uint8_t qpi_dummy;       /* dummy cycles of 0xEB in QPI, mode bits excluded */
+
+    /* DTR fast read 1-4D-4D, opcode 0: not supported */
+    uint8_t dtr_read_cmd;
+    uint8_t dtr_read_dummy;  /* mode bits (1 clock) excluded */
+
+    uint8_t cread_mode_bits; /* mode bits of 0xEB/0xED that keep the flash in continuous read mode, 0: not supported */
+
+    /* timing, from the datasheet AC characteristics */
+    uint32_t pp_typ_us;      /* page program */
+    uint32_t pp_max_us;
+    uint32_t wrsr_max_ms;    /* non-volatile status register write */
+    uint32_t ce_typ_ms;      /* chip erase */
+    uint32_t ce_max_ms;
+
+    /* erase suspend/resume, 0: not supported */
+    uint8_t suspend_cmd;
+    uint8_t resume_cmd;
+    uint32_t suspend_max_us; /* until the array can be read */
+
+    spif_erase_type_t erase[SPIF_ERASE_TYPE_MAX]; /* ascending size */
+} spif_flash_info_t;
+
+#if SPIF_CACHE_ENABLE
+typedef struct spif_cache_line_s {
+    uint32_t addr;  /* line aligned, SPIF_CACHE_INVALID_ADDR: empty */
+    uint32_t stamp; /* last use, for LRU */
+    uint8_t data[SPIF_CACHE_LINE_SIZE];
+} spif_cache_line_t;
+#endif
+
+/**
+ * one flash chip and the port it hangs on, every API call takes one.
+ * allocated by the caller, filled in by spif_init(), the members are private to spif.
+ * devices share nothing, so chips on different ports can be driven from different tasks.
+ * callers sharing one device are serialized by the port's bus lock (spi_lock), one API call at a time
+ */
+typedef struct spif_dev_s {
+    spif_port_spi_ops_t spi_ops;
+    spif_port_plat_ops_t plat_ops;
+
+    spif_flash_info_t flash;
+    spif_read_mode_t read_mode;
+    uint8_t qpi;               /* the flash is in QPI mode, every command on 4 lines */
+    uint8_t dual;              /* two chips in dual-flash mode, see SPIF_PORT_CAP_QSPI_DUAL */
+    uint8_t cread;             /* continuous read session open */
+    uint8_t cread_active;      /* the flash is in continuous read mode, the next read skips the opcode */
+
+    uint8_t rmw_buf[SPIF_RMW_BUF_SIZE];
+    spif_write_stats_t write_stats;
+
+#if SPIF_CACHE_ENABLE
+    spif_cache_line_t cache[SPIF_CACHE_LINES];
+    uint32_t cache_tick;
+    uint32_t cache_last; /* line of the previous access */
+    spif_cache_stats_t cache_stats;
+#endif
+
+    spif_async_t *volatile async; /* asynchronous operation in flight */
+    uint8_t erase_suspended;      /* the erase in flight is suspended */
+
+    spif_lock_stats_t lock_stats;
+    uint64_t lock_stamp;     /* us, when the holder took the lock */
+    const char *lock_caller;
+
+    const uint8_t *mmap_base;
+    uint8_t mmap_enabled; /* between spif_mmap() and spif_munmap() */
+    uint8_t mmap_active;  /* port currently in memory-mapped mode */
+} spif_dev_t;
 
 typedef struct {
     char *name;      /* flash name */
@@ -22,23 +233,184 @@ typedef struct {
 } spif_flash_t;
 
 /**
- * @brief
+ * @brief bind a device to its port and identify the flash (static table, then SFDP)
+ * @param spi_ops, plat_ops filled in by the port's *_get() functions, copied into dev
  * @return see SPIF status code
  */
-int spif_init(void);
+int spif_init(spif_dev_t *dev, const spif_port_spi_ops_t *spi_ops, const spif_port_plat_ops_t *plat_ops);
 
-int spif_read(uint32_t addr, uint8_t *data, uint32_t data_size);
+int spif_read(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size);
 
-int spif_fast_read(uint32_t addr, uint8_t *data, uint32_t data_size);
+/**
+ * @brief read with the current read mode (see spif_set_read_mode)
+ * @return see SPIF status code
+ */
+int spif_fast_read(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size);
 
-int spif_block_erase_32(uint32_t addr);
+/**
+ * @brief select the read mode used by spif_fast_read,
+ *        quad modes set the Quad Enable bit of the flash if needed,
+ *        SPIF_READ_MODE_QPI switches the flash to QPI: from then on every command uses 4 lines
+ * @return see SPIF status code
+ */
+int spif_set_read_mode(spif_dev_t *dev, spif_read_mode_t mode);
 
-int spif_block_erase_64(uint32_t addr);
+spif_read_mode_t spif_get_read_mode(spif_dev_t *dev);
 
-int spif_sector_erase(uint32_t addr);
+/**
+ * @brief open a continuous read session: the first spif_continuous_read() sends the read opcode with
+ *        mode bits that keep the flash in continuous read mode, the following ones send only the address
+ *        (8 clocks less per read in 1-4-4). any other spif call takes the flash out of the mode first,
+ *        the next spif_continuous_read() enters it again
+ * @note needs SPIF_READ_MODE_QUAD_IO or faster and a flash with cread_mode_bits
+ * @return see SPIF status code, SPIF_FAIL: not supported
+ */
+int spif_continuous_read_begin(spif_dev_t *dev);
 
-int spif_page_program(uint32_t addr, uint8_t *data, uint32_t data_size);
+/**
+ * @brief read inside the session, spif_fast_read() outside of it
+ * @return see SPIF status code
+ */
+int spif_continuous_read(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size);
+
+/**
+ * @brief close the session and take the flash out of continuous read mode
+ * @return see SPIF status code
+ */
+int spif_continuous_read_end(spif_dev_t *dev);
+
+/**
+ * @brief map the whole flash into the address space (QSPI memory-mapped mode),
+ *        reads through *base need no command, program/erase switch the port
+ *        back to indirect mode and restore the mapping afterwards.
+ *        ports with SPIF_PORT_CAP_QSPI_SIOO keep the flash in continuous read mode (outside QPI),
+ *        so only the first access sends the opcode
+ * @param base returns the start of the window, flash address 0
+ * @return see SPIF status code
+ */
+int spif_mmap(spif_dev_t *dev, const uint8_t **base);
+
+int spif_munmap(spif_dev_t *dev);
+
+/**
+ * @brief read cache statistics (SPIF_CACHE_ENABLE)
+ * @return SPIF_FAIL if the cache is not built in
+ */
+int spif_cache_stats_get(spif_dev_t *dev, spif_cache_stats_t *stats);
+
+void spif_cache_stats_reset(spif_dev_t *dev);
+
+/**
+ * @brief drop every cached line, needed only if the flash was changed behind spif
+ */
+void spif_cache_invalidate(spif_dev_t *dev);
+
+int spif_block_erase_32(spif_dev_t *dev, uint32_t addr);
+
+int spif_block_erase_64(spif_dev_t *dev, uint32_t addr);
+
+int spif_sector_erase(spif_dev_t *dev, uint32_t addr);
+
+/**
+ * @brief dry run of spif_erase_range(), only computes the plan
+ * @return see SPIF status code
+ */
+int spif_erase_plan(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_erase_plan_t *plan);
+
+/**
+ * @brief erase [addr, addr + size) with the fastest mix of the erase sizes the chip supports
+ * @param addr, size must be multiples of the smallest erase size
+ * @param plan optional, returns what was done
+ * @return see SPIF status code
+ */
+int spif_erase_range(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_erase_plan_t *plan);
+
+int spif_page_program(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size);
+
+/**
+ * @brief write any length at any address, split at page boundaries internally
+ * @param mode see spif_write_mode_t
+ * @return see SPIF status code
+ */
+int spif_write(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size, spif_write_mode_t mode);
+
+/**
+ * @brief spif_write() in SPIF_WRITE_MODE_PROGRAM of up to SPIF_IOV_MAX buffers written back to back,
+ *        e.g. a record header and its payload without copying them into one buffer first
+ * @return see SPIF status code
+ */
+int spif_writev(spif_dev_t *dev, uint32_t addr, const spif_iov_t *iov, uint32_t iov_count);
+
+/**
+ * @brief SPIF_WRITE_MODE_DIFF statistics since spif_init() or the last reset
+ * @return see SPIF status code
+ */
+int spif_write_stats_get(spif_dev_t *dev, spif_write_stats_t *stats);
+
+void spif_write_stats_reset(spif_dev_t *dev);
+
+/**
+ * @brief start a read and return at once, data is valid when the token is done
+ * @param token caller owned, must stay valid until done
+ * @param cb optional
+ * @return see SPIF status code, SPIF_BUSY if another asynchronous operation is in flight
+ */
+int spif_read_async(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size, spif_async_t *token, spif_async_cb_t cb, void *arg);
+
+/**
+ * @brief start a page program and return at once, data must stay valid until done
+ * @note the flash busy time is tracked by spif_async_poll(), call it from the main loop
+ * @return see SPIF status code, SPIF_BUSY if another asynchronous operation is in flight
+ */
+int spif_page_program_async(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size, spif_async_t *token, spif_async_cb_t cb, void *arg);
+
+/**
+ * @brief start an erase of one block and return at once
+ * @param size one of the erase sizes of the flash, addr aligned to it
+ * @note the flash busy time is tracked by spif_async_poll(), like a page program
+ * @return see SPIF status code, SPIF_BUSY if another asynchronous operation is in flight
+ */
+int spif_erase_async(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_async_t *token, spif_async_cb_t cb, void *arg);
+
+/**
+ * @brief suspend the erase started by spif_erase_async() so the flash can be read,
+ *        reads must stay out of the block being erased, program/erase wait for spif_erase_resume()
+ * @note spif_async_poll() does not finish a suspended erase, spif_async_wait() returns SPIF_BUSY on it
+ * @return SPIF_SUCCESS once the flash can be read (the erase may just have finished instead),
+ *         SPIF_FAIL if no erase is in flight or the flash has no suspend
+ */
+int spif_erase_suspend(spif_dev_t *dev);
+
+int spif_erase_resume(spif_dev_t *dev);
+
+/**
+ * @brief advance an asynchronous operation without blocking
+ * @return see SPIF asynchronous operation state
+ */
+int spif_async_poll(spif_dev_t *dev, spif_async_t *token);
+
+/**
+ * @brief block until an asynchronous operation is done, the bus lock is taken for each status poll only
+ * @return result of the operation, see SPIF status code, SPIF_BUSY if it is an erase suspended
+ *         by spif_erase_suspend() (spif_erase_resume() first), SPIF_TIMEOUT if it did not finish
+ *         in the maximum time of the operation (it stays in flight)
+ */
+int spif_async_wait(spif_dev_t *dev, spif_async_t *token);
+
+/**
+ * @brief bus lock statistics since spif_init() or the last reset
+ * @return see SPIF status code
+ */
+int spif_lock_stats_get(spif_dev_t *dev, spif_lock_stats_t *stats);
+
+void spif_lock_stats_reset(spif_dev_t *dev);
+
+/**
+ * @brief microseconds since boot from plat_ops.timestamp, for the layers on top of spif
+ * @return 0 without plat_ops.timestamp
+ */
+uint64_t spif_now_us(spif_dev_t *dev);
 
-void spif_page_test(uint32_t page_addr);
+void spif_page_test(spif_dev_t *dev, uint32_t page_addr);
 
 #endif /* __SPIF_H__ */
@@ -0,0 +1,78 @@
+/*
+ * spif_atomic.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_ATOMIC_H__
+#define __SPIF_ATOMIC_H__
+
+#include <stdint.h>
+#include "spif.h"
+
+/* bytes staged per program, the old copy is read back in pieces of this size as well */
+#define SPIF_ATOMIC_BUF_SIZE    256
+
+/**
+ * one sector of data updated all or nothing: two slots (sectors) hold a copy each, an update erases
+ * the older slot, programs the new data into it and programs the commit record last. the record
+ * sits in the last bytes of the slot: | data (sector size - 16) | magic | seq | data crc | crc |
+ * after a power loss the slot with the valid record of the highest seq is the data, the other one
+ * is at worst half erased or half programmed and has no valid record newer than it
+ */
+typedef struct {
+    spif_dev_t *dev; /* spif_init() done */
+    uint32_t addr;   /* two sectors from here, sector aligned */
+    uint8_t verify;  /* 1: spif_atomic_open() also checks the data crc of the copy picked (reads the sector) */
+} spif_atomic_config_t;
+
+typedef struct {
+    uint32_t updates;
+    uint32_t programs;  /* page programs, commit records included, blank pages are skipped */
+    uint32_t copied;    /* bytes carried over from the old copy */
+    uint32_t fallbacks; /* spif_atomic_open() found the newest record with bad data and took the older copy */
+} spif_atomic_stats_t;
+
+typedef struct spif_atomic_s {
+    spif_atomic_config_t config;
+    uint32_t sector_size;
+    uint32_t size;      /* data bytes per slot */
+
+    uint8_t valid;      /* 0: nothing committed yet, the data reads as 0xFF */
+    uint8_t cur;        /* slot of the data */
+    uint32_t seq;       /* of the data, the next update commits seq + 1 */
+
+    uint8_t buf[SPIF_ATOMIC_BUF_SIZE];
+    spif_atomic_stats_t stats;
+} spif_atomic_t;
+
+/**
+ * @brief find the data: two reads of the commit records (and with verify one read of the data)
+ * @return see SPIF status code
+ */
+int spif_atomic_open(spif_atomic_t *atomic, const spif_atomic_config_t *config);
+
+/**
+ * @brief read the committed data
+ * @return see SPIF status code
+ */
+int spif_atomic_read(spif_atomic_t *atomic, uint32_t offset, uint8_t *data, uint32_t size);
+
+/**
+ * @brief commit a new copy: the range given by data, the rest from the current copy (0xFF if none),
+ *        returning SPIF_SUCCESS the new copy is the data, after a power loss it is either copy
+ * @note  one sector erase, the non-blank pages and one commit record program per call
+ * @return see SPIF status code
+ */
+int spif_atomic_update(spif_atomic_t *atomic, uint32_t offset, const uint8_t *data, uint32_t size);
+
+/**
+ * @brief data bytes, sector size - 16
+ */
+uint32_t spif_atomic_size(spif_atomic_t *atomic);
+
+int spif_atomic_stats_get(spif_atomic_t *atomic, spif_atomic_stats_t *stats);
+
+void spif_atomic_stats_reset(spif_atomic_t *atomic);
+
+#endif /* __SPIF_ATOMIC_H__ */
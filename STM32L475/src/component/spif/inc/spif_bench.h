@@ -0,0 +1,91 @@
+/*
+ * spif_bench.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_BENCH_H__
+#define __SPIF_BENCH_H__
+
+#include <stdint.h>
+#include "spif.h"
+
+#ifndef SPIF_BENCH_SAMPLES_MAX
+#define SPIF_BENCH_SAMPLES_MAX    128
+#endif
+
+#define SPIF_BENCH_READ_SIZE_MAX  4096
+
+typedef struct {
+    uint32_t addr;    /* scratch area, 64K aligned, its content is destroyed */
+    uint32_t size;    /* 64K multiple, at least 64K */
+    uint16_t samples; /* per test, at most SPIF_BENCH_SAMPLES_MAX */
+    uint32_t seed;    /* random read addresses */
+} spif_bench_config_t;
+
+/**
+ * @brief run all tests and print CSV through plat_ops.log:
+ *        result,<test>,<size>,<samples>,<min_ns>,<median_ns>,<p99_ns>,<max_ns>,<kbps>
+ *        hist,<test>,<size>,<bucket_ns>,<count>   (log2 buckets, empty ones skipped)
+ *        tests: erase (every erase size up to 64K), read_seq, read_rand (16, 256, 4096 bytes),
+ *        page_program, page_program_poll
+ *        page_program waits through the driver, page_program_poll polls the status register back to back,
+ *        the difference of the two is the wait idle overhead
+ * @note  needs plat_ops.timestamp, reads use the current read mode, the read cache is invalidated
+ *        before every read so the numbers are of the flash (a cache line fill with SPIF_CACHE_ENABLE)
+ * @return see SPIF status code
+ */
+int spif_bench_run(spif_dev_t *dev, const spif_bench_config_t *config);
+
+/**
+ * @brief sequential read of the scratch area in piece_size pieces (at most SPIF_BENCH_READ_SIZE_MAX)
+ *        with work_us of processing (plat_ops.delay_us) after each, first one spif_fast_read per piece,
+ *        then through spif_stream with chunks of 256, 1024 and SPIF_BENCH_READ_SIZE_MAX bytes, CSV:
+ *        stream,<chunk>,<piece>,<work_us>,<bytes>,<ns>,<kbps>,<stalls>   (chunk 0: spif_fast_read per piece)
+ *        with read-ahead the time tends to the larger of bus time and work time instead of their sum,
+ *        read_seq of spif_bench_run() at SPIF_BENCH_READ_SIZE_MAX is about the raw bus rate
+ * @note  needs plat_ops.timestamp, the scratch area is only read
+ * @return see SPIF status code
+ */
+int spif_bench_stream(spif_dev_t *dev, const spif_bench_config_t *config, uint32_t piece_size, uint32_t work_us);
+
+/**
+ * @brief replay a log capture (data, split at '\n') as appends to the scratch area, first programmed
+ *        line by line, then through spif_lz flushed at the end and every 64 and 8 lines, CSV:
+ *        lz,<mode>,<flush_lines>,<bytes>,<flash_bytes>,<programs>,<write_ns>,<ratio_pct>,<seq_read_ns>,<rand_read_ns>
+ *        seq_read_ns reads it all back in SPIF_BENCH_READ_SIZE_MAX pieces, rand_read_ns is the mean of
+ *        samples reads of 64 bytes at random offsets
+ * @note  needs plat_ops.timestamp, size at most config->size
+ * @return see SPIF status code
+ */
+int spif_bench_lz(spif_dev_t *dev, const spif_bench_config_t *config, const uint8_t *data, uint32_t size);
+
+/**
+ * @brief spif_atomic against a plain rewrite, result/hist lines as spif_bench_run():
+ *        atomic_update / raw_rewrite of the whole data (sector size - 16) and of 64 bytes at random offsets
+ *        (raw_rewrite: spif_write in SPIF_WRITE_MODE_ERASE, not power loss safe),
+ *        atomic_open / atomic_open_verify: finding the data at boot, reread_two_copies: reading two
+ *        plain copies to pick one, and a line atomic,updates=,programs=,copied= of the updates
+ * @note  needs plat_ops.timestamp, uses the first four sectors of the scratch area
+ * @return see SPIF status code
+ */
+int spif_bench_atomic(spif_dev_t *dev, const spif_bench_config_t *config);
+
+/**
+ * @brief spif_fs against raw spif doing the same flash work, one line per test:
+ *        fs,<test>,<piece>,<bytes>,<fs_ns>,<raw_ns>,<factor_pct>   (factor_pct: fs_ns * 100 / raw_ns)
+ *        write / read: a file of size bytes in pieces of 256 and SPIF_BENCH_READ_SIZE_MAX bytes, against
+ *        spif_sector_erase + spif_page_program of every page / spif_fast_read of every piece,
+ *        append_sync: samples appends of 64 bytes each synced, against spif_write of 64 bytes,
+ *        overwrite_sync: samples overwrites of 256 bytes at random offsets each synced, against
+ *        spif_write in SPIF_WRITE_MODE_ERASE (not power loss safe),
+ *        mount: samples mounts (bytes: journal in use), against reading one checkpoint and the journal,
+ *        and a line fs,commits=,checkpoints=,erases=,programs=,cow_bytes= of the synced tests
+ * @note  needs plat_ops.timestamp, the file system takes the first half of the scratch area,
+ *        size: SPIF_BENCH_READ_SIZE_MAX multiple, at most config->size / 4
+ *        overwrite_sync needs spif_write() in SPIF_WRITE_MODE_ERASE to take the sector size
+ * @return see SPIF status code
+ */
+int spif_bench_fs(spif_dev_t *dev, const spif_bench_config_t *config, uint32_t size);
+
+#endif /* __SPIF_BENCH_H__ */
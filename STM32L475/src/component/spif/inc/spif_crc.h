@@ -0,0 +1,20 @@
+/*
+ * spif_crc.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_CRC_H__
+#define __SPIF_CRC_H__
+
+#include <stdint.h>
+
+#define SPIF_CRC32_INIT    0xFFFFFFFF
+
+/**
+ * @brief CRC-32 (IEEE 802.3), can be computed in pieces:
+ *        crc = spif_crc32(SPIF_CRC32_INIT, a, ...); crc = spif_crc32(crc, b, ...); crc ^= SPIF_CRC32_INIT;
+ */
+uint32_t spif_crc32(uint32_t crc, const void *data, uint32_t size);
+
+#endif /* __SPIF_CRC_H__ */
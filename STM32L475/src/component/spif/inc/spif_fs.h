@@ -0,0 +1,252 @@
+/*
+ * spif_fs.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_FS_H__
+#define __SPIF_FS_H__
+
+#include <stdint.h>
+#include "spif.h"
+
+/* blocks of the block device at most, RAM: 2 bytes each (4096: a 16 MB W25Q128 in 4K blocks) */
+#ifndef SPIF_FS_BLOCKS_MAX
+#define SPIF_FS_BLOCKS_MAX       4096
+#endif
+
+/* files and directories at most, the root directory included, RAM: 36 bytes each */
+#ifndef SPIF_FS_INODES_MAX
+#define SPIF_FS_INODES_MAX       64
+#endif
+
+/* one per file system, reads smaller than this are served a cache line at a time */
+#ifndef SPIF_FS_READ_CACHE_SIZE
+#define SPIF_FS_READ_CACHE_SIZE  256
+#endif
+
+/* one per open file, writes are programmed this many bytes at a time */
+#ifndef SPIF_FS_PROG_CACHE_SIZE
+#define SPIF_FS_PROG_CACHE_SIZE  256
+#endif
+
+#define SPIF_FS_NAME_MAX         23
+
+#define SPIF_FS_TYPE_NONE        0
+#define SPIF_FS_TYPE_FILE        1
+#define SPIF_FS_TYPE_DIR         2
+
+#define SPIF_FS_O_READ           0x01
+#define SPIF_FS_O_WRITE          0x02
+#define SPIF_FS_O_CREATE         0x04 /* create the file if it does not exist */
+#define SPIF_FS_O_TRUNC          0x08 /* with SPIF_FS_O_WRITE: drop the content */
+#define SPIF_FS_O_APPEND         0x10 /* every write goes to the end of the file */
+
+/**
+ * block device: erase units addressed by number, a program only turns bits 1 -> 0,
+ * spif_fs_bd_init() gives one over a region of a spif_dev_t, another one (RAM, another driver)
+ * only has to fill in the ops and the geometry
+ */
+typedef struct spif_fs_bd_s {
+    int (*read)(struct spif_fs_bd_s *bd, uint32_t block, uint32_t offset, void *data, uint32_t size);
+    int (*prog)(struct spif_fs_bd_s *bd, uint32_t block, uint32_t offset, const void *data, uint32_t size);
+    int (*erase)(struct spif_fs_bd_s *bd, uint32_t block);
+    uint32_t block_size;  /* erase unit */
+    uint32_t block_count;
+    void *ctx;            /* of the ops, spif_fs_bd_init(): the spif_dev_t */
+    uint32_t addr;        /* spif_fs_bd_init(): start of the region */
+} spif_fs_bd_t;
+
+/**
+ * region layout, in blocks:
+ * | checkpoint A | checkpoint B | journal | data ... |
+ * the metadata (inode table and the chain of blocks of every file) is in RAM and is never updated
+ * in place on flash: a sync appends a transaction of the changed entries to the journal, a full
+ * journal is folded into a checkpoint written to the older slot and committed by its header.
+ * mount reads one checkpoint and replays the journal. data is copy on write as well: an overwrite
+ * goes to a new block which replaces the old one in the chain at the next sync, appends program
+ * the erased tail of the last block, nothing committed is programmed again
+ */
+typedef struct {
+    spif_fs_bd_t *bd;
+    uint16_t journal_blocks; /* 0: 2, a checkpoint is written every time they fill up */
+} spif_fs_config_t;
+
+typedef struct {
+    uint8_t type;            /* SPIF_FS_TYPE_NONE: spif_fs_dir_read() at the end */
+    uint32_t size;
+    char name[SPIF_FS_NAME_MAX + 1];
+} spif_fs_info_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t parent;
+    uint32_t size;
+    uint16_t first;          /* first block of the chain */
+    uint16_t reserved2;
+    char name[SPIF_FS_NAME_MAX + 1];
+} spif_fs_inode_t;
+
+typedef struct spif_fs_file_s {
+    uint16_t inode;
+    uint8_t flags;
+    uint32_t pos;
+
+    uint32_t rindex;         /* read cursor: block rblock is block rindex of the file */
+    uint16_t rblock;
+    uint32_t rgeneration;    /* of the file system when the cursor was set */
+
+    uint8_t session;         /* block being written: 0 none, 1 in place, 2 copy of the old block wold */
+    uint32_t windex;
+    uint16_t wblock;
+    uint16_t wold;
+    uint32_t cache_offset;   /* cache holds the bytes of wblock from here, not programmed yet */
+    uint32_t cache_fill;
+    uint8_t cache[SPIF_FS_PROG_CACHE_SIZE];
+} spif_fs_file_t;
+
+typedef struct {
+    uint16_t inode;
+    uint16_t next;
+} spif_fs_dir_t;
+
+typedef struct {
+    uint32_t commits;        /* journal transactions */
+    uint32_t checkpoints;
+    uint32_t journal_bytes;
+    uint32_t erases;
+    uint32_t programs;
+    uint32_t cow_bytes;      /* old data copied by overwrites */
+    uint32_t read_hits;      /* of the read cache */
+    uint32_t read_misses;
+} spif_fs_stats_t;
+
+typedef struct spif_fs_s {
+    spif_fs_config_t config;
+    uint16_t slot_blocks;    /* per checkpoint */
+    uint16_t journal_start;
+    uint16_t data_start;
+
+    uint8_t slot;            /* of the checkpoint in use */
+    uint32_t seq;            /* of the checkpoint in use, the transactions after it carry it */
+    uint32_t jpos;           /* journal bytes in use */
+    uint16_t cursor;         /* next block tried by the allocator */
+    uint32_t generation;     /* bumped when a block leaves a chain, read cursors set before walk again */
+
+    uint16_t fat[SPIF_FS_BLOCKS_MAX];
+    spif_fs_inode_t inode[SPIF_FS_INODES_MAX];
+    uint32_t fat_dirty[(SPIF_FS_BLOCKS_MAX + 31) / 32];
+    uint32_t inode_dirty[(SPIF_FS_INODES_MAX + 31) / 32];
+
+    uint32_t rcache_block;
+    uint32_t rcache_offset;
+    uint32_t rcache_size;    /* 0: cache empty */
+    uint8_t rcache[SPIF_FS_READ_CACHE_SIZE];
+    uint8_t buf[SPIF_FS_PROG_CACHE_SIZE];
+
+    spif_fs_stats_t stats;
+} spif_fs_t;
+
+/**
+ * @brief block device over [addr, addr + size) of dev, a block is a sector (8K in dual-flash mode)
+ * @return see SPIF status code
+ */
+int spif_fs_bd_init(spif_fs_bd_t *bd, spif_dev_t *dev, uint32_t addr, uint32_t size);
+
+/**
+ * @brief erase the metadata blocks and commit an empty root directory
+ * @return see SPIF status code
+ */
+int spif_fs_format(spif_fs_t *fs, const spif_fs_config_t *config);
+
+/**
+ * @brief load the newest checkpoint and replay the journal, a transaction cut by a power loss is dropped
+ * @note  reads one checkpoint (36 bytes per inode, 2 per block) and the journal, about 1 ms for
+ *        a 16 MB flash on QSPI, and writes a checkpoint if the journal has a torn tail
+ * @return see SPIF status code, SPIF_FAIL if the region holds no file system of this geometry
+ */
+int spif_fs_mount(spif_fs_t *fs, const spif_fs_config_t *config);
+
+/**
+ * @brief the paths are absolute or not, "/a/b" and "a/b" are the same, names up to SPIF_FS_NAME_MAX
+ * @return see SPIF status code
+ */
+int spif_fs_mkdir(spif_fs_t *fs, const char *path);
+
+/**
+ * @brief remove a file or an empty directory, not one open
+ * @return see SPIF status code
+ */
+int spif_fs_remove(spif_fs_t *fs, const char *path);
+
+int spif_fs_stat(spif_fs_t *fs, const char *path, spif_fs_info_t *info);
+
+int spif_fs_dir_open(spif_fs_t *fs, spif_fs_dir_t *dir, const char *path);
+
+/**
+ * @brief next entry of the directory, info->type is SPIF_FS_TYPE_NONE after the last one
+ * @return see SPIF status code
+ */
+int spif_fs_dir_read(spif_fs_t *fs, spif_fs_dir_t *dir, spif_fs_info_t *info);
+
+/**
+ * @brief open a file, flags SPIF_FS_O_*, a file created or truncated is committed before this returns
+ * @note  one handle at most may write a file, what it writes is seen by other handles after spif_fs_sync()
+ * @return see SPIF status code
+ */
+int spif_fs_open(spif_fs_t *fs, spif_fs_file_t *file, const char *path, uint8_t flags);
+
+/**
+ * @brief read from the current position
+ * @param read_size less than size only at the end of the file
+ * @return see SPIF status code
+ */
+int spif_fs_read(spif_fs_t *fs, spif_fs_file_t *file, void *data, uint32_t size, uint32_t *read_size);
+
+/**
+ * @brief write at the current position (the end with SPIF_FS_O_APPEND), durable after spif_fs_sync()
+ * @note  appends program the erased tail of the last block, an overwrite copies the rest of the
+ *        block it lands in to a new one
+ * @return see SPIF status code, SPIF_FAIL when the region is full
+ */
+int spif_fs_write(spif_fs_t *fs, spif_fs_file_t *file, const void *data, uint32_t size);
+
+/**
+ * @brief move the current position, at most to the end of the file
+ * @return see SPIF status code
+ */
+int spif_fs_seek(spif_fs_t *fs, spif_fs_file_t *file, uint32_t offset);
+
+uint32_t spif_fs_tell(spif_fs_t *fs, spif_fs_file_t *file);
+
+uint32_t spif_fs_size(spif_fs_t *fs, spif_fs_file_t *file);
+
+/**
+ * @brief program the cache and commit the metadata, after a power loss the file is as of the last sync
+ * @return see SPIF status code
+ */
+int spif_fs_sync(spif_fs_t *fs, spif_fs_file_t *file);
+
+/**
+ * @brief spif_fs_sync() if open for writing
+ * @return see SPIF status code
+ */
+int spif_fs_close(spif_fs_t *fs, spif_fs_file_t *file);
+
+/**
+ * @brief fold the journal into a checkpoint now
+ * @return see SPIF status code
+ */
+int spif_fs_checkpoint(spif_fs_t *fs);
+
+/**
+ * @brief blocks not used by the metadata nor by any file
+ */
+uint32_t spif_fs_free_blocks(spif_fs_t *fs);
+
+int spif_fs_stats_get(spif_fs_t *fs, spif_fs_stats_t *stats);
+
+void spif_fs_stats_reset(spif_fs_t *fs);
+
+#endif /* __SPIF_FS_H__ */
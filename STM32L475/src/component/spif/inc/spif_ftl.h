@@ -0,0 +1,117 @@
+/*
+ * spif_ftl.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_FTL_H__
+#define __SPIF_FTL_H__
+
+#include <stdint.h>
+#include "spif.h"
+
+#define SPIF_FTL_SECTOR_SIZE    4096
+
+/* largest data pool, sets the RAM used by the mapping tables (8 bytes per sector + 1 bit) */
+#ifndef SPIF_FTL_SECTORS_MAX
+#define SPIF_FTL_SECTORS_MAX    256
+#endif
+
+#define SPIF_FTL_IO_SIZE        256
+
+/**
+ * region layout, in 4K sectors:
+ * | checkpoint A | checkpoint B | journal | data pool |
+ * logical sectors = data pool - spare_sectors
+ */
+typedef struct {
+    spif_dev_t *dev;          /* flash holding the region, spif_init() done */
+    uint32_t addr;            /* start of the FTL region, sector aligned */
+    uint32_t size;            /* size of the FTL region, sector aligned */
+    uint16_t spare_sectors;   /* pool sectors never mapped, at least 2 */
+    uint16_t journal_sectors; /* at least 1, a checkpoint is written every journal_sectors * 511 updates */
+    uint32_t wl_threshold;    /* static wear leveling once the erase counts spread more than this */
+} spif_ftl_config_t;
+
+typedef struct {
+    uint32_t logical_sectors;
+    uint32_t free_sectors;  /* erased and unmapped */
+    uint32_t dirty_sectors; /* unmapped, waiting for erase */
+    uint32_t ec_min;        /* erase count over the data pool */
+    uint32_t ec_max;
+    uint32_t erases;        /* since mount */
+    uint32_t wl_moves;      /* since mount */
+    uint32_t checkpoints;   /* since mount */
+} spif_ftl_stats_t;
+
+/* one FTL region, several may be mounted at once (on one flash or on different ones) */
+typedef struct spif_ftl_s {
+    spif_ftl_config_t config;
+    uint8_t mounted;
+
+    uint16_t ckpt_sectors;  /* per checkpoint slot */
+    uint16_t pool;
+    uint16_t logical;
+
+    uint32_t seq;
+    uint32_t journal_pos;   /* next free journal entry */
+    uint32_t writes;
+
+    uint16_t l2p[SPIF_FTL_SECTORS_MAX];
+    uint16_t p2l[SPIF_FTL_SECTORS_MAX];
+    uint32_t ec[SPIF_FTL_SECTORS_MAX];
+    uint8_t checked[(SPIF_FTL_SECTORS_MAX + 7) / 8]; /* blank-checked since mount */
+
+    uint8_t buf[SPIF_FTL_IO_SIZE];
+
+    spif_ftl_stats_t stats;
+} spif_ftl_t;
+
+/**
+ * @brief create an empty FTL in the region, the data pool is not erased here
+ * @return see SPIF status code
+ */
+int spif_ftl_format(spif_ftl_t *ftl, const spif_ftl_config_t *config);
+
+/**
+ * @brief load the newest checkpoint and replay the journal, spif_init() must be done
+ * @return see SPIF status code, SPIF_FAIL if the region holds no FTL of this geometry
+ */
+int spif_ftl_mount(spif_ftl_t *ftl, const spif_ftl_config_t *config);
+
+/**
+ * @brief write a whole logical sector (SPIF_FTL_SECTOR_SIZE bytes)
+ * @note  at most one erase and one static wear leveling move besides the write itself,
+ *        plus a checkpoint when the journal is full
+ * @return see SPIF status code
+ */
+int spif_ftl_write(spif_ftl_t *ftl, uint32_t lsn, const uint8_t *data);
+
+/**
+ * @brief read part of a logical sector, a sector never written reads 0xFF
+ * @return see SPIF status code
+ */
+int spif_ftl_read(spif_ftl_t *ftl, uint32_t lsn, uint32_t offset, uint8_t *data, uint32_t size);
+
+/**
+ * @brief drop a logical sector, it reads 0xFF afterwards
+ * @return see SPIF status code
+ */
+int spif_ftl_trim(spif_ftl_t *ftl, uint32_t lsn);
+
+/**
+ * @brief background work: erase dirty sectors and do static wear leveling
+ * @param max_steps number of sector erases/moves allowed in this call
+ * @return see SPIF status code
+ */
+int spif_ftl_gc(spif_ftl_t *ftl, uint32_t max_steps);
+
+/**
+ * @brief write a checkpoint now, shortens the next mount
+ * @return see SPIF status code
+ */
+int spif_ftl_sync(spif_ftl_t *ftl);
+
+int spif_ftl_stats_get(spif_ftl_t *ftl, spif_ftl_stats_t *stats);
+
+#endif /* __SPIF_FTL_H__ */
@@ -0,0 +1,132 @@
+/*
+ * spif_kv.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_KV_H__
+#define __SPIF_KV_H__
+
+#include <stdint.h>
+#include "spif.h"
+
+#define SPIF_KV_KEY_MAX      32 /* without the terminating '\0' */
+#define SPIF_KV_BATCH_MAX    16 /* items of one spif_kv_commit() */
+
+/* index slots, power of 2, at most 3/4 of them hold keys */
+#ifndef SPIF_KV_INDEX_SIZE
+#define SPIF_KV_INDEX_SIZE   256
+#endif
+
+#ifndef SPIF_KV_SECTORS_MAX
+#define SPIF_KV_SECTORS_MAX  64
+#endif
+
+#define SPIF_KV_IO_SIZE      256
+
+/**
+ * region layout, in 4K sectors:
+ * | index snapshot A | index snapshot B | log sectors (circular) |
+ */
+typedef struct {
+    spif_dev_t *dev;            /* flash holding the region, spif_init() done */
+    uint32_t addr;              /* start of the KV region, sector aligned */
+    uint32_t size;              /* size of the KV region, sector aligned */
+    uint16_t snapshot_interval; /* snapshot the index every this many log sectors, 0: only on spif_kv_sync() */
+} spif_kv_config_t;
+
+/* one item of spif_kv_commit(), value NULL deletes the key */
+typedef struct {
+    const char *key;
+    const void *value;
+    uint16_t size;
+} spif_kv_item_t;
+
+typedef struct {
+    uint32_t keys;
+    uint32_t log_sectors;
+    uint32_t free_sectors; /* log sectors not in use */
+    uint32_t writes;       /* records written since mount, compaction excluded */
+    uint32_t gc_copies;    /* live records moved by compaction since mount */
+    uint32_t gc_erases;    /* sectors reclaimed since mount */
+    uint32_t snapshots;    /* index snapshots since mount */
+    uint32_t replayed;     /* records replayed by the last mount */
+} spif_kv_stats_t;
+
+typedef struct spif_kv_slot_s {
+    uint32_t hash;
+    uint32_t addr; /* record, or SPIF_KV_SLOT_xxx */
+} spif_kv_slot_t;
+
+/* one store, several may be mounted at once (on one flash or on different ones) */
+typedef struct spif_kv_s {
+    spif_kv_config_t config;
+    uint8_t mounted;
+
+    uint16_t snapshot_sectors; /* per snapshot slot */
+    uint16_t sectors;          /* log sectors */
+
+    uint16_t head;             /* oldest log sector */
+    uint16_t tail;             /* sector being written */
+    uint16_t used;
+    uint32_t seq;              /* seq of the tail */
+    uint32_t pos;              /* next record address, 0: tail closed */
+    uint32_t gc_pos;           /* next record of the head to compact */
+    uint32_t snapshot_gen;
+    uint16_t since_snapshot;
+    uint8_t erased[(SPIF_KV_SECTORS_MAX + 7) / 8]; /* known to be blank */
+
+    spif_kv_slot_t index[SPIF_KV_INDEX_SIZE];
+    uint32_t keys;
+
+    uint8_t buf[SPIF_KV_IO_SIZE];
+
+    spif_kv_stats_t stats;
+} spif_kv_t;
+
+/**
+ * @brief erase the region and create an empty store
+ * @return see SPIF status code
+ */
+int spif_kv_format(spif_kv_t *kv, const spif_kv_config_t *config);
+
+/**
+ * @brief load the newest index snapshot and replay the log written after it
+ * @return see SPIF status code
+ */
+int spif_kv_mount(spif_kv_t *kv, const spif_kv_config_t *config);
+
+/**
+ * @brief read a value
+ * @param len optional, returns the stored size, which may be larger than size
+ * @return see SPIF status code, SPIF_FAIL if the key does not exist
+ */
+int spif_kv_get(spif_kv_t *kv, const char *key, void *value, uint16_t size, uint16_t *len);
+
+int spif_kv_set(spif_kv_t *kv, const char *key, const void *value, uint16_t size);
+
+int spif_kv_delete(spif_kv_t *kv, const char *key);
+
+/**
+ * @brief write several items, after a power loss either all or none of them are seen
+ * @note  the items must fit in one log sector together
+ * @return see SPIF status code
+ */
+int spif_kv_commit(spif_kv_t *kv, const spif_kv_item_t *items, uint32_t count);
+
+/**
+ * @brief compact the oldest log sector, at most max_records records and one erase per call
+ * @note  writes compact by themselves when the log runs out of free sectors
+ * @return see SPIF status code
+ */
+int spif_kv_gc(spif_kv_t *kv, uint32_t max_records);
+
+/**
+ * @brief snapshot the index now, the next mount replays nothing
+ * @return see SPIF status code
+ */
+int spif_kv_sync(spif_kv_t *kv);
+
+int spif_kv_stats_get(spif_kv_t *kv, spif_kv_stats_t *stats);
+
+#endif /* __SPIF_KV_H__ */
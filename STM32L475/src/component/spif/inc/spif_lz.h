@@ -0,0 +1,125 @@
+/*
+ * spif_lz.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_LZ_H__
+#define __SPIF_LZ_H__
+
+#include <stdint.h>
+#include "spif.h"
+
+/**
+ * uncompressed bytes per block, each block is compressed on its own (LZ77, the window is the block)
+ * and is the unit of random access. RAM of a spif_lz_t is about 3 * SPIF_LZ_BLOCK_SIZE
+ * + 2 << SPIF_LZ_HASH_BITS + SPIF_LZ_PAGE_SIZE
+ */
+#ifndef SPIF_LZ_BLOCK_SIZE
+#define SPIF_LZ_BLOCK_SIZE    2048
+#endif
+
+/* match finder hash table entries (log2), more finds more matches */
+#ifndef SPIF_LZ_HASH_BITS
+#define SPIF_LZ_HASH_BITS     10
+#endif
+
+/* output unit, compressed bytes are programmed a whole unit at a time (less if the flash page is smaller) */
+#define SPIF_LZ_PAGE_SIZE     256
+
+#define SPIF_LZ_SECTOR_SIZE   4096
+
+/**
+ * region layout, in 4K sectors, append only until spif_lz_format():
+ * | sector header | blocks ... | sector header | ... blocks ... |
+ * blocks run on across sectors, each sector header holds the uncompressed offset of the first
+ * block starting in it, which makes the headers an index that is binary searched
+ */
+typedef struct {
+    spif_dev_t *dev; /* flash holding the region, spif_init() done */
+    uint32_t addr;   /* start of the region, sector aligned */
+    uint32_t size;   /* size of the region, sector aligned */
+} spif_lz_config_t;
+
+typedef struct {
+    uint64_t raw_bytes;     /* written by the caller */
+    uint64_t comp_bytes;    /* programmed for them, block and sector headers included */
+    uint32_t blocks;
+    uint32_t stored_blocks; /* did not compress, kept as they were */
+    uint32_t programs;      /* page programs */
+    uint32_t compress_us;   /* 0 without plat_ops.timestamp */
+    uint64_t read_bytes;
+    uint32_t read_blocks;   /* blocks read and decompressed by spif_lz_read() */
+    uint32_t read_hits;     /* reads served by the block decompressed last */
+    uint32_t decompress_us;
+} spif_lz_stats_t;
+
+typedef struct spif_lz_s {
+    spif_lz_config_t config;
+    uint32_t capacity;      /* compressed bytes the region holds, sector headers excluded */
+    uint16_t unit;          /* output unit, see SPIF_LZ_PAGE_SIZE */
+
+    uint32_t end;           /* compressed offset of the next block, sector headers excluded */
+    uint32_t raw_end;       /* uncompressed bytes in blocks */
+    uint32_t raw_fill;      /* uncompressed bytes waiting in raw */
+
+    uint32_t page_addr;     /* flash address of the unit in page */
+    uint32_t prog_addr;     /* bytes of it below this address are in flash */
+    uint32_t fill_addr;     /* bytes of it below this address are filled in */
+
+    uint32_t cache_offset;  /* uncompressed offset of the block in cache */
+    uint32_t cache_size;    /* 0: cache empty */
+
+    uint8_t raw[SPIF_LZ_BLOCK_SIZE];
+    uint8_t out[SPIF_LZ_BLOCK_SIZE + 16]; /* a compressed block with its header */
+    uint8_t cache[SPIF_LZ_BLOCK_SIZE];
+    uint16_t hash[1 << SPIF_LZ_HASH_BITS];
+    uint8_t page[SPIF_LZ_PAGE_SIZE];
+
+    spif_lz_stats_t stats;
+} spif_lz_t;
+
+/**
+ * @brief erase the region and start an empty stream
+ * @return see SPIF status code
+ */
+int spif_lz_format(spif_lz_t *lz, const spif_lz_config_t *config);
+
+/**
+ * @brief find the end of the stream, the blocks of an interrupted write are dropped
+ * @note  after a power loss the writing goes on in the next sector, the rest of the old one is lost;
+ *        a sector header written for the interrupted block is cleared, so the mount may program
+ * @return see SPIF status code
+ */
+int spif_lz_mount(spif_lz_t *lz, const spif_lz_config_t *config);
+
+/**
+ * @brief append, compressed a block at a time, the last partial block stays in RAM until spif_lz_flush()
+ * @return see SPIF status code, SPIF_FAIL when the region is full
+ */
+int spif_lz_write(spif_lz_t *lz, const void *data, uint32_t size);
+
+/**
+ * @brief compress the partial block and program the partial unit, what was written survives a power loss
+ * @note  every flush ends a block early, which compresses worse, flush at the points that matter
+ * @return see SPIF status code, SPIF_FAIL when the partial block does not fit, the blocks before it are programmed
+ */
+int spif_lz_flush(spif_lz_t *lz);
+
+/**
+ * @brief read uncompressed data at any offset, only the blocks covering it are decompressed
+ * @param read_size less than size only at the end of the stream
+ * @return see SPIF status code
+ */
+int spif_lz_read(spif_lz_t *lz, uint32_t offset, void *data, uint32_t size, uint32_t *read_size);
+
+/**
+ * @brief uncompressed size of the stream, the data waiting for a flush included
+ */
+uint32_t spif_lz_size(spif_lz_t *lz);
+
+int spif_lz_stats_get(spif_lz_t *lz, spif_lz_stats_t *stats);
+
+void spif_lz_stats_reset(spif_lz_t *lz);
+
+#endif /* __SPIF_LZ_H__ */
@@ -14,24 +14,99 @@
 
 #define SPIF_SPI_INVALID_ADDR (0xFFFFFFFF)
 
+/* port capabilities */
+#define SPIF_PORT_CAP_QSPI_DDR  (1 << 0) /* qspi_command honours spif_port_qspi_cmd_t.ddr */
+#define SPIF_PORT_CAP_QSPI_SIOO (1 << 1) /* qspi_mmap honours spif_port_qspi_cmd_t.sioo */
+
+/**
+ * two identical chips in dual-flash mode, every command goes to both: byte 2n of a data phase is on the
+ * first chip, 2n + 1 on the second, so a status register read returns one byte per chip.
+ * the port sends addr / 2 to the chips, spif keeps data phases even sized on even addresses, and
+ * qspi_autopoll must match mask/match on both status bytes
+ */
+#define SPIF_PORT_CAP_QSPI_DUAL (1 << 2)
+
+/* QSPI phase width (number of IO lines), 0 means the phase is skipped */
+#define SPIF_QSPI_LINES_NONE  0
+#define SPIF_QSPI_LINES_1     1
+#define SPIF_QSPI_LINES_2     2
+#define SPIF_QSPI_LINES_4     4
+
+typedef struct spif_port_qspi_command_s {
+    uint8_t instruction;
+    uint8_t instruction_lines; /* SPIF_QSPI_LINES_NONE: no instruction phase (continuous read mode) */
+
+    uint32_t addr;         /* SPIF_SPI_INVALID_ADDR: no address phase */
+    uint8_t addr_lines;
+
+    uint8_t alt;           /* alternate byte, e.g. mode bits M7-M0 of 0xEB */
+    uint8_t alt_lines;     /* SPIF_QSPI_LINES_NONE: no alternate byte phase */
+
+    uint8_t dummy_cycles;
+    uint8_t data_lines;    /* used only when tx_size/rx_size > 0 */
+
+    uint8_t ddr;           /* 1: address, alternate and data phases on both clock edges, instruction and dummy unchanged */
+    uint8_t sioo;          /* qspi_mmap only, 1: the instruction for the first access only, later accesses start at the address */
+} spif_port_qspi_cmd_t;
+
+/* one segment of spi_transfer_iov() */
+typedef struct spif_port_iov_s {
+    const uint8_t *tx_buf; /* NULL: send 0xFF */
+    uint8_t *rx_buf;       /* NULL: discard what is received */
+    uint32_t size;
+} spif_port_iov_t;
+
+/* completion of an asynchronous transfer, may be called from interrupt context */
+typedef void (*spif_port_done_cb_t)(int result, void *arg);
+
 typedef struct spif_port_spi_operations_s {
     uint8_t ops_mode;
+    uint8_t caps; /* see port capabilities */
 
-    void (*spi_lock)(uint32_t ms);
+    /**
+     * optional, bus lock held by spif around every API call, NULL: single caller only
+     * spi_lock: SPIF_SUCCESS, SPIF_TIMEOUT after timeout_ms
+     * spi_trylock: optional fast path, SPIF_SUCCESS or SPIF_BUSY at once
+     */
+    int (*spi_lock)(uint32_t timeout_ms);
+    int (*spi_trylock)(void);
     void (*spi_unlock)(void);
 
     int (*spi_init)(void);
     int (*spi_deinit)(void);
 
     union {
+        /**
+         * every call is one chip select frame of any length, chip select is held from the first to the last byte
+         * spi_transfer: tx_size bytes out, then rx_size bytes in (rx_buf may be NULL when rx_size is 0)
+         */
         struct {
             int (*spi_send)(const uint8_t *tx_buf, uint32_t tx_size);
             int (*spi_recv)(uint8_t *rx_buf, uint32_t rx_size);
             int (*spi_transfer)(const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size);
+            /* optional, the segments in order in one frame, e.g. command + address, then the data from another buffer */
+            int (*spi_transfer_iov)(const spif_port_iov_t *iov, uint32_t iov_count);
         } spi;
 
         struct {
             int (*qspi_transfer)(uint8_t cmd, uint32_t addr, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size);
+            /* full control over the line width of every phase (dual/quad reads) */
+            int (*qspi_command)(const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size);
+
+            /* optional, enter memory-mapped mode with the given read command, base: start of the window */
+            int (*qspi_mmap)(const spif_port_qspi_cmd_t *cmd, const uint8_t **base);
+            /* optional, back to indirect mode */
+            int (*qspi_munmap)(void);
+
+            /**
+             * optional, let the controller poll a status register until (status & mask) == match
+             * cmd: the status register read, one byte, interval_us: poll interval hint, timeout_ms: return SPIF_TIMEOUT after it
+             */
+            int (*qspi_autopoll)(const spif_port_qspi_cmd_t *cmd, uint8_t mask, uint8_t match, uint32_t interval_us, uint32_t timeout_ms);
+
+            /* optional, start the data phase (DMA/IT) and return at once, done() is called on completion */
+            int (*qspi_command_async)(const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size,
+                                      spif_port_done_cb_t done, void *arg);
         } qspi;
     } ops;
 } spif_port_spi_ops_t;
@@ -40,6 +115,10 @@ typedef struct spif_port_platform_operations_s {
     int (*log)(const char *format, ...);
     void (*delay_us)(uint32_t us);
     void (*delay_ms)(uint32_t ms);
+
+    /* optional, free running counter, used by spif_bench */
+    uint64_t (*timestamp)(void);
+    uint32_t timestamp_hz;
 } spif_port_plat_ops_t;
 
 #endif /* __SPIF_PORT_H__ */
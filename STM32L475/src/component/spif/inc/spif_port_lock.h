@@ -0,0 +1,60 @@
+/*
+ * spif_port_lock.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_PORT_LOCK_H__
+#define __SPIF_PORT_LOCK_H__
+
+#include <stdint.h>
+
+/**
+ * bus lock for the ports, Cortex-M3/M4/M7 (LDREX/STREX, BASEPRI)
+ *
+ * bare metal: a spinlock, BASEPRI is raised to the priority ceiling only while the lock word is
+ * claimed, never while it is held: SysTick and the other interrupts keep running through
+ * a chip erase. on one core an interrupt that finds the lock held has preempted the holder, which
+ * cannot run before it returns, so in an interrupt the lock is tried once instead of waited for
+ *
+ * RTOS: the mutex hook replaces both, tasks block instead of spinning and nothing is masked
+ */
+typedef struct {
+    void *mutex;
+    int (*mutex_lock)(void *mutex, uint32_t timeout_ms); /* SPIF_SUCCESS or SPIF_TIMEOUT, timeout 0: try once */
+    void (*mutex_unlock)(void *mutex);
+} spif_port_lock_rtos_t;
+
+typedef struct {
+    volatile uint32_t locked;
+    uint32_t ceiling;       /* BASEPRI value, (priority << (8 - __NVIC_PRIO_BITS)), 0: no masking */
+    void (*delay_us)(uint32_t us);
+    spif_port_lock_rtos_t rtos;
+} spif_port_lock_t;
+
+/**
+ * @param ceiling BASEPRI value of the priority ceiling, 0: no interrupt masking
+ * @param delay_us wait between two attempts, must not depend on an interrupt below the ceiling
+ * @note  keeps the RTOS hook, so it may be set before the port is initialized
+ */
+void spif_port_lock_init(spif_port_lock_t *lock, uint32_t ceiling, void (*delay_us)(uint32_t us));
+
+/**
+ * @brief use an RTOS mutex from now on, NULL: back to the spinlock
+ * @note  only while the lock is free, usually once before spif_init()
+ */
+void spif_port_lock_rtos_set(spif_port_lock_t *lock, const spif_port_lock_rtos_t *rtos);
+
+/**
+ * @return SPIF_SUCCESS, SPIF_BUSY if held
+ */
+int spif_port_lock_try(spif_port_lock_t *lock);
+
+/**
+ * @return SPIF_SUCCESS, SPIF_TIMEOUT, at once in an interrupt if the lock is held
+ */
+int spif_port_lock_take(spif_port_lock_t *lock, uint32_t timeout_ms);
+
+void spif_port_lock_give(spif_port_lock_t *lock);
+
+#endif /* __SPIF_PORT_LOCK_H__ */
@@ -0,0 +1,111 @@
+/*
+ * spif_port_sim.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_PORT_SIM_H__
+#define __SPIF_PORT_SIM_H__
+
+#include <stdint.h>
+#include "spif_port.h"
+
+/**
+ * host simulated NOR flash, POSIX only (mmap, pthread), not part of the target build:
+ * gcc -Iinc src/spif*.c (without the target ports) app.c -lpthread, test/CMakeLists.txt builds the host tests on it
+ *
+ * time is virtual: bus transfers, busy time and delay_us/delay_ms of the platform ops
+ * advance a per-device clock, so runs are deterministic and do not sleep.
+ * an asynchronous transfer (qspi_command_async) takes bus time only: its completion is called
+ * once the clock passes the end of the transfer, work the caller does meanwhile (delay_us) overlaps it.
+ */
+#define SPIF_PORT_SIM_DEVICES    2
+
+typedef struct {
+    const char *image;   /* backing file, created and filled with 0xFF if missing, NULL: anonymous memory */
+    uint32_t size;       /* unit: Byte, multiple of 64K */
+    uint8_t jedec_id[3];
+    uint32_t clock_hz;   /* bus clock */
+    uint8_t qpi;         /* 4-4-4 mode: 0x38 enters, 0xFF exits, advertised in SFDP */
+    uint8_t dtr;         /* 0xED 1-4D-4D fast read, 8 clocks between address and data */
+    uint8_t dual;        /* two chips of size each in dual-flash mode, QSPI ops mode only */
+    uint8_t die_skew_pct; /* dual: the second chip takes this much longer to program/erase */
+
+    /* typical busy times */
+    uint32_t t_pp_us;
+    uint32_t t_se_us;    /* 4K */
+    uint32_t t_be32_us;
+    uint32_t t_be64_us;
+    uint32_t t_ce_ms;
+    uint32_t t_w_us;     /* write status register */
+    uint32_t t_sus_us;   /* erase/program suspend (0x75) until the array can be read */
+} spif_port_sim_config_t;
+
+typedef struct {
+    uint32_t commands;
+    uint32_t reads;
+    uint64_t read_bytes;
+    uint32_t programs;
+    uint64_t program_bytes;
+    uint32_t erases_4k;
+    uint32_t erases_32k;
+    uint32_t erases_64k;
+    uint32_t erases_chip;
+    uint32_t status_polls;
+    uint32_t suspends;    /* accepted erase/program suspends */
+    uint32_t overwrites;  /* programs that tried to turn a 0 bit back to 1 */
+    uint32_t violations;  /* commands the chip would ignore: busy, no WEL, no QE, bad dummy, wrong SPI/QPI mode, unknown opcode */
+    uint32_t power_cuts;  /* see spif_port_sim_power_cut() */
+    uint64_t bus_ns;      /* time spent on the bus */
+    uint64_t busy_ns;     /* time the array was busy programming/erasing */
+} spif_port_sim_stats_t;
+
+/**
+ * @brief W25Q128JV, 40 MHz, datasheet typical times
+ */
+void spif_port_sim_config_default(spif_port_sim_config_t *config);
+
+/**
+ * @brief create simulated device id (0 ~ SPIF_PORT_SIM_DEVICES - 1), before spif_init()
+ * @return see SPIF status code
+ */
+int spif_port_sim_open(uint8_t id, const spif_port_sim_config_t *config);
+
+int spif_port_sim_close(uint8_t id);
+
+/* the device answers in SPI ops mode (1-1-1 only) or QSPI ops mode, pick one per spif_init() */
+void spif_port_sim_spi_get(uint8_t id, spif_port_spi_ops_t *ops);
+void spif_port_sim_qspi_get(uint8_t id, spif_port_spi_ops_t *ops);
+void spif_port_sim_plat_get(uint8_t id, spif_port_plat_ops_t *ops);
+
+/**
+ * @brief virtual time of the device, unit: ns
+ */
+uint64_t spif_port_sim_time_ns(uint8_t id);
+
+int spif_port_sim_stats_get(uint8_t id, spif_port_sim_stats_t *stats);
+
+void spif_port_sim_stats_reset(uint8_t id);
+
+/**
+ * @brief erase cycles of the 4K sector (8K in dual-flash mode) holding addr since spif_port_sim_open()
+ */
+uint32_t spif_port_sim_erase_count(uint8_t id, uint32_t addr);
+
+/**
+ * @brief fault injection: the power fails during the commands-th command from now (1: the next one,
+ *        counted like stats.commands, 0: disarm). a program of that command stores only the first half
+ *        of its bytes, an erase clears only the first half of its block, a status register write is lost;
+ *        from then on every operation of the port fails and reads give 0xFF until spif_port_sim_power_on()
+ * @return see SPIF status code
+ */
+int spif_port_sim_power_cut(uint8_t id, uint32_t commands);
+
+/**
+ * @brief power back on: the array and the non-volatile status bits stay, the rest is reset
+ *        (WEL, QPI, continuous read, suspend, busy), spif_init() again afterwards
+ * @return see SPIF status code
+ */
+int spif_port_sim_power_on(uint8_t id);
+
+#endif /* __SPIF_PORT_SIM_H__ */
@@ -0,0 +1,121 @@
+/*
+ * spif_queue.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_QUEUE_H__
+#define __SPIF_QUEUE_H__
+
+#include <stdint.h>
+#include "spif.h"
+
+/* contiguous reads are merged into one flash read through this buffer */
+#ifndef SPIF_QUEUE_MERGE_BUF_SIZE
+#define SPIF_QUEUE_MERGE_BUF_SIZE    1024
+#endif
+
+/* SPIF request operation */
+#define SPIF_REQ_READ     0
+#define SPIF_REQ_WRITE    1 /* program only, the range must be erased (SPIF_WRITE_MODE_PROGRAM) */
+#define SPIF_REQ_ERASE    2 /* addr, size multiples of the smallest erase size */
+
+/* SPIF request priority class, served strictly in this order, FIFO inside a class */
+#define SPIF_REQ_PRIO_HIGH      0
+#define SPIF_REQ_PRIO_NORMAL    1
+#define SPIF_REQ_PRIO_LOW       2
+#define SPIF_REQ_PRIO_MAX       3
+
+/**
+ * one request, allocated by the caller and untouched by it from spif_queue_submit() until done.
+ * state follows SPIF asynchronous operation state: RUNNING once queued, DONE with result set
+ */
+typedef struct spif_req_s {
+    uint8_t op;            /* see SPIF request operation */
+    uint8_t prio;          /* see SPIF request priority class */
+    uint32_t addr;
+    uint8_t *buf;          /* read: destination, write: source, erase: unused */
+    uint32_t size;
+    spif_async_cb_t cb;    /* optional, called from spif_queue_poll() */
+    void *arg;
+
+    volatile uint8_t state;
+    int result;
+    uint32_t done;         /* bytes finished */
+    struct spif_req_s *next;
+} spif_req_t;
+
+typedef struct {
+    spif_dev_t *dev;        /* spif_init() done */
+    uint8_t erase_suspend;  /* 1: reads of a higher class suspend an erase in flight */
+    uint16_t suspend_max;   /* suspends allowed per erase block, 0: no limit */
+    uint32_t resume_min_us; /* erase time between a resume and the next suspend (needs plat_ops.timestamp) */
+} spif_queue_config_t;
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t reads;       /* flash reads issued for read requests */
+    uint32_t merged;      /* read requests served by the flash read of another one */
+    uint32_t suspends;
+    uint32_t suspend_denied; /* reads left waiting by suspend_max or resume_min_us */
+} spif_queue_stats_t;
+
+typedef struct spif_queue_s {
+    spif_queue_config_t config;
+
+    spif_req_t *head[SPIF_REQ_PRIO_MAX];
+    spif_req_t *tail[SPIF_REQ_PRIO_MAX];
+    spif_req_t *in_head;  /* submitted, not yet taken into the classes by poll, under the bus lock */
+    spif_req_t *in_tail;
+
+    spif_req_t *active;   /* owner of the write/erase step in flight */
+    spif_async_t token;
+    uint32_t step_addr;
+    uint32_t step_size;
+    uint16_t step_suspends;
+    uint8_t suspended;
+    uint64_t resume_stamp;
+
+    uint8_t buf[SPIF_QUEUE_MERGE_BUF_SIZE];
+    spif_queue_stats_t stats;
+} spif_queue_t;
+
+/**
+ * @brief bind a queue to a device, the device must not be used directly while requests are queued
+ * @return see SPIF status code
+ */
+int spif_queue_init(spif_queue_t *queue, const spif_queue_config_t *config);
+
+/**
+ * @brief queue a request and return at once, nothing is sent to the flash here
+ * @note  requests of different classes may pass each other, a read that must see a write of a
+ *        lower class waits for that write to be done first
+ * @note  any number of producers may submit, they meet poll only in a short section under the
+ *        bus lock of the device (spi_lock); without spi_lock submit and poll must run in one context
+ * @return see SPIF status code, SPIF_TIMEOUT if the bus lock was not got
+ */
+int spif_queue_submit(spif_queue_t *queue, spif_req_t *req);
+
+/**
+ * @brief do the work that can be done now: finish the write/erase step in flight, serve reads
+ *        (suspending an erase for them), start the next write/erase step. call it from the main loop
+ * @note  one context polls, callbacks run there; the lists of the classes are its own
+ * @return number of requests not done yet
+ */
+int spif_queue_poll(spif_queue_t *queue);
+
+/**
+ * @brief poll until the request is done
+ * @param timeout_ms how long to poll, requests of higher classes count against it too
+ * @return result of the request, see SPIF status code, SPIF_TIMEOUT if it is not done by then
+ *         (it stays queued and later polls finish it)
+ */
+int spif_queue_wait(spif_queue_t *queue, spif_req_t *req, uint32_t timeout_ms);
+
+int spif_queue_stats_get(spif_queue_t *queue, spif_queue_stats_t *stats);
+
+void spif_queue_stats_reset(spif_queue_t *queue);
+
+#endif /* __SPIF_QUEUE_H__ */
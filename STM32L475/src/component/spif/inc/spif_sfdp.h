@@ -0,0 +1,91 @@
+/*
+ * spif_sfdp.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_SFDP_H__
+#define __SPIF_SFDP_H__
+
+#include <stdint.h>
+
+#define SPIF_SFDP_ERASE_TYPE_MAX    4
+
+/* Quad Enable requirement, JESD216 BFPT DWORD 15 bits 22:20 */
+#define SPIF_SFDP_QER_NONE          0 /* no QE bit */
+#define SPIF_SFDP_QER_SR2_BIT1_WRSR 1 /* QE = SR2[1], written by 0x01 with 2 bytes */
+#define SPIF_SFDP_QER_SR1_BIT6      2 /* QE = SR1[6], written by 0x01 with 1 byte */
+#define SPIF_SFDP_QER_SR2_BIT7      3 /* QE = SR2[7], written by 0x3E */
+#define SPIF_SFDP_QER_SR2_BIT1_2B   4 /* QE = SR2[1], written by 0x01 with 2 bytes, no SR2 read needed */
+#define SPIF_SFDP_QER_SR2_BIT1      5 /* QE = SR2[1], read by 0x35, written by 0x31 */
+#define SPIF_SFDP_QER_UNKNOWN       0xFF /* not reported (BFPT older than JESD216A) */
+
+/* supported address bytes */
+#define SPIF_SFDP_ADDR_3B           0
+#define SPIF_SFDP_ADDR_3B_4B        1
+#define SPIF_SFDP_ADDR_4B           2
+
+typedef struct spif_sfdp_erase_s {
+    uint32_t size;   /* unit: Byte, 0: unused */
+    uint8_t cmd;
+    uint32_t typ_ms;
+    uint32_t max_ms;
+} spif_sfdp_erase_t;
+
+typedef struct spif_sfdp_info_s {
+    uint8_t major;  /* SFDP revision */
+    uint8_t minor;
+    uint8_t dwords; /* length of the basic flash parameter table */
+
+    uint64_t chip_size; /* unit: Byte */
+    uint32_t page_size; /* unit: Byte */
+    uint8_t addr_bytes; /* see SPIF_SFDP_ADDR_xxx */
+
+    /* fast read, opcode 0: not supported. dummy is the wait states, mode clocks excluded */
+    uint8_t quad_out_cmd;   /* 1-1-4 */
+    uint8_t quad_out_dummy;
+    uint8_t quad_out_mode;
+    uint8_t quad_io_cmd;    /* 1-4-4 */
+    uint8_t quad_io_dummy;
+    uint8_t quad_io_mode;
+    uint8_t qpi_cmd;        /* 4-4-4 */
+    uint8_t qpi_dummy;
+    uint8_t qpi_mode;
+
+    /* QPI enable/disable (JESD216B DWORD 15), opcode 0: no single-opcode sequence */
+    uint8_t qpi_enter_cmd;
+    uint8_t qpi_exit_cmd;
+
+    uint8_t dtr;            /* DTR clocking supported, the opcodes are not in the BFPT */
+
+    uint8_t qer; /* see SPIF_SFDP_QER_xxx */
+
+    /* timing, 0: not reported */
+    uint32_t pp_typ_us;
+    uint32_t pp_max_us;
+    uint32_t ce_typ_ms;
+    uint32_t ce_max_ms;
+
+    /* erase suspend/resume (JESD216B), opcode 0: not supported */
+    uint8_t suspend_cmd;
+    uint8_t resume_cmd;
+    uint32_t suspend_max_us; /* suspend latency, until the array can be read */
+
+    spif_sfdp_erase_t erase[SPIF_SFDP_ERASE_TYPE_MAX]; /* ascending size */
+} spif_sfdp_info_t;
+
+/**
+ * @brief read SFDP space
+ * @param addr SFDP address
+ * @return see SPIF status code
+ */
+typedef int (*spif_sfdp_read_t)(uint32_t addr, uint8_t *buf, uint32_t size, void *arg);
+
+/**
+ * @brief parse the JEDEC basic flash parameter table
+ * @note  no flash access other than read, so it can run on the host against a captured SFDP dump
+ * @return see SPIF status code
+ */
+int spif_sfdp_parse(spif_sfdp_read_t read, void *arg, spif_sfdp_info_t *info);
+
+#endif /* __SPIF_SFDP_H__ */
@@ -0,0 +1,94 @@
+/*
+ * spif_stream.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_STREAM_H__
+#define __SPIF_STREAM_H__
+
+#include <stdint.h>
+#include "spif.h"
+
+typedef struct {
+    spif_dev_t *dev;     /* spif_init() done */
+    uint32_t addr;       /* start of the data in flash */
+    uint32_t size;       /* unit: Byte */
+    uint8_t *buf;        /* 2 * chunk_size, caller owned, untouched by the caller until spif_stream_close() */
+    uint32_t chunk_size; /* bytes per flash read, even in dual-flash mode */
+} spif_stream_config_t;
+
+typedef struct {
+    uint32_t chunks;       /* flash reads issued */
+    uint32_t sync_reads;   /* read-ahead refused (SPIF_BUSY), read when the chunk was needed instead */
+    uint32_t stalls;       /* the caller waited for a read-ahead still running, the first chunk after open/seek not counted */
+    uint32_t stall_us;     /* total time of those waits, 0 without plat_ops.timestamp */
+    uint32_t stall_us_max;
+} spif_stream_stats_t;
+
+/**
+ * sequential reader with double-buffered read-ahead: while the caller consumes one chunk, the
+ * next one is read into the other buffer by spif_read_async() (DMA with a QSPI port that has
+ * qspi_command_async, a plain read otherwise)
+ */
+typedef struct spif_stream_s {
+    spif_stream_config_t config;
+
+    uint8_t cur;          /* buffer being consumed, the other one is the read-ahead */
+    uint32_t cur_size;    /* valid bytes in the current buffer */
+    uint32_t cur_offset;  /* bytes of it handed to the caller */
+    uint32_t next;        /* stream offset of the chunk after the current one */
+    uint32_t ahead_size;  /* bytes of the read-ahead in flight, 0: none */
+    uint8_t primed;       /* a chunk has been consumed since open/seek, waits from now on are stalls */
+    spif_async_t token;
+
+    spif_stream_stats_t stats;
+} spif_stream_t;
+
+/**
+ * @brief start reading at the beginning of the data
+ * @note  while a read-ahead is in flight it owns the device, other calls on it return SPIF_BUSY,
+ *        spif_stream_close() before using the device for anything else
+ * @return see SPIF status code
+ */
+int spif_stream_open(spif_stream_t *stream, const spif_stream_config_t *config);
+
+/**
+ * @brief zero copy: hand out what is left of the current chunk, starting the next read-ahead
+ *        when a new chunk is taken
+ * @param data valid until the next call on the stream
+ * @param size 0 at the end of the data
+ * @return see SPIF status code
+ */
+int spif_stream_get(spif_stream_t *stream, const uint8_t **data, uint32_t *size);
+
+/**
+ * @brief copy up to size bytes
+ * @param read_size less than size only at the end of the data
+ * @return see SPIF status code
+ */
+int spif_stream_read(spif_stream_t *stream, uint8_t *data, uint32_t size, uint32_t *read_size);
+
+/**
+ * @brief continue at offset (from the start of the data), inside the current chunk this is free,
+ *        elsewhere the read-ahead in flight is finished and thrown away
+ * @return see SPIF status code
+ */
+int spif_stream_seek(spif_stream_t *stream, uint32_t offset);
+
+/**
+ * @brief offset of the next byte handed out
+ */
+uint32_t spif_stream_tell(spif_stream_t *stream);
+
+/**
+ * @brief wait for the read-ahead in flight, after this the buffers and the device are free
+ * @return see SPIF status code
+ */
+int spif_stream_close(spif_stream_t *stream);
+
+int spif_stream_stats_get(spif_stream_t *stream, spif_stream_stats_t *stats);
+
+void spif_stream_stats_reset(spif_stream_t *stream);
+
+#endif /* __SPIF_STREAM_H__ */
@@ -8,34 +8,35 @@
 #include <string.h>
 #include "spif.h"
 #include "spif_port.h"
+#include "spif_sfdp.h"
 
 #undef TAG
 #define TAG "spif"
 
 #define SPIF_DEBUG_ENABLE    1
 #if SPIF_DEBUG_ENABLE
-#define SPIF_DEBUG(tag, fmt, ...)    s_plat_ops.log("[D][" tag "] " fmt "\r\n", ##__VA_ARGS__)
+#define SPIF_DEBUG(tag, fmt, ...)    dev->plat_ops.log("[D][" tag "] " fmt "\r\n", ##__VA_ARGS__)
 #else
 #define SPIF_DEBUG(tag, fmt, ...)
 #endif
 
 #define SPIF_INFO_ENABLE     1
 #if SPIF_INFO_ENABLE
-#define SPIF_INFO(tag, fmt, ...)     s_plat_ops.log("[I][" tag "] " fmt "\r\n", ##__VA_ARGS__)
+#define SPIF_INFO(tag, fmt, ...)     dev->plat_ops.log("[I][" tag "] " fmt "\r\n", ##__VA_ARGS__)
 #else
 #define SPIF_INFO(tag, fmt, ...)
 #endif
 
 #define SPIF_WARN_ENABLE     1
 #if SPIF_WARN_ENABLE
-#define SPIF_WARN(tag, fmt, ...)     s_plat_ops.log("[W][" tag "] " fmt "\r\n", ##__VA_ARGS__)
+#define SPIF_WARN(tag, fmt, ...)     dev->plat_ops.log("[W][" tag "] " fmt "\r\n", ##__VA_ARGS__)
 #else
 #define SPIF_WARN(tag, fmt, ...)
 #endif
 
 #define SPIF_ERROR_ENABLE    1
 #if SPIF_ERROR_ENABLE
-#define SPIF_ERROR(tag, fmt, ...)    s_plat_ops.log("[E][" tag "] " fmt "\r\n", ##__VA_ARGS__)
+#define SPIF_ERROR(tag, fmt, ...)    dev->plat_ops.log("[E][" tag "] " fmt "\r\n", ##__VA_ARGS__)
 #else
 #define SPIF_ERROR(tag, fmt, ...)
 #endif
@@ -54,39 +55,82 @@
 #define SPIF_CMD_READ_STATUS_REGISTER2 0x35
 #define SPIF_CMD_READ_STATUS_REGISTER3 0x15
 
+#define SPIF_CMD_WRITE_STATUS_REGISTER1 0x01
+#define SPIF_CMD_WRITE_STATUS_REGISTER2 0x31
+
 #define SPIF_CMD_READ_DATA             0x03
 #define SPIF_CMD_FAST_READ             0x0B
+#define SPIF_CMD_FAST_READ_QUAD_OUTPUT 0x6B
+#define SPIF_CMD_FAST_READ_QUAD_IO     0xEB
 
 #define SPIF_CMD_PAGE_PROGRAM          0x02
 #define SPIF_CMD_SECTOR_ERASE_4K       0x20
 #define SPIF_CMD_BLOCK_ERASE_32K       0x52
 #define SPIF_CMD_BLOCK_ERASE_64K       0xD8
 #define SPIF_CMD_CHIP_ERASE            0xC7
+#define SPIF_CMD_ERASE_SUSPEND         0x75
+#define SPIF_CMD_ERASE_RESUME          0x7A
 
 #define SPIF_CMD_DUMMY                 0xFF
 
+#define SPIF_CMD_FAST_READ_QUAD_IO_DTR 0xED
+#define SPIF_CMD_ENTER_QPI             0x38
+#define SPIF_CMD_EXIT_QPI              0xFF
+
 /* Status */
 #define SPIF_STATUS_BUSY               (1 << 0)
+#define SPIF_STATUS1_QE                (1 << 6) /* Quad Enable in status register 1 */
+#define SPIF_STATUS2_QE                (1 << 1) /* Quad Enable in status register 2 */
+
+/* Quad Enable bit location and how to set it */
+#define SPIF_QE_NONE                   0 /* no QE bit, quad mode is always available */
+#define SPIF_QE_SR1_BIT6               1 /* QE = SR1[6], written by 0x01 with 1 byte */
+#define SPIF_QE_SR2_BIT1               2 /* QE = SR2[1], written by 0x31 */
+#define SPIF_QE_SR2_BIT1_WRSR_2B       3 /* QE = SR2[1], written by 0x01 with 2 bytes (SR1, SR2) */
+
+/* mode bits of 0xEB, anything other than 0bxx10xxxx keeps the flash out of continuous read */
+#define SPIF_QUAD_IO_MODE_BITS         0xFF
+#define SPIF_CREAD_MODE_BITS           0xA0 /* M5-4 = 10: continuous read mode (Winbond) */
+
+/* asynchronous operation */
+#define SPIF_ASYNC_OP_READ             0
+#define SPIF_ASYNC_OP_PROGRAM          1
+#define SPIF_ASYNC_OP_ERASE            2
+
+/* SPIF bus access of an API call, checked against the asynchronous operation in flight */
+#define SPIF_ACCESS_READ               0 /* flash idle, or the erase in flight suspended */
+#define SPIF_ACCESS_EXCLUSIVE          1 /* no asynchronous operation in flight */
+#define SPIF_ACCESS_ASYNC              2 /* works on the asynchronous operation itself, no check */
+#define SPIF_ACCESS_CREAD              3 /* as SPIF_ACCESS_READ, the flash may stay in continuous read mode */
+
+/* busy polling */
+#define SPIF_WAIT_IDLE_DEFAULT_MS      10   /* timeout of a plain "is it idle" check */
+#define SPIF_POLL_INTERVAL_MIN_US      10
+#define SPIF_POLL_INTERVAL_MAX_US      1000
+#define SPIF_ASYNC_READ_US_PER_BYTE    8    /* data phase of an asynchronous read, 1 Mbit/s is far below any bus */
+
+/* defaults of what an SFDP table may not report */
+#define SPIF_SFDP_FAST_READ_DUMMY      8
+#define SPIF_SFDP_WRSR_MAX_MS          15
+#define SPIF_SFDP_PP_MAX_US            5000
+#define SPIF_SFDP_ERASE_MAX_MS         4000
+#define SPIF_3B_ADDR_MAX_SIZE          (16 * 1024 * 1024)
+
+/* SPI ops mode: a page program is staged with its command into one spi_transfer() frame */
+#define SPIF_SPI_PROGRAM_MAX           256
+
+#if SPIF_CACHE_ENABLE
+#if (SPIF_CACHE_LINE_SIZE < 256) || (SPIF_CACHE_LINE_SIZE > 4096) || (SPIF_CACHE_LINE_SIZE & (SPIF_CACHE_LINE_SIZE - 1))
+#error "SPIF_CACHE_LINE_SIZE must be a power of 2 from 256 to 4096"
+#endif
+#endif
 
-#define SPIF_ARRAY_SIZE(x)    (sizeof(x)/sizeof(x[0])) 
-
-typedef struct spif_flash_info_s {
-    char *name;
-
-    uint8_t mf_id;  /* Manufacturer ID */
-    uint8_t mt_id;  /* Memory Type ID */
-    uint8_t cap_id; /* Capacity ID */
-
-    uint32_t chip_size;   /* unit: Byte */
-    uint32_t block_size;  /* unit: Byte */
-    uint32_t sector_size; /* unit: Byte */
-    uint32_t page_size;   /* unit: Byte */
-} spif_flash_info_t;
+#define SPIF_CACHE_INVALID_ADDR        0xFFFFFFFF
 
-static spif_port_spi_ops_t s_spi_ops;
-static spif_port_plat_ops_t s_plat_ops;
+#define SPIF_ARRAY_SIZE(x)    (sizeof(x)/sizeof(x[0])) 
 
-static spif_flash_info_t s_spif_flash_info[] = {
+/* known flash, used instead of SFDP when the JEDEC ID matches */
+static const spif_flash_info_t s_spif_flash_info[] = {
     /* W25Q128JV-IN/IQ/JQ (2.7V - 3.6V) */
     {
         .name    = "W25Q128JV-IN/IQ/JQ",
@@ -97,6 +141,58 @@ static spif_flash_info_t s_spif_flash_info[] = {
         .block_size  = 64 * 1024,
         .sector_size = 4 * 1024,
         .page_size   = 256,
+        .read_mode       = SPIF_READ_MODE_QUAD_IO,
+        .qe_type         = SPIF_QE_SR2_BIT1,
+        .fast_read_dummy = 8,
+        .quad_out_dummy  = 8,
+        .quad_io_dummy   = 4,
+        .cread_mode_bits = SPIF_CREAD_MODE_BITS,
+        .pp_typ_us   = 400,
+        .pp_max_us   = 3000,
+        .wrsr_max_ms = 15,
+        .ce_typ_ms   = 40000,
+        .ce_max_ms   = 200000,
+        .suspend_cmd    = SPIF_CMD_ERASE_SUSPEND,
+        .resume_cmd     = SPIF_CMD_ERASE_RESUME,
+        .suspend_max_us = 20,
+        .erase = {
+            {4 * 1024,  SPIF_CMD_SECTOR_ERASE_4K, 45,  400},
+            {32 * 1024, SPIF_CMD_BLOCK_ERASE_32K, 120, 1600},
+            {64 * 1024, SPIF_CMD_BLOCK_ERASE_64K, 150, 2000},
+        },
+    },
+
+    /* W25Q128JV-IM/JM (2.7V - 3.6V), DTR */
+    {
+        .name    = "W25Q128JV-IM/JM",
+        .mf_id   = SPIF_MF_ID_WINBOND,
+        .mt_id   = 0x70,
+        .cap_id  = 0x18,
+        .chip_size   = 16 * 1024 * 1024,
+        .block_size  = 64 * 1024,
+        .sector_size = 4 * 1024,
+        .page_size   = 256,
+        .read_mode       = SPIF_READ_MODE_QUAD_IO_DTR,
+        .qe_type         = SPIF_QE_SR2_BIT1,
+        .fast_read_dummy = 8,
+        .quad_out_dummy  = 8,
+        .quad_io_dummy   = 4,
+        .dtr_read_cmd    = SPIF_CMD_FAST_READ_QUAD_IO_DTR,
+        .dtr_read_dummy  = 7,
+        .cread_mode_bits = SPIF_CREAD_MODE_BITS,
+        .pp_typ_us   = 400,
+        .pp_max_us   = 3000,
+        .wrsr_max_ms = 15,
+        .ce_typ_ms   = 40000,
+        .ce_max_ms   = 200000,
+        .suspend_cmd    = SPIF_CMD_ERASE_SUSPEND,
+        .resume_cmd     = SPIF_CMD_ERASE_RESUME,
+        .suspend_max_us = 20,
+        .erase = {
+            {4 * 1024,  SPIF_CMD_SECTOR_ERASE_4K, 45,  400},
+            {32 * 1024, SPIF_CMD_BLOCK_ERASE_32K, 120, 1600},
+            {64 * 1024, SPIF_CMD_BLOCK_ERASE_64K, 150, 2000},
+        },
     },
 
     /* GT25Q40D (1.65V - 3.6V) */
@@ -109,25 +205,183 @@ static spif_flash_info_t s_spif_flash_info[] = {
         .block_size  = 32 * 1024,
         .sector_size = 4 * 1024,
         .page_size   = 256,
+        .read_mode       = SPIF_READ_MODE_QUAD_IO,
+        .qe_type         = SPIF_QE_SR2_BIT1_WRSR_2B,
+        .fast_read_dummy = 8,
+        .quad_out_dummy  = 8,
+        .quad_io_dummy   = 4,
+        .pp_typ_us   = 600,
+        .pp_max_us   = 3000,
+        .wrsr_max_ms = 15,
+        .ce_typ_ms   = 2000,
+        .ce_max_ms   = 10000,
+        .erase = {
+            {4 * 1024,  SPIF_CMD_SECTOR_ERASE_4K, 60,  400},
+            {32 * 1024, SPIF_CMD_BLOCK_ERASE_32K, 200, 1600},
+            {64 * 1024, SPIF_CMD_BLOCK_ERASE_64K, 300, 2000},
+        },
     },
 };
 
-static uint16_t s_spif_flash_index = 0;
+uint64_t spif_now_us(spif_dev_t *dev)
+{
+    uint64_t ts = 0;
+    uint32_t hz = dev->plat_ops.timestamp_hz;
+
+    if ((dev->plat_ops.timestamp == NULL) || (hz == 0)) {
+        return 0;
+    }
+
+    ts = dev->plat_ops.timestamp();
+
+    /* split, ts * 1000000 overflows after 1.8e13 ticks (5 hours at 1 GHz) */
+    return (ts / hz) * 1000000ULL + (ts % hz) * 1000000ULL / hz;
+}
+
+/* a command with no alternate bytes or dummy cycles, on 4 lines throughout while in QPI */
+static void _spif_qspi_cmd_init(spif_dev_t *dev, spif_port_qspi_cmd_t *qspi_cmd, uint8_t instruction, uint32_t addr)
+{
+    uint8_t lines = dev->qpi ? SPIF_QSPI_LINES_4 : SPIF_QSPI_LINES_1;
+
+    memset(qspi_cmd, 0, sizeof(spif_port_qspi_cmd_t));
+
+    qspi_cmd->instruction = instruction;
+    qspi_cmd->instruction_lines = lines;
+    qspi_cmd->addr = addr;
+    qspi_cmd->addr_lines = lines;
+    qspi_cmd->alt_lines = SPIF_QSPI_LINES_NONE;
+    qspi_cmd->data_lines = lines;
+}
+
+/* qspi_transfer() is 1-1-1 only, QPI needs qspi_command() */
+static int _spif_qspi_transfer(spif_dev_t *dev, uint8_t cmd, uint32_t addr, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    spif_port_qspi_cmd_t qspi_cmd;
+
+    if (!dev->qpi) {
+        return dev->spi_ops.ops.qspi.qspi_transfer(cmd, addr, tx_buf, tx_size, rx_buf, rx_size);
+    }
+
+    _spif_qspi_cmd_init(dev, &qspi_cmd, cmd, addr);
+
+    return dev->spi_ops.ops.qspi.qspi_command(&qspi_cmd, tx_buf, tx_size, rx_buf, rx_size);
+}
+
+/**
+ * leave continuous read mode: the address and mode bit clocks all high (mode bits 0xFF end it), CS raised
+ * before the data. a flash in SPI mode not in continuous read mode sees the opcode 0xFF on IO0 and ignores it
+ */
+static int _spif_cread_exit(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_port_qspi_cmd_t qspi_cmd;
+
+    _spif_qspi_cmd_init(dev, &qspi_cmd, SPIF_CMD_EXIT_QPI, 0xFFFFFF);
+    qspi_cmd.instruction_lines = SPIF_QSPI_LINES_NONE;
+    qspi_cmd.addr_lines = SPIF_QSPI_LINES_4;
+    qspi_cmd.alt = SPIF_QUAD_IO_MODE_BITS;
+    qspi_cmd.alt_lines = SPIF_QSPI_LINES_4;
+
+    ret = dev->spi_ops.ops.qspi.qspi_command(&qspi_cmd, NULL, 0, NULL, 0);
+
+    dev->cread_active = 0;
+
+    return ret;
+}
+
+/**
+ * take the bus lock of the port for one API call, the try lock first so the uncontended case
+ * costs no timestamp. an asynchronous operation owns the flash past the call that started it,
+ * so calls that would disturb it are refused here, under the lock
+ */
+static int _spif_lock(spif_dev_t *dev, uint8_t access, const char *caller)
+{
+    spif_lock_stats_t *stats = &dev->lock_stats;
+    uint64_t start = 0;
+    uint32_t wait_us = 0;
+
+    if (dev->spi_ops.spi_lock != NULL) {
+        if ((dev->spi_ops.spi_trylock == NULL) || (dev->spi_ops.spi_trylock() != SPIF_SUCCESS)) {
+            start = spif_now_us(dev);
+
+            if (dev->spi_ops.spi_lock(SPIF_LOCK_TIMEOUT_MS) != SPIF_SUCCESS) {
+                stats->timeouts++;
+                SPIF_ERROR(TAG, "%s: bus lock timeout, held by %s.", caller,
+                           (dev->lock_caller != NULL) ? dev->lock_caller : "?");
+                return SPIF_TIMEOUT;
+            }
+
+            stats->contended++;
+            wait_us = (uint32_t)(spif_now_us(dev) - start);
+            if (wait_us > stats->wait_max_us) {
+                stats->wait_max_us = wait_us;
+            }
+        }
+    }
+
+    if (((access == SPIF_ACCESS_EXCLUSIVE) && (dev->async != NULL)) ||
+        ((access == SPIF_ACCESS_READ || access == SPIF_ACCESS_CREAD) && (dev->async != NULL) && !dev->erase_suspended)) {
+        stats->busy++;
+        if (dev->spi_ops.spi_unlock != NULL) {
+            dev->spi_ops.spi_unlock();
+        }
+        return SPIF_BUSY;
+    }
+
+    /* a flash in continuous read mode would take any other command as an address */
+    if (dev->cread_active && !dev->mmap_active && (access != SPIF_ACCESS_CREAD)) {
+        (void)_spif_cread_exit(dev);
+    }
+
+    stats->locks++;
+    dev->lock_caller = caller;
+    dev->lock_stamp = spif_now_us(dev);
+
+    return SPIF_SUCCESS;
+}
+
+static void _spif_unlock(spif_dev_t *dev)
+{
+    spif_lock_stats_t *stats = &dev->lock_stats;
+    uint32_t hold_us = (uint32_t)(spif_now_us(dev) - dev->lock_stamp);
+
+    stats->hold_total_us += hold_us;
+    if (hold_us > stats->hold_max_us) {
+        stats->hold_max_us = hold_us;
+        stats->hold_max_caller = dev->lock_caller;
+    }
+
+    if (dev->spi_ops.spi_unlock != NULL) {
+        dev->spi_ops.spi_unlock();
+    }
+}
 
-static int _spif_read_jedec_id(uint8_t *buf, uint32_t buf_len)
+static int _spif_read_jedec_id(spif_dev_t *dev, uint8_t *buf, uint32_t buf_len)
 {
     int ret = SPIF_SUCCESS;
 
     uint8_t cmd[] = {SPIF_CMD_READ_JEDEC_ID};
+    uint8_t id[6] = {0};
 
     if ((buf == NULL) || (buf_len < 3)) {
         return SPIF_FAIL;
     }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), buf, 3);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, buf, 3);
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), buf, 3);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, id, dev->dual ? 6 : 3);
+
+        /* dual-flash: the IDs of the two chips come interleaved and must match */
+        for (int i = 0; i < 3; i++) {
+            buf[i] = id[dev->dual ? (2 * i) : i];
+            if (dev->dual && (id[2 * i] != id[2 * i + 1])) {
+                SPIF_ERROR(TAG, "dual-flash: chips differ, 0x%02X%02X%02X / 0x%02X%02X%02X.",
+                           id[0], id[2], id[4], id[1], id[3], id[5]);
+                return SPIF_FAIL;
+            }
+        }
     }
     
     if (ret != SPIF_SUCCESS) {
@@ -138,39 +392,190 @@ static int _spif_read_jedec_id(uint8_t *buf, uint32_t buf_len)
     return ret;
 }
 
-static int _spif_read_status_register1(uint8_t *status)
+static int _spif_sfdp_read(uint32_t addr, uint8_t *buf, uint32_t size, void *arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_port_qspi_cmd_t qspi_cmd;
+
+    /* 0x5A: one dummy byte (8 clocks) after the address, like 0x0B */
+    uint8_t cmd[] = {SPIF_CMD_READ_SFDP_REGISTER, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF, SPIF_CMD_DUMMY};
+
+    spif_dev_t *dev = (spif_dev_t *)arg;
+    uint8_t pairs[32];
+    uint32_t chunk = 0;
+
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), buf, size);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        memset(&qspi_cmd, 0, sizeof(spif_port_qspi_cmd_t));
+        qspi_cmd.instruction = SPIF_CMD_READ_SFDP_REGISTER;
+        qspi_cmd.instruction_lines = SPIF_QSPI_LINES_1;
+        qspi_cmd.addr = addr;
+        qspi_cmd.addr_lines = SPIF_QSPI_LINES_1;
+        qspi_cmd.alt_lines = SPIF_QSPI_LINES_NONE;
+        qspi_cmd.dummy_cycles = 8;
+        qspi_cmd.data_lines = SPIF_QSPI_LINES_1;
+
+        if (!dev->dual) {
+            return dev->spi_ops.ops.qspi.qspi_command(&qspi_cmd, NULL, 0, buf, size);
+        }
+
+        /* dual-flash: both chips answer, every byte comes twice, the port halves the address */
+        for (uint32_t offset = 0; (offset < size) && (ret == SPIF_SUCCESS); offset += chunk) {
+            chunk = ((size - offset) < (sizeof(pairs) / 2)) ? (size - offset) : (sizeof(pairs) / 2);
+            qspi_cmd.addr = (addr + offset) * 2;
+            ret = dev->spi_ops.ops.qspi.qspi_command(&qspi_cmd, NULL, 0, pairs, chunk * 2);
+            for (uint32_t i = 0; i < chunk; i++) {
+                buf[offset + i] = pairs[2 * i];
+            }
+        }
+    }
+
+    return ret;
+}
+
+/* build the flash info from a parsed SFDP table */
+static int _spif_sfdp_info_get(spif_dev_t *dev, const spif_sfdp_info_t *sfdp, spif_flash_info_t *info)
+{
+    uint32_t quad_io_clocks = sfdp->quad_io_dummy + sfdp->quad_io_mode;
+    int types = 0;
+
+    memset(info, 0, sizeof(spif_flash_info_t));
+
+    if (sfdp->addr_bytes == SPIF_SFDP_ADDR_4B) {
+        SPIF_ERROR(TAG, "sfdp: 4-byte address only flash not supported.");
+        return SPIF_FAIL;
+    }
+
+    info->name = "SFDP";
+    info->chip_size = (uint32_t)sfdp->chip_size;
+    if (sfdp->chip_size > SPIF_3B_ADDR_MAX_SIZE) {
+        /* 3-byte addressing only reaches the lower 16 MB */
+        SPIF_WARN(TAG, "sfdp: %u MB flash, only the lower 16 MB is used.", (uint32_t)(sfdp->chip_size >> 20));
+        info->chip_size = SPIF_3B_ADDR_MAX_SIZE;
+    }
+
+    info->page_size = sfdp->page_size;
+
+    for (types = 0; (types < SPIF_ERASE_TYPE_MAX) && (sfdp->erase[types].size != 0); types++) {
+        info->erase[types].size = sfdp->erase[types].size;
+        info->erase[types].cmd = sfdp->erase[types].cmd;
+        info->erase[types].typ_ms = sfdp->erase[types].typ_ms;
+        info->erase[types].max_ms = (sfdp->erase[types].max_ms != 0) ? sfdp->erase[types].max_ms : SPIF_SFDP_ERASE_MAX_MS;
+        if ((info->erase[types].size <= 64 * 1024) || (info->block_size == 0)) {
+            info->block_size = info->erase[types].size;
+        }
+    }
+
+    info->sector_size = info->erase[0].size;
+
+    info->pp_typ_us = sfdp->pp_typ_us;
+    info->pp_max_us = (sfdp->pp_max_us != 0) ? sfdp->pp_max_us : SPIF_SFDP_PP_MAX_US;
+    info->wrsr_max_ms = SPIF_SFDP_WRSR_MAX_MS;
+    info->ce_typ_ms = sfdp->ce_typ_ms; /* 0 keeps spif_erase_range() away from chip erase */
+    info->ce_max_ms = (sfdp->ce_max_ms != 0) ? sfdp->ce_max_ms :
+                      (info->chip_size / info->erase[types - 1].size) * info->erase[types - 1].max_ms;
+
+    info->suspend_cmd = sfdp->suspend_cmd;
+    info->resume_cmd = sfdp->resume_cmd;
+    info->suspend_max_us = sfdp->suspend_max_us;
+
+    switch (sfdp->qer) {
+    case SPIF_SFDP_QER_NONE:
+        info->qe_type = SPIF_QE_NONE;
+        break;
+
+    case SPIF_SFDP_QER_SR1_BIT6:
+        info->qe_type = SPIF_QE_SR1_BIT6;
+        break;
+
+    case SPIF_SFDP_QER_SR2_BIT1:
+        info->qe_type = SPIF_QE_SR2_BIT1;
+        break;
+
+    case SPIF_SFDP_QER_SR2_BIT1_WRSR:
+    case SPIF_SFDP_QER_SR2_BIT1_2B:
+        info->qe_type = SPIF_QE_SR2_BIT1_WRSR_2B;
+        break;
+
+    default:
+        /* QE bit unknown, quad modes can not be enabled safely */
+        SPIF_WARN(TAG, "sfdp: quad enable requirement %d not supported.", sfdp->qer);
+        info->read_mode = SPIF_READ_MODE_FAST;
+        break;
+    }
+
+    /* every SFDP flash supports 0x0B, opcodes other than the usual ones are not used */
+    info->fast_read_dummy = SPIF_SFDP_FAST_READ_DUMMY;
+    if (info->read_mode != SPIF_READ_MODE_FAST) {
+        if ((sfdp->quad_io_cmd == SPIF_CMD_FAST_READ_QUAD_IO) && (quad_io_clocks >= 2)) {
+            /* the mode bits are sent as 2 clocks of alternate bytes */
+            info->read_mode = SPIF_READ_MODE_QUAD_IO;
+            info->quad_io_dummy = quad_io_clocks - 2;
+        } else if (sfdp->quad_out_cmd == SPIF_CMD_FAST_READ_QUAD_OUTPUT) {
+            info->read_mode = SPIF_READ_MODE_QUAD_OUTPUT;
+        } else {
+            info->read_mode = SPIF_READ_MODE_FAST;
+        }
+    }
+    info->quad_out_dummy = sfdp->quad_out_dummy + sfdp->quad_out_mode;
+
+    /* QPI with the usual 0xEB and single-opcode enter/exit only, DTR opcodes are not in the BFPT */
+    if ((info->read_mode == SPIF_READ_MODE_QUAD_IO) && (sfdp->qpi_cmd == SPIF_CMD_FAST_READ_QUAD_IO) &&
+        (sfdp->qpi_dummy + sfdp->qpi_mode >= 2) && (sfdp->qpi_enter_cmd != 0) && (sfdp->qpi_exit_cmd != 0)) {
+        info->read_mode = SPIF_READ_MODE_QPI;
+        info->qpi_enter_cmd = sfdp->qpi_enter_cmd;
+        info->qpi_exit_cmd = sfdp->qpi_exit_cmd;
+        info->qpi_dummy = sfdp->qpi_dummy + sfdp->qpi_mode - 2;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_read_status_register(spif_dev_t *dev, uint8_t reg_cmd, uint8_t *status)
 {
     int ret = SPIF_SUCCESS;
 
-    uint8_t cmd[] = {SPIF_CMD_READ_STATUS_REGISTER1};
-    uint8_t buf[1] = {0};
+    uint8_t cmd[] = {reg_cmd};
+    uint8_t buf[2] = {0};
+
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), buf, 1);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, buf, dev->dual ? 2 : 1);
+    }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), buf, 1);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, buf, 1);
+    /* dual-flash: one byte per chip, a bit is set when both chips have it, busy while either one is */
+    if (dev->dual) {
+        buf[0] = (buf[0] & buf[1]) | ((reg_cmd == SPIF_CMD_READ_STATUS_REGISTER1) ? ((buf[0] | buf[1]) & SPIF_STATUS_BUSY) : 0);
     }
 
     *status = buf[0];
 
     if (ret != SPIF_SUCCESS) {
-        SPIF_ERROR(TAG, "spi read status_register1 failed: %d.", ret);
+        SPIF_ERROR(TAG, "spi read status register 0x%02X failed: %d.", reg_cmd, ret);
         return ret;
     }
 
     return ret;
 }
 
-static int _spif_write_enable(void)
+static int _spif_read_status_register1(spif_dev_t *dev, uint8_t *status)
+{
+    return _spif_read_status_register(dev, SPIF_CMD_READ_STATUS_REGISTER1, status);
+}
+
+static int _spif_write_enable(spif_dev_t *dev)
 {
     int ret = SPIF_SUCCESS;
 
     uint8_t cmd[] = {SPIF_CMD_WRITE_ENABLE};
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, NULL, 0);
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, NULL, 0);
     }
 
     if (ret != SPIF_SUCCESS) {
@@ -181,16 +586,16 @@ static int _spif_write_enable(void)
     return ret;
 }
 
-static int _spif_write_disable(void)
+static int _spif_write_disable(spif_dev_t *dev)
 {
     int ret = SPIF_SUCCESS;
 
     uint8_t cmd[] = {SPIF_CMD_WRITE_DISABLE};
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, NULL, 0);
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, NULL, 0);
     }
 
     if (ret != SPIF_SUCCESS) {
@@ -201,286 +606,2420 @@ static int _spif_write_disable(void)
     return ret;
 }
 
-static int _spif_wait_idle(void)
+/**
+ * @brief wait until the flash clears its busy bit
+ * @param typ_us typical duration of the running operation, sets the poll interval
+ * @param timeout_ms maximum duration of the running operation
+ * @return see SPIF status code
+ */
+static int _spif_wait_idle(spif_dev_t *dev, uint32_t typ_us, uint32_t timeout_ms)
 {
     int ret = SPIF_SUCCESS;
     uint8_t status = 0xFF;
 
-    for (int i = 0; i < 500; i++) {
-        ret = _spif_read_status_register1(&status);
+    spif_port_qspi_cmd_t qspi_cmd;
+    uint32_t elapsed_us = 0;
+    uint32_t interval_us = typ_us / 8;
+
+    if (interval_us < SPIF_POLL_INTERVAL_MIN_US) {
+        interval_us = SPIF_POLL_INTERVAL_MIN_US;
+    } else if (interval_us > SPIF_POLL_INTERVAL_MAX_US) {
+        interval_us = SPIF_POLL_INTERVAL_MAX_US;
+    }
+
+    /* the controller polls by itself, the CPU can sleep meanwhile */
+    if ((dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) && (dev->spi_ops.ops.qspi.qspi_autopoll != NULL)) {
+        _spif_qspi_cmd_init(dev, &qspi_cmd, SPIF_CMD_READ_STATUS_REGISTER1, SPIF_SPI_INVALID_ADDR);
+        ret = dev->spi_ops.ops.qspi.qspi_autopoll(&qspi_cmd, SPIF_STATUS_BUSY, 0, interval_us, timeout_ms);
+        if (ret == SPIF_TIMEOUT) {
+            SPIF_ERROR(TAG, "wait idle timeout: %u ms.", timeout_ms);
+        }
+
+        return ret;
+    }
+
+    while (1) {
+        ret = _spif_read_status_register1(dev, &status);
         if (ret != SPIF_SUCCESS) {
             return ret;
         }
 
         if ((status & SPIF_STATUS_BUSY) == 0) {
+            return SPIF_SUCCESS;
+        }
+
+        /* only the delays are counted, so the real timeout is a little longer */
+        if ((elapsed_us / 1000) >= timeout_ms) {
             break;
         }
 
-        s_plat_ops.delay_us(50);
+        dev->plat_ops.delay_us(interval_us);
+        elapsed_us += interval_us;
     }
 
-    return ret;
+    SPIF_ERROR(TAG, "wait idle timeout: %u ms.", timeout_ms);
+
+    return SPIF_TIMEOUT;
 }
 
-static int _spif_chip_erase(void)
+static spif_erase_type_t *_spif_erase_type_get(spif_dev_t *dev, uint8_t erase_cmd)
 {
-    int ret = SPIF_SUCCESS;
-
-    uint8_t cmd[] = {SPIF_CMD_CHIP_ERASE};
+    spif_flash_info_t *info = &dev->flash;
 
-    ret = _spif_write_enable();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    for (int i = 0; i < SPIF_ERASE_TYPE_MAX; i++) {
+        if ((info->erase[i].size != 0) && (info->erase[i].cmd == erase_cmd)) {
+            return &info->erase[i];
+        }
     }
 
-    _spif_wait_idle();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    return NULL;
+}
+
+static int _spif_write_status_register(spif_dev_t *dev, uint8_t reg_cmd, uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t cmd[] = {reg_cmd, 0x00, 0x00};
+    uint8_t pairs[4];
+
+    if ((data == NULL) || (data_size == 0) || (data_size > 2)) {
+        return SPIF_FAIL;
     }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, NULL, 0);
+    /* dual-flash: the data phase alternates between the chips, both get the same value */
+    if (dev->dual) {
+        for (uint32_t i = 0; i < data_size; i++) {
+            pairs[2 * i] = data[i];
+            pairs[2 * i + 1] = data[i];
+        }
+        data = pairs;
+        data_size *= 2;
     }
 
+    ret = _spif_write_enable(dev);
     if (ret != SPIF_SUCCESS) {
-        SPIF_ERROR(TAG, "spi chip erase failed: %d.", ret);
         return ret;
     }
 
-    _spif_wait_idle();
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        memcpy(&cmd[1], data, data_size);
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, 1 + data_size, NULL, 0);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], SPIF_SPI_INVALID_ADDR, data, data_size, NULL, 0);
+    }
 
-    ret = _spif_write_disable();
     if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "spi write status register 0x%02X failed: %d.", reg_cmd, ret);
         return ret;
     }
 
-    return ret;
+    /* non-volatile status register write takes up to tW */
+    return _spif_wait_idle(dev, 0, dev->flash.wrsr_max_ms);
 }
 
-int spif_block_erase_32(uint32_t addr)
+static int _spif_quad_enable(spif_dev_t *dev)
 {
     int ret = SPIF_SUCCESS;
 
-    uint8_t cmd[] = {SPIF_CMD_BLOCK_ERASE_32K, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
+    uint8_t sr[2] = {0};
+    uint8_t qe_type = dev->flash.qe_type;
 
-    ret = _spif_write_enable();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    /* read first, QE is non-volatile and most parts ship with it already set */
+    switch (qe_type) {
+    case SPIF_QE_NONE:
+        return SPIF_SUCCESS;
+
+    case SPIF_QE_SR1_BIT6:
+        ret = _spif_read_status_register(dev, SPIF_CMD_READ_STATUS_REGISTER1, &sr[0]);
+        if ((ret != SPIF_SUCCESS) || (sr[0] & SPIF_STATUS1_QE)) {
+            return ret;
+        }
+
+        sr[0] |= SPIF_STATUS1_QE;
+        ret = _spif_write_status_register(dev, SPIF_CMD_WRITE_STATUS_REGISTER1, sr, 1);
+        break;
+
+    case SPIF_QE_SR2_BIT1:
+        ret = _spif_read_status_register(dev, SPIF_CMD_READ_STATUS_REGISTER2, &sr[1]);
+        if ((ret != SPIF_SUCCESS) || (sr[1] & SPIF_STATUS2_QE)) {
+            return ret;
+        }
+
+        sr[1] |= SPIF_STATUS2_QE;
+        ret = _spif_write_status_register(dev, SPIF_CMD_WRITE_STATUS_REGISTER2, &sr[1], 1);
+        break;
+
+    case SPIF_QE_SR2_BIT1_WRSR_2B:
+        ret = _spif_read_status_register(dev, SPIF_CMD_READ_STATUS_REGISTER2, &sr[1]);
+        if ((ret != SPIF_SUCCESS) || (sr[1] & SPIF_STATUS2_QE)) {
+            return ret;
+        }
+
+        ret = _spif_read_status_register(dev, SPIF_CMD_READ_STATUS_REGISTER1, &sr[0]);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        sr[1] |= SPIF_STATUS2_QE;
+        ret = _spif_write_status_register(dev, SPIF_CMD_WRITE_STATUS_REGISTER1, sr, 2);
+        break;
+
+    default:
+        return SPIF_FAIL;
     }
 
-    _spif_wait_idle();
     if (ret != SPIF_SUCCESS) {
         return ret;
     }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], addr, NULL, 0, NULL, 0);
+    /* verify, the status register may be locked (SRP/SRL) */
+    if (qe_type == SPIF_QE_SR1_BIT6) {
+        ret = _spif_read_status_register(dev, SPIF_CMD_READ_STATUS_REGISTER1, &sr[0]);
+        if ((ret == SPIF_SUCCESS) && ((sr[0] & SPIF_STATUS1_QE) == 0)) {
+            ret = SPIF_FAIL;
+        }
+    } else {
+        ret = _spif_read_status_register(dev, SPIF_CMD_READ_STATUS_REGISTER2, &sr[1]);
+        if ((ret == SPIF_SUCCESS) && ((sr[1] & SPIF_STATUS2_QE) == 0)) {
+            ret = SPIF_FAIL;
+        }
     }
 
-    _spif_wait_idle();
-
-    ret = _spif_write_disable();
     if (ret != SPIF_SUCCESS) {
-        return ret;
+        SPIF_ERROR(TAG, "quad enable failed.");
     }
 
     return ret;
 }
 
-int spif_block_erase_64(uint32_t addr)
+static void _spif_read_cmd_get(spif_dev_t *dev, spif_read_mode_t mode, uint32_t addr, spif_port_qspi_cmd_t *qspi_cmd)
 {
-    int ret = SPIF_SUCCESS;
+    spif_flash_info_t *info = &dev->flash;
+
+    _spif_qspi_cmd_init(dev, qspi_cmd, SPIF_CMD_READ_DATA, addr);
+
+    switch (mode) {
+    case SPIF_READ_MODE_FAST:
+        qspi_cmd->instruction = SPIF_CMD_FAST_READ;
+        qspi_cmd->dummy_cycles = info->fast_read_dummy;
+        break;
+
+    case SPIF_READ_MODE_QUAD_OUTPUT:
+        qspi_cmd->instruction = SPIF_CMD_FAST_READ_QUAD_OUTPUT;
+        qspi_cmd->dummy_cycles = info->quad_out_dummy;
+        qspi_cmd->data_lines = SPIF_QSPI_LINES_4;
+        break;
+
+    case SPIF_READ_MODE_QUAD_IO:
+        qspi_cmd->instruction = SPIF_CMD_FAST_READ_QUAD_IO;
+        qspi_cmd->addr_lines = SPIF_QSPI_LINES_4;
+        qspi_cmd->alt = SPIF_QUAD_IO_MODE_BITS;
+        qspi_cmd->alt_lines = SPIF_QSPI_LINES_4;
+        qspi_cmd->dummy_cycles = info->quad_io_dummy;
+        qspi_cmd->data_lines = SPIF_QSPI_LINES_4;
+        break;
+
+    case SPIF_READ_MODE_QUAD_IO_DTR:
+        /* address and mode bits take half the clocks, dummy cycles are full clocks */
+        qspi_cmd->instruction = info->dtr_read_cmd;
+        qspi_cmd->addr_lines = SPIF_QSPI_LINES_4;
+        qspi_cmd->alt = SPIF_QUAD_IO_MODE_BITS;
+        qspi_cmd->alt_lines = SPIF_QSPI_LINES_4;
+        qspi_cmd->dummy_cycles = info->dtr_read_dummy;
+        qspi_cmd->data_lines = SPIF_QSPI_LINES_4;
+        qspi_cmd->ddr = 1;
+        break;
+
+    case SPIF_READ_MODE_QPI:
+        /* instruction 2 clocks, address 6, mode bits 2: 10 clocks before the dummy instead of 16 */
+        qspi_cmd->instruction = SPIF_CMD_FAST_READ_QUAD_IO;
+        qspi_cmd->instruction_lines = SPIF_QSPI_LINES_4;
+        qspi_cmd->addr_lines = SPIF_QSPI_LINES_4;
+        qspi_cmd->alt = SPIF_QUAD_IO_MODE_BITS;
+        qspi_cmd->alt_lines = SPIF_QSPI_LINES_4;
+        qspi_cmd->dummy_cycles = info->qpi_dummy;
+        qspi_cmd->data_lines = SPIF_QSPI_LINES_4;
+        break;
+
+    default:
+        break;
+    }
+}
 
-    uint8_t cmd[] = {SPIF_CMD_BLOCK_ERASE_64K, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
+/* dual-flash: a data phase starts on an even address and moves whole byte pairs, odd ends go through a pair */
+static int _spif_read_pairs(spif_dev_t *dev, int (*read)(spif_dev_t *, uint32_t, uint8_t *, uint32_t),
+                            uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
 
-    ret = _spif_write_enable();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
-    }
+    uint8_t pair[2];
+    uint32_t size = 0;
 
-    _spif_wait_idle();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    if ((addr & 1) && (data_size > 0)) {
+        ret = read(dev, addr - 1, pair, 2);
+        data[0] = pair[1];
+        addr++;
+        data++;
+        data_size--;
     }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], addr, NULL, 0, NULL, 0);
+    size = data_size & ~1UL;
+    if ((ret == SPIF_SUCCESS) && (size > 0)) {
+        ret = read(dev, addr, data, size);
     }
 
-    _spif_wait_idle();
-
-    ret = _spif_write_disable();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    if ((ret == SPIF_SUCCESS) && (data_size & 1)) {
+        ret = read(dev, addr + size, pair, 2);
+        data[size] = pair[0];
     }
 
     return ret;
 }
 
-int spif_sector_erase(uint32_t addr)
+static int _spif_read_normal(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
 {
     int ret = SPIF_SUCCESS;
 
-    uint8_t cmd[] = {SPIF_CMD_SECTOR_ERASE_4K, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
-
-    ret = _spif_write_enable();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
-    }
+    spif_port_qspi_cmd_t qspi_cmd;
+    uint8_t cmd[] = {SPIF_CMD_READ_DATA, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
 
-    _spif_wait_idle();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    if (dev->dual && ((addr | data_size) & 1)) {
+        return _spif_read_pairs(dev, _spif_read_normal, addr, data, data_size);
     }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], addr, NULL, 0, NULL, 0);
+    /* 0x03 does not exist in QPI */
+    if (dev->qpi) {
+        _spif_read_cmd_get(dev, SPIF_READ_MODE_QPI, addr, &qspi_cmd);
+        return dev->spi_ops.ops.qspi.qspi_command(&qspi_cmd, NULL, 0, data, data_size);
     }
 
-    _spif_wait_idle();
-
-    ret = _spif_write_disable();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), data, data_size);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], addr, NULL, 0, data, data_size);
     }
 
     return ret;
 }
 
-int spif_page_program(uint32_t addr, uint8_t *data, uint32_t data_size)
+static int _spif_read_fast(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
 {
     int ret = SPIF_SUCCESS;
 
-    uint8_t cmd[] = {SPIF_CMD_PAGE_PROGRAM, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
-
-    if (data_size > s_spif_flash_info[s_spif_flash_index].page_size) {
-        SPIF_ERROR(TAG, "invalid data size.");
-        return SPIF_FAIL;
-    }
+    spif_port_qspi_cmd_t qspi_cmd;
 
-    if (((addr & 0xFF) + data_size) > s_spif_flash_info[s_spif_flash_index].page_size) {
-        SPIF_ERROR(TAG, "page program out of range.");
-        return SPIF_FAIL;
-    }
+    /* 0x0B: one dummy byte (8 clocks) after the address */
+    uint8_t cmd[] = {SPIF_CMD_FAST_READ, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF, SPIF_CMD_DUMMY};
 
-    ret = _spif_write_enable();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    if (dev->read_mode == SPIF_READ_MODE_NORMAL) {
+        return _spif_read_normal(dev, addr, data, data_size);
     }
 
-    ret = _spif_wait_idle();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+    if (dev->dual && ((addr | data_size) & 1)) {
+        return _spif_read_pairs(dev, _spif_read_fast, addr, data, data_size);
     }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
-        
-        ret = s_spi_ops.ops.spi.spi_send(data, data_size);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], addr, data, data_size, NULL, 0);
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), data, data_size);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        _spif_read_cmd_get(dev, dev->read_mode, addr, &qspi_cmd);
+        ret = dev->spi_ops.ops.qspi.qspi_command(&qspi_cmd, NULL, 0, data, data_size);
     }
 
-    ret = _spif_wait_idle();
+    return ret;
+}
 
-    ret = _spif_write_disable();
-    if (ret != SPIF_SUCCESS) {
-        return ret;
+#if SPIF_CACHE_ENABLE
+static spif_cache_line_t *_spif_cache_lookup(spif_dev_t *dev, uint32_t line_addr)
+{
+    for (int i = 0; i < SPIF_CACHE_LINES; i++) {
+        if (dev->cache[i].addr == line_addr) {
+            return &dev->cache[i];
+        }
     }
 
-    return ret;
+    return NULL;
 }
 
-int spif_read(uint32_t addr, uint8_t *data, uint32_t data_size)
+static spif_cache_line_t *_spif_cache_fill(spif_dev_t *dev, uint32_t line_addr)
 {
-    int ret = SPIF_SUCCESS;
+    spif_cache_line_t *line = &dev->cache[0];
 
-    uint8_t cmd[] = {SPIF_CMD_READ_DATA, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
+    /* empty line first, otherwise the least recently used one */
+    for (int i = 0; i < SPIF_CACHE_LINES; i++) {
+        if (dev->cache[i].addr == SPIF_CACHE_INVALID_ADDR) {
+            line = &dev->cache[i];
+            break;
+        }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), data, data_size);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], addr, NULL, 0, data, data_size);
+        if ((dev->cache_tick - dev->cache[i].stamp) > (dev->cache_tick - line->stamp)) {
+            line = &dev->cache[i];
+        }
     }
 
-    return ret;
+    line->addr = SPIF_CACHE_INVALID_ADDR;
+    if (_spif_read_fast(dev, line_addr, line->data, SPIF_CACHE_LINE_SIZE) != SPIF_SUCCESS) {
+        return NULL;
+    }
+
+    line->addr = line_addr;
+    line->stamp = dev->cache_tick;
+
+    return line;
 }
 
-int spif_fast_read(uint32_t addr, uint8_t *data, uint32_t data_size)
+static int _spif_cache_read(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
 {
-    int ret = SPIF_SUCCESS;
+    spif_cache_line_t *line = NULL;
+    uint32_t line_addr = 0;
+    uint32_t offset = 0;
+    uint32_t chunk = 0;
+
+    while (data_size > 0) {
+        line_addr = addr & ~(SPIF_CACHE_LINE_SIZE - 1);
+        offset = addr - line_addr;
+        chunk = SPIF_CACHE_LINE_SIZE - offset;
+        if (chunk > data_size) {
+            chunk = data_size;
+        }
+
+        dev->cache_tick++;
+
+        line = _spif_cache_lookup(dev, line_addr);
+        if (line != NULL) {
+            dev->cache_stats.hits++;
+            line->stamp = dev->cache_tick;
+        } else {
+            dev->cache_stats.misses++;
+            line = _spif_cache_fill(dev, line_addr);
+            if (line == NULL) {
+                return SPIF_FAIL;
+            }
+        }
+
+        memcpy(data, &line->data[offset], chunk);
 
-    uint8_t cmd[] = {SPIF_CMD_FAST_READ, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
+        /* sequential access, keep one line ahead */
+        if ((line_addr == (dev->cache_last + SPIF_CACHE_LINE_SIZE)) &&
+            ((line_addr + SPIF_CACHE_LINE_SIZE) < dev->flash.chip_size) &&
+            (_spif_cache_lookup(dev, line_addr + SPIF_CACHE_LINE_SIZE) == NULL)) {
+            dev->cache_stats.prefetches++;
+            (void)_spif_cache_fill(dev, line_addr + SPIF_CACHE_LINE_SIZE);
+        }
 
-    if (s_spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
-        ret = s_spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), data, data_size);
-    } else if (s_spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
-        ret = s_spi_ops.ops.qspi.qspi_transfer(cmd[0], addr, NULL, 0, data, data_size);
+        dev->cache_last = line_addr;
+        addr += chunk;
+        data += chunk;
+        data_size -= chunk;
     }
 
-    return ret;
+    return SPIF_SUCCESS;
 }
+#endif
 
 /**
- * @brief
- * @return see SPIF status code
+ * keep the cache equal to the flash: programming can only clear bits, so the
+ * cached data is ANDed with what was programmed, and erased ranges become 0xFF.
+ * a failed operation leaves the flash unknown, which drops the lines instead.
  */
-int spif_init(void)
+static void _spif_cache_update(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size, int valid)
 {
-    int ret = SPIF_SUCCESS;
+#if SPIF_CACHE_ENABLE
+    uint32_t start = 0;
+    uint32_t end = 0;
 
-    /* EC626 */
-    // extern void spif_port_ec626_spi_get(spif_port_spi_ops_t *ops);
-    // extern void spif_port_ec626_plat_get(spif_port_plat_ops_t *ops);
-    // spif_port_ec626_spi_get(&s_spi_ops);
-    // spif_port_ec626_plat_get(&s_plat_ops);
+    for (int i = 0; i < SPIF_CACHE_LINES; i++) {
+        spif_cache_line_t *line = &dev->cache[i];
 
-    /* STM32L475 */
-    void spif_port_stm32l4xx_qspi_get(spif_port_spi_ops_t *ops);
-    void spif_port_stm32l4xx_plat_get(spif_port_plat_ops_t *ops);
-    spif_port_stm32l4xx_qspi_get(&s_spi_ops);
-    spif_port_stm32l4xx_plat_get(&s_plat_ops);
+        if ((line->addr == SPIF_CACHE_INVALID_ADDR) ||
+            (line->addr >= (addr + data_size)) || ((line->addr + SPIF_CACHE_LINE_SIZE) <= addr)) {
+            continue;
+        }
 
-    uint8_t buf[3] = {0};
+        if (!valid) {
+            line->addr = SPIF_CACHE_INVALID_ADDR;
+            dev->cache_stats.invalidates++;
+            continue;
+        }
 
-    ret = s_spi_ops.spi_init();
-    if (ret != SPIF_SUCCESS) {
-        SPIF_ERROR(TAG, "spi port init failed: %d.", ret);
+        start = (addr > line->addr) ? addr : line->addr;
+        end = ((addr + data_size) < (line->addr + SPIF_CACHE_LINE_SIZE)) ? (addr + data_size) : (line->addr + SPIF_CACHE_LINE_SIZE);
+
+        for (uint32_t a = start; a < end; a++) {
+            line->data[a - line->addr] = (data != NULL) ? (line->data[a - line->addr] & data[a - addr]) : 0xFF;
+        }
     }
+#else
+    (void)dev;
+    (void)addr;
+    (void)data;
+    (void)data_size;
+    (void)valid;
+#endif
+}
 
-    (void)_spif_read_jedec_id(buf, SPIF_ARRAY_SIZE(buf));
+static int _spif_chip_erase(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
 
-    SPIF_DEBUG(TAG, "Manufacturer : 0x%x.", buf[0]);
-    SPIF_DEBUG(TAG, "Memory Type  : 0x%x.", buf[1]);
-    SPIF_DEBUG(TAG, "Capacity     : 0x%x.", buf[2]);
+    uint8_t cmd[] = {SPIF_CMD_CHIP_ERASE};
 
-    for (uint16_t i = 0; i < SPIF_ARRAY_SIZE(s_spif_flash_info); i++) {
-        if ((buf[0] == s_spif_flash_info[i].mf_id) &&
-            (buf[1] == s_spif_flash_info[i].mt_id) &&
-            (buf[2] == s_spif_flash_info[i].cap_id)) {
-            SPIF_INFO(TAG, "Flash: %s, Size: %d KB, Block: %d KB, Sector: %d KB, Page: %d B.",
-                      s_spif_flash_info[i].name,
-                      s_spif_flash_info[i].chip_size / 1024,
-                      s_spif_flash_info[i].block_size / 1024,
-                      s_spif_flash_info[i].sector_size / 1024,
-                      s_spif_flash_info[i].page_size);
-            s_spif_flash_index = i;
-            break;
-        }
+    ret = _spif_write_enable(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
     }
 
-    return ret;
+    ret = _spif_wait_idle(dev, 0, SPIF_WAIT_IDLE_DEFAULT_MS);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, NULL, 0);
+    }
+
+    _spif_cache_update(dev, 0, NULL, dev->flash.chip_size, ret == SPIF_SUCCESS);
+
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "spi chip erase failed: %d.", ret);
+        return ret;
+    }
+
+    ret = _spif_wait_idle(dev, dev->flash.ce_typ_ms * 1000, dev->flash.ce_max_ms);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_write_disable(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    return ret;
+}
+
+/* send the erase instruction, the flash is busy afterwards */
+static int _spif_erase_start(spif_dev_t *dev, const spif_erase_type_t *erase, uint32_t addr)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t erase_cmd = erase->cmd;
+    uint8_t cmd[] = {erase_cmd, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
+
+    ret = _spif_write_enable(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_wait_idle(dev, 0, SPIF_WAIT_IDLE_DEFAULT_MS);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], addr, NULL, 0, NULL, 0);
+    }
+
+    _spif_cache_update(dev, addr & ~(erase->size - 1), NULL, erase->size, ret == SPIF_SUCCESS);
+
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "spi erase 0x%02X failed: %d.", erase_cmd, ret);
+        return ret;
+    }
+
+    return ret;
+}
+
+static int _spif_erase(spif_dev_t *dev, uint8_t erase_cmd, uint32_t addr)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_erase_type_t *erase = _spif_erase_type_get(dev, erase_cmd);
+
+    if (erase == NULL) {
+        SPIF_ERROR(TAG, "erase 0x%02X not supported by flash.", erase_cmd);
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_erase_start(dev, erase, addr);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_wait_idle(dev, erase->typ_ms * 1000, erase->max_ms);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_write_disable(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    return ret;
+}
+
+/* 0xEB/0xED with mode bits, the flash can skip the opcode of the next read */
+static int _spif_cread_supported(spif_dev_t *dev)
+{
+    if ((dev->flash.cread_mode_bits == 0) || (dev->spi_ops.ops_mode != SPIF_SPI_OPS_QSPI) ||
+        (dev->spi_ops.ops.qspi.qspi_command == NULL)) {
+        return 0;
+    }
+
+    return (dev->read_mode == SPIF_READ_MODE_QUAD_IO) || (dev->read_mode == SPIF_READ_MODE_QUAD_IO_DTR) ||
+           (dev->read_mode == SPIF_READ_MODE_QPI);
+}
+
+/* program/erase need indirect mode, leave the memory-mapped window first */
+static int _spif_mmap_suspend(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (!dev->mmap_active) {
+        return SPIF_SUCCESS;
+    }
+
+    ret = dev->spi_ops.ops.qspi.qspi_munmap();
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "qspi leave memory-mapped mode failed: %d.", ret);
+        return ret;
+    }
+
+    dev->mmap_active = 0;
+
+    /* the mapped window may have left the flash in continuous read mode */
+    if (dev->cread_active) {
+        ret = _spif_cread_exit(dev);
+    }
+
+    return ret;
+}
+
+static int _spif_mmap_resume(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    const uint8_t *base = NULL;
+    spif_port_qspi_cmd_t qspi_cmd;
+
+    if (!dev->mmap_enabled || dev->mmap_active) {
+        return SPIF_SUCCESS;
+    }
+
+    _spif_read_cmd_get(dev, dev->read_mode, 0, &qspi_cmd);
+
+    /**
+     * continuous read mode: the controller sends the opcode on the first access only (SIOO),
+     * random accesses then cost the address and dummy clocks only. not in QPI, where the exit
+     * sequence would read as the QPI exit opcode if no access has happened
+     */
+    if (_spif_cread_supported(dev) && !dev->qpi && (dev->spi_ops.caps & SPIF_PORT_CAP_QSPI_SIOO)) {
+        qspi_cmd.alt = dev->flash.cread_mode_bits;
+        qspi_cmd.sioo = 1;
+    }
+
+    ret = dev->spi_ops.ops.qspi.qspi_mmap(&qspi_cmd, &base);
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "qspi enter memory-mapped mode failed: %d.", ret);
+        return ret;
+    }
+
+    dev->mmap_base = base;
+    dev->mmap_active = 1;
+    dev->cread_active = qspi_cmd.sioo;
+
+    return ret;
+}
+
+/* time of the fastest way to erase one block of erase type i, sub-blocks included */
+static uint32_t _spif_erase_best_ms(spif_dev_t *dev, int i)
+{
+    spif_flash_info_t *info = &dev->flash;
+    uint32_t split_ms = 0;
+
+    if (i == 0) {
+        return info->erase[0].typ_ms;
+    }
+
+    split_ms = (info->erase[i].size / info->erase[i - 1].size) * _spif_erase_best_ms(dev, i - 1);
+
+    return (split_ms < info->erase[i].typ_ms) ? split_ms : info->erase[i].typ_ms;
+}
+
+static int _spif_erase_block(spif_dev_t *dev, uint32_t addr, int i, spif_erase_plan_t *plan, uint8_t dry_run)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_flash_info_t *info = &dev->flash;
+    uint32_t sub_size = 0;
+
+    /* a block is erased directly unless its sub-blocks are faster in total */
+    if ((i == 0) || (info->erase[i].typ_ms <= _spif_erase_best_ms(dev, i))) {
+        plan->count[i]++;
+        plan->time_ms += info->erase[i].typ_ms;
+
+        return dry_run ? SPIF_SUCCESS : _spif_erase(dev, info->erase[i].cmd, addr);
+    }
+
+    sub_size = info->erase[i - 1].size;
+    for (uint32_t offset = 0; offset < info->erase[i].size; offset += sub_size) {
+        ret = _spif_erase_block(dev, addr + offset, i - 1, plan, dry_run);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * erase sizes divide each other and are aligned, so blocks are either nested or
+ * disjoint: taking the largest aligned block that fits at each step and erasing it
+ * the fastest way gives the minimal total time
+ */
+static int _spif_erase_walk(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_erase_plan_t *plan, uint8_t dry_run)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_flash_info_t *info = &dev->flash;
+    uint32_t end = addr + size;
+    int types = 0;
+    int i = 0;
+
+    memset(plan, 0, sizeof(spif_erase_plan_t));
+
+    for (types = 0; (types < SPIF_ERASE_TYPE_MAX) && (info->erase[types].size != 0); types++) {
+        plan->size[types] = info->erase[types].size;
+
+        if ((types > 0) && ((info->erase[types].size % info->erase[types - 1].size) != 0)) {
+            SPIF_ERROR(TAG, "erase sizes not nested.");
+            return SPIF_FAIL;
+        }
+    }
+
+    if ((types == 0) || ((addr % info->erase[0].size) != 0) || ((size % info->erase[0].size) != 0) ||
+        (addr > info->chip_size) || (size > (info->chip_size - addr))) {
+        SPIF_ERROR(TAG, "erase range 0x%06X + 0x%X invalid.", addr, size);
+        return SPIF_FAIL;
+    }
+
+    while (addr < end) {
+        for (i = types - 1; i > 0; i--) {
+            if (((addr % info->erase[i].size) == 0) && ((end - addr) >= info->erase[i].size)) {
+                break;
+            }
+        }
+
+        ret = _spif_erase_block(dev, addr, i, plan, dry_run);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        addr += info->erase[i].size;
+    }
+
+    return ret;
+}
+
+int spif_erase_plan(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_erase_plan_t *plan)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_flash_info_t *info = &dev->flash;
+
+    if (plan == NULL) {
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_erase_walk(dev, addr, size, plan, 1);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if ((addr == 0) && (size == info->chip_size) && (info->ce_typ_ms != 0) && (info->ce_typ_ms < plan->time_ms)) {
+        memset(plan->count, 0, sizeof(plan->count));
+        plan->chip_erase = 1;
+        plan->time_ms = info->ce_typ_ms;
+    }
+
+    return ret;
+}
+
+static int _spif_erase_range_locked(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_erase_plan_t *plan)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_erase_plan_t dry_plan;
+
+    if (plan == NULL) {
+        plan = &dry_plan;
+    }
+
+    ret = spif_erase_plan(dev, addr, size, plan);
+    if ((ret != SPIF_SUCCESS) || (size == 0)) {
+        return ret;
+    }
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (plan->chip_erase) {
+        ret = _spif_chip_erase(dev);
+    } else {
+        ret = _spif_erase_walk(dev, addr, size, plan, 0);
+    }
+
+    (void)_spif_mmap_resume(dev);
+
+    return ret;
+}
+
+int spif_erase_range(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_erase_plan_t *plan)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_erase_range_locked(dev, addr, size, plan);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_block_erase_32_locked(spif_dev_t *dev, uint32_t addr)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_erase(dev, SPIF_CMD_BLOCK_ERASE_32K, addr);
+
+    (void)_spif_mmap_resume(dev);
+
+    return ret;
+}
+
+int spif_block_erase_32(spif_dev_t *dev, uint32_t addr)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_block_erase_32_locked(dev, addr);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_block_erase_64_locked(spif_dev_t *dev, uint32_t addr)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_erase(dev, SPIF_CMD_BLOCK_ERASE_64K, addr);
+
+    (void)_spif_mmap_resume(dev);
+
+    return ret;
+}
+
+int spif_block_erase_64(spif_dev_t *dev, uint32_t addr)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_block_erase_64_locked(dev, addr);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_sector_erase_locked(spif_dev_t *dev, uint32_t addr)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_erase(dev, SPIF_CMD_SECTOR_ERASE_4K, addr);
+
+    (void)_spif_mmap_resume(dev);
+
+    return ret;
+}
+
+int spif_sector_erase(spif_dev_t *dev, uint32_t addr)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_sector_erase_locked(dev, addr);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_page_check(spif_dev_t *dev, uint32_t addr, uint32_t data_size)
+{
+    uint32_t page_size = dev->flash.page_size;
+
+    if (data_size > page_size) {
+        SPIF_ERROR(TAG, "invalid data size.");
+        return SPIF_FAIL;
+    }
+
+    if (((addr % page_size) + data_size) > page_size) {
+        SPIF_ERROR(TAG, "page program out of range.");
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static uint32_t _spif_iov_size(const spif_iov_t *iov, uint32_t iov_count)
+{
+    uint32_t size = 0;
+
+    for (uint32_t i = 0; i < iov_count; i++) {
+        size += iov[i].size;
+    }
+
+    return size;
+}
+
+static void _spif_iov_gather(uint8_t *buf, const spif_iov_t *iov, uint32_t iov_count)
+{
+    for (uint32_t i = 0; i < iov_count; i++) {
+        memcpy(buf, iov[i].buf, iov[i].size);
+        buf += iov[i].size;
+    }
+}
+
+/**
+ * write enable + page program of the concatenated buffers, returns while the flash is still programming;
+ * the SPI data must follow the address in the same chip select frame: one spi_transfer_iov() if the port
+ * has it, otherwise staged with the command in one spi_transfer() frame.
+ * QSPI takes one buffer per command, several are gathered in rmw_buf, spif_write() only passes one
+ */
+static int _spif_page_program_start_iov(spif_dev_t *dev, uint32_t addr, const spif_iov_t *iov, uint32_t iov_count)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t cmd[] = {SPIF_CMD_PAGE_PROGRAM, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF};
+    uint8_t frame[4 + SPIF_SPI_PROGRAM_MAX];
+    spif_port_iov_t port_iov[1 + SPIF_IOV_MAX];
+    uint32_t data_size = _spif_iov_size(iov, iov_count);
+    uint32_t offset = 0;
+
+    if ((iov_count == 0) || (iov_count > SPIF_IOV_MAX) ||
+        ((dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) && (data_size > SPIF_SPI_PROGRAM_MAX))) {
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_write_enable(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if ((dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) && (dev->spi_ops.ops.spi.spi_transfer_iov != NULL)) {
+        port_iov[0].tx_buf = cmd;
+        port_iov[0].rx_buf = NULL;
+        port_iov[0].size = SPIF_ARRAY_SIZE(cmd);
+        for (uint32_t i = 0; i < iov_count; i++) {
+            port_iov[1 + i].tx_buf = iov[i].buf;
+            port_iov[1 + i].rx_buf = NULL;
+            port_iov[1 + i].size = iov[i].size;
+        }
+        ret = dev->spi_ops.ops.spi.spi_transfer_iov(port_iov, 1 + iov_count);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        memcpy(frame, cmd, SPIF_ARRAY_SIZE(cmd));
+        _spif_iov_gather(&frame[SPIF_ARRAY_SIZE(cmd)], iov, iov_count);
+        ret = dev->spi_ops.ops.spi.spi_transfer(frame, SPIF_ARRAY_SIZE(cmd) + data_size, NULL, 0);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        if (iov_count > 1) {
+            _spif_iov_gather(dev->rmw_buf, iov, iov_count);
+        }
+        ret = _spif_qspi_transfer(dev, cmd[0], addr, (iov_count > 1) ? dev->rmw_buf : iov[0].buf, data_size, NULL, 0);
+    }
+
+    for (uint32_t i = 0; i < iov_count; i++) {
+        _spif_cache_update(dev, addr + offset, iov[i].buf, iov[i].size, ret == SPIF_SUCCESS);
+        offset += iov[i].size;
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "spi page program failed: %d.", ret);
+        return ret;
+    }
+
+    return ret;
+}
+
+static int _spif_page_program_start(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size)
+{
+    spif_iov_t iov = {data, data_size};
+
+    return _spif_page_program_start_iov(dev, addr, &iov, 1);
+}
+
+static int _spif_page_program_wait(spif_dev_t *dev)
+{
+    spif_flash_info_t *info = &dev->flash;
+
+    return _spif_wait_idle(dev, info->pp_typ_us, (info->pp_max_us + 999) / 1000);
+}
+
+static int _spif_page_program_one(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_page_program_start(dev, addr, data, data_size);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_page_program_wait(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_write_disable(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    return ret;
+}
+
+/**
+ * dual-flash: a data phase starts on an even address and moves whole byte pairs,
+ * an odd first or last byte is programmed as a pair with 0xFF, which leaves the other byte as it is
+ */
+static int _spif_page_program(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t pair[2];
+    uint32_t size = 0;
+
+    ret = _spif_page_check(dev, addr, data_size);
+    if ((ret != SPIF_SUCCESS) || !dev->dual || (((addr | data_size) & 1) == 0)) {
+        return (ret != SPIF_SUCCESS) ? ret : _spif_page_program_one(dev, addr, data, data_size);
+    }
+
+    if ((addr & 1) && (data_size > 0)) {
+        pair[0] = 0xFF;
+        pair[1] = data[0];
+        ret = _spif_page_program_one(dev, addr - 1, pair, 2);
+        addr++;
+        data++;
+        data_size--;
+    }
+
+    size = data_size & ~1UL;
+    if ((ret == SPIF_SUCCESS) && (size > 0)) {
+        ret = _spif_page_program_one(dev, addr, data, size);
+    }
+
+    if ((ret == SPIF_SUCCESS) && (data_size & 1)) {
+        pair[0] = data[size];
+        pair[1] = 0xFF;
+        ret = _spif_page_program_one(dev, addr + size, pair, 2);
+    }
+
+    return ret;
+}
+
+static int _spif_page_program_locked(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_page_program(dev, addr, data, data_size);
+
+    (void)_spif_mmap_resume(dev);
+
+    return ret;
+}
+
+int spif_page_program(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_page_program_locked(dev, addr, data, data_size);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_read_locked(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    /* already memory-mapped, no command needed. the window is the whole flash, chip_size long */
+    if (dev->mmap_active) {
+        if ((data == NULL) || (addr > dev->flash.chip_size) || (data_size > (dev->flash.chip_size - addr))) {
+            SPIF_ERROR(TAG, "read out of range.");
+            return SPIF_FAIL;
+        }
+
+        memcpy(data, dev->mmap_base + addr, data_size);
+        return SPIF_SUCCESS;
+    }
+
+#if SPIF_CACHE_ENABLE
+    /* reads of a line or more would only evict the hot lines */
+    if (data_size < SPIF_CACHE_LINE_SIZE) {
+        return _spif_cache_read(dev, addr, data, data_size);
+    }
+    dev->cache_stats.bypasses++;
+#endif
+
+    return _spif_read_normal(dev, addr, data, data_size);
+}
+
+int spif_read(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_READ, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_read_locked(dev, addr, data, data_size);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_fast_read_locked(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    if (dev->mmap_active) {
+        return _spif_read_locked(dev, addr, data, data_size);
+    }
+
+#if SPIF_CACHE_ENABLE
+    if (data_size < SPIF_CACHE_LINE_SIZE) {
+        return _spif_cache_read(dev, addr, data, data_size);
+    }
+    dev->cache_stats.bypasses++;
+#endif
+
+    return _spif_read_fast(dev, addr, data, data_size);
+}
+
+int spif_fast_read(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_READ, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_fast_read_locked(dev, addr, data, data_size);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_is_erased(const uint8_t *data, uint32_t data_size)
+{
+    for (uint32_t i = 0; i < data_size; i++) {
+        if (data[i] != 0xFF) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * program an arbitrary range from a list of buffers page by page,
+ * the next page is set up while the flash is still busy with the current one
+ */
+static int _spif_write_program_iov(spif_dev_t *dev, uint32_t addr, const spif_iov_t *iov, uint32_t iov_count)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t page_size = dev->flash.page_size;
+    uint32_t data_size = _spif_iov_size(iov, iov_count);
+    uint32_t chunk = 0;
+    uint32_t left = 0;
+    uint32_t index = 0;
+    uint32_t offset = 0;   /* consumed part of iov[index] */
+    spif_iov_t piece[SPIF_IOV_MAX];
+    uint32_t pieces = 0;
+    uint8_t erased = 0;
+    uint8_t busy = 0;
+
+    if (iov_count > SPIF_IOV_MAX) {
+        return SPIF_FAIL;
+    }
+
+    while (data_size > 0) {
+        chunk = page_size - (addr % page_size);
+        if (chunk > data_size) {
+            chunk = data_size;
+        }
+
+        /* the parts of the buffers that fall into this page */
+        pieces = 0;
+        erased = 1;
+        for (left = chunk; left > 0; pieces++) {
+            while (offset == iov[index].size) {
+                index++;
+                offset = 0;
+            }
+            piece[pieces].buf = (const uint8_t *)iov[index].buf + offset;
+            piece[pieces].size = ((iov[index].size - offset) < left) ? (iov[index].size - offset) : left;
+            /* programming 0xFF changes nothing on NOR flash */
+            erased &= _spif_is_erased(piece[pieces].buf, piece[pieces].size);
+            offset += piece[pieces].size;
+            left -= piece[pieces].size;
+        }
+
+        if (!erased) {
+            if (busy) {
+                ret = _spif_page_program_wait(dev);
+                if (ret != SPIF_SUCCESS) {
+                    return ret;
+                }
+                busy = 0;
+            }
+
+            if (dev->dual && ((addr | chunk) & 1)) {
+                /* odd dual-flash ends are programmed in pairs, see _spif_page_program() */
+                if (pieces > 1) {
+                    _spif_iov_gather(dev->rmw_buf, piece, pieces);
+                }
+                ret = _spif_page_program(dev, addr, (pieces > 1) ? dev->rmw_buf : piece[0].buf, chunk);
+            } else {
+                /* WEL is cleared by the flash itself once the page is programmed */
+                ret = _spif_page_program_start_iov(dev, addr, piece, pieces);
+                busy = 1;
+            }
+
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+
+        addr += chunk;
+        data_size -= chunk;
+    }
+
+    if (busy) {
+        ret = _spif_page_program_wait(dev);
+    }
+
+    return ret;
+}
+
+static int _spif_write_program(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size)
+{
+    spif_iov_t iov = {data, data_size};
+
+    return _spif_write_program_iov(dev, addr, &iov, 1);
+}
+
+/* read-modify-write every sector the range touches */
+static int _spif_write_erase(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_flash_info_t *info = &dev->flash;
+    uint32_t sector_size = info->sector_size;
+    uint32_t sector_addr = 0;
+    uint32_t offset = 0;
+    uint32_t chunk = 0;
+
+    if ((sector_size > SPIF_RMW_BUF_SIZE) || (info->erase[0].size != sector_size)) {
+        SPIF_ERROR(TAG, "sector size %u not supported by write.", sector_size);
+        return SPIF_FAIL;
+    }
+
+    while (data_size > 0) {
+        sector_addr = addr - (addr % sector_size);
+        offset = addr - sector_addr;
+
+        chunk = sector_size - offset;
+        if (chunk > data_size) {
+            chunk = data_size;
+        }
+
+        if (chunk == sector_size) {
+            /* whole sector overwritten, nothing to keep */
+            ret = _spif_erase(dev, info->erase[0].cmd, sector_addr);
+            if (ret == SPIF_SUCCESS) {
+                ret = _spif_write_program(dev, sector_addr, data, sector_size);
+            }
+        } else {
+            ret = _spif_fast_read_locked(dev, sector_addr, dev->rmw_buf, sector_size);
+            if (ret == SPIF_SUCCESS) {
+                memcpy(&dev->rmw_buf[offset], data, chunk);
+                ret = _spif_erase(dev, info->erase[0].cmd, sector_addr);
+            }
+
+            if (ret == SPIF_SUCCESS) {
+                ret = _spif_write_program(dev, sector_addr, dev->rmw_buf, sector_size);
+            }
+        }
+
+        if (ret != SPIF_SUCCESS) {
+            SPIF_ERROR(TAG, "write sector 0x%06X failed: %d.", sector_addr, ret);
+            return ret;
+        }
+
+        addr += chunk;
+        data += chunk;
+        data_size -= chunk;
+    }
+
+    return ret;
+}
+
+/**
+ * compare every sector the range touches with the new data first:
+ * unchanged pages are skipped, a sector is programmed in place when the new data only clears bits,
+ * and erased (read-modify-write) only when some bit has to go from 0 to 1
+ */
+static int _spif_write_diff(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_flash_info_t *info = &dev->flash;
+    uint32_t sector_size = info->sector_size;
+    uint32_t page_size = info->page_size;
+    uint32_t sector_addr = 0;
+    uint32_t offset = 0;
+    uint32_t chunk = 0;
+    uint32_t piece = 0;
+    uint8_t *old = NULL;
+    int need_erase = 0;
+    uint32_t programmed = 0;
+
+    if ((sector_size > SPIF_RMW_BUF_SIZE) || (info->erase[0].size != sector_size)) {
+        SPIF_ERROR(TAG, "sector size %u not supported by write.", sector_size);
+        return SPIF_FAIL;
+    }
+
+    while (data_size > 0) {
+        sector_addr = addr - (addr % sector_size);
+        offset = addr - sector_addr;
+
+        chunk = sector_size - offset;
+        if (chunk > data_size) {
+            chunk = data_size;
+        }
+
+        old = &dev->rmw_buf[offset];
+
+        ret = _spif_fast_read_locked(dev, addr, old, chunk);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        need_erase = 0;
+        for (uint32_t i = 0; i < chunk; i++) {
+            if ((old[i] & data[i]) != data[i]) {
+                need_erase = 1;
+                break;
+            }
+        }
+
+        if (need_erase) {
+            /* keep what is outside the range */
+            if (offset > 0) {
+                ret = _spif_fast_read_locked(dev, sector_addr, dev->rmw_buf, offset);
+            }
+
+            if ((ret == SPIF_SUCCESS) && (offset + chunk < sector_size)) {
+                ret = _spif_fast_read_locked(dev, addr + chunk, &dev->rmw_buf[offset + chunk], sector_size - offset - chunk);
+            }
+
+            if (ret == SPIF_SUCCESS) {
+                memcpy(old, data, chunk);
+                ret = _spif_erase(dev, info->erase[0].cmd, sector_addr);
+            }
+
+            if (ret == SPIF_SUCCESS) {
+                ret = _spif_write_program(dev, sector_addr, dev->rmw_buf, sector_size);
+            }
+
+            /* only what made it to the flash is counted */
+            if (ret == SPIF_SUCCESS) {
+                dev->write_stats.erases++;
+                for (uint32_t i = 0; i < sector_size; i += page_size) {
+                    if (!_spif_is_erased(&dev->rmw_buf[i], page_size)) {
+                        dev->write_stats.pages_programmed++;
+                    }
+                }
+            }
+        } else {
+            /**
+             * unchanged pages are turned into 0xFF in the buffer,
+             * which _spif_write_program() skips, the others take the new data
+             */
+            programmed = 0;
+            for (uint32_t i = 0; i < chunk; i += piece) {
+                piece = page_size - ((addr + i) % page_size);
+                if (piece > chunk - i) {
+                    piece = chunk - i;
+                }
+
+                if (memcmp(&old[i], &data[i], piece) == 0) {
+                    memset(&old[i], 0xFF, piece);
+                    dev->write_stats.pages_skipped++;
+                } else {
+                    memcpy(&old[i], &data[i], piece);
+                    programmed++;
+                }
+            }
+
+            ret = _spif_write_program(dev, addr, old, chunk);
+
+            if (ret == SPIF_SUCCESS) {
+                dev->write_stats.pages_programmed += programmed;
+                dev->write_stats.erases_avoided++;
+            }
+        }
+
+        if (ret != SPIF_SUCCESS) {
+            SPIF_ERROR(TAG, "write sector 0x%06X failed: %d.", sector_addr, ret);
+            return ret;
+        }
+
+        addr += chunk;
+        data += chunk;
+        data_size -= chunk;
+    }
+
+    return ret;
+}
+
+static int _spif_write_locked(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size, spif_write_mode_t mode)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((data == NULL) || (addr > dev->flash.chip_size) ||
+        (data_size > (dev->flash.chip_size - addr))) {
+        SPIF_ERROR(TAG, "write out of range.");
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (mode == SPIF_WRITE_MODE_ERASE) {
+        ret = _spif_write_erase(dev, addr, data, data_size);
+    } else if (mode == SPIF_WRITE_MODE_DIFF) {
+        ret = _spif_write_diff(dev, addr, data, data_size);
+    } else {
+        ret = _spif_write_program(dev, addr, data, data_size);
+    }
+
+    (void)_spif_mmap_resume(dev);
+
+    return ret;
+}
+
+int spif_write(spif_dev_t *dev, uint32_t addr, const uint8_t *data, uint32_t data_size, spif_write_mode_t mode)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_write_locked(dev, addr, data, data_size, mode);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+int spif_writev(spif_dev_t *dev, uint32_t addr, const spif_iov_t *iov, uint32_t iov_count)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t data_size = 0;
+
+    if ((iov == NULL) || (iov_count == 0) || (iov_count > SPIF_IOV_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    for (uint32_t i = 0; i < iov_count; i++) {
+        if ((iov[i].buf == NULL) && (iov[i].size > 0)) {
+            return SPIF_FAIL;
+        }
+        data_size += iov[i].size;
+    }
+
+    if ((addr > dev->flash.chip_size) || (data_size > (dev->flash.chip_size - addr))) {
+        SPIF_ERROR(TAG, "write out of range.");
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_write_program_iov(dev, addr, iov, iov_count);
+        (void)_spif_mmap_resume(dev);
+    }
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+int spif_write_stats_get(spif_dev_t *dev, spif_write_stats_t *stats)
+{
+    if (stats == NULL) {
+        return SPIF_FAIL;
+    }
+
+    *stats = dev->write_stats;
+
+    return SPIF_SUCCESS;
+}
+
+void spif_write_stats_reset(spif_dev_t *dev)
+{
+    memset(&dev->write_stats, 0, sizeof(spif_write_stats_t));
+}
+
+int spif_cache_stats_get(spif_dev_t *dev, spif_cache_stats_t *stats)
+{
+    if (stats == NULL) {
+        return SPIF_FAIL;
+    }
+
+#if SPIF_CACHE_ENABLE
+    *stats = dev->cache_stats;
+
+    return SPIF_SUCCESS;
+#else
+    (void)dev;
+    memset(stats, 0, sizeof(spif_cache_stats_t));
+
+    return SPIF_FAIL;
+#endif
+}
+
+void spif_cache_stats_reset(spif_dev_t *dev)
+{
+#if SPIF_CACHE_ENABLE
+    memset(&dev->cache_stats, 0, sizeof(spif_cache_stats_t));
+#else
+    (void)dev;
+#endif
+}
+
+static void _spif_cache_invalidate_locked(spif_dev_t *dev)
+{
+#if SPIF_CACHE_ENABLE
+    for (int i = 0; i < SPIF_CACHE_LINES; i++) {
+        dev->cache[i].addr = SPIF_CACHE_INVALID_ADDR;
+    }
+    dev->cache_last = SPIF_CACHE_INVALID_ADDR;
+#else
+    (void)dev;
+#endif
+}
+
+void spif_cache_invalidate(spif_dev_t *dev)
+{
+    if (_spif_lock(dev, SPIF_ACCESS_ASYNC, __func__) != SPIF_SUCCESS) {
+        return;
+    }
+
+    _spif_cache_invalidate_locked(dev);
+
+    _spif_unlock(dev);
+}
+
+static void _spif_async_complete(spif_dev_t *dev, spif_async_t *token, int result)
+{
+    spif_async_cb_t cb = token->cb;
+
+    token->result = result;
+    dev->async = NULL;
+    token->state = SPIF_ASYNC_DONE;
+
+    if (cb != NULL) {
+        cb(result, token->arg);
+    }
+}
+
+/* port completion, may run in interrupt context */
+static void _spif_async_transfer_done(int result, void *arg)
+{
+    spif_async_t *token = (spif_async_t *)arg;
+    spif_dev_t *dev = token->dev;
+
+    if (token->op == SPIF_ASYNC_OP_PROGRAM) {
+        /* finished by spif_async_poll() once the flash is idle again */
+        token->result = result;
+        token->state = SPIF_ASYNC_PROGRAMMING;
+        return;
+    }
+
+    _spif_async_complete(dev, token, result);
+}
+
+static int _spif_async_start(spif_dev_t *dev, spif_async_t *token, uint8_t op, uint32_t timeout_ms, spif_async_cb_t cb, void *arg)
+{
+    if (token == NULL) {
+        return SPIF_FAIL;
+    }
+
+    if (dev->async != NULL) {
+        return SPIF_BUSY;
+    }
+
+    token->dev = dev;
+    token->state = SPIF_ASYNC_RUNNING;
+    token->op = op;
+    token->timeout_ms = timeout_ms;
+    token->result = SPIF_SUCCESS;
+    token->cb = cb;
+    token->arg = arg;
+
+    dev->async = token;
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_read_async_locked(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size, spif_async_t *token, spif_async_cb_t cb, void *arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_port_qspi_cmd_t qspi_cmd;
+
+    ret = _spif_async_start(dev, token, SPIF_ASYNC_OP_READ,
+                            SPIF_WAIT_IDLE_DEFAULT_MS + data_size * SPIF_ASYNC_READ_US_PER_BYTE / 1000, cb, arg);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    /* memory-mapped reads are a plain copy, no point in going through the port */
+    if (dev->mmap_active || (dev->spi_ops.ops_mode != SPIF_SPI_OPS_QSPI) || (dev->spi_ops.ops.qspi.qspi_command_async == NULL) ||
+        (dev->dual && ((addr | data_size) & 1))) {
+        ret = _spif_fast_read_locked(dev, addr, data, data_size);
+        _spif_async_complete(dev, token, ret);
+        return SPIF_SUCCESS;
+    }
+
+    _spif_read_cmd_get(dev, dev->read_mode, addr, &qspi_cmd);
+
+    ret = dev->spi_ops.ops.qspi.qspi_command_async(&qspi_cmd, NULL, 0, data, data_size, _spif_async_transfer_done, token);
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "spi read async failed: %d.", ret);
+        dev->async = NULL;
+        token->state = SPIF_ASYNC_IDLE;
+        return ret;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_read_async(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size, spif_async_t *token, spif_async_cb_t cb, void *arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_read_async_locked(dev, addr, data, data_size, token, cb, arg);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_page_program_async_locked(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size, spif_async_t *token, spif_async_cb_t cb, void *arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_port_qspi_cmd_t qspi_cmd;
+
+    ret = _spif_page_check(dev, addr, data_size);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_async_start(dev, token, SPIF_ASYNC_OP_PROGRAM,
+                            SPIF_WAIT_IDLE_DEFAULT_MS + (dev->flash.pp_max_us + 999) / 1000, cb, arg);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    /* odd dual-flash ends take several programs, done synchronously */
+    if ((dev->spi_ops.ops_mode != SPIF_SPI_OPS_QSPI) || (dev->spi_ops.ops.qspi.qspi_command_async == NULL) ||
+        (dev->dual && ((addr | data_size) & 1))) {
+        ret = _spif_page_program_locked(dev, addr, data, data_size);
+        _spif_async_complete(dev, token, ret);
+        return SPIF_SUCCESS;
+    }
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_write_enable(dev);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        _spif_qspi_cmd_init(dev, &qspi_cmd, SPIF_CMD_PAGE_PROGRAM, addr);
+
+        ret = dev->spi_ops.ops.qspi.qspi_command_async(&qspi_cmd, data, data_size, NULL, 0, _spif_async_transfer_done, token);
+
+        _spif_cache_update(dev, addr, data, data_size, ret == SPIF_SUCCESS);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "spi page program async failed: %d.", ret);
+        (void)_spif_mmap_resume(dev);
+        dev->async = NULL;
+        token->state = SPIF_ASYNC_IDLE;
+        return ret;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_page_program_async(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size, spif_async_t *token, spif_async_cb_t cb, void *arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_page_program_async_locked(dev, addr, data, data_size, token, cb, arg);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_erase_async_locked(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_async_t *token, spif_async_cb_t cb, void *arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_erase_type_t *erase = NULL;
+
+    for (int i = 0; i < SPIF_ERASE_TYPE_MAX; i++) {
+        if ((dev->flash.erase[i].size != 0) && (dev->flash.erase[i].size == size)) {
+            erase = &dev->flash.erase[i];
+            break;
+        }
+    }
+
+    if ((erase == NULL) || (addr % size != 0) || (addr + size > dev->flash.chip_size)) {
+        SPIF_ERROR(TAG, "invalid erase 0x%08X, size %u.", addr, size);
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_async_start(dev, token, SPIF_ASYNC_OP_ERASE, erase->max_ms, cb, arg);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_erase_start(dev, erase, addr);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        (void)_spif_mmap_resume(dev);
+        dev->async = NULL;
+        token->state = SPIF_ASYNC_IDLE;
+        return ret;
+    }
+
+    /* nothing to transfer, the flash is busy from here on */
+    token->state = SPIF_ASYNC_PROGRAMMING;
+
+    return SPIF_SUCCESS;
+}
+
+int spif_erase_async(spif_dev_t *dev, uint32_t addr, uint32_t size, spif_async_t *token, spif_async_cb_t cb, void *arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_erase_async_locked(dev, addr, size, token, cb, arg);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_instruction(spif_dev_t *dev, uint8_t instruction)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t cmd[] = {instruction};
+
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        ret = dev->spi_ops.ops.spi.spi_transfer(cmd, SPIF_ARRAY_SIZE(cmd), NULL, 0);
+    } else if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) {
+        ret = _spif_qspi_transfer(dev, cmd[0], SPIF_SPI_INVALID_ADDR, NULL, 0, NULL, 0);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "spi instruction 0x%02X failed: %d.", instruction, ret);
+        return ret;
+    }
+
+    return ret;
+}
+
+static int _spif_erase_suspend_locked(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_async_t *token = dev->async;
+
+    if ((token == NULL) || (token->op != SPIF_ASYNC_OP_ERASE) || (token->state != SPIF_ASYNC_PROGRAMMING) ||
+        (dev->flash.suspend_cmd == 0)) {
+        return SPIF_FAIL;
+    }
+
+    if (dev->erase_suspended) {
+        return SPIF_SUCCESS;
+    }
+
+    /**
+     * an erase that finished meanwhile ignores the suspend, either way the flash is idle afterwards,
+     * so the suspend status bit (vendor specific) need not be read
+     */
+    ret = _spif_instruction(dev, dev->flash.suspend_cmd);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_wait_idle(dev, dev->flash.suspend_max_us, (dev->flash.suspend_max_us + 999) / 1000);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    dev->erase_suspended = 1;
+
+    return ret;
+}
+
+int spif_erase_suspend(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_ASYNC, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_erase_suspend_locked(dev);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_erase_resume_locked(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (!dev->erase_suspended) {
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_instruction(dev, dev->flash.resume_cmd);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    dev->erase_suspended = 0;
+
+    return ret;
+}
+
+int spif_erase_resume(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_ASYNC, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_erase_resume_locked(dev);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_async_poll_locked(spif_dev_t *dev, spif_async_t *token)
+{
+    int ret = SPIF_SUCCESS;
+    uint8_t status = 0;
+
+    if (token == NULL) {
+        return SPIF_ASYNC_IDLE;
+    }
+
+    /* a suspended erase only goes on after spif_erase_resume() */
+    if ((token->state != SPIF_ASYNC_PROGRAMMING) || dev->erase_suspended) {
+        return token->state;
+    }
+
+    ret = token->result;
+    if (ret == SPIF_SUCCESS) {
+        /* one status read per poll, the caller decides how often */
+        ret = _spif_read_status_register1(dev, &status);
+        if ((ret == SPIF_SUCCESS) && (status & SPIF_STATUS_BUSY)) {
+            return token->state;
+        }
+    }
+
+    (void)_spif_mmap_resume(dev);
+
+    _spif_async_complete(dev, token, ret);
+
+    return token->state;
+}
+
+int spif_async_poll(spif_dev_t *dev, spif_async_t *token)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_ASYNC, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_async_poll_locked(dev, token);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+int spif_async_wait(spif_dev_t *dev, spif_async_t *token)
+{
+    int ret = SPIF_SUCCESS;
+    uint32_t elapsed_us = 0;
+    uint32_t interval_us = 0;
+
+    if ((token == NULL) || (token->state == SPIF_ASYNC_IDLE)) {
+        return SPIF_FAIL;
+    }
+
+    while (1) {
+        /* the lock per poll only, other callers get the bus between two status reads */
+        ret = _spif_lock(dev, SPIF_ACCESS_ASYNC, __func__);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        if (dev->erase_suspended && (token->state == SPIF_ASYNC_PROGRAMMING)) {
+            _spif_unlock(dev);
+            return SPIF_BUSY;
+        }
+
+        ret = _spif_async_poll_locked(dev, token);
+
+        _spif_unlock(dev);
+
+        if (ret == SPIF_ASYNC_DONE) {
+            break;
+        }
+
+        /* the budget _spif_wait_idle() would give the operation, only the delays are counted */
+        if ((elapsed_us / 1000) >= token->timeout_ms) {
+            SPIF_ERROR(TAG, "async wait timeout: %u ms.", token->timeout_ms);
+            return SPIF_TIMEOUT;
+        }
+
+        /**
+         * the data phase ends in the port's completion and costs no bus access to check,
+         * finer steps keep a short read from waiting much longer than its transfer
+         */
+        interval_us = (token->state == SPIF_ASYNC_RUNNING) ? 1 : SPIF_POLL_INTERVAL_MIN_US;
+
+        dev->plat_ops.delay_us(interval_us);
+        elapsed_us += interval_us;
+    }
+
+    return token->result;
+}
+
+/* switch the flash, and every command after it, between SPI and QPI */
+static int _spif_qpi_set(spif_dev_t *dev, uint8_t enable)
+{
+    int ret = SPIF_SUCCESS;
+    uint8_t status = 0;
+
+    if (dev->qpi == enable) {
+        return SPIF_SUCCESS;
+    }
+
+    /* the enter opcode goes out on 1 line, the exit opcode on 4 */
+    ret = _spif_instruction(dev, enable ? dev->flash.qpi_enter_cmd : dev->flash.qpi_exit_cmd);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    dev->qpi = enable;
+
+    /* a flash still in SPI mode does not answer a 4-line command, the bus reads 0xFF */
+    ret = _spif_read_status_register1(dev, &status);
+    if ((ret != SPIF_SUCCESS) || (status == 0xFF)) {
+        SPIF_ERROR(TAG, "%s QPI failed.", enable ? "enter" : "exit");
+        dev->qpi = !enable;
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_read_mode_supported(spif_dev_t *dev, spif_read_mode_t mode)
+{
+    if (mode > dev->flash.read_mode) {
+        return 0;
+    }
+
+    if ((mode == SPIF_READ_MODE_QUAD_IO_DTR) &&
+        ((dev->flash.dtr_read_cmd == 0) || !(dev->spi_ops.caps & SPIF_PORT_CAP_QSPI_DDR))) {
+        return 0;
+    }
+
+    if ((mode == SPIF_READ_MODE_QPI) && ((dev->flash.qpi_enter_cmd == 0) || (dev->flash.qpi_exit_cmd == 0))) {
+        return 0;
+    }
+
+    if (mode == SPIF_READ_MODE_NORMAL) {
+        return 1;
+    }
+
+    /* only the plain 1-1-1 modes can be issued through spi_transfer */
+    if (dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) {
+        return (mode == SPIF_READ_MODE_FAST);
+    }
+
+    return (dev->spi_ops.ops.qspi.qspi_command != NULL);
+}
+
+static int _spif_set_read_mode_locked(spif_dev_t *dev, spif_read_mode_t mode)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (!_spif_read_mode_supported(dev, mode)) {
+        SPIF_ERROR(TAG, "read mode %d not supported.", mode);
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (mode >= SPIF_READ_MODE_QUAD_OUTPUT) {
+        ret = _spif_quad_enable(dev);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_qpi_set(dev, mode == SPIF_READ_MODE_QPI);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        dev->read_mode = mode;
+    }
+
+    /* the memory-mapped window follows the new read mode */
+    (void)_spif_mmap_resume(dev);
+
+    return ret;
+}
+
+int spif_set_read_mode(spif_dev_t *dev, spif_read_mode_t mode)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_set_read_mode_locked(dev, mode);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+spif_read_mode_t spif_get_read_mode(spif_dev_t *dev)
+{
+    return dev->read_mode;
+}
+
+int spif_continuous_read_begin(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_CREAD, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (_spif_cread_supported(dev)) {
+        dev->cread = 1;
+    } else {
+        SPIF_ERROR(TAG, "continuous read not supported in read mode %d.", dev->read_mode);
+        ret = SPIF_FAIL;
+    }
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_continuous_read_locked(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_port_qspi_cmd_t qspi_cmd;
+
+    if (dev->mmap_active) {
+        return _spif_read_locked(dev, addr, data, data_size);
+    }
+
+    /* the read mode may have changed since spif_continuous_read_begin() */
+    if (!dev->cread || !_spif_cread_supported(dev)) {
+        return _spif_read_fast(dev, addr, data, data_size);
+    }
+
+    if (dev->dual && ((addr | data_size) & 1)) {
+        return _spif_read_pairs(dev, _spif_continuous_read_locked, addr, data, data_size);
+    }
+
+    _spif_read_cmd_get(dev, dev->read_mode, addr, &qspi_cmd);
+    qspi_cmd.alt = dev->flash.cread_mode_bits;
+
+    /* the flash still holds the opcode of the previous read */
+    if (dev->cread_active) {
+        qspi_cmd.instruction_lines = SPIF_QSPI_LINES_NONE;
+    }
+
+    ret = dev->spi_ops.ops.qspi.qspi_command(&qspi_cmd, NULL, 0, data, data_size);
+    if (ret == SPIF_SUCCESS) {
+        dev->cread_active = 1;
+    }
+
+    return ret;
+}
+
+int spif_continuous_read(spif_dev_t *dev, uint32_t addr, uint8_t *data, uint32_t data_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_CREAD, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_continuous_read_locked(dev, addr, data, data_size);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+int spif_continuous_read_end(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    /* any access other than SPIF_ACCESS_CREAD leaves continuous read mode */
+    ret = _spif_lock(dev, SPIF_ACCESS_READ, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    dev->cread = 0;
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_mmap_locked(spif_dev_t *dev, const uint8_t **base)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (base == NULL) {
+        return SPIF_FAIL;
+    }
+
+    if ((dev->spi_ops.ops_mode != SPIF_SPI_OPS_QSPI) || (dev->spi_ops.ops.qspi.qspi_mmap == NULL)) {
+        SPIF_ERROR(TAG, "memory-mapped mode not supported by port.");
+        return SPIF_FAIL;
+    }
+
+    if (!dev->mmap_enabled) {
+        dev->mmap_enabled = 1;
+
+        ret = _spif_mmap_resume(dev);
+        if (ret != SPIF_SUCCESS) {
+            dev->mmap_enabled = 0;
+            return ret;
+        }
+    }
+
+    *base = dev->mmap_base;
+
+    return SPIF_SUCCESS;
+}
+
+int spif_mmap(spif_dev_t *dev, const uint8_t **base)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_mmap_locked(dev, base);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+static int _spif_munmap_locked(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_mmap_suspend(dev);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    dev->mmap_enabled = 0;
+    dev->mmap_base = NULL;
+
+    return ret;
+}
+
+int spif_munmap(spif_dev_t *dev)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lock(dev, SPIF_ACCESS_EXCLUSIVE, __func__);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_munmap_locked(dev);
+
+    _spif_unlock(dev);
+
+    return ret;
+}
+
+/**
+ * @brief
+ * @return see SPIF status code
+ */
+int spif_init(spif_dev_t *dev, const spif_port_spi_ops_t *spi_ops, const spif_port_plat_ops_t *plat_ops)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t buf[3] = {0};
+    spif_sfdp_info_t sfdp;
+    int sfdp_ret = SPIF_FAIL;
+    int found = 0;
+
+    if ((dev == NULL) || (spi_ops == NULL) || (plat_ops == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    memset(dev, 0, sizeof(spif_dev_t));
+    dev->spi_ops = *spi_ops;
+    dev->plat_ops = *plat_ops;
+    dev->dual = (dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) && (dev->spi_ops.caps & SPIF_PORT_CAP_QSPI_DUAL);
+
+    ret = dev->spi_ops.spi_init();
+    if (ret != SPIF_SUCCESS) {
+        SPIF_ERROR(TAG, "spi port init failed: %d.", ret);
+    }
+
+    /**
+     * a warm reset can leave the flash in continuous read mode or in QPI: the continuous read exit,
+     * then 0xFF on 4 lines takes it out of QPI, a flash in SPI mode ignores both
+     */
+    if ((dev->spi_ops.ops_mode == SPIF_SPI_OPS_QSPI) && (dev->spi_ops.ops.qspi.qspi_command != NULL)) {
+        (void)_spif_cread_exit(dev);
+        dev->qpi = 1;
+        (void)_spif_instruction(dev, SPIF_CMD_EXIT_QPI);
+        dev->qpi = 0;
+    }
+
+    if ((_spif_read_jedec_id(dev, buf, SPIF_ARRAY_SIZE(buf)) != SPIF_SUCCESS) && dev->dual) {
+        return SPIF_FAIL;
+    }
+
+    SPIF_DEBUG(TAG, "Manufacturer : 0x%x.", buf[0]);
+    SPIF_DEBUG(TAG, "Memory Type  : 0x%x.", buf[1]);
+    SPIF_DEBUG(TAG, "Capacity     : 0x%x.", buf[2]);
+
+    _spif_cache_invalidate_locked(dev);
+
+    sfdp_ret = spif_sfdp_parse(_spif_sfdp_read, dev, &sfdp);
+    if (sfdp_ret == SPIF_SUCCESS) {
+        SPIF_DEBUG(TAG, "SFDP         : v%d.%d, %d dwords.", sfdp.major, sfdp.minor, sfdp.dwords);
+    }
+
+    /* the static table overrides SFDP */
+    for (uint16_t i = 0; i < SPIF_ARRAY_SIZE(s_spif_flash_info); i++) {
+        if ((buf[0] == s_spif_flash_info[i].mf_id) &&
+            (buf[1] == s_spif_flash_info[i].mt_id) &&
+            (buf[2] == s_spif_flash_info[i].cap_id)) {
+            dev->flash = s_spif_flash_info[i];
+            found = 1;
+            break;
+        }
+    }
+
+    if (!found) {
+        if ((sfdp_ret != SPIF_SUCCESS) || (_spif_sfdp_info_get(dev, &sfdp, &dev->flash) != SPIF_SUCCESS)) {
+            SPIF_ERROR(TAG, "unknown flash 0x%02X%02X%02X without usable SFDP.", buf[0], buf[1], buf[2]);
+            return SPIF_FAIL;
+        }
+
+        dev->flash.mf_id = buf[0];
+        dev->flash.mt_id = buf[1];
+        dev->flash.cap_id = buf[2];
+        SPIF_WARN(TAG, "flash 0x%02X%02X%02X not in table, configured from SFDP.", buf[0], buf[1], buf[2]);
+    }
+
+    /* dual-flash: two chips side by side, the whole geometry doubles, the timing does not */
+    if (dev->dual) {
+        dev->flash.chip_size *= 2;
+        dev->flash.block_size *= 2;
+        dev->flash.sector_size *= 2;
+        dev->flash.page_size *= 2;
+        for (int i = 0; i < SPIF_ERASE_TYPE_MAX; i++) {
+            dev->flash.erase[i].size *= 2;
+        }
+        SPIF_INFO(TAG, "dual-flash: 2 x %s.", dev->flash.name);
+    }
+
+    /* programming part of a page is fine, larger pages are used in SPIF_SPI_PROGRAM_MAX pieces */
+    if ((dev->spi_ops.ops_mode == SPIF_SPI_OPS_SPI) && (dev->flash.page_size > SPIF_SPI_PROGRAM_MAX)) {
+        dev->flash.page_size = SPIF_SPI_PROGRAM_MAX;
+    }
+
+    SPIF_INFO(TAG, "Flash: %s, Size: %d KB, Block: %d KB, Sector: %d KB, Page: %d B.",
+              dev->flash.name,
+              dev->flash.chip_size / 1024,
+              dev->flash.block_size / 1024,
+              dev->flash.sector_size / 1024,
+              dev->flash.page_size);
+
+    /* pick the fastest read mode the flash and the port both support */
+    dev->read_mode = SPIF_READ_MODE_NORMAL;
+    for (int mode = dev->flash.read_mode; mode > SPIF_READ_MODE_NORMAL; mode--) {
+        if (!_spif_read_mode_supported(dev, (spif_read_mode_t)mode)) {
+            continue;
+        }
+
+        if (_spif_set_read_mode_locked(dev, (spif_read_mode_t)mode) == SPIF_SUCCESS) {
+            break;
+        }
+    }
+
+    SPIF_INFO(TAG, "read mode: %d.", dev->read_mode);
+
+    return ret;
+}
+
+int spif_lock_stats_get(spif_dev_t *dev, spif_lock_stats_t *stats)
+{
+    if ((dev == NULL) || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *stats = dev->lock_stats;
+
+    return SPIF_SUCCESS;
+}
+
+void spif_lock_stats_reset(spif_dev_t *dev)
+{
+    memset(&dev->lock_stats, 0, sizeof(spif_lock_stats_t));
 }
 
-void spif_page_test(uint32_t page_addr)
+void spif_page_test(spif_dev_t *dev, uint32_t page_addr)
 {
     int ret = SPIF_SUCCESS;
 
@@ -497,14 +3036,14 @@ void spif_page_test(uint32_t page_addr)
 
     memset(page_tx_buf, 0x11, 256);
     SPIF_DEBUG(TAG, "page program data: 0x%2X", page_tx_buf[0]);
-    ret = spif_page_program(page_addr, page_tx_buf, 256);
+    ret = spif_page_program(dev, page_addr, page_tx_buf, 256);
     if (ret != SPIF_SUCCESS) {
         SPIF_ERROR(TAG, "page program failed: %d.", ret);
         return;
     }
 
     memset(page_rx_buf, 0x00, 256);
-    ret = spif_read(page_addr, page_rx_buf, 256);
+    ret = spif_read(dev, page_addr, page_rx_buf, 256);
     if (ret != SPIF_SUCCESS) {
         SPIF_ERROR(TAG, "page read failed: %d.", ret);
         return;
@@ -516,9 +3055,9 @@ void spif_page_test(uint32_t page_addr)
     /* Test 2: sector erase */
     SPIF_DEBUG(TAG, "Test 2: sector erase\r\n");
 
-    spif_sector_erase(sector_addr);
+    spif_sector_erase(dev, sector_addr);
     memset(page_rx_buf, 0x00, 256);
-    spif_read(page_addr, page_rx_buf, 256);
+    spif_read(dev, page_addr, page_rx_buf, 256);
 
     SPIF_DEBUG(TAG, "page[  0:3  ] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[0], page_rx_buf[1], page_rx_buf[2], page_rx_buf[3]);
     SPIF_DEBUG(TAG, "page[252:255] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[252], page_rx_buf[253], page_rx_buf[254], page_rx_buf[255]);
@@ -528,10 +3067,10 @@ void spif_page_test(uint32_t page_addr)
 
     memset(page_tx_buf, 0x22, 18); /* 18 = 0x12 */
     SPIF_DEBUG(TAG, "page program data: 0x%2X", page_tx_buf[0]);
-    spif_page_program(page_addr, page_tx_buf, 18);
+    spif_page_program(dev, page_addr, page_tx_buf, 18);
 
     memset(page_rx_buf, 0x00, 18);
-    spif_read(page_addr, page_rx_buf, 18);
+    spif_read(dev, page_addr, page_rx_buf, 18);
 
     SPIF_DEBUG(TAG, "page[  0:3  ] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[0], page_rx_buf[1], page_rx_buf[2], page_rx_buf[3]);
     SPIF_DEBUG(TAG, "page[ 16:19 ] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[16], page_rx_buf[17], page_rx_buf[18], page_rx_buf[19]);
@@ -539,10 +3078,10 @@ void spif_page_test(uint32_t page_addr)
 
     memset(page_tx_buf, 0x11, 256); /* 18 = 0x12 */
     SPIF_DEBUG(TAG, "page program data: 0x%2X", page_tx_buf[0]);
-    spif_page_program(page_addr + 0x12, page_tx_buf, 256);
+    spif_page_program(dev, page_addr + 0x12, page_tx_buf, 256);
 
     memset(page_rx_buf, 0x00, 256);
-    spif_read(page_addr, page_rx_buf, 256);
+    spif_read(dev, page_addr, page_rx_buf, 256);
 
     SPIF_DEBUG(TAG, "page[  0:3  ] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[0], page_rx_buf[1], page_rx_buf[2], page_rx_buf[3]);
     SPIF_DEBUG(TAG, "page[ 16:19 ] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[16], page_rx_buf[17], page_rx_buf[18], page_rx_buf[19]);
@@ -551,24 +3090,24 @@ void spif_page_test(uint32_t page_addr)
     /* Test 4: page program overrun 2 */
     SPIF_DEBUG(TAG, "Test 4: page program overrun 2\r\n");
 
-    spif_sector_erase(sector_addr);
+    spif_sector_erase(dev, sector_addr);
 
     memset(page_tx_buf, 0x11, 256);
     SPIF_DEBUG(TAG, "page program data: 0x%2X", page_tx_buf[0]);
-    spif_page_program(page_addr, page_tx_buf, 256);
+    spif_page_program(dev, page_addr, page_tx_buf, 256);
 
     memset(page_rx_buf, 0x00, 256);
-    spif_read(page_addr, page_rx_buf, 256);
+    spif_read(dev, page_addr, page_rx_buf, 256);
 
     SPIF_DEBUG(TAG, "page[  0:3  ] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[0], page_rx_buf[1], page_rx_buf[2], page_rx_buf[3]);
     SPIF_DEBUG(TAG, "page[252:255] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[252], page_rx_buf[253], page_rx_buf[254], page_rx_buf[255]);
 
     memset(page_tx_buf, 0x22, 256);
     SPIF_DEBUG(TAG, "page program data: 0x%2X", page_tx_buf[0]);
-    spif_page_program(page_addr, page_tx_buf, 256);
+    spif_page_program(dev, page_addr, page_tx_buf, 256);
 
     memset(page_rx_buf, 0x00, 256);
-    spif_read(page_addr, page_rx_buf, 256);
+    spif_read(dev, page_addr, page_rx_buf, 256);
 
     SPIF_DEBUG(TAG, "page[  0:3  ] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[0], page_rx_buf[1], page_rx_buf[2], page_rx_buf[3]);
     SPIF_DEBUG(TAG, "page[252:255] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[252], page_rx_buf[253], page_rx_buf[254], page_rx_buf[255]);
@@ -576,9 +3115,9 @@ void spif_page_test(uint32_t page_addr)
     /* Test 5: block erase */
     SPIF_DEBUG(TAG, "Test 5: block erase\r\n");
 
-    spif_block_erase_32(block_addr);
+    spif_block_erase_32(dev, block_addr);
     memset(page_rx_buf, 0x00, 256);
-    spif_read(page_addr, page_rx_buf, 256);
+    spif_read(dev, page_addr, page_rx_buf, 256);
 
     SPIF_DEBUG(TAG, "page[  0:3  ] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[0], page_rx_buf[1], page_rx_buf[2], page_rx_buf[3]);
     SPIF_DEBUG(TAG, "page[252:255] 0x%02X 0x%02X 0x%02X 0x%02X", page_rx_buf[252], page_rx_buf[253], page_rx_buf[254], page_rx_buf[255]);
@@ -0,0 +1,249 @@
+/*
+ * spif_atomic.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <stddef.h>
+#include <string.h>
+#include "spif.h"
+#include "spif_crc.h"
+#include "spif_atomic.h"
+
+#define SPIF_ATOMIC_MAGIC    0x54494D43 /* "CMIT" */
+
+typedef struct spif_atomic_record_s {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t data_crc;
+    uint32_t crc;      /* of the record up to here */
+} spif_atomic_record_t;
+
+static uint32_t _spif_atomic_slot_addr(spif_atomic_t *atomic, uint8_t slot)
+{
+    return atomic->config.addr + slot * atomic->sector_size;
+}
+
+/* seq a is newer than seq b, wraps around */
+static int _spif_atomic_newer(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+static int _spif_atomic_record_get(spif_atomic_t *atomic, uint8_t slot, spif_atomic_record_t *record)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = spif_fast_read(atomic->config.dev, _spif_atomic_slot_addr(atomic, slot) + atomic->size, (uint8_t *)record,
+                         sizeof(spif_atomic_record_t));
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if ((record->magic != SPIF_ATOMIC_MAGIC) ||
+        ((spif_crc32(SPIF_CRC32_INIT, record, offsetof(spif_atomic_record_t, crc)) ^ SPIF_CRC32_INIT) != record->crc)) {
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_atomic_data_check(spif_atomic_t *atomic, uint8_t slot, const spif_atomic_record_t *record)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t addr = _spif_atomic_slot_addr(atomic, slot);
+    uint32_t crc = SPIF_CRC32_INIT;
+    uint32_t n = 0;
+
+    for (uint32_t pos = 0; pos < atomic->size; pos += n) {
+        n = (atomic->size - pos < SPIF_ATOMIC_BUF_SIZE) ? (atomic->size - pos) : SPIF_ATOMIC_BUF_SIZE;
+
+        ret = spif_fast_read(atomic->config.dev, addr + pos, atomic->buf, n);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        crc = spif_crc32(crc, atomic->buf, n);
+    }
+
+    return ((crc ^ SPIF_CRC32_INIT) == record->data_crc) ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+int spif_atomic_open(spif_atomic_t *atomic, const spif_atomic_config_t *config)
+{
+    spif_atomic_record_t record[2];
+    int good[2] = {0};
+    uint8_t order[2] = {0, 1};
+    uint8_t slot = 0;
+
+    if ((atomic == NULL) || (config == NULL) || (config->dev == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    if ((config->dev->flash.sector_size <= sizeof(spif_atomic_record_t)) || (config->addr % config->dev->flash.sector_size != 0) ||
+        ((uint64_t)config->addr + 2 * config->dev->flash.sector_size > config->dev->flash.chip_size)) {
+        return SPIF_FAIL;
+    }
+
+    memset(atomic, 0, sizeof(spif_atomic_t));
+    atomic->config = *config;
+    atomic->sector_size = config->dev->flash.sector_size;
+    atomic->size = atomic->sector_size - sizeof(spif_atomic_record_t);
+
+    for (slot = 0; slot < 2; slot++) {
+        good[slot] = (_spif_atomic_record_get(atomic, slot, &record[slot]) == SPIF_SUCCESS);
+    }
+
+    if (good[0] && good[1] && _spif_atomic_newer(record[1].seq, record[0].seq)) {
+        order[0] = 1;
+        order[1] = 0;
+    }
+
+    /* newest first, a record is programmed only after its data, verify guards against data gone bad since */
+    for (uint8_t i = 0; i < 2; i++) {
+        slot = order[i];
+        if (!good[slot]) {
+            continue;
+        }
+
+        if (config->verify && (_spif_atomic_data_check(atomic, slot, &record[slot]) != SPIF_SUCCESS)) {
+            atomic->stats.fallbacks++;
+            continue;
+        }
+
+        atomic->valid = 1;
+        atomic->cur = slot;
+        break;
+    }
+
+    /* the next commit must be newer than any record on flash, a rejected one included */
+    slot = good[order[0]] ? order[0] : order[1];
+    if (good[slot]) {
+        atomic->seq = record[slot].seq;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_atomic_read(spif_atomic_t *atomic, uint32_t offset, uint8_t *data, uint32_t size)
+{
+    if ((atomic == NULL) || ((data == NULL) && (size > 0)) || ((uint64_t)offset + size > atomic->size)) {
+        return SPIF_FAIL;
+    }
+
+    if (!atomic->valid) {
+        memset(data, 0xFF, size);
+        return SPIF_SUCCESS;
+    }
+
+    return spif_fast_read(atomic->config.dev, _spif_atomic_slot_addr(atomic, atomic->cur) + offset, data, size);
+}
+
+int spif_atomic_update(spif_atomic_t *atomic, uint32_t offset, const uint8_t *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = NULL;
+    spif_atomic_record_t record;
+    uint8_t slot = 0;
+    uint32_t dst = 0;
+    uint32_t src = 0;
+    uint32_t crc = SPIF_CRC32_INIT;
+    uint32_t n = 0;
+    uint32_t from = 0;
+    uint32_t to = 0;
+    uint32_t blank = 0;
+
+    if ((atomic == NULL) || ((data == NULL) && (size > 0)) || ((uint64_t)offset + size > atomic->size)) {
+        return SPIF_FAIL;
+    }
+
+    dev = atomic->config.dev;
+    slot = atomic->valid ? !atomic->cur : 0;
+    dst = _spif_atomic_slot_addr(atomic, slot);
+    src = _spif_atomic_slot_addr(atomic, atomic->cur);
+
+    /* the older copy goes first, the current one is untouched until the record is in */
+    ret = spif_sector_erase(dev, dst);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    for (uint32_t pos = 0; pos < atomic->size; pos += n) {
+        n = (atomic->size - pos < SPIF_ATOMIC_BUF_SIZE) ? (atomic->size - pos) : SPIF_ATOMIC_BUF_SIZE;
+
+        /* the part of this piece given by the caller */
+        from = (offset > pos) ? offset : pos;
+        to = (offset + size < pos + n) ? (offset + size) : (pos + n);
+
+        if ((from > pos) || (to < pos + n)) {
+            if (atomic->valid) {
+                ret = spif_fast_read(dev, src + pos, atomic->buf, n);
+                if (ret != SPIF_SUCCESS) {
+                    return ret;
+                }
+                atomic->stats.copied += n - ((to > from) ? (to - from) : 0);
+            } else {
+                memset(atomic->buf, 0xFF, n);
+            }
+        }
+
+        if (to > from) {
+            memcpy(&atomic->buf[from - pos], &data[from - offset], to - from);
+        }
+
+        crc = spif_crc32(crc, atomic->buf, n);
+
+        for (blank = 0; (blank < n) && (atomic->buf[blank] == 0xFF); blank++) {
+        }
+
+        if (blank < n) {
+            ret = spif_write(dev, dst + pos, atomic->buf, n, SPIF_WRITE_MODE_PROGRAM);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+            atomic->stats.programs++;
+        }
+    }
+
+    record.magic = SPIF_ATOMIC_MAGIC;
+    record.seq = atomic->seq + 1;
+    record.data_crc = crc ^ SPIF_CRC32_INIT;
+    record.crc = spif_crc32(SPIF_CRC32_INIT, &record, offsetof(spif_atomic_record_t, crc)) ^ SPIF_CRC32_INIT;
+
+    /* the commit */
+    ret = spif_write(dev, dst + atomic->size, (const uint8_t *)&record, sizeof(spif_atomic_record_t), SPIF_WRITE_MODE_PROGRAM);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    atomic->valid = 1;
+    atomic->cur = slot;
+    atomic->seq = record.seq;
+    atomic->stats.programs++;
+    atomic->stats.updates++;
+
+    return SPIF_SUCCESS;
+}
+
+uint32_t spif_atomic_size(spif_atomic_t *atomic)
+{
+    return atomic->size;
+}
+
+int spif_atomic_stats_get(spif_atomic_t *atomic, spif_atomic_stats_t *stats)
+{
+    if ((atomic == NULL) || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *stats = atomic->stats;
+
+    return SPIF_SUCCESS;
+}
+
+void spif_atomic_stats_reset(spif_atomic_t *atomic)
+{
+    memset(&atomic->stats, 0, sizeof(spif_atomic_stats_t));
+}
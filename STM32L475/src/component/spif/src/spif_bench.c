@@ -0,0 +1,906 @@
+/*
+ * spif_bench.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif.h"
+#include "spif_bench.h"
+#include "spif_stream.h"
+#include "spif_lz.h"
+#include "spif_atomic.h"
+#include "spif_fs.h"
+
+#define SPIF_BENCH_HIST_BUCKETS    40 /* log2 of ns, up to ~18 minutes */
+
+#define SPIF_BENCH_BLOCK_SIZE      (64 * 1024)
+
+#define SPIF_BENCH_LZ_READ_SIZE    64 /* a log record */
+
+typedef enum {
+    SPIF_BENCH_READ_SEQ = 0,
+    SPIF_BENCH_READ_RAND,
+    SPIF_BENCH_PAGE_PROGRAM,
+    SPIF_BENCH_PAGE_PROGRAM_POLL,
+    SPIF_BENCH_ERASE,
+} spif_bench_test_t;
+
+typedef enum {
+    SPIF_BENCH_ATOMIC_UPDATE = 0,
+    SPIF_BENCH_ATOMIC_RAW,
+    SPIF_BENCH_ATOMIC_OPEN,
+    SPIF_BENCH_ATOMIC_REREAD,
+} spif_bench_atomic_test_t;
+
+typedef enum {
+    SPIF_BENCH_FS_WRITE = 0,
+    SPIF_BENCH_FS_READ,
+    SPIF_BENCH_FS_APPEND,
+    SPIF_BENCH_FS_OVERWRITE,
+    SPIF_BENCH_FS_MOUNT,
+} spif_bench_fs_test_t;
+
+typedef struct {
+    spif_dev_t *dev;
+    const spif_bench_config_t *config;
+    uint32_t rand;
+    uint16_t count;
+    uint64_t samples[SPIF_BENCH_SAMPLES_MAX]; /* unit: ns */
+} spif_bench_ctx_t;
+
+static uint8_t s_spif_bench_buf[SPIF_BENCH_READ_SIZE_MAX];
+static uint8_t s_spif_bench_stream_buf[2 * SPIF_BENCH_READ_SIZE_MAX];
+static spif_lz_t s_spif_bench_lz;
+static spif_atomic_t s_spif_bench_atomic;
+static spif_fs_t s_spif_bench_fs;
+static spif_fs_bd_t s_spif_bench_fs_bd;
+static spif_fs_file_t s_spif_bench_fs_file;
+
+static uint32_t _spif_bench_rand(spif_bench_ctx_t *ctx)
+{
+    /* xorshift32 */
+    ctx->rand ^= ctx->rand << 13;
+    ctx->rand ^= ctx->rand >> 17;
+    ctx->rand ^= ctx->rand << 5;
+
+    return ctx->rand;
+}
+
+static uint64_t _spif_bench_ns(spif_dev_t *dev, uint64_t start, uint64_t end)
+{
+    uint64_t ticks = end - start;
+    uint32_t hz = dev->plat_ops.timestamp_hz;
+
+    /* split, ticks * 1e9 overflows after 1.8e10 ticks (18 s at 1 GHz) */
+    return (ticks / hz) * 1000000000ULL + (ticks % hz) * 1000000000ULL / hz;
+}
+
+static void _spif_bench_sort(uint64_t *v, uint16_t n)
+{
+    uint64_t tmp = 0;
+
+    for (uint16_t i = 1; i < n; i++) {
+        tmp = v[i];
+        int j = i - 1;
+        for (; (j >= 0) && (v[j] > tmp); j--) {
+            v[j + 1] = v[j];
+        }
+        v[j + 1] = tmp;
+    }
+}
+
+static void _spif_bench_report(spif_bench_ctx_t *ctx, const char *name, uint32_t size)
+{
+    spif_dev_t *dev = ctx->dev;
+    uint16_t n = ctx->count;
+    uint64_t *v = ctx->samples;
+    uint64_t total = 0;
+    uint16_t hist[SPIF_BENCH_HIST_BUCKETS] = {0};
+    uint32_t kbps = 0;
+
+    if (n == 0) {
+        return;
+    }
+
+    _spif_bench_sort(v, n);
+
+    for (uint16_t i = 0; i < n; i++) {
+        int b = 0;
+
+        total += v[i];
+        while ((b < SPIF_BENCH_HIST_BUCKETS - 1) && ((v[i] >> (b + 1)) != 0)) {
+            b++;
+        }
+        hist[b]++;
+    }
+
+    if (total > 0) {
+        kbps = (uint32_t)((uint64_t)size * n * 1000000000ULL / 1024 / total);
+    }
+
+    /* p99: the smallest sample not below 99% of them */
+    dev->plat_ops.log("result,%s,%u,%u,%llu,%llu,%llu,%llu,%u\r\n", name, size, n,
+                      (unsigned long long)v[0], (unsigned long long)v[(n - 1) / 2],
+                      (unsigned long long)v[(n * 99 + 99) / 100 - 1], (unsigned long long)v[n - 1], kbps);
+
+    for (int b = 0; b < SPIF_BENCH_HIST_BUCKETS; b++) {
+        if (hist[b] != 0) {
+            dev->plat_ops.log("hist,%s,%u,%llu,%u\r\n", name, size, 1ULL << b, hist[b]);
+        }
+    }
+}
+
+/* one operation of a test, timed */
+static int _spif_bench_once(spif_bench_ctx_t *ctx, spif_bench_test_t test, uint32_t size, uint16_t i)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = ctx->dev;
+    const spif_bench_config_t *config = ctx->config;
+    uint32_t addr = 0;
+    uint64_t start = 0;
+    spif_async_t token;
+
+    switch (test) {
+    case SPIF_BENCH_READ_SEQ:
+        addr = config->addr + (uint32_t)(((uint64_t)i * size) % config->size);
+        break;
+    case SPIF_BENCH_READ_RAND:
+        addr = config->addr + (_spif_bench_rand(ctx) % (config->size / size)) * size;
+        break;
+    case SPIF_BENCH_PAGE_PROGRAM:
+    case SPIF_BENCH_PAGE_PROGRAM_POLL:
+        /* first half of the block for the page programs, second half for the polled ones */
+        addr = config->addr + ((test == SPIF_BENCH_PAGE_PROGRAM) ? 0 : SPIF_BENCH_BLOCK_SIZE / 2) + i * size;
+        break;
+    default:
+        addr = config->addr + (uint32_t)(((uint64_t)i * size) % config->size);
+        break;
+    }
+
+    /* time the flash, not the read cache */
+    if ((test == SPIF_BENCH_READ_SEQ) || (test == SPIF_BENCH_READ_RAND)) {
+        spif_cache_invalidate(dev);
+    }
+
+    start = dev->plat_ops.timestamp();
+
+    switch (test) {
+    case SPIF_BENCH_READ_SEQ:
+    case SPIF_BENCH_READ_RAND:
+        ret = spif_fast_read(dev, addr, s_spif_bench_buf, size);
+        break;
+    case SPIF_BENCH_PAGE_PROGRAM:
+        ret = spif_page_program(dev, addr, s_spif_bench_buf, size);
+        break;
+    case SPIF_BENCH_PAGE_PROGRAM_POLL:
+        ret = spif_page_program_async(dev, addr, s_spif_bench_buf, size, &token, NULL, NULL);
+        if (ret == SPIF_SUCCESS) {
+            while (spif_async_poll(dev, &token) != SPIF_ASYNC_DONE) {
+            }
+            ret = token.result;
+        }
+        break;
+    default:
+        /* an aligned range of one erase size is planned as a single erase of that type */
+        ret = spif_erase_range(dev, addr, size, NULL);
+        break;
+    }
+
+    ctx->samples[ctx->count++] = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    return ret;
+}
+
+static int _spif_bench_test(spif_bench_ctx_t *ctx, spif_bench_test_t test, const char *name, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+    uint16_t samples = ctx->config->samples;
+
+    /* page programs must land on erased flash and fit in their half block */
+    if ((test == SPIF_BENCH_PAGE_PROGRAM) || (test == SPIF_BENCH_PAGE_PROGRAM_POLL)) {
+        if (samples > SPIF_BENCH_BLOCK_SIZE / 2 / size) {
+            samples = SPIF_BENCH_BLOCK_SIZE / 2 / size;
+        }
+
+        if (test == SPIF_BENCH_PAGE_PROGRAM) {
+            ret = spif_erase_range(ctx->dev, ctx->config->addr, SPIF_BENCH_BLOCK_SIZE, NULL);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+
+    ctx->count = 0;
+
+    for (uint16_t i = 0; i < samples; i++) {
+        ret = _spif_bench_once(ctx, test, size, i);
+        if (ret != SPIF_SUCCESS) {
+            ctx->dev->plat_ops.log("error,%s,%u,%d\r\n", name, size, ret);
+            return ret;
+        }
+    }
+
+    _spif_bench_report(ctx, name, size);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_bench_run(spif_dev_t *dev, const spif_bench_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    static const uint32_t read_size[] = {16, 256, SPIF_BENCH_READ_SIZE_MAX};
+    static spif_bench_ctx_t ctx;
+
+    if ((dev == NULL) || (config == NULL) || (dev->plat_ops.timestamp == NULL) || (dev->plat_ops.timestamp_hz == 0)) {
+        return SPIF_FAIL;
+    }
+
+    if ((config->addr % SPIF_BENCH_BLOCK_SIZE != 0) || (config->size % SPIF_BENCH_BLOCK_SIZE != 0) || (config->size == 0) ||
+        (config->samples == 0) || (config->samples > SPIF_BENCH_SAMPLES_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    memset(&ctx, 0, sizeof(spif_bench_ctx_t));
+    ctx.dev = dev;
+    ctx.config = config;
+    ctx.rand = (config->seed != 0) ? config->seed : 1;
+
+    for (uint32_t i = 0; i < sizeof(s_spif_bench_buf); i++) {
+        s_spif_bench_buf[i] = (uint8_t)_spif_bench_rand(&ctx);
+    }
+
+    dev->plat_ops.log("# spif_bench,%s,read_mode=%d,timestamp_hz=%u\r\n", dev->flash.name, spif_get_read_mode(dev), dev->plat_ops.timestamp_hz);
+    dev->plat_ops.log("# result,test,size,samples,min_ns,median_ns,p99_ns,max_ns,kbps\r\n");
+    dev->plat_ops.log("# hist,test,size,bucket_ns,count\r\n");
+
+    /* erase first, so the reads are of a known (blank) area */
+    for (uint32_t i = 0; (ret == SPIF_SUCCESS) && (i < SPIF_ERASE_TYPE_MAX); i++) {
+        uint32_t size = dev->flash.erase[i].size;
+        if ((size != 0) && (size <= config->size) && (SPIF_BENCH_BLOCK_SIZE % size == 0)) {
+            ret = _spif_bench_test(&ctx, SPIF_BENCH_ERASE, "erase", size);
+        }
+    }
+
+    for (uint32_t i = 0; (ret == SPIF_SUCCESS) && (i < sizeof(read_size) / sizeof(read_size[0])); i++) {
+        ret = _spif_bench_test(&ctx, SPIF_BENCH_READ_SEQ, "read_seq", read_size[i]);
+        if (ret == SPIF_SUCCESS) {
+            ret = _spif_bench_test(&ctx, SPIF_BENCH_READ_RAND, "read_rand", read_size[i]);
+        }
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_test(&ctx, SPIF_BENCH_PAGE_PROGRAM, "page_program", dev->flash.page_size);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_test(&ctx, SPIF_BENCH_PAGE_PROGRAM_POLL, "page_program_poll", dev->flash.page_size);
+    }
+
+    return ret;
+}
+
+/* one pass of spif_bench_stream(), chunk 0: no stream */
+static int _spif_bench_stream_pass(spif_dev_t *dev, const spif_bench_config_t *config, uint32_t chunk, uint32_t piece_size, uint32_t work_us)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_stream_t stream;
+    spif_stream_config_t stream_config;
+    spif_stream_stats_t stats = {0};
+    uint32_t offset = 0;
+    uint32_t size = 0;
+    uint64_t start = 0;
+    uint64_t ns = 0;
+
+    spif_cache_invalidate(dev);
+
+    if (chunk > 0) {
+        stream_config.dev = dev;
+        stream_config.addr = config->addr;
+        stream_config.size = config->size;
+        stream_config.buf = s_spif_bench_stream_buf;
+        stream_config.chunk_size = chunk;
+    }
+
+    start = dev->plat_ops.timestamp();
+
+    if (chunk > 0) {
+        ret = spif_stream_open(&stream, &stream_config);
+    }
+
+    while ((ret == SPIF_SUCCESS) && (offset < config->size)) {
+        size = (config->size - offset < piece_size) ? (config->size - offset) : piece_size;
+
+        if (chunk > 0) {
+            ret = spif_stream_read(&stream, s_spif_bench_buf, size, &size);
+        } else {
+            ret = spif_fast_read(dev, config->addr + offset, s_spif_bench_buf, size);
+        }
+
+        offset += size;
+
+        if (work_us > 0) {
+            dev->plat_ops.delay_us(work_us);
+        }
+    }
+
+    if (chunk > 0) {
+        (void)spif_stream_stats_get(&stream, &stats);
+        if (spif_stream_close(&stream) != SPIF_SUCCESS) {
+            ret = SPIF_FAIL;
+        }
+    }
+
+    ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    if (ret != SPIF_SUCCESS) {
+        dev->plat_ops.log("error,stream,%u,%d\r\n", chunk, ret);
+        return ret;
+    }
+
+    dev->plat_ops.log("stream,%u,%u,%u,%u,%llu,%u,%u\r\n", chunk, piece_size, work_us, config->size, (unsigned long long)ns,
+                      (ns > 0) ? (uint32_t)((uint64_t)config->size * 1000000000ULL / 1024 / ns) : 0, stats.stalls);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_bench_stream(spif_dev_t *dev, const spif_bench_config_t *config, uint32_t piece_size, uint32_t work_us)
+{
+    int ret = SPIF_SUCCESS;
+
+    static const uint32_t chunk_size[] = {0, 256, 1024, SPIF_BENCH_READ_SIZE_MAX};
+
+    if ((dev == NULL) || (config == NULL) || (dev->plat_ops.timestamp == NULL) || (dev->plat_ops.timestamp_hz == 0)) {
+        return SPIF_FAIL;
+    }
+
+    if ((config->size == 0) || (piece_size == 0) || (piece_size > SPIF_BENCH_READ_SIZE_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    dev->plat_ops.log("# spif_bench,%s,read_mode=%d,timestamp_hz=%u\r\n", dev->flash.name, spif_get_read_mode(dev), dev->plat_ops.timestamp_hz);
+    dev->plat_ops.log("# stream,chunk,piece,work_us,bytes,ns,kbps,stalls\r\n");
+
+    for (uint32_t i = 0; (ret == SPIF_SUCCESS) && (i < sizeof(chunk_size) / sizeof(chunk_size[0])); i++) {
+        ret = _spif_bench_stream_pass(dev, config, chunk_size[i], piece_size, work_us);
+    }
+
+    return ret;
+}
+
+/* raw: every line programmed as it comes, the way a plain log appends */
+static int _spif_bench_lz_raw(spif_dev_t *dev, const spif_bench_config_t *config, const uint8_t *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_bench_ctx_t ctx = {0};
+    uint32_t page_size = dev->flash.page_size;
+    uint32_t programs = 0;
+    uint32_t offset = 0;
+    uint32_t n = 0;
+    uint64_t start = 0;
+    uint64_t write_ns = 0;
+    uint64_t seq_ns = 0;
+    uint64_t rand_ns = 0;
+
+    ctx.dev = dev;
+    ctx.rand = config->seed ? config->seed : 1;
+
+    ret = spif_erase_range(dev, config->addr, config->size, NULL);
+
+    start = dev->plat_ops.timestamp();
+    while ((ret == SPIF_SUCCESS) && (offset < size)) {
+        n = 0;
+        while ((offset + n < size) && (data[offset + n++] != '\n')) {
+        }
+
+        ret = spif_write(dev, config->addr + offset, &data[offset], n, SPIF_WRITE_MODE_PROGRAM);
+        programs += (offset + n - 1) / page_size - offset / page_size + 1;
+        offset += n;
+    }
+    write_ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    spif_cache_invalidate(dev);
+    start = dev->plat_ops.timestamp();
+    for (offset = 0; (ret == SPIF_SUCCESS) && (offset < size); offset += n) {
+        n = (size - offset < SPIF_BENCH_READ_SIZE_MAX) ? (size - offset) : SPIF_BENCH_READ_SIZE_MAX;
+        ret = spif_fast_read(dev, config->addr + offset, s_spif_bench_buf, n);
+    }
+    seq_ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    start = dev->plat_ops.timestamp();
+    for (uint16_t i = 0; (ret == SPIF_SUCCESS) && (i < config->samples); i++) {
+        offset = _spif_bench_rand(&ctx) % size;
+        n = (size - offset < SPIF_BENCH_LZ_READ_SIZE) ? (size - offset) : SPIF_BENCH_LZ_READ_SIZE;
+        ret = spif_fast_read(dev, config->addr + offset, s_spif_bench_buf, n);
+    }
+    rand_ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    if (ret != SPIF_SUCCESS) {
+        dev->plat_ops.log("error,lz,raw,%d\r\n", ret);
+        return ret;
+    }
+
+    dev->plat_ops.log("lz,raw,0,%u,%u,%u,%llu,100,%llu,%llu\r\n", size, size, programs, (unsigned long long)write_ns,
+                      (unsigned long long)seq_ns, (unsigned long long)(rand_ns / config->samples));
+
+    return SPIF_SUCCESS;
+}
+
+/* the same lines through spif_lz, flushed every flush_lines of them (0: once at the end) */
+static int _spif_bench_lz_pass(spif_dev_t *dev, const spif_bench_config_t *config, const uint8_t *data, uint32_t size, uint32_t flush_lines)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_bench_ctx_t ctx = {0};
+    spif_lz_t *lz = &s_spif_bench_lz;
+    spif_lz_config_t lz_config = {dev, config->addr, config->size};
+    spif_lz_stats_t stats = {0};
+    uint32_t lines = 0;
+    uint32_t offset = 0;
+    uint32_t n = 0;
+    uint64_t start = 0;
+    uint64_t write_ns = 0;
+    uint64_t seq_ns = 0;
+    uint64_t rand_ns = 0;
+
+    ctx.dev = dev;
+    ctx.rand = config->seed ? config->seed : 1;
+
+    ret = spif_lz_format(lz, &lz_config);
+
+    start = dev->plat_ops.timestamp();
+    while ((ret == SPIF_SUCCESS) && (offset < size)) {
+        n = 0;
+        while ((offset + n < size) && (data[offset + n++] != '\n')) {
+        }
+
+        ret = spif_lz_write(lz, &data[offset], n);
+        offset += n;
+
+        if ((ret == SPIF_SUCCESS) && (flush_lines > 0) && (++lines % flush_lines == 0)) {
+            ret = spif_lz_flush(lz);
+        }
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = spif_lz_flush(lz);
+    }
+    write_ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    (void)spif_lz_stats_get(lz, &stats);
+
+    spif_cache_invalidate(dev);
+    start = dev->plat_ops.timestamp();
+    for (offset = 0; (ret == SPIF_SUCCESS) && (offset < size); offset += n) {
+        ret = spif_lz_read(lz, offset, s_spif_bench_buf, SPIF_BENCH_READ_SIZE_MAX, &n);
+        if ((ret == SPIF_SUCCESS) && (n == 0)) {
+            ret = SPIF_FAIL;
+        }
+    }
+    seq_ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    start = dev->plat_ops.timestamp();
+    for (uint16_t i = 0; (ret == SPIF_SUCCESS) && (i < config->samples); i++) {
+        ret = spif_lz_read(lz, _spif_bench_rand(&ctx) % size, s_spif_bench_buf, SPIF_BENCH_LZ_READ_SIZE, &n);
+    }
+    rand_ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    if (ret != SPIF_SUCCESS) {
+        dev->plat_ops.log("error,lz,%u,%d\r\n", flush_lines, ret);
+        return ret;
+    }
+
+    dev->plat_ops.log("lz,lz,%u,%u,%llu,%u,%llu,%u,%llu,%llu\r\n", flush_lines, size, (unsigned long long)stats.comp_bytes,
+                      stats.programs, (unsigned long long)write_ns, (uint32_t)(stats.comp_bytes * 100 / size),
+                      (unsigned long long)seq_ns, (unsigned long long)(rand_ns / config->samples));
+
+    return SPIF_SUCCESS;
+}
+
+int spif_bench_lz(spif_dev_t *dev, const spif_bench_config_t *config, const uint8_t *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    static const uint32_t flush_lines[] = {0, 64, 8};
+
+    if ((dev == NULL) || (config == NULL) || (data == NULL) || (dev->plat_ops.timestamp == NULL) || (dev->plat_ops.timestamp_hz == 0)) {
+        return SPIF_FAIL;
+    }
+
+    if ((size == 0) || (size > config->size) || (config->samples == 0)) {
+        return SPIF_FAIL;
+    }
+
+    dev->plat_ops.log("# spif_bench,%s,read_mode=%d,timestamp_hz=%u\r\n", dev->flash.name, spif_get_read_mode(dev), dev->plat_ops.timestamp_hz);
+    dev->plat_ops.log("# lz,mode,flush_lines,bytes,flash_bytes,programs,write_ns,ratio_pct,seq_read_ns,rand_read_ns\r\n");
+
+    ret = _spif_bench_lz_raw(dev, config, data, size);
+
+    for (uint32_t i = 0; (ret == SPIF_SUCCESS) && (i < sizeof(flush_lines) / sizeof(flush_lines[0])); i++) {
+        ret = _spif_bench_lz_pass(dev, config, data, size, flush_lines[i]);
+    }
+
+    return ret;
+}
+
+/* one test of spif_bench_atomic(), samples timed operations, size: bytes updated */
+static int _spif_bench_atomic_test(spif_bench_ctx_t *ctx, spif_bench_atomic_test_t test, const char *name, uint32_t size, uint8_t verify)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = ctx->dev;
+    spif_atomic_t *atomic = &s_spif_bench_atomic;
+    spif_atomic_config_t atomic_config = {dev, ctx->config->addr, verify};
+    uint32_t sector_size = dev->flash.sector_size;
+    uint32_t raw_addr = ctx->config->addr + 2 * sector_size;
+    uint32_t offset = 0;
+    uint32_t n = 0;
+    uint64_t start = 0;
+
+    ctx->count = 0;
+
+    for (uint16_t i = 0; (ret == SPIF_SUCCESS) && (i < ctx->config->samples); i++) {
+        offset = (size < atomic->size) ? (_spif_bench_rand(ctx) % (atomic->size - size + 1)) : 0;
+        /* the data changes every time */
+        s_spif_bench_stream_buf[0] = (uint8_t)i;
+
+        start = dev->plat_ops.timestamp();
+
+        switch (test) {
+        case SPIF_BENCH_ATOMIC_UPDATE:
+            ret = spif_atomic_update(atomic, offset, s_spif_bench_stream_buf, size);
+            break;
+        case SPIF_BENCH_ATOMIC_RAW:
+            ret = spif_write(dev, raw_addr + offset, s_spif_bench_stream_buf, size, SPIF_WRITE_MODE_ERASE);
+            break;
+        case SPIF_BENCH_ATOMIC_OPEN:
+            ret = spif_atomic_open(atomic, &atomic_config);
+            break;
+        case SPIF_BENCH_ATOMIC_REREAD:
+        default:
+            /* two plain copies read and compared at boot */
+            for (uint32_t pos = 0; (ret == SPIF_SUCCESS) && (pos < 2 * sector_size); pos += n) {
+                n = (2 * sector_size - pos < SPIF_BENCH_READ_SIZE_MAX) ? (2 * sector_size - pos) : SPIF_BENCH_READ_SIZE_MAX;
+                ret = spif_fast_read(dev, raw_addr + pos, s_spif_bench_buf, n);
+            }
+            break;
+        }
+
+        ctx->samples[ctx->count++] = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        dev->plat_ops.log("error,%s,%u,%d\r\n", name, size, ret);
+        return ret;
+    }
+
+    _spif_bench_report(ctx, name, size);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_bench_atomic(spif_dev_t *dev, const spif_bench_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    static spif_bench_ctx_t ctx;
+    spif_atomic_config_t atomic_config = {dev, 0, 0};
+    spif_atomic_stats_t stats = {0};
+    uint32_t size = 0;
+
+    if ((dev == NULL) || (config == NULL) || (dev->plat_ops.timestamp == NULL) || (dev->plat_ops.timestamp_hz == 0)) {
+        return SPIF_FAIL;
+    }
+
+    if ((config->addr % SPIF_BENCH_BLOCK_SIZE != 0) || (config->size < 4 * dev->flash.sector_size) ||
+        (dev->flash.sector_size > sizeof(s_spif_bench_stream_buf)) || (config->samples == 0) ||
+        (config->samples > SPIF_BENCH_SAMPLES_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    memset(&ctx, 0, sizeof(spif_bench_ctx_t));
+    ctx.dev = dev;
+    ctx.config = config;
+    ctx.rand = (config->seed != 0) ? config->seed : 1;
+
+    for (uint32_t i = 0; i < sizeof(s_spif_bench_stream_buf); i++) {
+        s_spif_bench_stream_buf[i] = (uint8_t)_spif_bench_rand(&ctx);
+    }
+
+    ret = spif_erase_range(dev, config->addr, 4 * dev->flash.sector_size, NULL);
+
+    atomic_config.addr = config->addr;
+    if (ret == SPIF_SUCCESS) {
+        ret = spif_atomic_open(&s_spif_bench_atomic, &atomic_config);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    size = spif_atomic_size(&s_spif_bench_atomic);
+
+    dev->plat_ops.log("# spif_bench,%s,read_mode=%d,timestamp_hz=%u\r\n", dev->flash.name, spif_get_read_mode(dev), dev->plat_ops.timestamp_hz);
+    dev->plat_ops.log("# result,test,size,samples,min_ns,median_ns,p99_ns,max_ns,kbps\r\n");
+    dev->plat_ops.log("# hist,test,size,bucket_ns,count\r\n");
+
+    ret = _spif_bench_atomic_test(&ctx, SPIF_BENCH_ATOMIC_UPDATE, "atomic_update", size, 0);
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_atomic_test(&ctx, SPIF_BENCH_ATOMIC_RAW, "raw_rewrite", size, 0);
+    }
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_atomic_test(&ctx, SPIF_BENCH_ATOMIC_UPDATE, "atomic_update", SPIF_BENCH_LZ_READ_SIZE, 0);
+    }
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_atomic_test(&ctx, SPIF_BENCH_ATOMIC_RAW, "raw_rewrite", SPIF_BENCH_LZ_READ_SIZE, 0);
+    }
+
+    (void)spif_atomic_stats_get(&s_spif_bench_atomic, &stats);
+
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_atomic_test(&ctx, SPIF_BENCH_ATOMIC_OPEN, "atomic_open", 0, 0);
+    }
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_atomic_test(&ctx, SPIF_BENCH_ATOMIC_OPEN, "atomic_open_verify", 0, 1);
+    }
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_atomic_test(&ctx, SPIF_BENCH_ATOMIC_REREAD, "reread_two_copies", 2 * dev->flash.sector_size, 0);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        dev->plat_ops.log("atomic,updates=%u,programs=%u,copied=%u\r\n", stats.updates, stats.programs, stats.copied);
+    }
+
+    return ret;
+}
+
+/* the file system side of a test of spif_bench_fs() on "/bench", returns its time in ns */
+static int _spif_bench_fs_run(spif_bench_ctx_t *ctx, spif_bench_fs_test_t test, uint32_t piece, uint32_t size, uint64_t *ns)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = ctx->dev;
+    spif_fs_t *fs = &s_spif_bench_fs;
+    spif_fs_file_t *file = &s_spif_bench_fs_file;
+    spif_fs_config_t fs_config = {&s_spif_bench_fs_bd, 0};
+    uint8_t flags = SPIF_FS_O_WRITE;
+    uint32_t n = 0;
+    uint64_t start = 0;
+
+    spif_cache_invalidate(dev);
+    start = dev->plat_ops.timestamp();
+
+    switch (test) {
+    case SPIF_BENCH_FS_WRITE:
+        flags |= SPIF_FS_O_CREATE | SPIF_FS_O_TRUNC;
+        break;
+    case SPIF_BENCH_FS_READ:
+        flags = SPIF_FS_O_READ;
+        break;
+    case SPIF_BENCH_FS_APPEND:
+        flags |= SPIF_FS_O_APPEND;
+        break;
+    case SPIF_BENCH_FS_MOUNT:
+        for (uint16_t i = 0; (ret == SPIF_SUCCESS) && (i < ctx->config->samples); i++) {
+            ret = spif_fs_mount(fs, &fs_config);
+        }
+        *ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+        return ret;
+    default:
+        break;
+    }
+
+    ret = spif_fs_open(fs, file, "/bench", flags);
+
+    for (uint32_t pos = 0; (ret == SPIF_SUCCESS) && (pos < size); pos += piece) {
+        switch (test) {
+        case SPIF_BENCH_FS_WRITE:
+            ret = spif_fs_write(fs, file, &s_spif_bench_stream_buf[pos % SPIF_BENCH_READ_SIZE_MAX], piece);
+            break;
+        case SPIF_BENCH_FS_READ:
+            ret = spif_fs_read(fs, file, s_spif_bench_buf, piece, &n);
+            if ((ret == SPIF_SUCCESS) && (n != piece)) {
+                ret = SPIF_FAIL;
+            }
+            break;
+        case SPIF_BENCH_FS_APPEND:
+            ret = spif_fs_write(fs, file, &s_spif_bench_stream_buf[pos % SPIF_BENCH_READ_SIZE_MAX], piece);
+            if (ret == SPIF_SUCCESS) {
+                ret = spif_fs_sync(fs, file);
+            }
+            break;
+        case SPIF_BENCH_FS_OVERWRITE:
+        default:
+            ret = spif_fs_seek(fs, file, _spif_bench_rand(ctx) % (spif_fs_size(fs, file) - piece + 1));
+            if (ret == SPIF_SUCCESS) {
+                ret = spif_fs_write(fs, file, &s_spif_bench_stream_buf[pos % SPIF_BENCH_READ_SIZE_MAX], piece);
+            }
+            if (ret == SPIF_SUCCESS) {
+                ret = spif_fs_sync(fs, file);
+            }
+            break;
+        }
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = spif_fs_close(fs, file);
+    }
+
+    *ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    return ret;
+}
+
+/* the same flash work done by hand in the raw half of the scratch area, returns its time in ns */
+static int _spif_bench_fs_raw(spif_bench_ctx_t *ctx, spif_bench_fs_test_t test, uint32_t piece, uint32_t size, uint64_t *ns)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = ctx->dev;
+    uint32_t sector_size = dev->flash.sector_size;
+    uint32_t page_size = dev->flash.page_size;
+    uint32_t raw_addr = ctx->config->addr + ctx->config->size / 2;
+    uint32_t meta_size = 0;
+    uint32_t n = 0;
+    uint64_t start = 0;
+
+    /* appends go to erased flash after the data of the write test */
+    if (test == SPIF_BENCH_FS_APPEND) {
+        raw_addr += ctx->config->size / 4;
+        ret = spif_erase_range(dev, raw_addr, (size + sector_size - 1) / sector_size * sector_size, NULL);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    spif_cache_invalidate(dev);
+    start = dev->plat_ops.timestamp();
+
+    switch (test) {
+    case SPIF_BENCH_FS_WRITE:
+        /* erased a sector at a time like the file system blocks, programmed a page at a time */
+        for (uint32_t pos = 0; (ret == SPIF_SUCCESS) && (pos < size); pos += sector_size) {
+            ret = spif_sector_erase(dev, raw_addr + pos);
+        }
+        for (uint32_t pos = 0; (ret == SPIF_SUCCESS) && (pos < size); pos += page_size) {
+            ret = spif_page_program(dev, raw_addr + pos, s_spif_bench_buf, page_size);
+        }
+        break;
+    case SPIF_BENCH_FS_READ:
+        for (uint32_t pos = 0; (ret == SPIF_SUCCESS) && (pos < size); pos += piece) {
+            ret = spif_fast_read(dev, raw_addr + pos, s_spif_bench_buf, piece);
+        }
+        break;
+    case SPIF_BENCH_FS_APPEND:
+        for (uint32_t pos = 0; (ret == SPIF_SUCCESS) && (pos < size); pos += piece) {
+            ret = spif_write(dev, raw_addr + pos, s_spif_bench_buf, piece, SPIF_WRITE_MODE_PROGRAM);
+        }
+        break;
+    case SPIF_BENCH_FS_OVERWRITE:
+        /* read-modify-write of the sector, not power loss safe */
+        for (uint32_t pos = 0; (ret == SPIF_SUCCESS) && (pos < size); pos += piece) {
+            ret = spif_write(dev, raw_addr + _spif_bench_rand(ctx) % (ctx->config->size / 4 - piece + 1), s_spif_bench_buf, piece,
+                             SPIF_WRITE_MODE_ERASE);
+        }
+        break;
+    case SPIF_BENCH_FS_MOUNT:
+    default:
+        /* the bytes a mount reads: one checkpoint and the whole journal */
+        meta_size = (s_spif_bench_fs.slot_blocks + s_spif_bench_fs.config.journal_blocks) * sector_size;
+        for (uint16_t i = 0; (ret == SPIF_SUCCESS) && (i < ctx->config->samples); i++) {
+            for (uint32_t pos = 0; (ret == SPIF_SUCCESS) && (pos < meta_size); pos += n) {
+                n = (meta_size - pos < SPIF_BENCH_READ_SIZE_MAX) ? (meta_size - pos) : SPIF_BENCH_READ_SIZE_MAX;
+                ret = spif_fast_read(dev, ctx->config->addr + pos, s_spif_bench_buf, n);
+            }
+        }
+        break;
+    }
+
+    *ns = _spif_bench_ns(dev, start, dev->plat_ops.timestamp());
+
+    return ret;
+}
+
+static int _spif_bench_fs_test(spif_bench_ctx_t *ctx, spif_bench_fs_test_t test, const char *name, uint32_t piece, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = ctx->dev;
+    uint64_t fs_ns = 0;
+    uint64_t raw_ns = 0;
+
+    ret = _spif_bench_fs_run(ctx, test, piece, size, &fs_ns);
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_fs_raw(ctx, test, piece, size, &raw_ns);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        dev->plat_ops.log("error,fs_%s,%u,%d\r\n", name, piece, ret);
+        return ret;
+    }
+
+    dev->plat_ops.log("fs,%s,%u,%u,%llu,%llu,%u\r\n", name, piece, size, (unsigned long long)fs_ns, (unsigned long long)raw_ns,
+                      (raw_ns > 0) ? (uint32_t)(fs_ns * 100 / raw_ns) : 0);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_bench_fs(spif_dev_t *dev, const spif_bench_config_t *config, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    static const uint32_t piece[] = {256, SPIF_BENCH_READ_SIZE_MAX};
+    static spif_bench_ctx_t ctx;
+    spif_fs_config_t fs_config = {&s_spif_bench_fs_bd, 0};
+    spif_fs_stats_t stats = {0};
+    uint32_t sector_size = 0;
+
+    if ((dev == NULL) || (config == NULL) || (dev->plat_ops.timestamp == NULL) || (dev->plat_ops.timestamp_hz == 0)) {
+        return SPIF_FAIL;
+    }
+
+    sector_size = dev->flash.sector_size;
+    if ((config->addr % SPIF_BENCH_BLOCK_SIZE != 0) || (config->size % SPIF_BENCH_BLOCK_SIZE != 0) || (config->samples == 0) ||
+        (size % SPIF_BENCH_READ_SIZE_MAX != 0) || (size == 0) || (size > config->size / 4) ||
+        ((uint64_t)config->samples * SPIF_BENCH_LZ_READ_SIZE > config->size / 4)) {
+        return SPIF_FAIL;
+    }
+
+    memset(&ctx, 0, sizeof(spif_bench_ctx_t));
+    ctx.dev = dev;
+    ctx.config = config;
+    ctx.rand = (config->seed != 0) ? config->seed : 1;
+
+    for (uint32_t i = 0; i < sizeof(s_spif_bench_stream_buf); i++) {
+        s_spif_bench_stream_buf[i] = (uint8_t)_spif_bench_rand(&ctx);
+    }
+    memcpy(s_spif_bench_buf, s_spif_bench_stream_buf, sizeof(s_spif_bench_buf));
+
+    /* the file system in the first half, raw spif in the second */
+    ret = spif_fs_bd_init(&s_spif_bench_fs_bd, dev, config->addr, config->size / 2);
+    if (ret == SPIF_SUCCESS) {
+        ret = spif_fs_format(&s_spif_bench_fs, &fs_config);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    dev->plat_ops.log("# spif_bench,%s,read_mode=%d,timestamp_hz=%u,sector=%u\r\n", dev->flash.name, spif_get_read_mode(dev),
+                      dev->plat_ops.timestamp_hz, sector_size);
+    dev->plat_ops.log("# fs,test,piece,bytes,fs_ns,raw_ns,factor_pct\r\n");
+
+    for (uint32_t i = 0; (ret == SPIF_SUCCESS) && (i < sizeof(piece) / sizeof(piece[0])); i++) {
+        ret = _spif_bench_fs_test(&ctx, SPIF_BENCH_FS_WRITE, "write", piece[i], size);
+        if (ret == SPIF_SUCCESS) {
+            ret = _spif_bench_fs_test(&ctx, SPIF_BENCH_FS_READ, "read", piece[i], size);
+        }
+    }
+
+    spif_fs_stats_reset(&s_spif_bench_fs);
+
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_fs_test(&ctx, SPIF_BENCH_FS_APPEND, "append_sync", SPIF_BENCH_LZ_READ_SIZE,
+                                  config->samples * SPIF_BENCH_LZ_READ_SIZE);
+    }
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_fs_test(&ctx, SPIF_BENCH_FS_OVERWRITE, "overwrite_sync", 256, config->samples * 256);
+    }
+
+    (void)spif_fs_stats_get(&s_spif_bench_fs, &stats);
+
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_bench_fs_test(&ctx, SPIF_BENCH_FS_MOUNT, "mount", 0, config->samples * s_spif_bench_fs.jpos);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        dev->plat_ops.log("fs,commits=%u,checkpoints=%u,erases=%u,programs=%u,cow_bytes=%u\r\n", stats.commits, stats.checkpoints,
+                          stats.erases, stats.programs, stats.cow_bytes);
+    }
+
+    return ret;
+}
@@ -0,0 +1,28 @@
+/*
+ * spif_crc.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include "spif_crc.h"
+
+/* 4-bit table, 64 bytes of flash instead of 1 KB */
+static const uint32_t s_spif_crc32_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t spif_crc32(uint32_t crc, const void *data, uint32_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    for (uint32_t i = 0; i < size; i++) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ s_spif_crc32_table[crc & 0x0F];
+        crc = (crc >> 4) ^ s_spif_crc32_table[crc & 0x0F];
+    }
+
+    return crc;
+}
@@ -0,0 +1,1520 @@
+/*
+ * spif_fs.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <stddef.h>
+#include <string.h>
+#include "spif.h"
+#include "spif_crc.h"
+#include "spif_fs.h"
+
+#define SPIF_FS_CHECKPOINT_MAGIC  0x50435346 /* "FSCP" */
+#define SPIF_FS_TX_MAGIC          0x58545346 /* "FSTX" */
+
+/* fat entries: the next block of the chain, or one of these */
+#define SPIF_FS_BLOCK_FREE        0xFFFF
+#define SPIF_FS_BLOCK_END         0xFFFE /* last block of a chain, as inode first: no block */
+#define SPIF_FS_BLOCK_PENDING     0xFFFD /* out of its chain, free once that is committed, RAM only */
+#define SPIF_FS_BLOCK_ALLOC       0xFFFC /* copy being written, not in a chain yet, RAM only */
+#define SPIF_FS_BLOCK_META        0xFFFB /* checkpoints and journal */
+
+#define SPIF_FS_INODE_NONE        0xFFFF
+
+#define SPIF_FS_SESSION_IN_PLACE  1
+#define SPIF_FS_SESSION_COPY      2
+
+typedef struct spif_fs_checkpoint_s {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t block_count;
+    uint16_t inodes;
+    uint16_t cursor;
+    uint32_t data_size; /* inode table, then the fat */
+    uint32_t data_crc;
+    uint32_t reserved;
+    uint32_t crc;       /* of the header up to here */
+} spif_fs_checkpoint_t;
+
+/* followed by inodes * (index, inode), fats * (index, entry) and the crc of it all */
+typedef struct spif_fs_tx_s {
+    uint32_t magic;
+    uint32_t seq;       /* of the checkpoint it goes on */
+    uint16_t inodes;
+    uint16_t fats;
+} spif_fs_tx_t;
+
+#define SPIF_FS_TX_INODE_SIZE     (2 + sizeof(spif_fs_inode_t))
+#define SPIF_FS_TX_FAT_SIZE       4
+
+/* sequential access to the bytes of consecutive blocks (a checkpoint slot, the journal) through fs->buf */
+typedef struct {
+    uint16_t start;     /* first block */
+    uint32_t pos;       /* offset of buf[0] */
+    uint32_t fill;      /* writer: bytes in buf, reader: bytes of buf read from flash */
+    uint32_t next;      /* reader: offset of the next byte */
+    uint32_t crc;
+} spif_fs_io_t;
+
+static int _spif_fs_read(spif_fs_t *fs, uint32_t block, uint32_t offset, void *data, uint32_t size)
+{
+    return fs->config.bd->read(fs->config.bd, block, offset, data, size);
+}
+
+static int _spif_fs_prog(spif_fs_t *fs, uint32_t block, uint32_t offset, const void *data, uint32_t size)
+{
+    if ((fs->rcache_size > 0) && (fs->rcache_block == block)) {
+        fs->rcache_size = 0;
+    }
+
+    fs->stats.programs++;
+
+    return fs->config.bd->prog(fs->config.bd, block, offset, data, size);
+}
+
+static int _spif_fs_erase(spif_fs_t *fs, uint32_t block)
+{
+    if ((fs->rcache_size > 0) && (fs->rcache_block == block)) {
+        fs->rcache_size = 0;
+    }
+
+    fs->stats.erases++;
+
+    return fs->config.bd->erase(fs->config.bd, block);
+}
+
+/* the bytes [offset, offset + size) of consecutive blocks from start */
+static int _spif_fs_area_read(spif_fs_t *fs, uint32_t start, uint32_t offset, void *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t block_size = fs->config.bd->block_size;
+    uint8_t *p = (uint8_t *)data;
+    uint32_t n = 0;
+
+    for (; size > 0; offset += n, p += n, size -= n) {
+        n = block_size - offset % block_size;
+        if (n > size) {
+            n = size;
+        }
+
+        ret = _spif_fs_read(fs, start + offset / block_size, offset % block_size, p, n);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_fs_area_prog(spif_fs_t *fs, uint32_t start, uint32_t offset, const void *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t block_size = fs->config.bd->block_size;
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t n = 0;
+
+    for (; size > 0; offset += n, p += n, size -= n) {
+        n = block_size - offset % block_size;
+        if (n > size) {
+            n = size;
+        }
+
+        ret = _spif_fs_prog(fs, start + offset / block_size, offset % block_size, p, n);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_fs_io_flush(spif_fs_t *fs, spif_fs_io_t *io)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (io->fill > 0) {
+        ret = _spif_fs_area_prog(fs, io->start, io->pos, fs->buf, io->fill);
+        io->pos += io->fill;
+        io->fill = 0;
+    }
+
+    return ret;
+}
+
+static int _spif_fs_io_put(spif_fs_t *fs, spif_fs_io_t *io, const void *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t n = 0;
+
+    io->crc = spif_crc32(io->crc, data, size);
+
+    for (; size > 0; p += n, size -= n) {
+        n = sizeof(fs->buf) - io->fill;
+        if (n > size) {
+            n = size;
+        }
+
+        memcpy(&fs->buf[io->fill], p, n);
+        io->fill += n;
+
+        if (io->fill == sizeof(fs->buf)) {
+            ret = _spif_fs_io_flush(fs, io);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
+
+/* limit: the reader never fetches bytes at or past it */
+static int _spif_fs_io_get(spif_fs_t *fs, spif_fs_io_t *io, void *data, uint32_t size, uint32_t limit)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t *p = (uint8_t *)data;
+    uint32_t n = 0;
+
+    for (; size > 0; p += n, size -= n) {
+        if ((io->next < io->pos) || (io->next >= io->pos + io->fill)) {
+            n = limit - io->next;
+            if (n > sizeof(fs->buf)) {
+                n = sizeof(fs->buf);
+            }
+
+            ret = _spif_fs_area_read(fs, io->start, io->next, fs->buf, n);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+
+            io->pos = io->next;
+            io->fill = n;
+        }
+
+        n = io->pos + io->fill - io->next;
+        if (n > size) {
+            n = size;
+        }
+
+        memcpy(p, &fs->buf[io->next - io->pos], n);
+        io->crc = spif_crc32(io->crc, p, n);
+        io->next += n;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static void _spif_fs_fat_set(spif_fs_t *fs, uint16_t block, uint16_t next)
+{
+    fs->fat[block] = next;
+    fs->fat_dirty[block / 32] |= 1UL << (block % 32);
+}
+
+static void _spif_fs_inode_dirty(spif_fs_t *fs, uint16_t inode)
+{
+    fs->inode_dirty[inode / 32] |= 1UL << (inode % 32);
+}
+
+/* the fat entry as committed, the RAM only states are free blocks on flash */
+static uint16_t _spif_fs_fat_flash(uint16_t next)
+{
+    return ((next == SPIF_FS_BLOCK_PENDING) || (next == SPIF_FS_BLOCK_ALLOC)) ? SPIF_FS_BLOCK_FREE : next;
+}
+
+/* the metadata in RAM is on flash: blocks out of a chain can be used again */
+static void _spif_fs_committed(spif_fs_t *fs)
+{
+    memset(fs->fat_dirty, 0, sizeof(fs->fat_dirty));
+    memset(fs->inode_dirty, 0, sizeof(fs->inode_dirty));
+
+    for (uint32_t i = fs->data_start; i < fs->config.bd->block_count; i++) {
+        if (fs->fat[i] == SPIF_FS_BLOCK_PENDING) {
+            fs->fat[i] = SPIF_FS_BLOCK_FREE;
+        }
+    }
+}
+
+static uint32_t _spif_fs_journal_size(spif_fs_t *fs)
+{
+    return fs->config.journal_blocks * fs->config.bd->block_size;
+}
+
+static int _spif_fs_checkpoint_write(spif_fs_t *fs)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_fs_checkpoint_t checkpoint;
+    spif_fs_io_t io = {0};
+    uint16_t fat[32];
+    uint32_t n = 0;
+    uint8_t slot = !fs->slot;
+
+    io.start = slot * fs->slot_blocks;
+    io.pos = sizeof(spif_fs_checkpoint_t);
+    io.crc = SPIF_CRC32_INIT;
+
+    for (uint32_t i = 0; i < fs->slot_blocks; i++) {
+        ret = _spif_fs_erase(fs, io.start + i);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    ret = _spif_fs_io_put(fs, &io, fs->inode, sizeof(fs->inode));
+
+    for (uint32_t i = 0; (ret == SPIF_SUCCESS) && (i < fs->config.bd->block_count); i += n) {
+        n = fs->config.bd->block_count - i;
+        if (n > sizeof(fat) / sizeof(fat[0])) {
+            n = sizeof(fat) / sizeof(fat[0]);
+        }
+
+        for (uint32_t j = 0; j < n; j++) {
+            fat[j] = _spif_fs_fat_flash(fs->fat[i + j]);
+        }
+
+        ret = _spif_fs_io_put(fs, &io, fat, n * sizeof(fat[0]));
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_fs_io_flush(fs, &io);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    memset(&checkpoint, 0xFF, sizeof(spif_fs_checkpoint_t));
+    checkpoint.magic = SPIF_FS_CHECKPOINT_MAGIC;
+    checkpoint.seq = fs->seq + 1;
+    checkpoint.block_count = fs->config.bd->block_count;
+    checkpoint.inodes = SPIF_FS_INODES_MAX;
+    checkpoint.cursor = fs->cursor;
+    checkpoint.data_size = io.pos - sizeof(spif_fs_checkpoint_t);
+    checkpoint.data_crc = io.crc ^ SPIF_CRC32_INIT;
+    checkpoint.crc = spif_crc32(SPIF_CRC32_INIT, &checkpoint, offsetof(spif_fs_checkpoint_t, crc)) ^ SPIF_CRC32_INIT;
+
+    /* the commit, the journal of the older checkpoint does not apply to it (seq) and is erased after */
+    ret = _spif_fs_area_prog(fs, io.start, 0, &checkpoint, sizeof(spif_fs_checkpoint_t));
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    fs->slot = slot;
+    fs->seq = checkpoint.seq;
+    fs->stats.checkpoints++;
+    _spif_fs_committed(fs);
+
+    for (uint32_t i = 0; i < fs->config.journal_blocks; i++) {
+        ret = _spif_fs_erase(fs, fs->journal_start + i);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    fs->jpos = 0;
+
+    return SPIF_SUCCESS;
+}
+
+/* append the changed entries to the journal as one transaction, a checkpoint if they do not fit */
+static int _spif_fs_commit(spif_fs_t *fs)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_fs_tx_t tx;
+    spif_fs_io_t io = {0};
+    uint16_t entry[2];
+    uint32_t size = 0;
+    uint32_t crc = 0;
+
+    tx.magic = SPIF_FS_TX_MAGIC;
+    tx.seq = fs->seq;
+    tx.inodes = 0;
+    tx.fats = 0;
+
+    for (uint32_t i = 0; i < SPIF_FS_INODES_MAX; i++) {
+        tx.inodes += (fs->inode_dirty[i / 32] >> (i % 32)) & 1;
+    }
+
+    for (uint32_t i = 0; i < fs->config.bd->block_count; i++) {
+        tx.fats += (fs->fat_dirty[i / 32] >> (i % 32)) & 1;
+    }
+
+    if ((tx.inodes == 0) && (tx.fats == 0)) {
+        return SPIF_SUCCESS;
+    }
+
+    size = sizeof(spif_fs_tx_t) + tx.inodes * SPIF_FS_TX_INODE_SIZE + tx.fats * SPIF_FS_TX_FAT_SIZE + sizeof(crc);
+    if ((uint64_t)fs->jpos + size > _spif_fs_journal_size(fs)) {
+        return _spif_fs_checkpoint_write(fs);
+    }
+
+    io.start = fs->journal_start;
+    io.pos = fs->jpos;
+    io.crc = SPIF_CRC32_INIT;
+
+    ret = _spif_fs_io_put(fs, &io, &tx, sizeof(spif_fs_tx_t));
+
+    for (uint16_t i = 0; (ret == SPIF_SUCCESS) && (i < SPIF_FS_INODES_MAX); i++) {
+        if ((fs->inode_dirty[i / 32] >> (i % 32)) & 1) {
+            ret = _spif_fs_io_put(fs, &io, &i, sizeof(i));
+            if (ret == SPIF_SUCCESS) {
+                ret = _spif_fs_io_put(fs, &io, &fs->inode[i], sizeof(spif_fs_inode_t));
+            }
+        }
+    }
+
+    for (uint32_t i = 0; (ret == SPIF_SUCCESS) && (i < fs->config.bd->block_count); i++) {
+        if ((fs->fat_dirty[i / 32] >> (i % 32)) & 1) {
+            entry[0] = (uint16_t)i;
+            entry[1] = _spif_fs_fat_flash(fs->fat[i]);
+            ret = _spif_fs_io_put(fs, &io, entry, sizeof(entry));
+        }
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        crc = io.crc ^ SPIF_CRC32_INIT;
+        ret = _spif_fs_io_put(fs, &io, &crc, sizeof(crc));
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_fs_io_flush(fs, &io);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    fs->jpos += size;
+    fs->stats.commits++;
+    fs->stats.journal_bytes += size;
+    _spif_fs_committed(fs);
+
+    return SPIF_SUCCESS;
+}
+
+/* apply the transactions of the checkpoint in use, stop at the first one torn or of another checkpoint */
+static int _spif_fs_replay(spif_fs_t *fs)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_fs_tx_t tx;
+    spif_fs_io_t io = {0};
+    uint32_t limit = _spif_fs_journal_size(fs);
+    uint32_t size = 0;
+    uint32_t crc = 0;
+    uint16_t index = 0;
+    uint16_t entry[2];
+    uint8_t chunk[16];
+    uint32_t n = 0;
+
+    io.start = fs->journal_start;
+
+    while ((uint64_t)fs->jpos + sizeof(spif_fs_tx_t) + sizeof(crc) <= limit) {
+        io.next = fs->jpos;
+        io.crc = SPIF_CRC32_INIT;
+
+        ret = _spif_fs_io_get(fs, &io, &tx, sizeof(spif_fs_tx_t), limit);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        size = sizeof(spif_fs_tx_t) + tx.inodes * SPIF_FS_TX_INODE_SIZE + tx.fats * SPIF_FS_TX_FAT_SIZE + sizeof(crc);
+        if ((tx.magic != SPIF_FS_TX_MAGIC) || (tx.seq != fs->seq) || (tx.inodes > SPIF_FS_INODES_MAX) ||
+            (tx.fats > fs->config.bd->block_count) || ((uint64_t)fs->jpos + size > limit)) {
+            break;
+        }
+
+        /* check the whole transaction before applying any of it */
+        for (uint32_t pos = sizeof(spif_fs_tx_t); (ret == SPIF_SUCCESS) && (pos < size - sizeof(crc)); pos += n) {
+            n = size - sizeof(crc) - pos;
+            if (n > sizeof(chunk)) {
+                n = sizeof(chunk);
+            }
+            ret = _spif_fs_io_get(fs, &io, chunk, n, limit);
+        }
+
+        crc = io.crc ^ SPIF_CRC32_INIT;
+        if (ret == SPIF_SUCCESS) {
+            ret = _spif_fs_io_get(fs, &io, chunk, sizeof(crc), limit);
+        }
+
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        if (memcmp(&crc, chunk, sizeof(crc)) != 0) {
+            break;
+        }
+
+        io.next = fs->jpos + sizeof(spif_fs_tx_t);
+
+        for (uint16_t i = 0; (ret == SPIF_SUCCESS) && (i < tx.inodes); i++) {
+            ret = _spif_fs_io_get(fs, &io, &index, sizeof(index), limit);
+            if ((ret == SPIF_SUCCESS) && (index < SPIF_FS_INODES_MAX)) {
+                ret = _spif_fs_io_get(fs, &io, &fs->inode[index], sizeof(spif_fs_inode_t), limit);
+            }
+        }
+
+        for (uint16_t i = 0; (ret == SPIF_SUCCESS) && (i < tx.fats); i++) {
+            ret = _spif_fs_io_get(fs, &io, entry, sizeof(entry), limit);
+            if ((ret == SPIF_SUCCESS) && (entry[0] < fs->config.bd->block_count)) {
+                fs->fat[entry[0]] = entry[1];
+            }
+        }
+
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        fs->jpos += size;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_fs_setup(spif_fs_t *fs, const spif_fs_config_t *config)
+{
+    spif_fs_bd_t *bd = NULL;
+    uint32_t meta_size = 0;
+    uint16_t journal_blocks = 0;
+
+    if ((fs == NULL) || (config == NULL) || (config->bd == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    bd = config->bd;
+    if ((bd->read == NULL) || (bd->prog == NULL) || (bd->erase == NULL) || (bd->block_size < sizeof(fs->buf)) ||
+        (bd->block_count > SPIF_FS_BLOCKS_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    journal_blocks = (config->journal_blocks > 0) ? config->journal_blocks : 2;
+    meta_size = sizeof(spif_fs_checkpoint_t) + sizeof(fs->inode) + bd->block_count * sizeof(fs->fat[0]);
+
+    memset(fs, 0, sizeof(spif_fs_t));
+    fs->config = *config;
+    fs->config.journal_blocks = journal_blocks;
+    fs->slot_blocks = (meta_size + bd->block_size - 1) / bd->block_size;
+    fs->journal_start = 2 * fs->slot_blocks;
+    fs->data_start = fs->journal_start + journal_blocks;
+
+    if (fs->data_start >= bd->block_count) {
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_fs_format(spif_fs_t *fs, const spif_fs_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_fs_setup(fs, config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    for (uint32_t i = 0; i < fs->config.bd->block_count; i++) {
+        fs->fat[i] = (i < fs->data_start) ? SPIF_FS_BLOCK_META : SPIF_FS_BLOCK_FREE;
+    }
+
+    fs->inode[0].type = SPIF_FS_TYPE_DIR;
+    fs->inode[0].first = SPIF_FS_BLOCK_END;
+    fs->cursor = fs->data_start;
+
+    /* the checkpoint goes to slot 0, slot 1 may hold one of an older file system with a higher seq */
+    fs->slot = 1;
+    for (uint32_t i = 0; i < fs->slot_blocks; i++) {
+        ret = _spif_fs_erase(fs, fs->slot_blocks + i);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return _spif_fs_checkpoint_write(fs);
+}
+
+/* seq a is newer than seq b, wraps around */
+static int _spif_fs_newer(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+static int _spif_fs_checkpoint_load(spif_fs_t *fs, uint8_t slot, const spif_fs_checkpoint_t *checkpoint)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t start = slot * fs->slot_blocks;
+    uint32_t fat_size = fs->config.bd->block_count * sizeof(fs->fat[0]);
+    uint32_t crc = SPIF_CRC32_INIT;
+
+    ret = _spif_fs_area_read(fs, start, sizeof(spif_fs_checkpoint_t), fs->inode, sizeof(fs->inode));
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_fs_area_read(fs, start, sizeof(spif_fs_checkpoint_t) + sizeof(fs->inode), fs->fat, fat_size);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    crc = spif_crc32(crc, fs->inode, sizeof(fs->inode));
+    crc = spif_crc32(crc, fs->fat, fat_size);
+
+    return ((crc ^ SPIF_CRC32_INIT) == checkpoint->data_crc) ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+int spif_fs_mount(spif_fs_t *fs, const spif_fs_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_fs_checkpoint_t checkpoint[2];
+    int good[2] = {0};
+    uint8_t order[2] = {0, 1};
+    uint8_t slot = 0;
+    uint32_t limit = 0;
+    uint32_t n = 0;
+
+    ret = _spif_fs_setup(fs, config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    for (slot = 0; slot < 2; slot++) {
+        ret = _spif_fs_area_read(fs, slot * fs->slot_blocks, 0, &checkpoint[slot], sizeof(spif_fs_checkpoint_t));
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        good[slot] = (checkpoint[slot].magic == SPIF_FS_CHECKPOINT_MAGIC) &&
+                     ((spif_crc32(SPIF_CRC32_INIT, &checkpoint[slot], offsetof(spif_fs_checkpoint_t, crc)) ^ SPIF_CRC32_INIT) ==
+                      checkpoint[slot].crc) &&
+                     (checkpoint[slot].block_count == config->bd->block_count) && (checkpoint[slot].inodes == SPIF_FS_INODES_MAX) &&
+                     (checkpoint[slot].data_size == sizeof(fs->inode) + config->bd->block_count * sizeof(fs->fat[0]));
+    }
+
+    if (good[0] && good[1] && _spif_fs_newer(checkpoint[1].seq, checkpoint[0].seq)) {
+        order[0] = 1;
+        order[1] = 0;
+    }
+
+    ret = SPIF_FAIL;
+    for (uint8_t i = 0; (i < 2) && (ret != SPIF_SUCCESS); i++) {
+        slot = order[i];
+        if (good[slot]) {
+            ret = _spif_fs_checkpoint_load(fs, slot, &checkpoint[slot]);
+        }
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return SPIF_FAIL;
+    }
+
+    fs->slot = slot;
+    fs->seq = checkpoint[slot].seq;
+    fs->cursor = checkpoint[slot].cursor;
+
+    ret = _spif_fs_replay(fs);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    /* appends need erased journal after the last transaction, a torn or stale one is left: start over */
+    limit = _spif_fs_journal_size(fs);
+    for (uint32_t pos = fs->jpos; pos < limit; pos += n) {
+        n = (limit - pos < sizeof(fs->buf)) ? (limit - pos) : sizeof(fs->buf);
+
+        ret = _spif_fs_area_read(fs, fs->journal_start, pos, fs->buf, n);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (fs->buf[i] != 0xFF) {
+                return _spif_fs_checkpoint_write(fs);
+            }
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_fs_checkpoint(spif_fs_t *fs)
+{
+    if (fs == NULL) {
+        return SPIF_FAIL;
+    }
+
+    return _spif_fs_checkpoint_write(fs);
+}
+
+/* take a free block and erase it, it is SPIF_FS_BLOCK_ALLOC until it goes into a chain */
+static int _spif_fs_alloc(spif_fs_t *fs, uint16_t *block)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t count = fs->config.bd->block_count - fs->data_start;
+    uint32_t b = 0;
+    uint8_t pending = 0;
+
+    for (uint8_t round = 0; round < 2; round++) {
+        for (uint32_t i = 0; i < count; i++) {
+            b = fs->data_start + (fs->cursor - fs->data_start + i) % count;
+
+            if (fs->fat[b] == SPIF_FS_BLOCK_PENDING) {
+                pending = 1;
+            }
+
+            if (fs->fat[b] != SPIF_FS_BLOCK_FREE) {
+                continue;
+            }
+
+            ret = _spif_fs_erase(fs, b);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+
+            fs->fat[b] = SPIF_FS_BLOCK_ALLOC;
+            fs->cursor = (b + 1 < fs->config.bd->block_count) ? (b + 1) : fs->data_start;
+            *block = (uint16_t)b;
+
+            return SPIF_SUCCESS;
+        }
+
+        /* blocks dropped since the last commit are free after one */
+        if (!pending) {
+            break;
+        }
+
+        ret = _spif_fs_commit(fs);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return SPIF_FAIL;
+}
+
+static void _spif_fs_chain_free(spif_fs_t *fs, uint16_t inode)
+{
+    uint16_t block = fs->inode[inode].first;
+    uint16_t next = 0;
+
+    while (block < fs->config.bd->block_count) {
+        next = fs->fat[block];
+        _spif_fs_fat_set(fs, block, SPIF_FS_BLOCK_PENDING);
+        block = next;
+    }
+
+    fs->inode[inode].first = SPIF_FS_BLOCK_END;
+    fs->generation++;
+}
+
+/* block index of the chain of a file, SPIF_FS_BLOCK_END past the end, prev: the one before (or END) */
+static uint16_t _spif_fs_block_at(spif_fs_t *fs, uint16_t inode, uint32_t index, uint16_t *prev)
+{
+    uint16_t block = fs->inode[inode].first;
+
+    *prev = SPIF_FS_BLOCK_END;
+
+    for (uint32_t i = 0; (i < index) && (block < fs->config.bd->block_count); i++) {
+        *prev = block;
+        block = fs->fat[block];
+    }
+
+    return (block < fs->config.bd->block_count) ? block : SPIF_FS_BLOCK_END;
+}
+
+/* bytes of the file in block index of its chain */
+static uint32_t _spif_fs_block_valid(spif_fs_t *fs, uint32_t size, uint32_t index)
+{
+    uint32_t block_size = fs->config.bd->block_size;
+    uint32_t start = index * block_size;
+
+    if (size <= start) {
+        return 0;
+    }
+
+    return (size - start < block_size) ? (size - start) : block_size;
+}
+
+static uint32_t _spif_fs_file_size(spif_fs_t *fs, spif_fs_file_t *file)
+{
+    uint32_t size = fs->inode[file->inode].size;
+    uint32_t end = file->windex * fs->config.bd->block_size + file->cache_offset + file->cache_fill;
+
+    return ((file->session != 0) && (end > size)) ? end : size;
+}
+
+/* copy [offset, offset + size) of block from to block to through the file's cache, blank pieces are skipped */
+static int _spif_fs_copy(spif_fs_t *fs, spif_fs_file_t *file, uint16_t from, uint16_t to, uint32_t offset, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t n = 0;
+    uint32_t blank = 0;
+
+    for (; size > 0; offset += n, size -= n) {
+        n = (size < sizeof(file->cache)) ? size : sizeof(file->cache);
+
+        ret = _spif_fs_read(fs, from, offset, file->cache, n);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        for (blank = 0; (blank < n) && (file->cache[blank] == 0xFF); blank++) {
+        }
+
+        if (blank < n) {
+            ret = _spif_fs_prog(fs, to, offset, file->cache, n);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+
+        fs->stats.cow_bytes += n;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+/* the bytes of block from offset on are erased, read through the file's cache */
+static int _spif_fs_blank(spif_fs_t *fs, spif_fs_file_t *file, uint16_t block, uint32_t offset, uint8_t *blank)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t n = 0;
+
+    *blank = 0;
+
+    for (; offset < fs->config.bd->block_size; offset += n) {
+        n = fs->config.bd->block_size - offset;
+        if (n > sizeof(file->cache)) {
+            n = sizeof(file->cache);
+        }
+
+        ret = _spif_fs_read(fs, block, offset, file->cache, n);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (file->cache[i] != 0xFF) {
+                return SPIF_SUCCESS;
+            }
+        }
+    }
+
+    *blank = 1;
+
+    return SPIF_SUCCESS;
+}
+
+/* program the cache, an in-place block grows the file right away, a copy only once it replaces the old block */
+static int _spif_fs_flush(spif_fs_t *fs, spif_fs_file_t *file)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_fs_inode_t *node = &fs->inode[file->inode];
+    uint32_t end = 0;
+
+    if (file->cache_fill == 0) {
+        return SPIF_SUCCESS;
+    }
+
+    ret = _spif_fs_prog(fs, file->wblock, file->cache_offset, file->cache, file->cache_fill);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    file->cache_offset += file->cache_fill;
+    file->cache_fill = 0;
+
+    end = file->windex * fs->config.bd->block_size + file->cache_offset;
+    if ((file->session == SPIF_FS_SESSION_IN_PLACE) && (end > node->size)) {
+        node->size = end;
+        _spif_fs_inode_dirty(fs, file->inode);
+    }
+
+    return SPIF_SUCCESS;
+}
+
+/* start writing block index of the file at offset */
+static int _spif_fs_session_open(spif_fs_t *fs, spif_fs_file_t *file, uint32_t index, uint32_t offset)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_fs_inode_t *node = &fs->inode[file->inode];
+    uint16_t prev = 0;
+    uint16_t block = _spif_fs_block_at(fs, file->inode, index, &prev);
+    uint16_t copy = 0;
+    uint32_t valid = 0;
+    uint8_t blank = 0;
+
+    file->windex = index;
+    file->cache_offset = offset;
+    file->cache_fill = 0;
+
+    /* past the chain (offset is 0): a new block at its end, written in place */
+    if (block == SPIF_FS_BLOCK_END) {
+        ret = _spif_fs_alloc(fs, &copy);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        if (prev == SPIF_FS_BLOCK_END) {
+            node->first = copy;
+            _spif_fs_inode_dirty(fs, file->inode);
+        } else {
+            _spif_fs_fat_set(fs, prev, copy);
+        }
+        _spif_fs_fat_set(fs, copy, SPIF_FS_BLOCK_END);
+
+        file->session = SPIF_FS_SESSION_IN_PLACE;
+        file->wblock = copy;
+
+        return SPIF_SUCCESS;
+    }
+
+    /* an append goes into the tail of the block unless a power loss left bytes there */
+    valid = _spif_fs_block_valid(fs, node->size, index);
+    if (offset == valid) {
+        ret = _spif_fs_blank(fs, file, block, offset, &blank);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        if (blank) {
+            file->session = SPIF_FS_SESSION_IN_PLACE;
+            file->wblock = block;
+            return SPIF_SUCCESS;
+        }
+    }
+
+    /* an overwrite: a copy of the block with the bytes before offset, the rest follows at the end */
+    ret = _spif_fs_alloc(fs, &copy);
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_fs_copy(fs, file, block, copy, 0, offset);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    file->session = SPIF_FS_SESSION_COPY;
+    file->wblock = copy;
+    file->wold = block;
+
+    return SPIF_SUCCESS;
+}
+
+/* program the cache, a copy gets the rest of the old block and takes its place in the chain */
+static int _spif_fs_session_end(spif_fs_t *fs, spif_fs_file_t *file)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_fs_inode_t *node = &fs->inode[file->inode];
+    uint16_t prev = 0;
+    uint32_t valid = 0;
+    uint32_t end = 0;
+
+    if (file->session == 0) {
+        return SPIF_SUCCESS;
+    }
+
+    ret = _spif_fs_flush(fs, file);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (file->session == SPIF_FS_SESSION_COPY) {
+        valid = _spif_fs_block_valid(fs, node->size, file->windex);
+        if (file->cache_offset < valid) {
+            ret = _spif_fs_copy(fs, file, file->wold, file->wblock, file->cache_offset, valid - file->cache_offset);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+
+        (void)_spif_fs_block_at(fs, file->inode, file->windex, &prev);
+        if (prev == SPIF_FS_BLOCK_END) {
+            node->first = file->wblock;
+        } else {
+            _spif_fs_fat_set(fs, prev, file->wblock);
+        }
+        _spif_fs_fat_set(fs, file->wblock, fs->fat[file->wold]);
+        _spif_fs_fat_set(fs, file->wold, SPIF_FS_BLOCK_PENDING);
+        fs->generation++;
+
+        end = file->windex * fs->config.bd->block_size + file->cache_offset;
+        if (end > node->size) {
+            node->size = end;
+        }
+        _spif_fs_inode_dirty(fs, file->inode);
+    }
+
+    file->session = 0;
+
+    return SPIF_SUCCESS;
+}
+
+/* the child of dir named [name, name + len), SPIF_FS_INODE_NONE if none */
+static uint16_t _spif_fs_child(spif_fs_t *fs, uint16_t dir, const char *name, uint32_t len)
+{
+    for (uint16_t i = 1; i < SPIF_FS_INODES_MAX; i++) {
+        if ((fs->inode[i].type != SPIF_FS_TYPE_NONE) && (fs->inode[i].parent == dir) &&
+            (strncmp(fs->inode[i].name, name, len) == 0) && (fs->inode[i].name[len] == '\0')) {
+            return i;
+        }
+    }
+
+    return SPIF_FS_INODE_NONE;
+}
+
+/**
+ * walk the path, inode: SPIF_FS_INODE_NONE if it does not exist, then parent and name are the
+ * directory and the name it would have (parent SPIF_FS_INODE_NONE if a directory on the way is missing)
+ */
+static int _spif_fs_lookup(spif_fs_t *fs, const char *path, uint16_t *inode, uint16_t *parent, const char **name, uint32_t *len)
+{
+    uint16_t cur = 0;
+    uint32_t n = 0;
+
+    *inode = 0;
+    *parent = SPIF_FS_INODE_NONE;
+
+    if ((fs == NULL) || (path == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    while (1) {
+        while (*path == '/') {
+            path++;
+        }
+
+        if (*path == '\0') {
+            return SPIF_SUCCESS;
+        }
+
+        for (n = 0; (path[n] != '\0') && (path[n] != '/'); n++) {
+        }
+
+        if ((n > SPIF_FS_NAME_MAX) || (fs->inode[cur].type != SPIF_FS_TYPE_DIR)) {
+            *inode = SPIF_FS_INODE_NONE;
+            return SPIF_FAIL;
+        }
+
+        *parent = cur;
+        *name = path;
+        *len = n;
+        cur = _spif_fs_child(fs, cur, path, n);
+        *inode = cur;
+        path += n;
+
+        if (cur == SPIF_FS_INODE_NONE) {
+            while (*path == '/') {
+                path++;
+            }
+            if (*path != '\0') {
+                *parent = SPIF_FS_INODE_NONE;
+            }
+            return SPIF_SUCCESS;
+        }
+    }
+}
+
+static int _spif_fs_create(spif_fs_t *fs, uint16_t parent, const char *name, uint32_t len, uint8_t type, uint16_t *inode)
+{
+    for (uint16_t i = 1; i < SPIF_FS_INODES_MAX; i++) {
+        if (fs->inode[i].type != SPIF_FS_TYPE_NONE) {
+            continue;
+        }
+
+        memset(&fs->inode[i], 0, sizeof(spif_fs_inode_t));
+        fs->inode[i].type = type;
+        fs->inode[i].parent = parent;
+        fs->inode[i].first = SPIF_FS_BLOCK_END;
+        memcpy(fs->inode[i].name, name, len);
+        _spif_fs_inode_dirty(fs, i);
+        *inode = i;
+
+        return SPIF_SUCCESS;
+    }
+
+    return SPIF_FAIL;
+}
+
+int spif_fs_mkdir(spif_fs_t *fs, const char *path)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint16_t inode = 0;
+    uint16_t parent = 0;
+    const char *name = NULL;
+    uint32_t len = 0;
+
+    ret = _spif_fs_lookup(fs, path, &inode, &parent, &name, &len);
+    if ((ret != SPIF_SUCCESS) || (inode != SPIF_FS_INODE_NONE) || (parent == SPIF_FS_INODE_NONE)) {
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_fs_create(fs, parent, name, len, SPIF_FS_TYPE_DIR, &inode);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    return _spif_fs_commit(fs);
+}
+
+int spif_fs_remove(spif_fs_t *fs, const char *path)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint16_t inode = 0;
+    uint16_t parent = 0;
+    const char *name = NULL;
+    uint32_t len = 0;
+
+    ret = _spif_fs_lookup(fs, path, &inode, &parent, &name, &len);
+    if ((ret != SPIF_SUCCESS) || (inode == SPIF_FS_INODE_NONE) || (inode == 0)) {
+        return SPIF_FAIL;
+    }
+
+    if (fs->inode[inode].type == SPIF_FS_TYPE_DIR) {
+        for (uint16_t i = 1; i < SPIF_FS_INODES_MAX; i++) {
+            if ((fs->inode[i].type != SPIF_FS_TYPE_NONE) && (fs->inode[i].parent == inode)) {
+                return SPIF_FAIL;
+            }
+        }
+    } else {
+        _spif_fs_chain_free(fs, inode);
+    }
+
+    memset(&fs->inode[inode], 0, sizeof(spif_fs_inode_t));
+    _spif_fs_inode_dirty(fs, inode);
+
+    return _spif_fs_commit(fs);
+}
+
+static void _spif_fs_info(spif_fs_t *fs, uint16_t inode, spif_fs_info_t *info)
+{
+    info->type = fs->inode[inode].type;
+    info->size = fs->inode[inode].size;
+    memcpy(info->name, fs->inode[inode].name, sizeof(info->name));
+}
+
+int spif_fs_stat(spif_fs_t *fs, const char *path, spif_fs_info_t *info)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint16_t inode = 0;
+    uint16_t parent = 0;
+    const char *name = NULL;
+    uint32_t len = 0;
+
+    ret = _spif_fs_lookup(fs, path, &inode, &parent, &name, &len);
+    if ((ret != SPIF_SUCCESS) || (inode == SPIF_FS_INODE_NONE) || (info == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    _spif_fs_info(fs, inode, info);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_fs_dir_open(spif_fs_t *fs, spif_fs_dir_t *dir, const char *path)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint16_t inode = 0;
+    uint16_t parent = 0;
+    const char *name = NULL;
+    uint32_t len = 0;
+
+    ret = _spif_fs_lookup(fs, path, &inode, &parent, &name, &len);
+    if ((ret != SPIF_SUCCESS) || (inode == SPIF_FS_INODE_NONE) || (dir == NULL) || (fs->inode[inode].type != SPIF_FS_TYPE_DIR)) {
+        return SPIF_FAIL;
+    }
+
+    dir->inode = inode;
+    dir->next = 1;
+
+    return SPIF_SUCCESS;
+}
+
+int spif_fs_dir_read(spif_fs_t *fs, spif_fs_dir_t *dir, spif_fs_info_t *info)
+{
+    if ((fs == NULL) || (dir == NULL) || (info == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    for (; dir->next < SPIF_FS_INODES_MAX; dir->next++) {
+        if ((fs->inode[dir->next].type != SPIF_FS_TYPE_NONE) && (fs->inode[dir->next].parent == dir->inode)) {
+            _spif_fs_info(fs, dir->next, info);
+            dir->next++;
+            return SPIF_SUCCESS;
+        }
+    }
+
+    memset(info, 0, sizeof(spif_fs_info_t));
+
+    return SPIF_SUCCESS;
+}
+
+int spif_fs_open(spif_fs_t *fs, spif_fs_file_t *file, const char *path, uint8_t flags)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint16_t inode = 0;
+    uint16_t parent = 0;
+    const char *name = NULL;
+    uint32_t len = 0;
+
+    ret = _spif_fs_lookup(fs, path, &inode, &parent, &name, &len);
+    if ((ret != SPIF_SUCCESS) || (file == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    if (inode == SPIF_FS_INODE_NONE) {
+        if (!(flags & SPIF_FS_O_CREATE) || (parent == SPIF_FS_INODE_NONE)) {
+            return SPIF_FAIL;
+        }
+
+        ret = _spif_fs_create(fs, parent, name, len, SPIF_FS_TYPE_FILE, &inode);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    } else if (fs->inode[inode].type != SPIF_FS_TYPE_FILE) {
+        return SPIF_FAIL;
+    }
+
+    memset(file, 0, sizeof(spif_fs_file_t));
+    file->inode = inode;
+    file->flags = flags;
+    file->rblock = SPIF_FS_BLOCK_END;
+
+    if ((flags & SPIF_FS_O_TRUNC) && (flags & SPIF_FS_O_WRITE) && (fs->inode[inode].size > 0)) {
+        _spif_fs_chain_free(fs, inode);
+        fs->inode[inode].size = 0;
+        _spif_fs_inode_dirty(fs, inode);
+    }
+
+    if (flags & SPIF_FS_O_APPEND) {
+        file->pos = fs->inode[inode].size;
+    }
+
+    return _spif_fs_commit(fs);
+}
+
+/* read within block (the cache line holding offset for small reads) */
+static int _spif_fs_read_cached(spif_fs_t *fs, uint16_t block, uint32_t offset, uint8_t *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t line = 0;
+    uint32_t n = 0;
+    uint8_t miss = 0;
+
+    if (size >= sizeof(fs->rcache)) {
+        return _spif_fs_read(fs, block, offset, data, size);
+    }
+
+    for (; size > 0; offset += n, data += n, size -= n) {
+        if ((fs->rcache_size == 0) || (fs->rcache_block != block) || (offset < fs->rcache_offset) ||
+            (offset >= fs->rcache_offset + fs->rcache_size)) {
+            line = offset - offset % sizeof(fs->rcache);
+            n = fs->config.bd->block_size - line;
+            if (n > sizeof(fs->rcache)) {
+                n = sizeof(fs->rcache);
+            }
+
+            fs->rcache_size = 0;
+            ret = _spif_fs_read(fs, block, line, fs->rcache, n);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+
+            fs->rcache_block = block;
+            fs->rcache_offset = line;
+            fs->rcache_size = n;
+            fs->stats.read_misses++;
+            miss = 1;
+        } else if (!miss) {
+            fs->stats.read_hits++;
+        }
+
+        n = fs->rcache_offset + fs->rcache_size - offset;
+        if (n > size) {
+            n = size;
+        }
+
+        memcpy(data, &fs->rcache[offset - fs->rcache_offset], n);
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_fs_read(spif_fs_t *fs, spif_fs_file_t *file, void *data, uint32_t size, uint32_t *read_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t block_size = 0;
+    uint32_t done = 0;
+    uint32_t index = 0;
+    uint32_t offset = 0;
+    uint32_t n = 0;
+    uint16_t prev = 0;
+
+    if ((fs == NULL) || (file == NULL) || ((data == NULL) && (size > 0)) || (read_size == NULL) || !(file->flags & SPIF_FS_O_READ)) {
+        return SPIF_FAIL;
+    }
+
+    *read_size = 0;
+    block_size = fs->config.bd->block_size;
+
+    /* what this handle wrote must be on flash and in the chain */
+    ret = (file->session == SPIF_FS_SESSION_COPY) ? _spif_fs_session_end(fs, file) : _spif_fs_flush(fs, file);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (file->pos < fs->inode[file->inode].size) {
+        n = fs->inode[file->inode].size - file->pos;
+        if (size > n) {
+            size = n;
+        }
+    } else {
+        size = 0;
+    }
+
+    for (; done < size; done += n) {
+        index = file->pos / block_size;
+        offset = file->pos % block_size;
+
+        /* the cursor follows the chain from where the last read left it, unless a block left a chain since */
+        if ((file->rblock == SPIF_FS_BLOCK_END) || (file->rgeneration != fs->generation) || (file->rindex > index)) {
+            file->rblock = _spif_fs_block_at(fs, file->inode, index, &prev);
+        } else {
+            for (; file->rindex < index; file->rindex++) {
+                file->rblock = fs->fat[file->rblock];
+            }
+        }
+
+        file->rindex = index;
+        file->rgeneration = fs->generation;
+
+        if (file->rblock >= fs->config.bd->block_count) {
+            file->rblock = SPIF_FS_BLOCK_END;
+            return SPIF_FAIL;
+        }
+
+        n = block_size - offset;
+        if (n > size - done) {
+            n = size - done;
+        }
+
+        ret = _spif_fs_read_cached(fs, file->rblock, offset, (uint8_t *)data + done, n);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        file->pos += n;
+        *read_size += n;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_fs_write(spif_fs_t *fs, spif_fs_file_t *file, const void *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t block_size = 0;
+    uint32_t index = 0;
+    uint32_t offset = 0;
+    uint32_t n = 0;
+
+    if ((fs == NULL) || (file == NULL) || ((data == NULL) && (size > 0)) || !(file->flags & SPIF_FS_O_WRITE)) {
+        return SPIF_FAIL;
+    }
+
+    block_size = fs->config.bd->block_size;
+
+    if (file->flags & SPIF_FS_O_APPEND) {
+        file->pos = _spif_fs_file_size(fs, file);
+    }
+
+    while (size > 0) {
+        index = file->pos / block_size;
+        offset = file->pos % block_size;
+
+        if ((file->session == 0) || (file->windex != index) || (file->cache_offset + file->cache_fill != offset)) {
+            ret = _spif_fs_session_end(fs, file);
+            if (ret == SPIF_SUCCESS) {
+                ret = _spif_fs_session_open(fs, file, index, offset);
+            }
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+
+        n = sizeof(file->cache) - file->cache_fill;
+        if (n > block_size - offset) {
+            n = block_size - offset;
+        }
+        if (n > size) {
+            n = size;
+        }
+
+        memcpy(&file->cache[file->cache_fill], p, n);
+        file->cache_fill += n;
+        file->pos += n;
+        p += n;
+        size -= n;
+
+        if ((file->cache_fill == sizeof(file->cache)) || (offset + n == block_size)) {
+            ret = _spif_fs_flush(fs, file);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_fs_seek(spif_fs_t *fs, spif_fs_file_t *file, uint32_t offset)
+{
+    if ((fs == NULL) || (file == NULL) || (offset > _spif_fs_file_size(fs, file))) {
+        return SPIF_FAIL;
+    }
+
+    file->pos = offset;
+
+    return SPIF_SUCCESS;
+}
+
+uint32_t spif_fs_tell(spif_fs_t *fs, spif_fs_file_t *file)
+{
+    (void)fs;
+
+    return file->pos;
+}
+
+uint32_t spif_fs_size(spif_fs_t *fs, spif_fs_file_t *file)
+{
+    return _spif_fs_file_size(fs, file);
+}
+
+int spif_fs_sync(spif_fs_t *fs, spif_fs_file_t *file)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((fs == NULL) || (file == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    /* an in-place block stays open, the next append needs no check of its tail */
+    ret = (file->session == SPIF_FS_SESSION_COPY) ? _spif_fs_session_end(fs, file) : _spif_fs_flush(fs, file);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    return _spif_fs_commit(fs);
+}
+
+int spif_fs_close(spif_fs_t *fs, spif_fs_file_t *file)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((fs == NULL) || (file == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    if (file->flags & SPIF_FS_O_WRITE) {
+        ret = _spif_fs_session_end(fs, file);
+        if (ret == SPIF_SUCCESS) {
+            ret = _spif_fs_commit(fs);
+        }
+    }
+
+    file->flags = 0;
+
+    return ret;
+}
+
+uint32_t spif_fs_free_blocks(spif_fs_t *fs)
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = fs->data_start; i < fs->config.bd->block_count; i++) {
+        count += (fs->fat[i] == SPIF_FS_BLOCK_FREE) || (fs->fat[i] == SPIF_FS_BLOCK_PENDING);
+    }
+
+    return count;
+}
+
+int spif_fs_stats_get(spif_fs_t *fs, spif_fs_stats_t *stats)
+{
+    if ((fs == NULL) || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *stats = fs->stats;
+
+    return SPIF_SUCCESS;
+}
+
+void spif_fs_stats_reset(spif_fs_t *fs)
+{
+    memset(&fs->stats, 0, sizeof(spif_fs_stats_t));
+}
+
+static int _spif_fs_bd_read(spif_fs_bd_t *bd, uint32_t block, uint32_t offset, void *data, uint32_t size)
+{
+    return spif_fast_read((spif_dev_t *)bd->ctx, bd->addr + block * bd->block_size + offset, (uint8_t *)data, size);
+}
+
+static int _spif_fs_bd_prog(spif_fs_bd_t *bd, uint32_t block, uint32_t offset, const void *data, uint32_t size)
+{
+    return spif_write((spif_dev_t *)bd->ctx, bd->addr + block * bd->block_size + offset, (const uint8_t *)data, size,
+                      SPIF_WRITE_MODE_PROGRAM);
+}
+
+static int _spif_fs_bd_erase(spif_fs_bd_t *bd, uint32_t block)
+{
+    return spif_sector_erase((spif_dev_t *)bd->ctx, bd->addr + block * bd->block_size);
+}
+
+int spif_fs_bd_init(spif_fs_bd_t *bd, spif_dev_t *dev, uint32_t addr, uint32_t size)
+{
+    uint32_t sector_size = 0;
+
+    if ((bd == NULL) || (dev == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    sector_size = dev->flash.sector_size;
+    if ((sector_size == 0) || (addr % sector_size != 0) || (size % sector_size != 0) || (size == 0) ||
+        ((uint64_t)addr + size > dev->flash.chip_size)) {
+        return SPIF_FAIL;
+    }
+
+    memset(bd, 0, sizeof(spif_fs_bd_t));
+    bd->read = _spif_fs_bd_read;
+    bd->prog = _spif_fs_bd_prog;
+    bd->erase = _spif_fs_bd_erase;
+    bd->block_size = sector_size;
+    bd->block_count = size / sector_size;
+    bd->ctx = dev;
+    bd->addr = addr;
+
+    return SPIF_SUCCESS;
+}
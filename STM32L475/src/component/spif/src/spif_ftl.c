@@ -0,0 +1,732 @@
+/*
+ * spif_ftl.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif.h"
+#include "spif_crc.h"
+#include "spif_ftl.h"
+
+#define SPIF_FTL_MAGIC                 0x314C5446 /* "FTL1" */
+
+#define SPIF_FTL_INVALID               0xFFFF
+
+/* erase count word, bit 31 set: the sector is not erased */
+#define SPIF_FTL_EC_DIRTY              0x80000000
+#define SPIF_FTL_EC_MASK               0x7FFFFFFF
+
+/* journal entry types, 0xFF is an empty slot */
+#define SPIF_FTL_ENTRY_HEADER          0x01 /* first entry of a journal sector, arg: checkpoint seq */
+#define SPIF_FTL_ENTRY_MAP             0x02 /* lsn (arg) now lives in psn */
+#define SPIF_FTL_ENTRY_ERASE           0x03 /* psn erased, arg: new erase count */
+#define SPIF_FTL_ENTRY_TRIM            0x04 /* lsn (arg) unmapped */
+#define SPIF_FTL_ENTRY_EMPTY           0xFF
+
+#define SPIF_FTL_ENTRIES_PER_SECTOR    (SPIF_FTL_SECTOR_SIZE / sizeof(spif_ftl_entry_t))
+
+/* static wear leveling is tried once every this many writes */
+#define SPIF_FTL_WL_PERIOD             16
+
+typedef struct spif_ftl_entry_s {
+    uint8_t type;
+    uint8_t crc;  /* low byte of the CRC-32 of the other fields */
+    uint16_t psn;
+    uint32_t arg;
+} spif_ftl_entry_t;
+
+/* followed by l2p[logical] (uint16_t) and ec[pool] (uint32_t) */
+typedef struct spif_ftl_ckpt_s {
+    uint32_t magic;
+    uint32_t seq;
+    uint16_t logical;
+    uint16_t pool;
+    uint32_t crc; /* seq, logical, pool and both tables */
+} spif_ftl_ckpt_t;
+
+static uint32_t _spif_ftl_ckpt_addr(spif_ftl_t *ftl, uint32_t slot)
+{
+    return ftl->config.addr + slot * ftl->ckpt_sectors * SPIF_FTL_SECTOR_SIZE;
+}
+
+static uint32_t _spif_ftl_journal_addr(spif_ftl_t *ftl)
+{
+    return _spif_ftl_ckpt_addr(ftl, 2);
+}
+
+static uint32_t _spif_ftl_pool_addr(spif_ftl_t *ftl, uint16_t psn)
+{
+    return _spif_ftl_journal_addr(ftl) + (ftl->config.journal_sectors + psn) * SPIF_FTL_SECTOR_SIZE;
+}
+
+static int _spif_ftl_geometry(spif_ftl_t *ftl, const spif_ftl_config_t *config)
+{
+    uint32_t sectors = 0;
+    uint32_t ckpt_size = 0;
+    int32_t pool = 0;
+
+    if ((config == NULL) || (config->dev == NULL) || ((config->addr % SPIF_FTL_SECTOR_SIZE) != 0) || ((config->size % SPIF_FTL_SECTOR_SIZE) != 0) ||
+        (config->spare_sectors < 2) || (config->journal_sectors < 1)) {
+        return SPIF_FAIL;
+    }
+
+    sectors = config->size / SPIF_FTL_SECTOR_SIZE;
+
+    /* the checkpoint size depends on the pool size, which depends on the checkpoint size */
+    for (uint32_t ckpt = 1; ; ckpt++) {
+        pool = (int32_t)sectors - 2 * ckpt - config->journal_sectors;
+        if (pool <= config->spare_sectors) {
+            return SPIF_FAIL;
+        }
+
+        ckpt_size = sizeof(spif_ftl_ckpt_t) + (pool - config->spare_sectors) * sizeof(uint16_t) + pool * sizeof(uint32_t);
+        if (ckpt_size <= ckpt * SPIF_FTL_SECTOR_SIZE) {
+            ftl->ckpt_sectors = ckpt;
+            break;
+        }
+    }
+
+    if (pool > SPIF_FTL_SECTORS_MAX) {
+        return SPIF_FAIL;
+    }
+
+    ftl->config = *config;
+    ftl->pool = pool;
+    ftl->logical = pool - config->spare_sectors;
+
+    return SPIF_SUCCESS;
+}
+
+static uint8_t _spif_ftl_entry_crc(const spif_ftl_entry_t *entry)
+{
+    uint32_t crc = SPIF_CRC32_INIT;
+
+    crc = spif_crc32(crc, &entry->type, sizeof(entry->type));
+    crc = spif_crc32(crc, &entry->psn, sizeof(entry->psn));
+    crc = spif_crc32(crc, &entry->arg, sizeof(entry->arg));
+
+    return (crc ^ SPIF_CRC32_INIT) & 0xFF;
+}
+
+static int _spif_ftl_erase_sectors(spif_ftl_t *ftl, uint32_t addr, uint32_t count)
+{
+    int ret = SPIF_SUCCESS;
+
+    /* backwards, so an erased first sector means the whole range is erased */
+    while (count-- > 0) {
+        ret = spif_sector_erase(ftl->config.dev, addr + count * SPIF_FTL_SECTOR_SIZE);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return ret;
+}
+
+static uint32_t _spif_ftl_ckpt_crc(spif_ftl_t *ftl, const spif_ftl_ckpt_t *ckpt)
+{
+    uint32_t crc = SPIF_CRC32_INIT;
+
+    crc = spif_crc32(crc, &ckpt->seq, sizeof(ckpt->seq));
+    crc = spif_crc32(crc, &ckpt->logical, sizeof(ckpt->logical));
+    crc = spif_crc32(crc, &ckpt->pool, sizeof(ckpt->pool));
+    crc = spif_crc32(crc, ftl->l2p, ckpt->logical * sizeof(uint16_t));
+    crc = spif_crc32(crc, ftl->ec, ckpt->pool * sizeof(uint32_t));
+
+    return crc ^ SPIF_CRC32_INIT;
+}
+
+/* write the RAM tables to the other slot, then start an empty journal */
+static int _spif_ftl_checkpoint(spif_ftl_t *ftl)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_ftl_ckpt_t ckpt;
+    uint32_t addr = 0;
+
+    ckpt.magic = SPIF_FTL_MAGIC;
+    ckpt.seq = ftl->seq + 1;
+    ckpt.logical = ftl->logical;
+    ckpt.pool = ftl->pool;
+    ckpt.crc = _spif_ftl_ckpt_crc(ftl, &ckpt);
+
+    addr = _spif_ftl_ckpt_addr(ftl, ckpt.seq & 1);
+
+    ret = _spif_ftl_erase_sectors(ftl, addr, ftl->ckpt_sectors);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = spif_write(ftl->config.dev, addr + sizeof(spif_ftl_ckpt_t), (const uint8_t *)ftl->l2p,
+                     ckpt.logical * sizeof(uint16_t), SPIF_WRITE_MODE_PROGRAM);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = spif_write(ftl->config.dev, addr + sizeof(spif_ftl_ckpt_t) + ckpt.logical * sizeof(uint16_t), (const uint8_t *)ftl->ec,
+                     ckpt.pool * sizeof(uint32_t), SPIF_WRITE_MODE_PROGRAM);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    /* header last, the checkpoint is valid from here on */
+    ret = spif_write(ftl->config.dev, addr, (const uint8_t *)&ckpt, sizeof(spif_ftl_ckpt_t), SPIF_WRITE_MODE_PROGRAM);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ftl->seq = ckpt.seq;
+
+    ret = _spif_ftl_erase_sectors(ftl, _spif_ftl_journal_addr(ftl), ftl->config.journal_sectors);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ftl->journal_pos = 0;
+    ftl->stats.checkpoints++;
+
+    return ret;
+}
+
+static int _spif_ftl_journal_put(spif_ftl_t *ftl, uint8_t type, uint16_t psn, uint32_t arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_ftl_entry_t entry;
+
+    entry.type = type;
+    entry.psn = psn;
+    entry.arg = arg;
+    entry.crc = _spif_ftl_entry_crc(&entry);
+
+    ret = spif_write(ftl->config.dev, _spif_ftl_journal_addr(ftl) + ftl->journal_pos * sizeof(spif_ftl_entry_t),
+                     (const uint8_t *)&entry, sizeof(spif_ftl_entry_t), SPIF_WRITE_MODE_PROGRAM);
+
+    /* a failed slot is left behind, replay drops it by its CRC */
+    ftl->journal_pos++;
+
+    return ret;
+}
+
+static int _spif_ftl_journal_append(spif_ftl_t *ftl, uint8_t type, uint16_t psn, uint32_t arg)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (ftl->journal_pos >= ftl->config.journal_sectors * SPIF_FTL_ENTRIES_PER_SECTOR) {
+        ret = _spif_ftl_checkpoint(ftl);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    if ((ftl->journal_pos % SPIF_FTL_ENTRIES_PER_SECTOR) == 0) {
+        ret = _spif_ftl_journal_put(ftl, SPIF_FTL_ENTRY_HEADER, SPIF_FTL_INVALID, ftl->seq);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return _spif_ftl_journal_put(ftl, type, psn, arg);
+}
+
+static void _spif_ftl_apply(spif_ftl_t *ftl, const spif_ftl_entry_t *entry)
+{
+    uint16_t old = SPIF_FTL_INVALID;
+
+    switch (entry->type) {
+    case SPIF_FTL_ENTRY_MAP:
+    case SPIF_FTL_ENTRY_TRIM:
+        if (entry->arg >= ftl->logical) {
+            break;
+        }
+
+        old = ftl->l2p[entry->arg];
+        if (old != SPIF_FTL_INVALID) {
+            ftl->p2l[old] = SPIF_FTL_INVALID;
+        }
+
+        ftl->l2p[entry->arg] = SPIF_FTL_INVALID;
+
+        if ((entry->type == SPIF_FTL_ENTRY_MAP) && (entry->psn < ftl->pool)) {
+            ftl->l2p[entry->arg] = entry->psn;
+            ftl->p2l[entry->psn] = entry->arg;
+            ftl->ec[entry->psn] |= SPIF_FTL_EC_DIRTY;
+        }
+        break;
+
+    case SPIF_FTL_ENTRY_ERASE:
+        if (entry->psn < ftl->pool) {
+            ftl->ec[entry->psn] = entry->arg & SPIF_FTL_EC_MASK;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int _spif_ftl_replay(spif_ftl_t *ftl)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_ftl_entry_t *entries = (spif_ftl_entry_t *)ftl->buf;
+    uint32_t total = ftl->config.journal_sectors * SPIF_FTL_ENTRIES_PER_SECTOR;
+    uint32_t chunk = SPIF_FTL_IO_SIZE / sizeof(spif_ftl_entry_t);
+
+    for (uint32_t pos = 0; pos < total; pos += chunk) {
+        ret = spif_read(ftl->config.dev, _spif_ftl_journal_addr(ftl) + pos * sizeof(spif_ftl_entry_t), ftl->buf, SPIF_FTL_IO_SIZE);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        for (uint32_t i = 0; i < chunk; i++) {
+            const spif_ftl_entry_t *entry = &entries[i];
+
+            if (entry->type == SPIF_FTL_ENTRY_EMPTY) {
+                ftl->journal_pos = pos + i;
+                return SPIF_SUCCESS;
+            }
+
+            if (((pos + i) % SPIF_FTL_ENTRIES_PER_SECTOR) == 0) {
+                /* journal of an older checkpoint, its erase was interrupted */
+                if ((entry->type != SPIF_FTL_ENTRY_HEADER) || (entry->crc != _spif_ftl_entry_crc(entry)) ||
+                    (entry->arg != ftl->seq)) {
+                    ftl->journal_pos = 0;
+                    return _spif_ftl_erase_sectors(ftl, _spif_ftl_journal_addr(ftl), ftl->config.journal_sectors);
+                }
+                continue;
+            }
+
+            /* torn entry, power was lost while it was programmed */
+            if (entry->crc != _spif_ftl_entry_crc(entry)) {
+                continue;
+            }
+
+            _spif_ftl_apply(ftl, entry);
+        }
+    }
+
+    ftl->journal_pos = total;
+
+    return ret;
+}
+
+static int _spif_ftl_ckpt_load(spif_ftl_t *ftl, uint32_t slot, const spif_ftl_ckpt_t *ckpt)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t addr = _spif_ftl_ckpt_addr(ftl, slot) + sizeof(spif_ftl_ckpt_t);
+
+    ret = spif_read(ftl->config.dev, addr, (uint8_t *)ftl->l2p, ckpt->logical * sizeof(uint16_t));
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = spif_read(ftl->config.dev, addr + ckpt->logical * sizeof(uint16_t), (uint8_t *)ftl->ec, ckpt->pool * sizeof(uint32_t));
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    return (_spif_ftl_ckpt_crc(ftl, ckpt) == ckpt->crc) ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+static int _spif_ftl_blank_check(spif_ftl_t *ftl, uint16_t psn)
+{
+    int ret = SPIF_SUCCESS;
+
+    for (uint32_t offset = 0; offset < SPIF_FTL_SECTOR_SIZE; offset += SPIF_FTL_IO_SIZE) {
+        ret = spif_read(ftl->config.dev, _spif_ftl_pool_addr(ftl, psn) + offset, ftl->buf, SPIF_FTL_IO_SIZE);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        for (uint32_t i = 0; i < SPIF_FTL_IO_SIZE; i++) {
+            if (ftl->buf[i] != 0xFF) {
+                return SPIF_FAIL;
+            }
+        }
+    }
+
+    return ret;
+}
+
+static int _spif_ftl_erase(spif_ftl_t *ftl, uint16_t psn)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t ec = (ftl->ec[psn] & SPIF_FTL_EC_MASK) + 1;
+
+    ret = spif_sector_erase(ftl->config.dev, _spif_ftl_pool_addr(ftl, psn));
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ftl->ec[psn] = ec;
+    ftl->checked[psn / 8] |= (1 << (psn % 8));
+    ftl->stats.erases++;
+
+    return _spif_ftl_journal_append(ftl, SPIF_FTL_ENTRY_ERASE, psn, ec);
+}
+
+/* unmapped sector, erased or not, with the lowest (or highest when worn) erase count */
+static uint16_t _spif_ftl_find(spif_ftl_t *ftl, uint8_t dirty, uint8_t worn)
+{
+    uint16_t best = SPIF_FTL_INVALID;
+    uint32_t ec = 0;
+
+    for (uint16_t psn = 0; psn < ftl->pool; psn++) {
+        if ((ftl->p2l[psn] != SPIF_FTL_INVALID) || (((ftl->ec[psn] & SPIF_FTL_EC_DIRTY) != 0) != dirty)) {
+            continue;
+        }
+
+        ec = ftl->ec[psn] & SPIF_FTL_EC_MASK;
+        if ((best == SPIF_FTL_INVALID) ||
+            (worn ? (ec > (ftl->ec[best] & SPIF_FTL_EC_MASK)) : (ec < (ftl->ec[best] & SPIF_FTL_EC_MASK)))) {
+            best = psn;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * take an erased sector, erasing a dirty one if there is none. a sector believed
+ * erased may have been programmed right before a power loss, so each one is
+ * blank-checked once per mount before use
+ */
+static int _spif_ftl_alloc(spif_ftl_t *ftl, uint8_t worn, uint16_t *psn)
+{
+    int ret = SPIF_SUCCESS;
+
+    while ((*psn = _spif_ftl_find(ftl, 0, worn)) != SPIF_FTL_INVALID) {
+        if (ftl->checked[*psn / 8] & (1 << (*psn % 8))) {
+            return SPIF_SUCCESS;
+        }
+
+        ret = _spif_ftl_blank_check(ftl, *psn);
+        if (ret == SPIF_SUCCESS) {
+            ftl->checked[*psn / 8] |= (1 << (*psn % 8));
+            return SPIF_SUCCESS;
+        }
+
+        ftl->ec[*psn] |= SPIF_FTL_EC_DIRTY;
+    }
+
+    *psn = _spif_ftl_find(ftl, 1, worn);
+    if (*psn == SPIF_FTL_INVALID) {
+        return SPIF_FAIL;
+    }
+
+    return _spif_ftl_erase(ftl, *psn);
+}
+
+static int _spif_ftl_map(spif_ftl_t *ftl, uint32_t lsn, uint16_t psn)
+{
+    spif_ftl_entry_t entry;
+
+    entry.type = SPIF_FTL_ENTRY_MAP;
+    entry.psn = psn;
+    entry.arg = lsn;
+    _spif_ftl_apply(ftl, &entry);
+
+    return _spif_ftl_journal_append(ftl, SPIF_FTL_ENTRY_MAP, psn, lsn);
+}
+
+/* move the coldest data into the most worn erased sector, so its young sector gets used */
+static int _spif_ftl_wear_level(spif_ftl_t *ftl, uint8_t *moved)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint16_t cold = SPIF_FTL_INVALID;
+    uint16_t target = SPIF_FTL_INVALID;
+    uint32_t ec_max = 0;
+    uint32_t ec = 0;
+
+    *moved = 0;
+
+    for (uint16_t psn = 0; psn < ftl->pool; psn++) {
+        ec = ftl->ec[psn] & SPIF_FTL_EC_MASK;
+        ec_max = (ec > ec_max) ? ec : ec_max;
+
+        if ((ftl->p2l[psn] != SPIF_FTL_INVALID) &&
+            ((cold == SPIF_FTL_INVALID) || (ec < (ftl->ec[cold] & SPIF_FTL_EC_MASK)))) {
+            cold = psn;
+        }
+    }
+
+    if ((cold == SPIF_FTL_INVALID) || ((ec_max - (ftl->ec[cold] & SPIF_FTL_EC_MASK)) <= ftl->config.wl_threshold)) {
+        return SPIF_SUCCESS;
+    }
+
+    ret = _spif_ftl_alloc(ftl, 1, &target);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    for (uint32_t offset = 0; offset < SPIF_FTL_SECTOR_SIZE; offset += SPIF_FTL_IO_SIZE) {
+        ret = spif_read(ftl->config.dev, _spif_ftl_pool_addr(ftl, cold) + offset, ftl->buf, SPIF_FTL_IO_SIZE);
+        if (ret == SPIF_SUCCESS) {
+            ret = spif_write(ftl->config.dev, _spif_ftl_pool_addr(ftl, target) + offset, ftl->buf, SPIF_FTL_IO_SIZE, SPIF_WRITE_MODE_PROGRAM);
+        }
+
+        if (ret != SPIF_SUCCESS) {
+            ftl->ec[target] |= SPIF_FTL_EC_DIRTY;
+            return ret;
+        }
+    }
+
+    ret = _spif_ftl_map(ftl, ftl->p2l[cold], target);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ftl->stats.wl_moves++;
+    *moved = 1;
+
+    return ret;
+}
+
+int spif_ftl_format(spif_ftl_t *ftl, const spif_ftl_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (ftl == NULL) {
+        return SPIF_FAIL;
+    }
+
+    ftl->mounted = 0;
+
+    ret = _spif_ftl_geometry(ftl, config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    /* both slots, an old checkpoint with a higher seq must not survive */
+    ret = _spif_ftl_erase_sectors(ftl, _spif_ftl_ckpt_addr(ftl, 0), 2 * ftl->ckpt_sectors);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    /* content of the pool is unknown, every sector is erased before its first use */
+    memset(ftl->l2p, 0xFF, sizeof(ftl->l2p));
+    memset(ftl->p2l, 0xFF, sizeof(ftl->p2l));
+    for (uint16_t psn = 0; psn < ftl->pool; psn++) {
+        ftl->ec[psn] = SPIF_FTL_EC_DIRTY;
+    }
+
+    ftl->seq = 0;
+
+    return _spif_ftl_checkpoint(ftl);
+}
+
+int spif_ftl_mount(spif_ftl_t *ftl, const spif_ftl_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_ftl_ckpt_t ckpt[2];
+    uint32_t first = 0;
+
+    if (ftl == NULL) {
+        return SPIF_FAIL;
+    }
+
+    ftl->mounted = 0;
+
+    ret = _spif_ftl_geometry(ftl, config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    for (uint32_t slot = 0; slot < 2; slot++) {
+        ret = spif_read(ftl->config.dev, _spif_ftl_ckpt_addr(ftl, slot), (uint8_t *)&ckpt[slot], sizeof(spif_ftl_ckpt_t));
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        if ((ckpt[slot].magic != SPIF_FTL_MAGIC) ||
+            (ckpt[slot].logical != ftl->logical) || (ckpt[slot].pool != ftl->pool)) {
+            ckpt[slot].magic = 0;
+        }
+    }
+
+    /* newest valid checkpoint first */
+    first = ((ckpt[1].magic == SPIF_FTL_MAGIC) && ((ckpt[0].magic != SPIF_FTL_MAGIC) || (ckpt[1].seq > ckpt[0].seq))) ? 1 : 0;
+
+    ret = SPIF_FAIL;
+    for (uint32_t i = 0; (i < 2) && (ret != SPIF_SUCCESS); i++) {
+        uint32_t slot = first ^ i;
+        if (ckpt[slot].magic == SPIF_FTL_MAGIC) {
+            ret = _spif_ftl_ckpt_load(ftl, slot, &ckpt[slot]);
+            ftl->seq = ckpt[slot].seq;
+        }
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    memset(ftl->p2l, 0xFF, sizeof(ftl->p2l));
+    for (uint16_t lsn = 0; lsn < ftl->logical; lsn++) {
+        if (ftl->l2p[lsn] < ftl->pool) {
+            ftl->p2l[ftl->l2p[lsn]] = lsn;
+        } else {
+            ftl->l2p[lsn] = SPIF_FTL_INVALID;
+        }
+    }
+
+    memset(ftl->checked, 0, sizeof(ftl->checked));
+    memset(&ftl->stats, 0, sizeof(spif_ftl_stats_t));
+    ftl->writes = 0;
+
+    ret = _spif_ftl_replay(ftl);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ftl->mounted = 1;
+
+    return ret;
+}
+
+int spif_ftl_write(spif_ftl_t *ftl, uint32_t lsn, const uint8_t *data)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint16_t psn = SPIF_FTL_INVALID;
+    uint8_t moved = 0;
+
+    if ((ftl == NULL) || !ftl->mounted || (lsn >= ftl->logical) || (data == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_ftl_alloc(ftl, 0, &psn);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = spif_write(ftl->config.dev, _spif_ftl_pool_addr(ftl, psn), data, SPIF_FTL_SECTOR_SIZE, SPIF_WRITE_MODE_PROGRAM);
+    if (ret != SPIF_SUCCESS) {
+        ftl->ec[psn] |= SPIF_FTL_EC_DIRTY;
+        return ret;
+    }
+
+    /* the old sector, if any, turns dirty */
+    ret = _spif_ftl_map(ftl, lsn, psn);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if ((++ftl->writes % SPIF_FTL_WL_PERIOD) == 0) {
+        ret = _spif_ftl_wear_level(ftl, &moved);
+    }
+
+    return ret;
+}
+
+int spif_ftl_read(spif_ftl_t *ftl, uint32_t lsn, uint32_t offset, uint8_t *data, uint32_t size)
+{
+    if ((ftl == NULL) || !ftl->mounted || (lsn >= ftl->logical) || (data == NULL) ||
+        (offset > SPIF_FTL_SECTOR_SIZE) || (size > (SPIF_FTL_SECTOR_SIZE - offset))) {
+        return SPIF_FAIL;
+    }
+
+    if (ftl->l2p[lsn] == SPIF_FTL_INVALID) {
+        memset(data, 0xFF, size);
+        return SPIF_SUCCESS;
+    }
+
+    return spif_read(ftl->config.dev, _spif_ftl_pool_addr(ftl, ftl->l2p[lsn]) + offset, data, size);
+}
+
+int spif_ftl_trim(spif_ftl_t *ftl, uint32_t lsn)
+{
+    spif_ftl_entry_t entry;
+
+    if ((ftl == NULL) || !ftl->mounted || (lsn >= ftl->logical)) {
+        return SPIF_FAIL;
+    }
+
+    if (ftl->l2p[lsn] == SPIF_FTL_INVALID) {
+        return SPIF_SUCCESS;
+    }
+
+    entry.type = SPIF_FTL_ENTRY_TRIM;
+    entry.psn = SPIF_FTL_INVALID;
+    entry.arg = lsn;
+    _spif_ftl_apply(ftl, &entry);
+
+    return _spif_ftl_journal_append(ftl, SPIF_FTL_ENTRY_TRIM, SPIF_FTL_INVALID, lsn);
+}
+
+int spif_ftl_gc(spif_ftl_t *ftl, uint32_t max_steps)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint16_t psn = SPIF_FTL_INVALID;
+    uint8_t moved = 0;
+
+    if ((ftl == NULL) || !ftl->mounted) {
+        return SPIF_FAIL;
+    }
+
+    for (uint32_t step = 0; step < max_steps; step++) {
+        /* least worn first, it is the next one handed out */
+        psn = _spif_ftl_find(ftl, 1, 0);
+        if (psn != SPIF_FTL_INVALID) {
+            ret = _spif_ftl_erase(ftl, psn);
+        } else {
+            ret = _spif_ftl_wear_level(ftl, &moved);
+            if ((ret == SPIF_SUCCESS) && !moved) {
+                break;
+            }
+        }
+
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    return ret;
+}
+
+int spif_ftl_sync(spif_ftl_t *ftl)
+{
+    if ((ftl == NULL) || !ftl->mounted) {
+        return SPIF_FAIL;
+    }
+
+    return _spif_ftl_checkpoint(ftl);
+}
+
+int spif_ftl_stats_get(spif_ftl_t *ftl, spif_ftl_stats_t *stats)
+{
+    uint32_t ec = 0;
+
+    if ((ftl == NULL) || !ftl->mounted || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *stats = ftl->stats;
+    stats->logical_sectors = ftl->logical;
+    stats->free_sectors = 0;
+    stats->dirty_sectors = 0;
+    stats->ec_min = SPIF_FTL_EC_MASK;
+    stats->ec_max = 0;
+
+    for (uint16_t psn = 0; psn < ftl->pool; psn++) {
+        ec = ftl->ec[psn] & SPIF_FTL_EC_MASK;
+        stats->ec_min = (ec < stats->ec_min) ? ec : stats->ec_min;
+        stats->ec_max = (ec > stats->ec_max) ? ec : stats->ec_max;
+
+        if (ftl->p2l[psn] == SPIF_FTL_INVALID) {
+            if (ftl->ec[psn] & SPIF_FTL_EC_DIRTY) {
+                stats->dirty_sectors++;
+            } else {
+                stats->free_sectors++;
+            }
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
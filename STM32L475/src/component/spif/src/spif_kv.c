@@ -0,0 +1,949 @@
+/*
+ * spif_kv.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <stddef.h>
+#include <string.h>
+#include "spif.h"
+#include "spif_crc.h"
+#include "spif_kv.h"
+
+#define SPIF_KV_SECTOR_SIZE            4096
+
+#define SPIF_KV_SECTOR_MAGIC           0x474F4C4B /* "KLOG" */
+#define SPIF_KV_SNAPSHOT_MAGIC         0x58444E49 /* "INDX" */
+#define SPIF_KV_REC_MAGIC              0xA5
+
+#define SPIF_KV_REC_MORE               0x01 /* more records of the same commit follow */
+#define SPIF_KV_VAL_DELETED            0xFFFF
+
+#define SPIF_KV_SLOT_EMPTY             0xFFFFFFFF
+#define SPIF_KV_SLOT_DELETED           0xFFFFFFFE
+
+#define SPIF_KV_INVALID                0xFFFF
+
+/* log sectors kept free for compaction */
+#define SPIF_KV_FREE_MIN               2
+
+#define SPIF_KV_ALIGN(x)               (((x) + 3) & ~3UL)
+
+typedef struct spif_kv_sector_s {
+    uint32_t magic;
+    uint32_t seq; /* position in the log, +1 per opened sector */
+    uint32_t crc;
+    uint32_t reserved;
+} spif_kv_sector_t;
+
+/* followed by key_len bytes of key and val_len bytes of value */
+typedef struct spif_kv_rec_s {
+    uint8_t magic;
+    uint8_t flags;
+    uint8_t key_len;
+    uint8_t reserved;
+    uint16_t val_len; /* SPIF_KV_VAL_DELETED: tombstone, no value */
+    uint16_t reserved2;
+    uint32_t crc;     /* of everything else, key and value included */
+} spif_kv_rec_t;
+
+/* followed by the index table */
+typedef struct spif_kv_snapshot_s {
+    uint32_t magic;
+    uint32_t gen;
+    uint32_t pos;     /* replay starts here */
+    uint32_t pos_seq; /* seq of the sector holding pos */
+    uint32_t keys;
+    uint32_t crc;
+} spif_kv_snapshot_t;
+
+#define SPIF_KV_SECTOR_DATA            (SPIF_KV_SECTOR_SIZE - sizeof(spif_kv_sector_t))
+
+static uint32_t _spif_kv_snapshot_addr(spif_kv_t *kv, uint32_t slot)
+{
+    return kv->config.addr + slot * kv->snapshot_sectors * SPIF_KV_SECTOR_SIZE;
+}
+
+static uint32_t _spif_kv_sector_addr(spif_kv_t *kv, uint16_t sector)
+{
+    return _spif_kv_snapshot_addr(kv, 2) + sector * SPIF_KV_SECTOR_SIZE;
+}
+
+static uint16_t _spif_kv_sector_of(spif_kv_t *kv, uint32_t addr)
+{
+    return (addr - _spif_kv_sector_addr(kv, 0)) / SPIF_KV_SECTOR_SIZE;
+}
+
+/* end of the sector a record address belongs to, the address may be that end already */
+static uint32_t _spif_kv_sector_end(spif_kv_t *kv, uint32_t addr)
+{
+    return _spif_kv_sector_addr(kv, _spif_kv_sector_of(kv, addr - 1)) + SPIF_KV_SECTOR_SIZE;
+}
+
+/* the tail takes size more bytes */
+static uint8_t _spif_kv_room(spif_kv_t *kv, uint32_t size)
+{
+    return (kv->pos != 0) && ((kv->pos + size) <= _spif_kv_sector_end(kv, kv->pos));
+}
+
+static uint16_t _spif_kv_next(spif_kv_t *kv, uint16_t sector)
+{
+    return (sector + 1) % kv->sectors;
+}
+
+/* FNV-1a */
+static uint32_t _spif_kv_hash(const char *key, uint8_t key_len)
+{
+    uint32_t hash = 0x811C9DC5;
+
+    for (uint8_t i = 0; i < key_len; i++) {
+        hash ^= (uint8_t)key[i];
+        hash *= 0x01000193;
+    }
+
+    return hash;
+}
+
+static uint32_t _spif_kv_rec_size(uint8_t key_len, uint16_t val_len)
+{
+    return SPIF_KV_ALIGN(sizeof(spif_kv_rec_t) + key_len + ((val_len == SPIF_KV_VAL_DELETED) ? 0 : val_len));
+}
+
+static int _spif_kv_geometry(spif_kv_t *kv, const spif_kv_config_t *config)
+{
+    uint32_t sectors = 0;
+
+    if ((config == NULL) || (config->dev == NULL) || ((config->addr % SPIF_KV_SECTOR_SIZE) != 0) || ((config->size % SPIF_KV_SECTOR_SIZE) != 0)) {
+        return SPIF_FAIL;
+    }
+
+    kv->snapshot_sectors = (sizeof(spif_kv_snapshot_t) + sizeof(kv->index) + SPIF_KV_SECTOR_SIZE - 1) / SPIF_KV_SECTOR_SIZE;
+
+    sectors = config->size / SPIF_KV_SECTOR_SIZE;
+    if ((sectors < (2UL * kv->snapshot_sectors + SPIF_KV_FREE_MIN + 1)) ||
+        ((sectors - 2 * kv->snapshot_sectors) > SPIF_KV_SECTORS_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    kv->config = *config;
+    kv->sectors = sectors - 2 * kv->snapshot_sectors;
+
+    return SPIF_SUCCESS;
+}
+
+/**
+ * read and check the record at addr
+ * @param good returns 0 if the CRC does not match, a torn record that can be stepped over
+ * @return record size, 0 at the end of the records of this sector
+ */
+static uint32_t _spif_kv_rec_read(spif_kv_t *kv, uint32_t addr, spif_kv_rec_t *rec, char *key, uint8_t *good)
+{
+    uint32_t crc = SPIF_CRC32_INIT;
+    uint32_t end = _spif_kv_sector_end(kv, addr);
+    uint32_t size = 0;
+    uint32_t chunk = 0;
+
+    *good = 0;
+
+    if ((addr + sizeof(spif_kv_rec_t)) > end) {
+        return 0;
+    }
+
+    if (spif_read(kv->config.dev, addr, (uint8_t *)rec, sizeof(spif_kv_rec_t)) != SPIF_SUCCESS) {
+        return 0;
+    }
+
+    size = _spif_kv_rec_size(rec->key_len, rec->val_len);
+    if ((rec->magic != SPIF_KV_REC_MAGIC) || (rec->key_len == 0) || (rec->key_len > SPIF_KV_KEY_MAX) ||
+        ((addr + size) > end)) {
+        return 0;
+    }
+
+    crc = spif_crc32(crc, rec, offsetof(spif_kv_rec_t, crc));
+
+    addr += sizeof(spif_kv_rec_t);
+    size -= sizeof(spif_kv_rec_t);
+    if (spif_read(kv->config.dev, addr, (uint8_t *)key, rec->key_len) != SPIF_SUCCESS) {
+        return 0;
+    }
+    crc = spif_crc32(crc, key, rec->key_len);
+
+    addr += rec->key_len;
+    for (uint32_t left = (rec->val_len == SPIF_KV_VAL_DELETED) ? 0 : rec->val_len; left > 0; left -= chunk) {
+        chunk = (left > SPIF_KV_IO_SIZE) ? SPIF_KV_IO_SIZE : left;
+        if (spif_read(kv->config.dev, addr, kv->buf, chunk) != SPIF_SUCCESS) {
+            return 0;
+        }
+        crc = spif_crc32(crc, kv->buf, chunk);
+        addr += chunk;
+    }
+
+    *good = ((crc ^ SPIF_CRC32_INIT) == rec->crc);
+
+    return _spif_kv_rec_size(rec->key_len, rec->val_len);
+}
+
+/* slot of the key, or SPIF_KV_INVALID. *free returns where it would be inserted */
+static uint16_t _spif_kv_find(spif_kv_t *kv, const char *key, uint8_t key_len, uint32_t hash, uint16_t *free)
+{
+    spif_kv_rec_t rec;
+    char stored[SPIF_KV_KEY_MAX];
+    uint16_t slot = 0;
+
+    if (free != NULL) {
+        *free = SPIF_KV_INVALID;
+    }
+
+    for (uint16_t i = 0; i < SPIF_KV_INDEX_SIZE; i++) {
+        slot = (hash + i) & (SPIF_KV_INDEX_SIZE - 1);
+
+        if (kv->index[slot].addr == SPIF_KV_SLOT_EMPTY) {
+            if ((free != NULL) && (*free == SPIF_KV_INVALID)) {
+                *free = slot;
+            }
+            return SPIF_KV_INVALID;
+        }
+
+        if (kv->index[slot].addr == SPIF_KV_SLOT_DELETED) {
+            if ((free != NULL) && (*free == SPIF_KV_INVALID)) {
+                *free = slot;
+            }
+            continue;
+        }
+
+        if (kv->index[slot].hash != hash) {
+            continue;
+        }
+
+        /* same hash, compare the key stored in flash */
+        if ((spif_read(kv->config.dev, kv->index[slot].addr, (uint8_t *)&rec, sizeof(spif_kv_rec_t)) == SPIF_SUCCESS) &&
+            (rec.key_len == key_len) &&
+            (spif_read(kv->config.dev, kv->index[slot].addr + sizeof(spif_kv_rec_t), (uint8_t *)stored, key_len) == SPIF_SUCCESS) &&
+            (memcmp(stored, key, key_len) == 0)) {
+            return slot;
+        }
+    }
+
+    return SPIF_KV_INVALID;
+}
+
+static int _spif_kv_index_put(spif_kv_t *kv, const char *key, uint8_t key_len, uint32_t addr, uint8_t deleted)
+{
+    uint32_t hash = _spif_kv_hash(key, key_len);
+    uint16_t free = SPIF_KV_INVALID;
+    uint16_t slot = _spif_kv_find(kv, key, key_len, hash, &free);
+
+    if (slot != SPIF_KV_INVALID) {
+        if (deleted) {
+            kv->index[slot].addr = SPIF_KV_SLOT_DELETED;
+            kv->keys--;
+        } else {
+            kv->index[slot].addr = addr;
+        }
+        return SPIF_SUCCESS;
+    }
+
+    if (deleted) {
+        return SPIF_SUCCESS;
+    }
+
+    if ((free == SPIF_KV_INVALID) || (kv->keys >= (SPIF_KV_INDEX_SIZE / 4 * 3))) {
+        return SPIF_FAIL;
+    }
+
+    kv->index[free].hash = hash;
+    kv->index[free].addr = addr;
+    kv->keys++;
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_kv_snapshot(spif_kv_t *kv)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_kv_snapshot_t snap;
+    uint32_t addr = 0;
+
+    snap.magic = SPIF_KV_SNAPSHOT_MAGIC;
+    snap.gen = kv->snapshot_gen + 1;
+    snap.pos = kv->pos;
+    snap.pos_seq = kv->seq;
+    snap.keys = kv->keys;
+    snap.crc = spif_crc32(SPIF_CRC32_INIT, &snap, offsetof(spif_kv_snapshot_t, crc));
+    snap.crc = spif_crc32(snap.crc, kv->index, sizeof(kv->index)) ^ SPIF_CRC32_INIT;
+
+    addr = _spif_kv_snapshot_addr(kv, snap.gen & 1);
+
+    for (uint16_t i = 0; i < kv->snapshot_sectors; i++) {
+        ret = spif_sector_erase(kv->config.dev, addr + i * SPIF_KV_SECTOR_SIZE);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    ret = spif_write(kv->config.dev, addr + sizeof(spif_kv_snapshot_t), (const uint8_t *)kv->index, sizeof(kv->index), SPIF_WRITE_MODE_PROGRAM);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    /* header last, the snapshot is valid from here on */
+    ret = spif_write(kv->config.dev, addr, (const uint8_t *)&snap, sizeof(spif_kv_snapshot_t), SPIF_WRITE_MODE_PROGRAM);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    kv->snapshot_gen = snap.gen;
+    kv->since_snapshot = 0;
+    kv->stats.snapshots++;
+
+    return ret;
+}
+
+/* start the next free sector as the tail, no compaction here */
+static int _spif_kv_open(spif_kv_t *kv)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_kv_sector_t hdr;
+    uint16_t sector = (kv->tail == SPIF_KV_INVALID) ? 0 : _spif_kv_next(kv, kv->tail);
+
+    if (kv->used >= kv->sectors) {
+        return SPIF_FAIL;
+    }
+
+    if (!(kv->erased[sector / 8] & (1 << (sector % 8)))) {
+        ret = spif_sector_erase(kv->config.dev, _spif_kv_sector_addr(kv, sector));
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    hdr.magic = SPIF_KV_SECTOR_MAGIC;
+    hdr.seq = kv->seq + 1;
+    hdr.crc = spif_crc32(SPIF_CRC32_INIT, &hdr.seq, sizeof(hdr.seq)) ^ SPIF_CRC32_INIT;
+    hdr.reserved = 0xFFFFFFFF;
+
+    kv->erased[sector / 8] &= ~(1 << (sector % 8));
+
+    ret = spif_write(kv->config.dev, _spif_kv_sector_addr(kv, sector), (const uint8_t *)&hdr, sizeof(spif_kv_sector_t), SPIF_WRITE_MODE_PROGRAM);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (kv->head == SPIF_KV_INVALID) {
+        kv->head = sector;
+        kv->gc_pos = _spif_kv_sector_addr(kv, sector) + sizeof(spif_kv_sector_t);
+    }
+
+    kv->tail = sector;
+    kv->used++;
+    kv->seq = hdr.seq;
+    kv->pos = _spif_kv_sector_addr(kv, sector) + sizeof(spif_kv_sector_t);
+
+    if ((kv->config.snapshot_interval != 0) && (++kv->since_snapshot >= kv->config.snapshot_interval)) {
+        ret = _spif_kv_snapshot(kv);
+    }
+
+    return ret;
+}
+
+static int _spif_kv_append(spif_kv_t *kv, const char *key, uint8_t key_len, const void *value, uint16_t val_len, uint8_t flags, uint32_t *addr)
+{
+    spif_kv_rec_t rec;
+    uint32_t size = _spif_kv_rec_size(key_len, val_len);
+    spif_iov_t iov[3];
+
+    memset(&rec, 0xFF, sizeof(spif_kv_rec_t));
+    rec.magic = SPIF_KV_REC_MAGIC;
+    rec.flags = flags;
+    rec.key_len = key_len;
+    rec.val_len = val_len;
+    rec.crc = spif_crc32(SPIF_CRC32_INIT, &rec, offsetof(spif_kv_rec_t, crc));
+    rec.crc = spif_crc32(rec.crc, key, key_len);
+    if (val_len != SPIF_KV_VAL_DELETED) {
+        rec.crc = spif_crc32(rec.crc, value, val_len);
+    }
+    rec.crc ^= SPIF_CRC32_INIT;
+
+    *addr = kv->pos;
+
+    /* the whole record is reserved first, a torn one fails its CRC and closes the sector */
+    kv->pos += size;
+
+    /* header, key and value straight from where they are, the alignment padding stays erased */
+    iov[0].buf = &rec;
+    iov[0].size = sizeof(spif_kv_rec_t);
+    iov[1].buf = key;
+    iov[1].size = key_len;
+    iov[2].buf = value;
+    iov[2].size = (val_len == SPIF_KV_VAL_DELETED) ? 0 : val_len;
+
+    return spif_writev(kv->config.dev, *addr, iov, 3);
+}
+
+/* move a live record of the head to the tail, as a single record commit */
+static int _spif_kv_copy(spif_kv_t *kv, uint32_t from, const spif_kv_rec_t *rec, const char *key)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_kv_rec_t copy = *rec;
+    uint32_t size = _spif_kv_rec_size(rec->key_len, rec->val_len);
+    uint32_t val_from = from + sizeof(spif_kv_rec_t) + rec->key_len;
+    uint32_t to = 0;
+    uint32_t chunk = 0;
+
+    if (!_spif_kv_room(kv, size)) {
+        ret = _spif_kv_open(kv);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    to = kv->pos;
+    kv->pos += size;
+
+    /* the flags change, so the CRC is computed again */
+    copy.flags = 0;
+
+    /* small records are copied in one program */
+    if (size <= SPIF_KV_IO_SIZE) {
+        ret = spif_read(kv->config.dev, from, kv->buf, size);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        copy.crc = spif_crc32(SPIF_CRC32_INIT, &copy, offsetof(spif_kv_rec_t, crc));
+        copy.crc = spif_crc32(copy.crc, &kv->buf[sizeof(spif_kv_rec_t)], copy.key_len + copy.val_len) ^ SPIF_CRC32_INIT;
+        memcpy(kv->buf, &copy, sizeof(spif_kv_rec_t));
+
+        ret = spif_write(kv->config.dev, to, kv->buf, size, SPIF_WRITE_MODE_PROGRAM);
+    } else {
+        copy.crc = spif_crc32(SPIF_CRC32_INIT, &copy, offsetof(spif_kv_rec_t, crc));
+        copy.crc = spif_crc32(copy.crc, key, copy.key_len);
+        for (uint32_t offset = 0; offset < copy.val_len; offset += chunk) {
+            chunk = ((copy.val_len - offset) > SPIF_KV_IO_SIZE) ? SPIF_KV_IO_SIZE : (copy.val_len - offset);
+            ret = spif_read(kv->config.dev, val_from + offset, kv->buf, chunk);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+            copy.crc = spif_crc32(copy.crc, kv->buf, chunk);
+        }
+        copy.crc ^= SPIF_CRC32_INIT;
+
+        ret = spif_write(kv->config.dev, to, (const uint8_t *)&copy, sizeof(spif_kv_rec_t), SPIF_WRITE_MODE_PROGRAM);
+        if (ret == SPIF_SUCCESS) {
+            ret = spif_write(kv->config.dev, to + sizeof(spif_kv_rec_t), (const uint8_t *)key, copy.key_len, SPIF_WRITE_MODE_PROGRAM);
+        }
+
+        for (uint32_t offset = 0; (ret == SPIF_SUCCESS) && (offset < copy.val_len); offset += chunk) {
+            chunk = ((copy.val_len - offset) > SPIF_KV_IO_SIZE) ? SPIF_KV_IO_SIZE : (copy.val_len - offset);
+            ret = spif_read(kv->config.dev, val_from + offset, kv->buf, chunk);
+            if (ret == SPIF_SUCCESS) {
+                ret = spif_write(kv->config.dev, to + sizeof(spif_kv_rec_t) + copy.key_len + offset, kv->buf, chunk, SPIF_WRITE_MODE_PROGRAM);
+            }
+        }
+    }
+
+    /* nothing may follow a gap that was never programmed, close the sector */
+    if (ret != SPIF_SUCCESS) {
+        kv->pos = 0;
+        return ret;
+    }
+
+    kv->stats.gc_copies++;
+
+    return _spif_kv_index_put(kv, key, copy.key_len, to, 0);
+}
+
+/**
+ * compact the head: move its live records to the tail, then erase it.
+ * *done returns 1 once the head was erased
+ */
+static int _spif_kv_gc_step(spif_kv_t *kv, uint32_t max_records, uint8_t *done)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_kv_rec_t rec;
+    char key[SPIF_KV_KEY_MAX];
+    uint32_t size = 0;
+    uint16_t slot = SPIF_KV_INVALID;
+    uint16_t head = kv->head;
+    uint8_t good = 0;
+
+    *done = 0;
+
+    /* the tail is never compacted */
+    if (kv->used < 2) {
+        return SPIF_SUCCESS;
+    }
+
+    for (uint32_t i = 0; i < max_records; i++) {
+        size = _spif_kv_rec_read(kv, kv->gc_pos, &rec, key, &good);
+        if (size == 0) {
+            ret = spif_sector_erase(kv->config.dev, _spif_kv_sector_addr(kv, head));
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+
+            kv->erased[head / 8] |= (1 << (head % 8));
+            kv->head = _spif_kv_next(kv, head);
+            kv->used--;
+            kv->gc_pos = _spif_kv_sector_addr(kv, kv->head) + sizeof(spif_kv_sector_t);
+            kv->stats.gc_erases++;
+            *done = 1;
+            return SPIF_SUCCESS;
+        }
+
+        /* live only while the index still points here */
+        slot = (!good || (rec.val_len == SPIF_KV_VAL_DELETED)) ? SPIF_KV_INVALID :
+               _spif_kv_find(kv, key, rec.key_len, _spif_kv_hash(key, rec.key_len), NULL);
+        if ((slot != SPIF_KV_INVALID) && (kv->index[slot].addr == kv->gc_pos)) {
+            ret = _spif_kv_copy(kv, kv->gc_pos, &rec, key);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+
+        kv->gc_pos += size;
+    }
+
+    return ret;
+}
+
+/* make room for size bytes of records in the tail */
+static int _spif_kv_reserve(spif_kv_t *kv, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t done = 0;
+
+    if (size > SPIF_KV_SECTOR_DATA) {
+        return SPIF_FAIL;
+    }
+
+    /**
+     * the last free sector belongs to compaction, when compaction took it (power loss
+     * before the head was erased) the head is reclaimed before records go to the tail.
+     * each round reclaims one sector, give up once a whole pass found nothing to reclaim
+     */
+    for (uint16_t i = 0; (i < kv->sectors) &&
+         ((kv->sectors - kv->used) < (_spif_kv_room(kv, size) ? (SPIF_KV_FREE_MIN - 1) : SPIF_KV_FREE_MIN)); i++) {
+        do {
+            ret = _spif_kv_gc_step(kv, SPIF_KV_SECTOR_DATA / sizeof(spif_kv_rec_t), &done);
+        } while ((ret == SPIF_SUCCESS) && !done && (kv->used >= 2));
+
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    if (_spif_kv_room(kv, size)) {
+        return SPIF_SUCCESS;
+    }
+
+    /* the store is full of live records */
+    if ((kv->sectors - kv->used) < SPIF_KV_FREE_MIN) {
+        return SPIF_FAIL;
+    }
+
+    return _spif_kv_open(kv);
+}
+
+/* replay the records of one sector from addr, a commit counts once its last record is seen */
+static int _spif_kv_replay_sector(spif_kv_t *kv, uint32_t addr, uint8_t is_tail)
+{
+    spif_kv_rec_t rec;
+    char key[SPIF_KV_KEY_MAX];
+    uint32_t pending[SPIF_KV_BATCH_MAX];
+    uint32_t count = 0;
+    uint32_t size = 0;
+    uint8_t good = 0;
+
+    while ((size = _spif_kv_rec_read(kv, addr, &rec, key, &good)) != 0) {
+        addr += size;
+
+        /* a torn record drops the commit it belongs to */
+        if (!good || (count >= SPIF_KV_BATCH_MAX)) {
+            count = 0;
+            continue;
+        }
+
+        pending[count++] = addr - size;
+
+        if (rec.flags & SPIF_KV_REC_MORE) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            (void)_spif_kv_rec_read(kv, pending[i], &rec, key, &good);
+            (void)_spif_kv_index_put(kv, key, rec.key_len, pending[i], rec.val_len == SPIF_KV_VAL_DELETED);
+            kv->stats.replayed++;
+        }
+        count = 0;
+    }
+
+    if (is_tail) {
+        /**
+         * appending goes on only if the rest of the sector is blank, and no unfinished
+         * commit is left, which the next record would otherwise complete
+         */
+        kv->pos = (count == 0) ? addr : 0;
+        for (uint32_t offset = addr; (kv->pos != 0) && (offset < _spif_kv_sector_end(kv, addr)); offset += size) {
+            size = _spif_kv_sector_end(kv, addr) - offset;
+            size = (size > SPIF_KV_IO_SIZE) ? SPIF_KV_IO_SIZE : size;
+            if (spif_read(kv->config.dev, offset, kv->buf, size) != SPIF_SUCCESS) {
+                kv->pos = 0;
+                break;
+            }
+
+            for (uint32_t i = 0; i < size; i++) {
+                if (kv->buf[i] != 0xFF) {
+                    kv->pos = 0;
+                    break;
+                }
+            }
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_kv_snapshot_load(spif_kv_t *kv, uint32_t *pos)
+{
+    spif_kv_snapshot_t snap[2];
+    spif_kv_sector_t hdr;
+    uint32_t crc = 0;
+    uint32_t slot = 0;
+    uint16_t limit = 0;
+
+    for (slot = 0; slot < 2; slot++) {
+        if ((spif_read(kv->config.dev, _spif_kv_snapshot_addr(kv, slot), (uint8_t *)&snap[slot], sizeof(spif_kv_snapshot_t)) != SPIF_SUCCESS) ||
+            (snap[slot].magic != SPIF_KV_SNAPSHOT_MAGIC)) {
+            snap[slot].magic = 0;
+        }
+    }
+
+    for (uint32_t i = 0; i < 2; i++) {
+        /* newest first */
+        slot = ((snap[1].magic != 0) && ((snap[0].magic == 0) || (snap[1].gen > snap[0].gen))) ? 1 : 0;
+        slot ^= i;
+        if (snap[slot].magic == 0) {
+            continue;
+        }
+
+        kv->snapshot_gen = (snap[slot].gen > kv->snapshot_gen) ? snap[slot].gen : kv->snapshot_gen;
+
+        /* the replay start must still be in the log, pos may be the end of its sector */
+        if ((snap[slot].pos <= _spif_kv_sector_addr(kv, 0)) || (snap[slot].pos > _spif_kv_sector_addr(kv, kv->sectors)) ||
+            (spif_read(kv->config.dev, _spif_kv_sector_addr(kv, _spif_kv_sector_of(kv, snap[slot].pos - 1)), (uint8_t *)&hdr, sizeof(hdr)) != SPIF_SUCCESS) ||
+            (hdr.magic != SPIF_KV_SECTOR_MAGIC) || (hdr.seq != snap[slot].pos_seq)) {
+            continue;
+        }
+
+        if (spif_read(kv->config.dev, _spif_kv_snapshot_addr(kv, slot) + sizeof(spif_kv_snapshot_t), (uint8_t *)kv->index, sizeof(kv->index)) != SPIF_SUCCESS) {
+            continue;
+        }
+
+        crc = spif_crc32(SPIF_CRC32_INIT, &snap[slot], offsetof(spif_kv_snapshot_t, crc));
+        crc = spif_crc32(crc, kv->index, sizeof(kv->index)) ^ SPIF_CRC32_INIT;
+        if (crc != snap[slot].crc) {
+            continue;
+        }
+
+        kv->keys = snap[slot].keys;
+        *pos = snap[slot].pos;
+
+        /**
+         * records compacted after the snapshot are gone from their old sectors,
+         * which are now past the replay start in log order. the copies are replayed
+         */
+        limit = (_spif_kv_sector_of(kv, *pos - 1) + kv->sectors - kv->head) % kv->sectors;
+        for (uint16_t i = 0; i < SPIF_KV_INDEX_SIZE; i++) {
+            if ((kv->index[i].addr < SPIF_KV_SLOT_DELETED) &&
+                (((_spif_kv_sector_of(kv, kv->index[i].addr) + kv->sectors - kv->head) % kv->sectors) > limit)) {
+                kv->index[i].addr = SPIF_KV_SLOT_DELETED;
+                kv->keys--;
+            }
+        }
+
+        return SPIF_SUCCESS;
+    }
+
+    return SPIF_FAIL;
+}
+
+int spif_kv_format(spif_kv_t *kv, const spif_kv_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (kv == NULL) {
+        return SPIF_FAIL;
+    }
+
+    kv->mounted = 0;
+
+    ret = _spif_kv_geometry(kv, config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = spif_erase_range(kv->config.dev, config->addr, config->size, NULL);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    return spif_kv_mount(kv, config);
+}
+
+int spif_kv_mount(spif_kv_t *kv, const spif_kv_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_kv_sector_t hdr;
+    uint32_t head_seq = 0;
+    uint32_t pos = 0;
+    uint16_t sector = 0;
+
+    if (kv == NULL) {
+        return SPIF_FAIL;
+    }
+
+    kv->mounted = 0;
+
+    ret = _spif_kv_geometry(kv, config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    memset(kv->erased, 0, sizeof(kv->erased));
+    memset(&kv->stats, 0, sizeof(spif_kv_stats_t));
+    kv->head = SPIF_KV_INVALID;
+    kv->tail = SPIF_KV_INVALID;
+    kv->used = 0;
+    kv->seq = 0;
+    kv->pos = 0;
+    kv->snapshot_gen = 0;
+    kv->since_snapshot = 0;
+
+    /* the log runs from the lowest to the highest sector seq */
+    for (uint16_t i = 0; i < kv->sectors; i++) {
+        ret = spif_read(kv->config.dev, _spif_kv_sector_addr(kv, i), (uint8_t *)&hdr, sizeof(hdr));
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        if ((hdr.magic != SPIF_KV_SECTOR_MAGIC) ||
+            (hdr.crc != (spif_crc32(SPIF_CRC32_INIT, &hdr.seq, sizeof(hdr.seq)) ^ SPIF_CRC32_INIT))) {
+            continue;
+        }
+
+        if ((kv->head == SPIF_KV_INVALID) || (hdr.seq < head_seq)) {
+            kv->head = i;
+            head_seq = hdr.seq;
+        }
+
+        if ((kv->tail == SPIF_KV_INVALID) || (hdr.seq > kv->seq)) {
+            kv->tail = i;
+            kv->seq = hdr.seq;
+        }
+    }
+
+    memset(kv->index, 0xFF, sizeof(kv->index));
+    kv->keys = 0;
+
+    if (kv->tail != SPIF_KV_INVALID) {
+        kv->used = (kv->tail + kv->sectors - kv->head) % kv->sectors + 1;
+        kv->gc_pos = _spif_kv_sector_addr(kv, kv->head) + sizeof(spif_kv_sector_t);
+
+        if (_spif_kv_snapshot_load(kv, &pos) != SPIF_SUCCESS) {
+            memset(kv->index, 0xFF, sizeof(kv->index));
+            kv->keys = 0;
+            pos = kv->gc_pos;
+        }
+
+        for (sector = _spif_kv_sector_of(kv, pos - 1); ; sector = _spif_kv_next(kv, sector)) {
+            if (sector != _spif_kv_sector_of(kv, pos - 1)) {
+                pos = _spif_kv_sector_addr(kv, sector) + sizeof(spif_kv_sector_t);
+            }
+
+            ret = _spif_kv_replay_sector(kv, pos, sector == kv->tail);
+            if ((ret != SPIF_SUCCESS) || (sector == kv->tail)) {
+                break;
+            }
+        }
+
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    kv->mounted = 1;
+
+    return ret;
+}
+
+int spif_kv_commit(spif_kv_t *kv, const spif_kv_item_t *items, uint32_t count)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t addr[SPIF_KV_BATCH_MAX];
+    uint32_t total = 0;
+    uint32_t new_keys = 0;
+    uint32_t key_len = 0;
+    uint16_t val_len = 0;
+
+    if ((kv == NULL) || !kv->mounted || (items == NULL) || (count == 0) || (count > SPIF_KV_BATCH_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        key_len = (items[i].key == NULL) ? 0 : strlen(items[i].key);
+        val_len = (items[i].value == NULL) ? SPIF_KV_VAL_DELETED : items[i].size;
+        if ((key_len == 0) || (key_len > SPIF_KV_KEY_MAX) || ((items[i].value != NULL) && (items[i].size == SPIF_KV_VAL_DELETED))) {
+            return SPIF_FAIL;
+        }
+        total += _spif_kv_rec_size(key_len, val_len);
+        if ((items[i].value != NULL) && (_spif_kv_find(kv, items[i].key, key_len, _spif_kv_hash(items[i].key, key_len), NULL) == SPIF_KV_INVALID)) {
+            new_keys++;
+        }
+    }
+
+    /* fail before anything reaches the flash */
+    if ((kv->keys + new_keys) > (SPIF_KV_INDEX_SIZE / 4 * 3)) {
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_kv_reserve(kv, total);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        key_len = strlen(items[i].key);
+        val_len = (items[i].value == NULL) ? SPIF_KV_VAL_DELETED : items[i].size;
+
+        ret = _spif_kv_append(kv, items[i].key, key_len, items[i].value, val_len,
+                              (i < (count - 1)) ? SPIF_KV_REC_MORE : 0, &addr[i]);
+        if (ret != SPIF_SUCCESS) {
+            /* the rest of the commit never gets its last record, close the sector */
+            kv->pos = 0;
+            return ret;
+        }
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        ret = _spif_kv_index_put(kv, items[i].key, strlen(items[i].key), addr[i], items[i].value == NULL);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    kv->stats.writes += count;
+
+    return ret;
+}
+
+int spif_kv_set(spif_kv_t *kv, const char *key, const void *value, uint16_t size)
+{
+    spif_kv_item_t item = {key, value, size};
+
+    if (value == NULL) {
+        return SPIF_FAIL;
+    }
+
+    return spif_kv_commit(kv, &item, 1);
+}
+
+int spif_kv_delete(spif_kv_t *kv, const char *key)
+{
+    spif_kv_item_t item = {key, NULL, 0};
+
+    return spif_kv_commit(kv, &item, 1);
+}
+
+int spif_kv_get(spif_kv_t *kv, const char *key, void *value, uint16_t size, uint16_t *len)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_kv_rec_t rec;
+    uint32_t key_len = 0;
+    uint16_t slot = SPIF_KV_INVALID;
+
+    if ((kv == NULL) || !kv->mounted || (key == NULL) || ((value == NULL) && (size != 0))) {
+        return SPIF_FAIL;
+    }
+
+    key_len = strlen(key);
+    if ((key_len == 0) || (key_len > SPIF_KV_KEY_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    slot = _spif_kv_find(kv, key, key_len, _spif_kv_hash(key, key_len), NULL);
+    if (slot == SPIF_KV_INVALID) {
+        return SPIF_FAIL;
+    }
+
+    ret = spif_read(kv->config.dev, kv->index[slot].addr, (uint8_t *)&rec, sizeof(spif_kv_rec_t));
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (len != NULL) {
+        *len = rec.val_len;
+    }
+
+    if (size > rec.val_len) {
+        size = rec.val_len;
+    }
+
+    if (size == 0) {
+        return SPIF_SUCCESS;
+    }
+
+    return spif_read(kv->config.dev, kv->index[slot].addr + sizeof(spif_kv_rec_t) + key_len, (uint8_t *)value, size);
+}
+
+int spif_kv_gc(spif_kv_t *kv, uint32_t max_records)
+{
+    uint8_t done = 0;
+
+    if ((kv == NULL) || !kv->mounted) {
+        return SPIF_FAIL;
+    }
+
+    return _spif_kv_gc_step(kv, max_records, &done);
+}
+
+int spif_kv_sync(spif_kv_t *kv)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((kv == NULL) || !kv->mounted) {
+        return SPIF_FAIL;
+    }
+
+    /* a snapshot needs a replay start inside the log */
+    if (kv->pos == 0) {
+        ret = _spif_kv_reserve(kv, SPIF_KV_SECTOR_DATA);
+        if ((ret != SPIF_SUCCESS) || (kv->since_snapshot == 0)) {
+            return ret;
+        }
+    }
+
+    return _spif_kv_snapshot(kv);
+}
+
+int spif_kv_stats_get(spif_kv_t *kv, spif_kv_stats_t *stats)
+{
+    if ((kv == NULL) || !kv->mounted || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *stats = kv->stats;
+    stats->keys = kv->keys;
+    stats->log_sectors = kv->sectors;
+    stats->free_sectors = kv->sectors - kv->used;
+
+    return SPIF_SUCCESS;
+}
@@ -0,0 +1,864 @@
+/*
+ * spif_lz.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <stddef.h>
+#include <string.h>
+#include "spif.h"
+#include "spif_crc.h"
+#include "spif_lz.h"
+
+#if (SPIF_LZ_BLOCK_SIZE < 64) || (SPIF_LZ_BLOCK_SIZE > 32768)
+#error "spif_lz: SPIF_LZ_BLOCK_SIZE must be 64 ~ 32768"
+#endif
+
+#define SPIF_LZ_SECTOR_MAGIC    0x43535A4C /* "LZSC" */
+#define SPIF_LZ_BLOCK_MAGIC     0x4B42     /* "BK" */
+
+#define SPIF_LZ_BLOCK_STORED    0x01 /* did not compress, the data as it was */
+
+#define SPIF_LZ_MATCH_MIN       4
+#define SPIF_LZ_LEN_MASK        15   /* 4 bit lengths of the token, 15: length bytes follow */
+
+typedef struct spif_lz_sector_s {
+    uint32_t magic;
+    uint32_t first;      /* compressed offset of the first block starting in this sector or later */
+    uint32_t raw_offset; /* uncompressed offset of that block */
+    uint32_t crc;
+} spif_lz_sector_t;
+
+/* followed by comp_size bytes */
+typedef struct spif_lz_block_s {
+    uint16_t magic;
+    uint8_t flags;
+    uint8_t reserved;
+    uint16_t raw_size;
+    uint16_t comp_size;
+    uint32_t raw_offset;
+    uint32_t crc;        /* of the header up to here and the compressed bytes */
+} spif_lz_block_t;
+
+#define SPIF_LZ_SECTOR_DATA     (SPIF_LZ_SECTOR_SIZE - sizeof(spif_lz_sector_t))
+
+/* ---------------------------------------------------------------------------------------------- */
+
+static uint32_t _spif_lz_read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t _spif_lz_hash(uint32_t v)
+{
+    return (uint32_t)(v * 2654435761U) >> (32 - SPIF_LZ_HASH_BITS);
+}
+
+/* the part of a length beyond the token: bytes of 255, then one below 255 */
+static uint32_t _spif_lz_len_put(uint8_t *dst, uint32_t op, uint32_t len)
+{
+    while (len >= 255) {
+        dst[op++] = 255;
+        len -= 255;
+    }
+    dst[op++] = (uint8_t)len;
+
+    return op;
+}
+
+/* one sequence: token, literals, and unless len is 0 (the last sequence) the match */
+static uint32_t _spif_lz_sequence(uint8_t *dst, uint32_t op, const uint8_t *literal, uint32_t lit, uint32_t off, uint32_t len)
+{
+    uint32_t token_lit = (lit < SPIF_LZ_LEN_MASK) ? lit : SPIF_LZ_LEN_MASK;
+    uint32_t token_len = 0;
+
+    if (len > 0) {
+        token_len = ((len - SPIF_LZ_MATCH_MIN) < SPIF_LZ_LEN_MASK) ? (len - SPIF_LZ_MATCH_MIN) : SPIF_LZ_LEN_MASK;
+    }
+
+    dst[op++] = (uint8_t)((token_lit << 4) | token_len);
+    if (token_lit == SPIF_LZ_LEN_MASK) {
+        op = _spif_lz_len_put(dst, op, lit - SPIF_LZ_LEN_MASK);
+    }
+
+    memcpy(&dst[op], literal, lit);
+    op += lit;
+
+    if (len > 0) {
+        dst[op++] = off & 0xFF;
+        dst[op++] = (off >> 8) & 0xFF;
+        if (token_len == SPIF_LZ_LEN_MASK) {
+            op = _spif_lz_len_put(dst, op, len - SPIF_LZ_MATCH_MIN - SPIF_LZ_LEN_MASK);
+        }
+    }
+
+    return op;
+}
+
+/* worst size of a sequence of lit literals and a match of len bytes */
+static uint32_t _spif_lz_sequence_max(uint32_t lit, uint32_t len)
+{
+    return 1 + (lit / 255 + 1) + lit + 2 + (len / 255 + 1);
+}
+
+/**
+ * LZ4 style: sequences of token (literal length << 4 | match length - 4), extra literal length,
+ * literals, match offset (2 bytes, little endian), extra match length; the last sequence has
+ * literals only. one hash table entry per 4 byte prefix, the latest position wins.
+ * returns the compressed size, 0 if it would not be below cap
+ */
+static uint32_t _spif_lz_compress(spif_lz_t *lz, const uint8_t *src, uint32_t size, uint8_t *dst, uint32_t cap)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+    uint32_t anchor = 0;
+    uint32_t ref = 0;
+    uint32_t len = 0;
+    uint32_t h = 0;
+
+    memset(lz->hash, 0, sizeof(lz->hash));
+
+    while (ip + SPIF_LZ_MATCH_MIN <= size) {
+        /* entries are position + 1, 0: empty */
+        h = _spif_lz_hash(_spif_lz_read32(&src[ip]));
+        ref = lz->hash[h];
+        lz->hash[h] = (uint16_t)(ip + 1);
+
+        if ((ref == 0) || (memcmp(&src[ref - 1], &src[ip], SPIF_LZ_MATCH_MIN) != 0)) {
+            ip++;
+            continue;
+        }
+
+        ref--;
+        len = SPIF_LZ_MATCH_MIN;
+        while ((ip + len < size) && (src[ref + len] == src[ip + len])) {
+            len++;
+        }
+
+        if (op + _spif_lz_sequence_max(ip - anchor, len) >= cap) {
+            return 0;
+        }
+
+        op = _spif_lz_sequence(dst, op, &src[anchor], ip - anchor, ip - ref, len);
+
+        /* the position before the end of the match, cheap help for the next search */
+        ip += len;
+        if (ip + SPIF_LZ_MATCH_MIN <= size) {
+            lz->hash[_spif_lz_hash(_spif_lz_read32(&src[ip - 2]))] = (uint16_t)(ip - 1);
+        }
+        anchor = ip;
+    }
+
+    if (op + _spif_lz_sequence_max(size - anchor, 0) >= cap) {
+        return 0;
+    }
+
+    return _spif_lz_sequence(dst, op, &src[anchor], size - anchor, 0, 0);
+}
+
+/* more length bytes of a 15 in the token */
+static int _spif_lz_len_get(const uint8_t *src, uint32_t size, uint32_t *ip, uint32_t *len)
+{
+    uint8_t b = 0;
+
+    do {
+        if (*ip >= size) {
+            return SPIF_FAIL;
+        }
+        b = src[(*ip)++];
+        *len += b;
+    } while (b == 255);
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_lz_decompress(const uint8_t *src, uint32_t size, uint8_t *dst, uint32_t raw_size)
+{
+    uint32_t ip = 0;
+    uint32_t op = 0;
+    uint32_t lit = 0;
+    uint32_t len = 0;
+    uint32_t off = 0;
+    uint8_t token = 0;
+
+    while (ip < size) {
+        token = src[ip++];
+
+        lit = token >> 4;
+        if ((lit == SPIF_LZ_LEN_MASK) && (_spif_lz_len_get(src, size, &ip, &lit) != SPIF_SUCCESS)) {
+            return SPIF_FAIL;
+        }
+
+        if ((lit > size - ip) || (lit > raw_size - op)) {
+            return SPIF_FAIL;
+        }
+
+        memcpy(&dst[op], &src[ip], lit);
+        ip += lit;
+        op += lit;
+
+        if (ip == size) {
+            break;
+        }
+
+        if (size - ip < 2) {
+            return SPIF_FAIL;
+        }
+
+        off = src[ip] | ((uint32_t)src[ip + 1] << 8);
+        ip += 2;
+
+        len = token & SPIF_LZ_LEN_MASK;
+        if ((len == SPIF_LZ_LEN_MASK) && (_spif_lz_len_get(src, size, &ip, &len) != SPIF_SUCCESS)) {
+            return SPIF_FAIL;
+        }
+        len += SPIF_LZ_MATCH_MIN;
+
+        if ((off == 0) || (off > op) || (len > raw_size - op)) {
+            return SPIF_FAIL;
+        }
+
+        /* byte by byte, the match may overlap what it produces */
+        for (uint32_t i = 0; i < len; i++) {
+            dst[op + i] = dst[op - off + i];
+        }
+        op += len;
+    }
+
+    return (op == raw_size) ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/* flash address of a compressed offset */
+static uint32_t _spif_lz_addr(spif_lz_t *lz, uint32_t offset)
+{
+    return lz->config.addr + (offset / SPIF_LZ_SECTOR_DATA) * SPIF_LZ_SECTOR_SIZE + sizeof(spif_lz_sector_t) +
+           offset % SPIF_LZ_SECTOR_DATA;
+}
+
+static uint32_t _spif_lz_sector_addr(spif_lz_t *lz, uint32_t sector)
+{
+    return lz->config.addr + sector * SPIF_LZ_SECTOR_SIZE;
+}
+
+/* the bytes not programmed yet come from the unit being filled */
+static int _spif_lz_flash_read(spif_lz_t *lz, uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+    uint32_t n = 0;
+
+    if (addr < lz->prog_addr) {
+        n = (lz->prog_addr - addr < size) ? (lz->prog_addr - addr) : size;
+        ret = spif_fast_read(lz->config.dev, addr, buf, n);
+    }
+
+    if ((ret == SPIF_SUCCESS) && (n < size)) {
+        memcpy(&buf[n], &lz->page[addr + n - lz->page_addr], size - n);
+    }
+
+    return ret;
+}
+
+/* read compressed bytes, skipping the sector headers */
+static int _spif_lz_stream_read(spif_lz_t *lz, uint32_t offset, uint8_t *buf, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+    uint32_t n = 0;
+
+    while ((ret == SPIF_SUCCESS) && (size > 0)) {
+        n = SPIF_LZ_SECTOR_DATA - offset % SPIF_LZ_SECTOR_DATA;
+        if (n > size) {
+            n = size;
+        }
+
+        ret = _spif_lz_flash_read(lz, _spif_lz_addr(lz, offset), buf, n);
+        offset += n;
+        buf += n;
+        size -= n;
+    }
+
+    return ret;
+}
+
+static int _spif_lz_erased(spif_lz_t *lz, uint32_t addr, uint32_t size)
+{
+    uint32_t n = 0;
+
+    /* the cache is the scratch buffer */
+    lz->cache_size = 0;
+
+    while (size > 0) {
+        n = (size < SPIF_LZ_BLOCK_SIZE) ? size : SPIF_LZ_BLOCK_SIZE;
+        if (spif_fast_read(lz->config.dev, addr, lz->cache, n) != SPIF_SUCCESS) {
+            return 0;
+        }
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (lz->cache[i] != 0xFF) {
+                return 0;
+            }
+        }
+
+        addr += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+static int _spif_lz_sector_get(spif_lz_t *lz, uint32_t sector, spif_lz_sector_t *header)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lz_flash_read(lz, _spif_lz_sector_addr(lz, sector), (uint8_t *)header, sizeof(spif_lz_sector_t));
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if ((header->magic != SPIF_LZ_SECTOR_MAGIC) ||
+        ((spif_crc32(SPIF_CRC32_INIT, header, offsetof(spif_lz_sector_t, crc)) ^ SPIF_CRC32_INIT) != header->crc)) {
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _spif_lz_block_get(spif_lz_t *lz, uint32_t offset, spif_lz_block_t *block)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (offset + sizeof(spif_lz_block_t) > lz->capacity) {
+        return SPIF_FAIL;
+    }
+
+    ret = _spif_lz_stream_read(lz, offset, (uint8_t *)block, sizeof(spif_lz_block_t));
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if ((block->magic != SPIF_LZ_BLOCK_MAGIC) || (block->raw_size == 0) || (block->raw_size > SPIF_LZ_BLOCK_SIZE) ||
+        (block->comp_size > SPIF_LZ_BLOCK_SIZE) || (offset + sizeof(spif_lz_block_t) + block->comp_size > lz->capacity)) {
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+/* header and compressed bytes (into out) of the block at offset, checked */
+static int _spif_lz_block_load(spif_lz_t *lz, uint32_t offset, spif_lz_block_t *block)
+{
+    int ret = SPIF_SUCCESS;
+    uint32_t crc = 0;
+
+    ret = _spif_lz_block_get(lz, offset, block);
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_lz_stream_read(lz, offset + sizeof(spif_lz_block_t), lz->out, block->comp_size);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    crc = spif_crc32(SPIF_CRC32_INIT, block, offsetof(spif_lz_block_t, crc));
+    crc = spif_crc32(crc, lz->out, block->comp_size) ^ SPIF_CRC32_INIT;
+
+    return (crc == block->crc) ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+/* compressed offset of the block holding an uncompressed offset below raw_end */
+static int _spif_lz_find(spif_lz_t *lz, uint32_t offset, uint32_t *pos)
+{
+    spif_lz_sector_t header;
+    spif_lz_block_t block;
+    uint32_t lo = 0;
+    uint32_t hi = (lz->end + SPIF_LZ_SECTOR_DATA - 1) / SPIF_LZ_SECTOR_DATA;
+    uint32_t mid = 0;
+    uint32_t s = 0;
+    uint32_t first = 0xFFFFFFFF;
+
+    /* the last sector whose first block starts at or before offset, a power loss may leave bad headers */
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        s = mid;
+        while ((s < hi) && (_spif_lz_sector_get(lz, s, &header) != SPIF_SUCCESS)) {
+            s++;
+        }
+
+        if ((s < hi) && (header.raw_offset <= offset)) {
+            first = header.first;
+            lo = s + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (first == 0xFFFFFFFF) {
+        return SPIF_FAIL;
+    }
+
+    /* then block by block, a sector holds only a few */
+    for (uint32_t p = first; p < lz->end; p += sizeof(spif_lz_block_t) + block.comp_size) {
+        if ((_spif_lz_block_get(lz, p, &block) != SPIF_SUCCESS) || (offset < block.raw_offset)) {
+            return SPIF_FAIL;
+        }
+
+        if (offset < block.raw_offset + block.raw_size) {
+            *pos = p;
+            return SPIF_SUCCESS;
+        }
+    }
+
+    return SPIF_FAIL;
+}
+
+static int _spif_lz_cache_fill(spif_lz_t *lz, uint32_t offset)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_lz_block_t block;
+    uint32_t pos = 0;
+    uint64_t start = 0;
+
+    lz->cache_size = 0;
+
+    ret = _spif_lz_find(lz, offset, &pos);
+    if (ret == SPIF_SUCCESS) {
+        ret = _spif_lz_block_load(lz, pos, &block);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    start = spif_now_us(lz->config.dev);
+
+    if (block.flags & SPIF_LZ_BLOCK_STORED) {
+        ret = (block.comp_size == block.raw_size) ? SPIF_SUCCESS : SPIF_FAIL;
+        memcpy(lz->cache, lz->out, block.raw_size);
+    } else {
+        ret = _spif_lz_decompress(lz->out, block.comp_size, lz->cache, block.raw_size);
+    }
+
+    lz->stats.decompress_us += (uint32_t)(spif_now_us(lz->config.dev) - start);
+    lz->stats.read_blocks++;
+
+    if (ret == SPIF_SUCCESS) {
+        lz->cache_offset = block.raw_offset;
+        lz->cache_size = block.raw_size;
+    }
+
+    return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+static void _spif_lz_unit_start(spif_lz_t *lz, uint32_t addr)
+{
+    lz->page_addr = addr - addr % lz->unit;
+    lz->prog_addr = addr;
+    lz->fill_addr = addr;
+    memset(lz->page, 0xFF, lz->unit);
+}
+
+/* program what is filled in and not programmed yet, a full unit makes room for the next one */
+static int _spif_lz_program(spif_lz_t *lz)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (lz->fill_addr > lz->prog_addr) {
+        ret = spif_write(lz->config.dev, lz->prog_addr, &lz->page[lz->prog_addr - lz->page_addr], lz->fill_addr - lz->prog_addr,
+                         SPIF_WRITE_MODE_PROGRAM);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+
+        lz->stats.programs++;
+        lz->stats.comp_bytes += lz->fill_addr - lz->prog_addr;
+        lz->prog_addr = lz->fill_addr;
+    }
+
+    if (lz->fill_addr == lz->page_addr + lz->unit) {
+        _spif_lz_unit_start(lz, lz->fill_addr);
+    }
+
+    return SPIF_SUCCESS;
+}
+
+/* append a block (header and compressed bytes), opening sectors on the way */
+static int _spif_lz_put(spif_lz_t *lz, const uint8_t *data, uint32_t size, uint32_t raw_offset, uint32_t raw_next)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_lz_sector_t header;
+    uint32_t start = lz->end;
+    uint32_t n = 0;
+
+    if (lz->end + size > lz->capacity) {
+        return SPIF_FAIL;
+    }
+
+    while (size > 0) {
+        if (lz->end % SPIF_LZ_SECTOR_DATA == 0) {
+            /* the first block starting here is this one, or the next if this one started before */
+            header.magic = SPIF_LZ_SECTOR_MAGIC;
+            header.first = (lz->end == start) ? start : (lz->end + size);
+            header.raw_offset = (lz->end == start) ? raw_offset : raw_next;
+            header.crc = spif_crc32(SPIF_CRC32_INIT, &header, offsetof(spif_lz_sector_t, crc)) ^ SPIF_CRC32_INIT;
+
+            _spif_lz_unit_start(lz, _spif_lz_sector_addr(lz, lz->end / SPIF_LZ_SECTOR_DATA));
+            memcpy(lz->page, &header, sizeof(spif_lz_sector_t));
+            lz->fill_addr += sizeof(spif_lz_sector_t);
+        }
+
+        n = lz->page_addr + lz->unit - lz->fill_addr;
+        if (n > size) {
+            n = size;
+        }
+
+        memcpy(&lz->page[lz->fill_addr - lz->page_addr], data, n);
+        lz->fill_addr += n;
+        lz->end += n;
+        data += n;
+        size -= n;
+
+        if (lz->fill_addr == lz->page_addr + lz->unit) {
+            ret = _spif_lz_program(lz);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
+
+/* compress the uncompressed bytes waiting in raw into one block */
+static int _spif_lz_block_end(spif_lz_t *lz)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_lz_block_t block;
+    uint8_t *comp = &lz->out[sizeof(spif_lz_block_t)];
+    uint32_t size = 0;
+    uint64_t start = 0;
+
+    start = spif_now_us(lz->config.dev);
+
+    memset(&block, 0, sizeof(spif_lz_block_t));
+    block.magic = SPIF_LZ_BLOCK_MAGIC;
+    block.raw_size = (uint16_t)lz->raw_fill;
+    block.raw_offset = lz->raw_end;
+
+    size = _spif_lz_compress(lz, lz->raw, lz->raw_fill, comp, lz->raw_fill);
+    if (size == 0) {
+        memcpy(comp, lz->raw, lz->raw_fill);
+        size = lz->raw_fill;
+        block.flags |= SPIF_LZ_BLOCK_STORED;
+        lz->stats.stored_blocks++;
+    }
+
+    block.comp_size = (uint16_t)size;
+    block.crc = spif_crc32(SPIF_CRC32_INIT, &block, offsetof(spif_lz_block_t, crc));
+    block.crc = spif_crc32(block.crc, comp, size) ^ SPIF_CRC32_INIT;
+    memcpy(lz->out, &block, sizeof(spif_lz_block_t));
+
+    lz->stats.compress_us += (uint32_t)(spif_now_us(lz->config.dev) - start);
+
+    ret = _spif_lz_put(lz, lz->out, sizeof(spif_lz_block_t) + size, lz->raw_end, lz->raw_end + lz->raw_fill);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    lz->raw_end += lz->raw_fill;
+    lz->raw_fill = 0;
+    lz->stats.blocks++;
+
+    return SPIF_SUCCESS;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+static int _spif_lz_setup(spif_lz_t *lz, const spif_lz_config_t *config)
+{
+    spif_flash_info_t *info = NULL;
+
+    if ((lz == NULL) || (config == NULL) || (config->dev == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    info = &config->dev->flash;
+
+    if ((config->size < SPIF_LZ_SECTOR_SIZE) || (config->addr % SPIF_LZ_SECTOR_SIZE != 0) || (config->size % SPIF_LZ_SECTOR_SIZE != 0) ||
+        (config->addr % info->sector_size != 0) || (config->size % info->sector_size != 0) ||
+        ((uint64_t)config->addr + config->size > info->chip_size)) {
+        return SPIF_FAIL;
+    }
+
+    memset(lz, 0, sizeof(spif_lz_t));
+    lz->config = *config;
+    lz->capacity = config->size / SPIF_LZ_SECTOR_SIZE * SPIF_LZ_SECTOR_DATA;
+    lz->unit = (info->page_size < SPIF_LZ_PAGE_SIZE) ? info->page_size : SPIF_LZ_PAGE_SIZE;
+
+    if ((lz->unit == 0) || (SPIF_LZ_SECTOR_SIZE % lz->unit != 0)) {
+        return SPIF_FAIL;
+    }
+
+    /* nothing buffered, every read goes to the flash */
+    _spif_lz_unit_start(lz, config->addr + config->size);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_lz_format(spif_lz_t *lz, const spif_lz_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    ret = _spif_lz_setup(lz, config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = spif_erase_range(config->dev, config->addr, config->size, NULL);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    _spif_lz_unit_start(lz, config->addr);
+
+    return SPIF_SUCCESS;
+}
+
+/* follow the blocks from *offset as long as they check out */
+static uint32_t _spif_lz_walk(spif_lz_t *lz, uint32_t *offset, uint32_t *raw_offset)
+{
+    spif_lz_block_t block;
+    uint32_t count = 0;
+
+    while ((_spif_lz_block_load(lz, *offset, &block) == SPIF_SUCCESS) && (block.raw_offset == *raw_offset)) {
+        *offset += sizeof(spif_lz_block_t) + block.comp_size;
+        *raw_offset += block.raw_size;
+        count++;
+    }
+
+    return count;
+}
+
+int spif_lz_mount(spif_lz_t *lz, const spif_lz_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_lz_sector_t header;
+    uint32_t sectors = 0;
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    uint32_t mid = 0;
+    uint32_t sector = 0;
+    uint32_t end = 0;
+    uint32_t raw_end = 0;
+    uint32_t addr = 0;
+    uint32_t zero = 0;
+
+    ret = _spif_lz_setup(lz, config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    /* sectors are opened in order: the first one whose first unit is blank ends the used ones */
+    sectors = config->size / SPIF_LZ_SECTOR_SIZE;
+    hi = sectors;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (_spif_lz_erased(lz, _spif_lz_sector_addr(lz, mid), lz->unit)) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    if (lo == 0) {
+        _spif_lz_unit_start(lz, config->addr);
+        return SPIF_SUCCESS;
+    }
+
+    /* the blocks of the last good sector header onwards are checked */
+    sector = lo;
+    do {
+        sector--;
+        ret = _spif_lz_sector_get(lz, sector, &header);
+    } while ((ret != SPIF_SUCCESS) && (sector > 0));
+
+    if (ret != SPIF_SUCCESS) {
+        return SPIF_FAIL;
+    }
+
+    end = header.first;
+    raw_end = header.raw_offset;
+
+    /**
+     * none there: the block running into this sector may be the one cut short, or this sector
+     * is the one opened after an earlier power loss, the sector before tells
+     */
+    if ((_spif_lz_walk(lz, &end, &raw_end) == 0) && (sector > 0) && (_spif_lz_sector_get(lz, sector - 1, &header) == SPIF_SUCCESS)) {
+        end = header.first;
+        raw_end = header.raw_offset;
+        (void)_spif_lz_walk(lz, &end, &raw_end);
+    }
+
+    /* what follows the last good block must be blank, if not, go on in the next blank sector */
+    while (end < lz->capacity) {
+        sector = end / SPIF_LZ_SECTOR_DATA;
+        addr = (end % SPIF_LZ_SECTOR_DATA != 0) ? _spif_lz_addr(lz, end) : _spif_lz_sector_addr(lz, sector);
+        if (_spif_lz_erased(lz, addr, _spif_lz_sector_addr(lz, sector + 1) - addr)) {
+            break;
+        }
+        end = (sector + 1) * SPIF_LZ_SECTOR_DATA;
+
+        /**
+         * a sector opened by the block cut short has a good header for raw offsets never stored,
+         * the headers would no longer ascend for the binary search of spif_lz_read(): clear its magic
+         */
+        if ((end < lz->capacity) && (_spif_lz_sector_get(lz, sector + 1, &header) == SPIF_SUCCESS) &&
+            (header.raw_offset > raw_end)) {
+            ret = spif_write(config->dev, _spif_lz_sector_addr(lz, sector + 1), (const uint8_t *)&zero, sizeof(zero),
+                             SPIF_WRITE_MODE_PROGRAM);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+
+    lz->end = end;
+    lz->raw_end = raw_end;
+
+    if (end < lz->capacity) {
+        _spif_lz_unit_start(lz, (end % SPIF_LZ_SECTOR_DATA != 0) ? _spif_lz_addr(lz, end) : _spif_lz_sector_addr(lz, end / SPIF_LZ_SECTOR_DATA));
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_lz_write(spif_lz_t *lz, const void *data, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+
+    const uint8_t *src = (const uint8_t *)data;
+    uint32_t n = 0;
+
+    if ((lz == NULL) || ((data == NULL) && (size > 0))) {
+        return SPIF_FAIL;
+    }
+
+    while (size > 0) {
+        n = SPIF_LZ_BLOCK_SIZE - lz->raw_fill;
+        if (n > size) {
+            n = size;
+        }
+
+        memcpy(&lz->raw[lz->raw_fill], src, n);
+        lz->raw_fill += n;
+        lz->stats.raw_bytes += n;
+        src += n;
+        size -= n;
+
+        if (lz->raw_fill == SPIF_LZ_BLOCK_SIZE) {
+            ret = _spif_lz_block_end(lz);
+            if (ret != SPIF_SUCCESS) {
+                return ret;
+            }
+        }
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int spif_lz_flush(spif_lz_t *lz)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (lz == NULL) {
+        return SPIF_FAIL;
+    }
+
+    if (lz->raw_fill > 0) {
+        ret = _spif_lz_block_end(lz);
+    }
+
+    /* a block that does not fit fails the flush, the complete ones before it are programmed all the same */
+    if (_spif_lz_program(lz) != SPIF_SUCCESS) {
+        return SPIF_FAIL;
+    }
+
+    return ret;
+}
+
+int spif_lz_read(spif_lz_t *lz, uint32_t offset, void *data, uint32_t size, uint32_t *read_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t *dst = (uint8_t *)data;
+    uint32_t total = 0;
+    uint32_t done = 0;
+    uint32_t n = 0;
+
+    if ((lz == NULL) || ((data == NULL) && (size > 0)) || (read_size == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    total = lz->raw_end + lz->raw_fill;
+
+    while ((done < size) && (offset < total)) {
+        if (offset >= lz->raw_end) {
+            /* not compressed yet */
+            n = total - offset;
+            if (n > size - done) {
+                n = size - done;
+            }
+            memcpy(&dst[done], &lz->raw[offset - lz->raw_end], n);
+        } else {
+            if ((lz->cache_size != 0) && (offset >= lz->cache_offset) && (offset < lz->cache_offset + lz->cache_size)) {
+                lz->stats.read_hits++;
+            } else {
+                ret = _spif_lz_cache_fill(lz, offset);
+                if (ret != SPIF_SUCCESS) {
+                    break;
+                }
+            }
+
+            n = lz->cache_offset + lz->cache_size - offset;
+            if (n > size - done) {
+                n = size - done;
+            }
+            memcpy(&dst[done], &lz->cache[offset - lz->cache_offset], n);
+        }
+
+        done += n;
+        offset += n;
+    }
+
+    lz->stats.read_bytes += done;
+    *read_size = done;
+
+    return ret;
+}
+
+uint32_t spif_lz_size(spif_lz_t *lz)
+{
+    return lz->raw_end + lz->raw_fill;
+}
+
+int spif_lz_stats_get(spif_lz_t *lz, spif_lz_stats_t *stats)
+{
+    if ((lz == NULL) || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *stats = lz->stats;
+
+    return SPIF_SUCCESS;
+}
+
+void spif_lz_stats_reset(spif_lz_t *lz)
+{
+    memset(&lz->stats, 0, sizeof(spif_lz_stats_t));
+}
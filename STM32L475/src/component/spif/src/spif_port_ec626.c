@@ -13,6 +13,7 @@
 
 #include "spif.h"
 #include "spif_port.h"
+#include "spif_port_lock.h"
 
 extern ARM_DRIVER_USART Driver_LPUSART1;
 
@@ -33,6 +34,29 @@ static ARM_DRIVER_SPI *s_spi_drv = &Driver_SPI1;
 
 #define EC626_SPI_FREQUENCY           (4 * 1000 * 1000)
 
+/**
+ * 接收时 MOSI 上发送的 dummy 数据, 同时是 DMA 的源地址, 所以不能放在栈上;
+ * 超过这个长度的接收分段进行, 片选一直保持
+ */
+#ifndef EC626_SPI_DUMMY_SIZE
+#define EC626_SPI_DUMMY_SIZE          512
+#endif
+
+/* 一段传输的超时, 512 字节在 4 MHz 下约 1 ms */
+#define EC626_SPI_TIMEOUT_MS          100
+
+/**
+ * 总线锁的天花板优先级 (BASEPRI 值), 只在抢锁时屏蔽, 0 表示不屏蔽中断;
+ * 在中断中使用 flash 时设置为其中最高的优先级, 并且要低于 SPI 驱动自己的中断
+ */
+#ifndef EC626_SPI_LOCK_CEILING
+#define EC626_SPI_LOCK_CEILING        0
+#endif
+
+static spif_port_lock_t s_spi_lock;
+
+static uint8_t s_spi_dummy[EC626_SPI_DUMMY_SIZE];
+
 static int ec626_log(const char *format, ...)
 {
     char str_buf[512] = {0};
@@ -47,6 +71,22 @@ static int ec626_log(const char *format, ...)
     return 0;
 }
 
+/* 粗略的忙等, 每次循环约 4 个时钟, 只用于等锁和传输超时 */
+static void _ec626_delay_us(uint32_t us)
+{
+    volatile uint32_t count = us * (SystemCoreClock / 1000000 / 4);
+
+    while (count--) {
+    }
+}
+
+static void _ec626_delay_ms(uint32_t ms)
+{
+    while (ms--) {
+        _ec626_delay_us(1000);
+    }
+}
+
 static void _ec626_spi_cs_pin_init(void)
 {
     pad_config_t pad_config = {0};
@@ -72,6 +112,10 @@ static int _ec626_spi_init(void)
 
     _ec626_spi_cs_pin_init();
 
+    memset(s_spi_dummy, 0xFF, sizeof(s_spi_dummy));
+
+    spif_port_lock_init(&s_spi_lock, EC626_SPI_LOCK_CEILING, _ec626_delay_us);
+
     ret = s_spi_drv->Initialize(NULL);
     if (ret != ARM_DRIVER_OK) {
         return SPIF_FAIL;
@@ -92,93 +136,172 @@ static int _ec626_spi_init(void)
 
 static int _ec626_spi_deinit(void)
 {
-    // TODO
-    return SPIF_SUCCESS;
+    int ret = SPIF_SUCCESS;
+
+    /* 先中止可能还在进行的 DMA 传输, 断电之后它不能再访问缓冲 */
+    (void)s_spi_drv->Control(ARM_SPI_ABORT_TRANSFER, 0);
+
+    if (s_spi_drv->PowerControl(ARM_POWER_OFF) != ARM_DRIVER_OK) {
+        ret = SPIF_FAIL;
+    }
+
+    /* Initialize 打开的 DMA 通道由 Uninitialize 关闭 */
+    if (s_spi_drv->Uninitialize() != ARM_DRIVER_OK) {
+        ret = SPIF_FAIL;
+    }
+
+    /* 片选保持输出高电平, flash 不会被选中 */
+    _ec626_spi_cs_set(1);
+
+    return ret;
+}
+
+static int _ec626_spi_lock(uint32_t timeout_ms)
+{
+    return spif_port_lock_take(&s_spi_lock, timeout_ms);
 }
 
-static void _ec626_spi_lock(uint32_t ms)
+static int _ec626_spi_trylock(void)
 {
-    // TODO
+    return spif_port_lock_try(&s_spi_lock);
 }
 
 static void _ec626_spi_unlock(void)
 {
-    // TODO
+    spif_port_lock_give(&s_spi_lock);
 }
 
-static int _ec626_spi_recv(uint8_t *recv_buf, uint32_t recv_size)
+/**
+ * Send/Transfer 只是启动传输 (DMA), 要等驱动空闲之后才能继续或者释放片选;
+ * 没有周期计数器, 超时按 1 us 的忙等累计, 实际略长. 超时后中止传输, 否则驱动一直忙
+ */
+static int _ec626_spi_wait(void)
 {
-    int ret = 0;
+    ARM_SPI_STATUS status;
+    uint32_t elapsed_us = 0;
 
-    /**
-     * 1. Nor Flash 所用到的指令中, 接收的数据应该不会超过 9 个字节
-     * 2. 0xFF 为 dummy 数据
-     */
-    uint8_t send_buf[16] = {0xFF};
+    status = s_spi_drv->GetStatus();
+    while (status.busy) {
+        if ((elapsed_us / 1000) >= EC626_SPI_TIMEOUT_MS) {
+            (void)s_spi_drv->Control(ARM_SPI_ABORT_TRANSFER, 0);
+            return SPIF_TIMEOUT;
+        }
 
-    if ((recv_buf == NULL) || (recv_size == 0) || (recv_size > 16)) {
-        return SPIF_FAIL;
+        _ec626_delay_us(1);
+        elapsed_us++;
+
+        status = s_spi_drv->GetStatus();
     }
 
-    _ec626_spi_cs_set(0);
+    return status.data_lost ? SPIF_FAIL : SPIF_SUCCESS;
+}
 
-    /**
-     * 1. 对于硬件 SPI 来说, 只是调用 Receive 函数是没有时钟信号输出的
-     * 2. 只有调用 Transfer 函数, 在发送的时候同时接收, 才能有时钟信号输出
-     */
-    ret = s_spi_drv->Transfer(send_buf, recv_buf, recv_size);
-    if (ret != ARM_DRIVER_OK) {
+/**
+ * 一段传输, tx_buf 为 NULL 时发送 0xFF, rx_buf 为 NULL 时丢弃收到的数据
+ * 1. 对于硬件 SPI 来说, 只是调用 Receive 函数是没有时钟信号输出的
+ * 2. 只有调用 Transfer 函数, 在发送的时候同时接收, 才能有时钟信号输出
+ */
+static int _ec626_spi_segment(const uint8_t *tx_buf, uint8_t *rx_buf, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+    int32_t status = ARM_DRIVER_OK;
+    const uint8_t *src = NULL;
+    uint32_t chunk = 0;
+
+    for (uint32_t offset = 0; (offset < size) && (ret == SPIF_SUCCESS); offset += chunk) {
+        if (tx_buf != NULL) {
+            src = &tx_buf[offset];
+            chunk = size - offset;
+        } else {
+            src = s_spi_dummy;
+            chunk = ((size - offset) < EC626_SPI_DUMMY_SIZE) ? (size - offset) : EC626_SPI_DUMMY_SIZE;
+        }
+
+        if (rx_buf != NULL) {
+            status = s_spi_drv->Transfer(src, &rx_buf[offset], chunk);
+        } else {
+            status = s_spi_drv->Send(src, chunk);
+        }
+
+        if (status != ARM_DRIVER_OK) {
+            return SPIF_FAIL;
+        }
+
+        ret = _ec626_spi_wait();
+    }
+
+    return ret;
+}
+
+static int _ec626_spi_recv(uint8_t *recv_buf, uint32_t recv_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((recv_buf == NULL) || (recv_size == 0)) {
         return SPIF_FAIL;
     }
 
+    _ec626_spi_cs_set(0);
+    ret = _ec626_spi_segment(NULL, recv_buf, recv_size);
     _ec626_spi_cs_set(1);
 
-    return SPIF_SUCCESS;
+    return ret;
 }
 
 static int _ec626_spi_send(const uint8_t *send_buf, uint32_t send_size)
 {
-    int ret = 0;
-
-    /* Nor Flash 所用到的指令中, 接收的数据应该不会超过 9 个字节 */
-    uint8_t recv_buf[16] = {0x0};
+    int ret = SPIF_SUCCESS;
 
-    if ((send_buf == NULL) || (send_size == 0) || (send_size > 16)) {
+    if ((send_buf == NULL) || (send_size == 0)) {
         return SPIF_FAIL;
     }
 
     _ec626_spi_cs_set(0);
+    ret = _ec626_spi_segment(send_buf, NULL, send_size);
+    _ec626_spi_cs_set(1);
 
-    /* 尽管调用 Send 函数是有时钟输出的, 为了统一, 这里也改为调用 Transfer 函数 */
-    ret = s_spi_drv->Transfer(send_buf, recv_buf, send_size);
-    if (ret != ARM_DRIVER_OK) {
+    return ret;
+}
+
+/* 指令 (+ 地址 + 数据) 和读到的数据在同一个片选周期内 */
+static int _ec626_spi_transfer(const uint8_t *send_buf, uint32_t send_size, uint8_t *recv_buf, uint32_t recv_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((send_buf == NULL) || (send_size == 0) || ((recv_buf == NULL) && (recv_size > 0))) {
         return SPIF_FAIL;
     }
 
+    _ec626_spi_cs_set(0);
+
+    ret = _ec626_spi_segment(send_buf, NULL, send_size);
+    if ((ret == SPIF_SUCCESS) && (recv_size > 0)) {
+        ret = _ec626_spi_segment(NULL, recv_buf, recv_size);
+    }
+
     _ec626_spi_cs_set(1);
 
-    return SPIF_SUCCESS;
+    return ret;
 }
 
-int _ec626_spi_transfer(const uint8_t *send_buf, uint32_t send_size, uint8_t *recv_buf, uint32_t recv_size)
+/* 各段依次传输, 片选一直保持; CMSIS 驱动没有 DMA 链表, 每段单独启动一次 */
+static int _ec626_spi_transfer_iov(const spif_port_iov_t *iov, uint32_t iov_count)
 {
-    int ret = 0;
+    int ret = SPIF_SUCCESS;
 
-    _ec626_spi_cs_set(0);
-
-    ret = _ec626_spi_send(send_buf, send_size);
-    if (ret != ARM_DRIVER_OK) {
+    if ((iov == NULL) || (iov_count == 0)) {
         return SPIF_FAIL;
     }
 
-    ret = _ec626_spi_recv(recv_buf, recv_size);
-    if (ret != ARM_DRIVER_OK) {
-        return SPIF_FAIL;
+    _ec626_spi_cs_set(0);
+
+    for (uint32_t i = 0; (i < iov_count) && (ret == SPIF_SUCCESS); i++) {
+        ret = _ec626_spi_segment(iov[i].tx_buf, iov[i].rx_buf, iov[i].size);
     }
 
     _ec626_spi_cs_set(1);
 
-    return SPIF_SUCCESS;
+    return ret;
 }
 
 void spif_port_ec626_spi_get(spif_port_spi_ops_t *ops)
@@ -190,10 +313,24 @@ void spif_port_ec626_spi_get(spif_port_spi_ops_t *ops)
     ops->spi_init = _ec626_spi_init;
     ops->spi_deinit = _ec626_spi_deinit;
     ops->spi_lock = _ec626_spi_lock;
+    ops->spi_trylock = _ec626_spi_trylock;
     ops->spi_unlock = _ec626_spi_unlock;
-    ops->spi_send = _ec626_spi_send;
-    ops->spi_recv = _ec626_spi_recv;
-    ops->spi_transfer = _ec626_spi_transfer;
+
+    ops->ops.spi.spi_send = _ec626_spi_send;
+    ops->ops.spi.spi_recv = _ec626_spi_recv;
+    ops->ops.spi.spi_transfer = _ec626_spi_transfer;
+    ops->ops.spi.spi_transfer_iov = _ec626_spi_transfer_iov;
+
+    ops->ops_mode = SPIF_SPI_OPS_SPI;
+    ops->caps = 0;
+}
+
+/**
+ * 在 RTOS 下用互斥量代替自旋锁, NULL 恢复自旋锁; 在 spif_init() 之前调用
+ */
+void spif_port_ec626_lock_rtos_set(const spif_port_lock_rtos_t *rtos)
+{
+    spif_port_lock_rtos_set(&s_spi_lock, rtos);
 }
 
 void spif_port_ec626_plat_get(spif_port_plat_ops_t *ops)
@@ -203,5 +340,8 @@ void spif_port_ec626_plat_get(spif_port_plat_ops_t *ops)
     }
 
     ops->log = ec626_log;
-    ops->delay_ms = NULL;
+    ops->delay_us = _ec626_delay_us;
+    ops->delay_ms = _ec626_delay_ms;
+    ops->timestamp = NULL;
+    ops->timestamp_hz = 0;
 }
@@ -0,0 +1,98 @@
+/*
+ * spif_port_lock.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+
+#include "cmsis_compiler.h"
+
+#include "spif.h"
+#include "spif_port_lock.h"
+
+/* 两次尝试之间的等待 */
+#define SPIF_PORT_LOCK_POLL_US    10
+
+void spif_port_lock_init(spif_port_lock_t *lock, uint32_t ceiling, void (*delay_us)(uint32_t us))
+{
+    /* RTOS 钩子可能已在 spif_init() 之前设置, 这里不清除 */
+    lock->locked = 0;
+    lock->ceiling = ceiling;
+    lock->delay_us = delay_us;
+}
+
+void spif_port_lock_rtos_set(spif_port_lock_t *lock, const spif_port_lock_rtos_t *rtos)
+{
+    if (rtos == NULL) {
+        memset(&lock->rtos, 0, sizeof(spif_port_lock_rtos_t));
+    } else {
+        lock->rtos = *rtos;
+    }
+}
+
+int spif_port_lock_try(spif_port_lock_t *lock)
+{
+    uint32_t basepri = 0;
+
+    if (lock->rtos.mutex_lock != NULL) {
+        return (lock->rtos.mutex_lock(lock->rtos.mutex, 0) == SPIF_SUCCESS) ? SPIF_SUCCESS : SPIF_BUSY;
+    }
+
+    /* 只在抢锁的几条指令内提升到天花板优先级, 持锁期间不屏蔽中断, SysTick 照常运行 */
+    basepri = __get_BASEPRI();
+    if (lock->ceiling != 0) {
+        __set_BASEPRI_MAX(lock->ceiling);
+    }
+
+    do {
+        if (__LDREXW(&lock->locked) != 0) {
+            __CLREX();
+            __set_BASEPRI(basepri);
+            return SPIF_BUSY;
+        }
+    } while (__STREXW(1, &lock->locked) != 0);
+
+    /* 之后的访问不能提前到拿锁之前 */
+    __DMB();
+
+    __set_BASEPRI(basepri);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_port_lock_take(spif_port_lock_t *lock, uint32_t timeout_ms)
+{
+    uint32_t elapsed_us = 0;
+
+    if (lock->rtos.mutex_lock != NULL) {
+        return lock->rtos.mutex_lock(lock->rtos.mutex, timeout_ms);
+    }
+
+    /**
+     * 单核上中断里看到锁被占用, 说明持有者被它抢占了, 中断返回前持有者不会运行, 等下去只会超时, 只试一次;
+     * 线程模式下持有者是另一个任务 (没有设置 RTOS 钩子) 或另一个核, 等待期间不屏蔽中断. 只累计延时, 实际超时略长
+     */
+    while (spif_port_lock_try(lock) != SPIF_SUCCESS) {
+        if ((__get_IPSR() != 0) || ((elapsed_us / 1000) >= timeout_ms)) {
+            return SPIF_TIMEOUT;
+        }
+
+        lock->delay_us(SPIF_PORT_LOCK_POLL_US);
+        elapsed_us += SPIF_PORT_LOCK_POLL_US;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+void spif_port_lock_give(spif_port_lock_t *lock)
+{
+    if (lock->rtos.mutex_unlock != NULL) {
+        lock->rtos.mutex_unlock(lock->rtos.mutex);
+        return;
+    }
+
+    /* 临界区内的访问先完成, 再放锁 */
+    __DMB();
+    lock->locked = 0;
+}
@@ -0,0 +1,1426 @@
+/*
+ * spif_port_sim.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spif.h"
+#include "spif_port.h"
+#include "spif_port_sim.h"
+
+#define SIM_SECTOR_SIZE     4096
+#define SIM_PAGE_SIZE       256
+#define SIM_SFDP_SIZE       256
+#define SIM_SFDP_BFPT_ADDR  0x80
+
+#define SIM_SR1_BUSY        (1 << 0)
+#define SIM_SR1_WEL         (1 << 1)
+#define SIM_SR2_QE          (1 << 1)
+#define SIM_SR2_SUS         (1 << 7)
+
+/* 异步传输完成前虚拟时钟停住这么久 (真实时间), 认为调用方在空转等待 */
+#define SIM_JOB_IDLE_MS     1
+
+typedef struct {
+    uint8_t used;
+    spif_port_sim_config_t config;
+
+    int fd;
+    uint8_t dies;       /* 双片模式为 2, 字节 2n 在第一片, 2n + 1 在第二片 */
+    uint32_t size;      /* mem 的大小, 各片合计 */
+    uint8_t *mem;
+    uint32_t *erase_count;
+    uint8_t sfdp[SIM_SFDP_SIZE];
+
+    uint8_t sr1;
+    uint8_t sr2;
+    uint8_t sr3;
+    uint8_t wel;
+    uint8_t qpi;        /* 0x38 之后所有指令都是 4-4-4 */
+    uint8_t cread;      /* 连续读模式: 下一条指令没有指令阶段, 直接从地址开始 */
+    uint8_t cread_cmd;  /* 进入连续读模式的读指令 */
+    uint8_t mapped;
+    uint8_t mapped_cmd; /* 映射使用的读指令, 0: 映射不会进入连续读模式 */
+
+    uint64_t now_ns;
+    uint64_t busy_until_ns;
+    uint64_t busy_skew_ns;      /* 双片: 第一片比第二片提前完成的时间 */
+    uint8_t busy_cmd;           /* 正在执行的编程/擦除指令, 暂停只对 0x02 和 0x20/0x52/0xD8 有效 */
+    uint32_t busy_addr;         /* 正在擦除的区域, 暂停期间不可读 */
+    uint32_t busy_size;
+    uint64_t suspend_left_ns;   /* 暂停时剩余的忙时间 */
+
+    uint32_t cut_countdown;     /* 断电: 倒数到 0 的那条指令只执行一半, 之后芯片不再响应, 0: 不断电 */
+    uint8_t cut_tearing;        /* 断电的那条指令正在执行 */
+    uint8_t off;
+
+    spif_port_sim_stats_t stats;
+
+    pthread_mutex_t mutex; /* 保护以上状态, 异步线程也会访问 */
+    pthread_mutex_t bus_lock;
+
+    /**
+     * 异步传输: 一次只有一个, 提交时就在自己的时间线上执行完, 占用的是总线时间, 不是 CPU 时间;
+     * 虚拟时钟走到传输结束时由工作线程调用 done, 相当于 DMA 完成中断
+     */
+    pthread_t worker;
+    pthread_cond_t cond;
+    uint8_t worker_exit;
+    uint8_t job_pending;   /* done 还没有调用 */
+    uint8_t job_calling;   /* done 正在执行 */
+    uint64_t job_done_ns;
+    int job_result;
+    spif_port_done_cb_t job_done;
+    void *job_arg;
+} sim_dev_t;
+
+static sim_dev_t s_sim_dev[SPIF_PORT_SIM_DEVICES];
+
+/* 平台接口的 log, 模拟器自己的错误也走这里 */
+static int _sim_log(const char *format, ...)
+{
+    va_list list;
+
+    va_start(list, format);
+    vprintf(format, list);
+    va_end(list);
+
+    return 0;
+}
+
+static void _sim_le32(uint8_t *buf, uint32_t v)
+{
+    buf[0] = v & 0xFF;
+    buf[1] = (v >> 8) & 0xFF;
+    buf[2] = (v >> 16) & 0xFF;
+    buf[3] = (v >> 24) & 0xFF;
+}
+
+/* count (5 bit) * unit, 取能表示 value 的最小单位, 返回 count | (unit index << 5) */
+static uint32_t _sim_sfdp_time(uint32_t value, const uint32_t *unit, int units)
+{
+    if (value == 0) {
+        value = 1;
+    }
+
+    for (int i = 0; i < units; i++) {
+        uint32_t count = (value + unit[i] - 1) / unit[i];
+        if ((count >= 1) && (count <= 32)) {
+            return (count - 1) | (i << 5);
+        }
+    }
+
+    return 31 | ((units - 1) << 5);
+}
+
+/* 按配置生成 JESD216B SFDP: 头, BFPT 参数头, 16 DWORD 的 BFPT */
+static void _sim_sfdp_build(sim_dev_t *sim)
+{
+    static const uint32_t erase_unit[] = {1, 16, 128, 1000};
+    static const uint32_t pp_unit[] = {8, 64};
+    static const uint32_t ce_unit[] = {16, 256, 4000, 64000};
+
+    uint8_t *sfdp = sim->sfdp;
+    uint8_t *bfpt = sim->sfdp + SIM_SFDP_BFPT_ADDR;
+    uint32_t dw = 0;
+    uint32_t t = 0;
+
+    memset(sfdp, 0xFF, SIM_SFDP_SIZE);
+
+    _sim_le32(&sfdp[0], 0x50444653);   /* "SFDP" */
+    sfdp[4] = 6;                       /* v1.6 */
+    sfdp[5] = 1;
+    sfdp[6] = 0;                       /* 1 个参数头 */
+    sfdp[7] = 0xFF;
+
+    sfdp[8] = 0x00;                    /* BFPT id LSB */
+    sfdp[9] = 6;
+    sfdp[10] = 1;
+    sfdp[11] = 16;                     /* dwords */
+    _sim_le32(&sfdp[12], SIM_SFDP_BFPT_ADDR | 0xFF000000);
+
+    /* DWORD 1: 4K 擦除 0x20, 3 字节地址, 支持 1-1-4 和 1-4-4, bit 19 DTR */
+    _sim_le32(&bfpt[0], 0xFFE020E5 | (sim->config.dtr ? (1UL << 19) : 0));
+    /* DWORD 2: 容量, 单位 bit */
+    _sim_le32(&bfpt[4], sim->config.size * 8 - 1);
+    /* DWORD 3: 1-4-4 0xEB 2 个 mode clock + 4 dummy, 1-1-4 0x6B 8 dummy */
+    _sim_le32(&bfpt[8], 0x6B08EB44);
+    _sim_le32(&bfpt[12], 0xFFFFFFFF);
+    /* DWORD 5: bit 4 支持 4-4-4 */
+    _sim_le32(&bfpt[16], sim->config.qpi ? 0xFFFFFFFE : 0xFFFFFFEE);
+    _sim_le32(&bfpt[20], 0xFF00FFFF);
+    /* DWORD 7: 4-4-4 0xEB 2 个 mode clock + 2 dummy */
+    _sim_le32(&bfpt[24], sim->config.qpi ? 0xEB42FFFF : 0xFF00FFFF);
+    /* DWORD 8 - 9: 擦除类型 4K 0x20, 32K 0x52, 64K 0xD8 */
+    _sim_le32(&bfpt[28], 0x520F200C);
+    _sim_le32(&bfpt[32], 0xFF00D810);
+
+    /* DWORD 10: 擦除时间, max = typ * 2 * (1 + 1) */
+    dw = 1;
+    t = _sim_sfdp_time((sim->config.t_se_us + 999) / 1000, erase_unit, 4);
+    dw |= t << 4;
+    t = _sim_sfdp_time((sim->config.t_be32_us + 999) / 1000, erase_unit, 4);
+    dw |= t << 11;
+    t = _sim_sfdp_time((sim->config.t_be64_us + 999) / 1000, erase_unit, 4);
+    dw |= t << 18;
+    _sim_le32(&bfpt[36], dw);
+
+    /* DWORD 11: 页大小 256, 页编程时间, 整片擦除时间 */
+    dw = 1 | (8 << 4);
+    t = _sim_sfdp_time(sim->config.t_pp_us, pp_unit, 2);
+    dw |= (t & 0x1F) << 8;
+    dw |= (t >> 5) << 13;
+    t = _sim_sfdp_time(sim->config.t_ce_ms, ce_unit, 4);
+    dw |= t << 24;
+    _sim_le32(&bfpt[40], dw);
+
+    /* DWORD 12: 支持暂停/恢复, 暂停延迟 t_sus_us (单位 1us) */
+    t = (sim->config.t_sus_us > 0) ? sim->config.t_sus_us - 1 : 0;
+    _sim_le32(&bfpt[44], (1UL << 29) | ((t & 0x1F) << 24));
+    /* DWORD 13: 擦除暂停 0x75, 恢复 0x7A, 编程暂停/恢复相同 */
+    _sim_le32(&bfpt[48], 0x757A757A);
+    _sim_le32(&bfpt[52], 0);
+    /* DWORD 15: QE = SR2[1], 0x35 读, 0x31 写; 4-4-4 置 QE 后 0x38 进入, 0xFF 退出 */
+    _sim_le32(&bfpt[56], (5UL << 20) | (sim->config.qpi ? ((1UL << 4) | (1UL << 0)) : 0));
+    _sim_le32(&bfpt[60], 0);
+}
+
+static uint64_t _sim_cycles_ns(sim_dev_t *sim, uint64_t cycles)
+{
+    return cycles * 1000000000ULL / sim->config.clock_hz;
+}
+
+static uint32_t _sim_phase_cycles(uint32_t bytes, uint8_t lines)
+{
+    if (lines == SPIF_QSPI_LINES_NONE) {
+        return 0;
+    }
+
+    return bytes * 8 / lines;
+}
+
+static void _sim_bus(sim_dev_t *sim, uint64_t cycles)
+{
+    uint64_t ns = _sim_cycles_ns(sim, cycles);
+
+    sim->now_ns += ns;
+    sim->stats.bus_ns += ns;
+}
+
+/* 读指令地址之后的空周期 (含 mode bits), -1: 不是读指令或当前模式下不支持 */
+static int _sim_read_dummy(sim_dev_t *sim, uint8_t cmd)
+{
+    switch (cmd) {
+    case 0x03:
+        return sim->qpi ? -1 : 0;
+    case 0x0B:
+    case 0x6B:
+        return sim->qpi ? -1 : 8;
+    case 0xEB:
+        return sim->qpi ? 4 : 6;
+    case 0xED:
+        return (sim->config.dtr && !sim->qpi) ? 8 : -1;
+    default:
+        return -1;
+    }
+}
+
+static int _sim_busy(sim_dev_t *sim)
+{
+    return sim->now_ns < sim->busy_until_ns;
+}
+
+/* 芯片收到一条指令 */
+static void _sim_command(sim_dev_t *sim)
+{
+    sim->stats.commands++;
+
+    if ((sim->cut_countdown != 0) && (--sim->cut_countdown == 0)) {
+        sim->off = 1;
+        sim->cut_tearing = 1;
+        sim->stats.power_cuts++;
+    }
+}
+
+/* 双片: 第二片慢 die_skew_pct, 两片都完成才算结束 */
+static void _sim_busy_start(sim_dev_t *sim, uint64_t us)
+{
+    sim->busy_skew_ns = (sim->dies > 1) ? us * 10 * sim->config.die_skew_pct : 0;
+    sim->busy_until_ns = sim->now_ns + us * 1000 + sim->busy_skew_ns;
+    sim->stats.busy_ns += us * 1000 + sim->busy_skew_ns;
+    sim->busy_cmd = 0;
+}
+
+/* 双片模式下数据阶段两片各占一半, 必须从偶地址开始且为偶数长度 */
+static int _sim_dual_odd(sim_dev_t *sim, uint32_t addr, uint32_t size)
+{
+    return (sim->dies > 1) && ((addr | size) & 1);
+}
+
+/* size 是单片的擦除大小 */
+static void _sim_erase(sim_dev_t *sim, uint32_t addr, uint32_t size, uint32_t busy_us)
+{
+    size *= sim->dies;
+    addr &= ~(size - 1);
+    if (addr + size > sim->size) {
+        sim->stats.violations++;
+        return;
+    }
+
+    /* 断电时只擦完前一半, 后一半还是原来的内容 */
+    memset(sim->mem + addr, 0xFF, sim->cut_tearing ? (size / 2) : size);
+    for (uint32_t i = 0; i < size / SIM_SECTOR_SIZE; i++) {
+        sim->erase_count[addr / SIM_SECTOR_SIZE + i]++;
+    }
+
+    sim->wel = 0;
+    _sim_busy_start(sim, busy_us);
+    sim->busy_addr = addr;
+    sim->busy_size = size;
+}
+
+/* 页内回绕, 超过一页时只有最后一页的数据有效, 与真实芯片一致; 双片时两片的页并排, 页大小翻倍 */
+static void _sim_program(sim_dev_t *sim, uint32_t addr, const uint8_t *data, uint32_t size)
+{
+    uint32_t page_size = SIM_PAGE_SIZE * sim->dies;
+    uint32_t page = addr & ~(page_size - 1) & (sim->size - 1);
+    uint32_t offset = addr & (page_size - 1);
+    uint32_t skip = (size > page_size) ? (size - page_size) : 0;
+    uint32_t end = size;
+    int overwrite = 0;
+
+    /* 断电时只编程了前一半 */
+    if (sim->cut_tearing) {
+        end = skip + (size - skip) / 2;
+    }
+
+    for (uint32_t i = skip; i < end; i++) {
+        uint8_t *p = &sim->mem[page + ((offset + i) % page_size)];
+        if ((*p & data[i]) != data[i]) {
+            overwrite = 1;
+        }
+        *p &= data[i];
+    }
+
+    sim->stats.programs++;
+    sim->stats.program_bytes += size;
+    if (overwrite) {
+        sim->stats.overwrites++;
+    }
+}
+
+/* repeat: 每个字节重复的次数, 双片时 ID 和 SFDP 两片各回一份 */
+static void _sim_read(const uint8_t *src, uint32_t limit, uint32_t addr, uint8_t repeat, uint8_t *rx_buf, uint32_t rx_size)
+{
+    /* 读到末尾从 0 地址继续 */
+    for (uint32_t i = 0; i < rx_size; i++) {
+        rx_buf[i] = src[(addr + i / repeat) % limit];
+    }
+}
+
+/**
+ * 指令执行, SPI 和 QSPI 共用
+ * dummy: 地址之后的空周期 (含 mode bits), quad: 指令使用了 4 线
+ * 返回 0: 接受, 1: 芯片会忽略 (记为 violation), -1: 未知指令
+ */
+static int _sim_execute(sim_dev_t *sim, uint8_t cmd, uint32_t addr, uint32_t dummy, int quad,
+                        const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    uint8_t sr_pair[2];
+
+    _sim_command(sim);
+
+    if (sim->off && !sim->cut_tearing) {
+        return 1;
+    }
+
+    /* 忙时只响应读状态寄存器和暂停 */
+    if (_sim_busy(sim) && (cmd != 0x05) && (cmd != 0x35) && (cmd != 0x15) && (cmd != 0x75)) {
+        return 1;
+    }
+
+    /* 暂停期间不能再编程/擦除/写状态寄存器 */
+    if ((sim->sr2 & SIM_SR2_SUS) &&
+        ((cmd == 0x02) || (cmd == 0x20) || (cmd == 0x52) || (cmd == 0xD8) || (cmd == 0xC7) || (cmd == 0x01) || (cmd == 0x31) || (cmd == 0x75))) {
+        return 1;
+    }
+
+    if (quad && !(sim->sr2 & SIM_SR2_QE)) {
+        return 1;
+    }
+
+    switch (cmd) {
+    case 0x9F:
+        _sim_read(sim->config.jedec_id, 3, 0, sim->dies, rx_buf, rx_size);
+        break;
+
+    case 0x5A:
+        if (dummy != 8) {
+            return 1;
+        }
+        /* 双片时控制器把地址除以 2 发给芯片 */
+        _sim_read(sim->sfdp, SIM_SFDP_SIZE, (addr / sim->dies) & (SIM_SFDP_SIZE - 1), sim->dies, rx_buf, rx_size);
+        break;
+
+    case 0x05:
+        sim->stats.status_polls++;
+        for (uint32_t i = 0; i < rx_size; i++) {
+            /* 双片时偶数字节来自第一片, 它提前完成 */
+            uint64_t until = ((sim->dies > 1) && !(i & 1)) ? sim->busy_until_ns - sim->busy_skew_ns : sim->busy_until_ns;
+            rx_buf[i] = sim->sr1 | (sim->wel ? SIM_SR1_WEL : 0) | ((sim->now_ns < until) ? SIM_SR1_BUSY : 0);
+        }
+        break;
+
+    case 0x35:
+        memset(rx_buf, sim->sr2, rx_size);
+        break;
+
+    case 0x15:
+        memset(rx_buf, sim->sr3, rx_size);
+        break;
+
+    case 0x06:
+        sim->wel = 1;
+        break;
+
+    case 0x04:
+        sim->wel = 0;
+        break;
+
+    case 0x01:
+    case 0x31:
+        if (!sim->wel || (tx_size == 0)) {
+            return 1;
+        }
+        /* 双片共用一个模型, 两片必须写入相同的值 */
+        if (sim->dies > 1) {
+            if ((tx_size & 1) || (tx_size > 4) || (tx_buf[0] != tx_buf[1]) || ((tx_size > 2) && (tx_buf[2] != tx_buf[3]))) {
+                return 1;
+            }
+            sr_pair[0] = tx_buf[0];
+            sr_pair[1] = tx_buf[tx_size - 1];
+            tx_buf = sr_pair;
+            tx_size /= 2;
+        }
+        /* 断电时状态寄存器还没写进去 */
+        if (sim->cut_tearing) {
+            break;
+        }
+        if (cmd == 0x01) {
+            sim->sr1 = tx_buf[0] & 0xFC;
+            if (tx_size > 1) {
+                sim->sr2 = tx_buf[1];
+            }
+        } else {
+            sim->sr2 = tx_buf[0];
+        }
+        sim->wel = 0;
+        _sim_busy_start(sim, sim->config.t_w_us);
+        break;
+
+    case 0x38:
+        if (!sim->config.qpi || !(sim->sr2 & SIM_SR2_QE)) {
+            return 1;
+        }
+        sim->qpi = 1;
+        break;
+
+    case 0xFF:
+        /* SPI 模式下 0xFF 是 continuous read 复位, 同样被接受 */
+        sim->qpi = 0;
+        break;
+
+    case 0x03:
+    case 0x0B:
+    case 0x6B:
+    case 0xEB:
+    case 0xED:
+        if (((int)dummy != _sim_read_dummy(sim, cmd)) || _sim_dual_odd(sim, addr, rx_size)) {
+            return 1;
+        }
+        /* 被暂停擦除的区域内容不确定 */
+        if ((sim->sr2 & SIM_SR2_SUS) && (sim->busy_size != 0) &&
+            (addr < sim->busy_addr + sim->busy_size) && (addr + rx_size > sim->busy_addr)) {
+            return 1;
+        }
+        _sim_read(sim->mem, sim->size, addr, 1, rx_buf, rx_size);
+        sim->stats.reads++;
+        sim->stats.read_bytes += rx_size;
+        break;
+
+    case 0x02:
+        if (!sim->wel || _sim_dual_odd(sim, addr, tx_size)) {
+            return 1;
+        }
+        /* SPI 模式下数据随后由 spi_send 送来 */
+        sim->wel = 0;
+        if (tx_size > 0) {
+            _sim_program(sim, addr, tx_buf, tx_size);
+            _sim_busy_start(sim, sim->config.t_pp_us);
+            sim->busy_cmd = cmd;
+            sim->busy_size = 0;
+        }
+        break;
+
+    case 0x20:
+    case 0x52:
+    case 0xD8:
+    case 0xC7:
+        if (!sim->wel) {
+            return 1;
+        }
+        if (cmd == 0x20) {
+            _sim_erase(sim, addr, 4 * 1024, sim->config.t_se_us);
+            sim->stats.erases_4k++;
+        } else if (cmd == 0x52) {
+            _sim_erase(sim, addr, 32 * 1024, sim->config.t_be32_us);
+            sim->stats.erases_32k++;
+        } else if (cmd == 0xD8) {
+            _sim_erase(sim, addr, 64 * 1024, sim->config.t_be64_us);
+            sim->stats.erases_64k++;
+        } else {
+            _sim_erase(sim, 0, sim->config.size, sim->config.t_ce_ms * 1000);
+            sim->stats.erases_chip++;
+        }
+        /* 整片擦除不可暂停 */
+        if (cmd != 0xC7) {
+            sim->busy_cmd = cmd;
+        }
+        break;
+
+    case 0x75:
+        /* 空闲时芯片忽略暂停, 不算违规 */
+        if (!_sim_busy(sim)) {
+            break;
+        }
+        if (sim->busy_cmd == 0) {
+            return 1;
+        }
+        /* 剩余的忙时间留到恢复, 暂停本身还要 t_sus_us 才能读, 两片同时暂停 */
+        sim->suspend_left_ns = sim->busy_until_ns - sim->now_ns;
+        sim->busy_skew_ns = 0;
+        sim->stats.busy_ns -= sim->suspend_left_ns;
+        sim->busy_until_ns = sim->now_ns + (uint64_t)sim->config.t_sus_us * 1000;
+        sim->sr2 |= SIM_SR2_SUS;
+        sim->stats.suspends++;
+        break;
+
+    case 0x7A:
+        /* 没有暂停时同样被忽略 */
+        if (!(sim->sr2 & SIM_SR2_SUS)) {
+            break;
+        }
+        sim->sr2 &= ~SIM_SR2_SUS;
+        sim->busy_until_ns = sim->now_ns + sim->suspend_left_ns;
+        sim->stats.busy_ns += sim->suspend_left_ns;
+        break;
+
+    default:
+        return -1;
+    }
+
+    return 0;
+}
+
+static int _sim_result(sim_dev_t *sim, int ret, uint8_t cmd, uint8_t *rx_buf, uint32_t rx_size)
+{
+    /* 断电后总线上没有应答, 控制器报错 */
+    if (sim->off) {
+        sim->cut_tearing = 0;
+        if (rx_buf != NULL) {
+            memset(rx_buf, 0xFF, rx_size);
+        }
+        return SPIF_FAIL;
+    }
+
+    if (ret == 0) {
+        return SPIF_SUCCESS;
+    }
+
+    /* 被忽略的指令, 读到的是总线上的上拉电平 */
+    if (rx_buf != NULL) {
+        memset(rx_buf, 0xFF, rx_size);
+    }
+
+    sim->stats.violations++;
+
+    if (ret < 0) {
+        _sim_log("[E][sim] unknown command 0x%02X.\r\n", cmd);
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+static int _sim_qspi_execute(sim_dev_t *sim, const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    int ret = 0;
+    int quad = 0;
+    int cont = 0;
+    uint8_t opcode = cmd->instruction;
+    uint32_t dummy = 0;
+    uint64_t cycles = 0;
+    uint64_t ddr_cycles = 0;
+
+    /* 内存映射模式下控制器不接受间接模式指令 */
+    if (sim->mapped) {
+        return SPIF_FAIL;
+    }
+
+    /* DDR 时指令之后的阶段每个时钟传两次 */
+    cycles = _sim_phase_cycles(1, cmd->instruction_lines);
+    if (cmd->addr != SPIF_SPI_INVALID_ADDR) {
+        ddr_cycles += _sim_phase_cycles(3, cmd->addr_lines);
+    }
+    dummy = _sim_phase_cycles(1, cmd->alt_lines);
+    /* 双片时两片的数据线并行, 各传一半 */
+    ddr_cycles += _sim_phase_cycles((tx_size + rx_size) / sim->dies, cmd->data_lines);
+    if (cmd->ddr) {
+        dummy /= 2;
+        ddr_cycles /= 2;
+    }
+    dummy += cmd->dummy_cycles;
+    cycles += ddr_cycles + dummy;
+    _sim_bus(sim, cycles);
+
+    quad = (cmd->instruction_lines == SPIF_QSPI_LINES_4) || (cmd->addr_lines == SPIF_QSPI_LINES_4) ||
+           (((tx_size + rx_size) > 0) && (cmd->data_lines == SPIF_QSPI_LINES_4));
+
+    /**
+     * 没有指令阶段: 连续读模式下是上一条读指令的延续, 在数据之前释放片选时只由 mode bits 决定是否退出;
+     * 不在连续读模式时芯片把地址当作指令, 地址和 mode 全 1 是上层的连续读退出序列,
+     * SPI 模式下是空指令 0xFF, QPI 模式下就是退出 QPI
+     */
+    if (cmd->instruction_lines == SPIF_QSPI_LINES_NONE) {
+        if (sim->cread && ((tx_size + rx_size) > 0)) {
+            opcode = sim->cread_cmd;
+            cont = 1;
+        } else {
+            _sim_command(sim);
+            if (sim->cread) {
+                sim->cread = ((cmd->alt_lines != SPIF_QSPI_LINES_NONE) && ((cmd->alt & 0x30) == 0x20));
+            } else if (((cmd->addr & 0xFFFFFF) == 0xFFFFFF) && ((cmd->alt_lines == SPIF_QSPI_LINES_NONE) || (cmd->alt == 0xFF))) {
+                sim->qpi = 0;
+            } else {
+                ret = 1;
+            }
+            return _sim_result(sim, ret, cmd->instruction, rx_buf, rx_size);
+        }
+    }
+
+    /**
+     * 连续读模式下的指令会被当作地址; QPI 模式下只认 4 线指令; SPI 模式下的 4 线指令芯片不会识别,
+     * 其中 0xFF 是上层不确定芯片状态时发出的 QPI 退出序列, 不算违规
+     */
+    if (cont) {
+        ret = _sim_execute(sim, opcode, cmd->addr, dummy, quad, tx_buf, tx_size, rx_buf, rx_size);
+    } else if (sim->cread) {
+        _sim_command(sim);
+        ret = 1;
+    } else if (!sim->qpi && (cmd->instruction_lines == SPIF_QSPI_LINES_4)) {
+        _sim_command(sim);
+        ret = (cmd->instruction == 0xFF) ? 0 : 1;
+    } else if ((sim->qpi && (cmd->instruction_lines != SPIF_QSPI_LINES_4)) || (cmd->ddr && (cmd->instruction != 0xED))) {
+        _sim_command(sim);
+        ret = 1;
+    } else {
+        ret = _sim_execute(sim, cmd->instruction, cmd->addr, dummy, quad, tx_buf, tx_size, rx_buf, rx_size);
+    }
+
+    /* Winbond: 0xEB/0xED 的 mode bits M5-4 = 10 时进入 (保持) 连续读模式 */
+    if ((ret == 0) && ((opcode == 0xEB) || (opcode == 0xED))) {
+        sim->cread = (cmd->alt_lines != SPIF_QSPI_LINES_NONE) && ((cmd->alt & 0x30) == 0x20);
+        sim->cread_cmd = opcode;
+    }
+
+    return _sim_result(sim, ret, opcode, rx_buf, rx_size);
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+static void _sim_delay_us(sim_dev_t *sim, uint32_t us)
+{
+    pthread_mutex_lock(&sim->mutex);
+    sim->now_ns += (uint64_t)us * 1000;
+
+    /* 延时期间结束的异步传输, 完成中断在延时返回前就已处理 */
+    pthread_cond_broadcast(&sim->cond);
+    while ((sim->job_pending && (sim->now_ns >= sim->job_done_ns)) || sim->job_calling) {
+        pthread_cond_wait(&sim->cond, &sim->mutex);
+    }
+    pthread_mutex_unlock(&sim->mutex);
+}
+
+static void _sim_delay_ms(sim_dev_t *sim, uint32_t ms)
+{
+    _sim_delay_us(sim, ms * 1000);
+}
+
+/* 虚拟时钟, 单位 ns */
+static uint64_t _sim_timestamp(sim_dev_t *sim)
+{
+    uint64_t now = 0;
+
+    pthread_mutex_lock(&sim->mutex);
+    now = sim->now_ns;
+    pthread_mutex_unlock(&sim->mutex);
+
+    return now;
+}
+
+static int _sim_spi_init(sim_dev_t *sim)
+{
+    return sim->used ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+static int _sim_spi_deinit(sim_dev_t *sim)
+{
+    (void)sim;
+    return SPIF_SUCCESS;
+}
+
+/* 真实时间 ms 之后的绝对时间 */
+static void _sim_deadline(struct timespec *ts, uint32_t ms)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+/* 总线锁按真实时间超时, 不推进虚拟时钟 */
+static int _sim_spi_lock(sim_dev_t *sim, uint32_t ms)
+{
+    struct timespec ts;
+
+    _sim_deadline(&ts, ms);
+
+    return (pthread_mutex_timedlock(&sim->bus_lock, &ts) == 0) ? SPIF_SUCCESS : SPIF_TIMEOUT;
+}
+
+static int _sim_spi_trylock(sim_dev_t *sim)
+{
+    return (pthread_mutex_trylock(&sim->bus_lock) == 0) ? SPIF_SUCCESS : SPIF_BUSY;
+}
+
+static void _sim_spi_unlock(sim_dev_t *sim)
+{
+    pthread_mutex_unlock(&sim->bus_lock);
+}
+
+/* tx_buf: 指令 + 3 字节地址 (+ dummy 字节) + 写入数据 */
+static int _sim_spi_transfer(sim_dev_t *sim, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    int ret = 0;
+    uint8_t cmd = 0;
+    uint32_t header = 1;
+    uint32_t addr = SPIF_SPI_INVALID_ADDR;
+    uint32_t dummy = 0;
+
+    if ((tx_buf == NULL) || (tx_size == 0)) {
+        return SPIF_FAIL;
+    }
+
+    pthread_mutex_lock(&sim->mutex);
+
+    _sim_bus(sim, (uint64_t)(tx_size + rx_size) * 8);
+
+    cmd = tx_buf[0];
+    switch (cmd) {
+    case 0x03: case 0x02: case 0x20: case 0x52: case 0xD8:
+        header = 4;
+        break;
+    case 0x0B: case 0x5A:
+        header = 5;
+        dummy = 8;
+        break;
+    default:
+        break;
+    }
+
+    if (tx_size < header) {
+        /* 地址或 dummy 不完整 */
+        _sim_command(sim);
+        ret = 1;
+    } else {
+        if (header >= 4) {
+            addr = ((uint32_t)tx_buf[1] << 16) | ((uint32_t)tx_buf[2] << 8) | tx_buf[3];
+        }
+
+        ret = _sim_execute(sim, cmd, addr, dummy, 0, tx_buf + header, tx_size - header, rx_buf, rx_size);
+    }
+
+    ret = _sim_result(sim, ret, cmd, rx_buf, rx_size);
+
+    pthread_mutex_unlock(&sim->mutex);
+
+    return ret;
+}
+
+/* SPI 模式下每次调用都是一个独立的片选周期 */
+static int _sim_spi_send(sim_dev_t *sim, const uint8_t *tx_buf, uint32_t tx_size)
+{
+    return _sim_spi_transfer(sim, tx_buf, tx_size, NULL, 0);
+}
+
+/* 只接收时 MOSI 保持高电平, 芯片收到的是空指令 0xFF, 读到的是上拉电平 */
+static int _sim_spi_recv(sim_dev_t *sim, uint8_t *rx_buf, uint32_t rx_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    pthread_mutex_lock(&sim->mutex);
+
+    _sim_bus(sim, (uint64_t)rx_size * 8);
+    _sim_command(sim);
+    memset(rx_buf, 0xFF, rx_size);
+    sim->cut_tearing = 0;
+
+    ret = sim->off ? SPIF_FAIL : SPIF_SUCCESS;
+
+    pthread_mutex_unlock(&sim->mutex);
+
+    return ret;
+}
+
+/**
+ * 分段传输, 片选在整个调用期间保持: 第一个带 rx_buf 的段之前的字节是芯片收到的指令/地址/数据,
+ * 之后芯片进入输出阶段, 后续段的 tx 字节被忽略, 收到的数据依次分散到各段的 rx_buf
+ */
+static int _sim_spi_transfer_iov(sim_dev_t *sim, const spif_port_iov_t *iov, uint32_t iov_count)
+{
+    int ret = SPIF_SUCCESS;
+    uint8_t *tx_buf = NULL;
+    uint8_t *rx_buf = NULL;
+    uint32_t tx_size = 0;
+    uint32_t rx_size = 0;
+    uint32_t rx_first = iov_count;
+    uint32_t offset = 0;
+
+    if ((iov == NULL) || (iov_count == 0)) {
+        return SPIF_FAIL;
+    }
+
+    for (uint32_t i = 0; i < iov_count; i++) {
+        if ((rx_first == iov_count) && (iov[i].rx_buf != NULL)) {
+            rx_first = i;
+        }
+
+        if (rx_first == iov_count) {
+            tx_size += iov[i].size;
+        } else {
+            rx_size += iov[i].size;
+        }
+    }
+
+    if (tx_size == 0) {
+        for (uint32_t i = 0; (i < iov_count) && (ret == SPIF_SUCCESS); i++) {
+            if (iov[i].rx_buf != NULL) {
+                ret = _sim_spi_recv(sim, iov[i].rx_buf, iov[i].size);
+            }
+        }
+        return ret;
+    }
+
+    tx_buf = malloc(tx_size);
+    rx_buf = (rx_size > 0) ? malloc(rx_size) : NULL;
+    if ((tx_buf == NULL) || ((rx_size > 0) && (rx_buf == NULL))) {
+        free(tx_buf);
+        free(rx_buf);
+        return SPIF_FAIL;
+    }
+
+    for (uint32_t i = 0; i < rx_first; i++) {
+        if (iov[i].tx_buf != NULL) {
+            memcpy(&tx_buf[offset], iov[i].tx_buf, iov[i].size);
+        } else {
+            memset(&tx_buf[offset], 0xFF, iov[i].size);
+        }
+        offset += iov[i].size;
+    }
+
+    ret = _sim_spi_transfer(sim, tx_buf, tx_size, rx_buf, rx_size);
+
+    offset = 0;
+    for (uint32_t i = rx_first; (i < iov_count) && (ret == SPIF_SUCCESS); i++) {
+        if (iov[i].rx_buf != NULL) {
+            memcpy(iov[i].rx_buf, &rx_buf[offset], iov[i].size);
+        }
+        offset += iov[i].size;
+    }
+
+    free(tx_buf);
+    free(rx_buf);
+
+    return ret;
+}
+
+static int _sim_qspi_command(sim_dev_t *sim, const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    pthread_mutex_lock(&sim->mutex);
+    ret = _sim_qspi_execute(sim, cmd, tx_buf, tx_size, rx_buf, rx_size);
+    pthread_mutex_unlock(&sim->mutex);
+
+    return ret;
+}
+
+static int _sim_qspi_transfer(sim_dev_t *sim, uint8_t cmd, uint32_t addr, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    spif_port_qspi_cmd_t qspi_cmd = {0};
+
+    qspi_cmd.instruction = cmd;
+    qspi_cmd.instruction_lines = SPIF_QSPI_LINES_1;
+    qspi_cmd.addr = addr;
+    qspi_cmd.addr_lines = SPIF_QSPI_LINES_1;
+    qspi_cmd.alt_lines = SPIF_QSPI_LINES_NONE;
+    qspi_cmd.dummy_cycles = 0;
+    qspi_cmd.data_lines = SPIF_QSPI_LINES_1;
+
+    return _sim_qspi_command(sim, &qspi_cmd, tx_buf, tx_size, rx_buf, rx_size);
+}
+
+static int _sim_qspi_mmap(sim_dev_t *sim, const spif_port_qspi_cmd_t *cmd, const uint8_t **base)
+{
+    int ret = SPIF_SUCCESS;
+    uint32_t dummy = 0;
+
+    pthread_mutex_lock(&sim->mutex);
+
+    dummy = _sim_phase_cycles(1, cmd->alt_lines) / (cmd->ddr ? 2 : 1) + cmd->dummy_cycles;
+
+    /* 读指令在映射期间反复使用, 这里检查一次 */
+    if (sim->mapped || _sim_busy(sim) || sim->off) {
+        ret = SPIF_FAIL;
+    } else if ((cmd->data_lines == SPIF_QSPI_LINES_4) && !(sim->sr2 & SIM_SR2_QE)) {
+        sim->stats.violations++;
+        ret = SPIF_FAIL;
+    } else if ((sim->qpi != (cmd->instruction_lines == SPIF_QSPI_LINES_4)) || (cmd->ddr != (cmd->instruction == 0xED)) || sim->cread) {
+        sim->stats.violations++;
+        ret = SPIF_FAIL;
+    } else if ((cmd->alt_lines != SPIF_QSPI_LINES_NONE) && ((cmd->alt & 0x30) == 0x20) && !cmd->sioo) {
+        /* 每次访问都发指令, 第二次访问时芯片已经在连续读模式 */
+        sim->stats.violations++;
+        ret = SPIF_FAIL;
+    } else if ((int)dummy != _sim_read_dummy(sim, cmd->instruction)) {
+        sim->stats.violations++;
+        ret = SPIF_FAIL;
+    } else {
+        sim->mapped = 1;
+        sim->mapped_cmd = ((cmd->alt_lines != SPIF_QSPI_LINES_NONE) && ((cmd->alt & 0x30) == 0x20)) ? cmd->instruction : 0;
+        *base = sim->mem;
+    }
+
+    pthread_mutex_unlock(&sim->mutex);
+
+    return ret;
+}
+
+static int _sim_qspi_munmap(sim_dev_t *sim)
+{
+    pthread_mutex_lock(&sim->mutex);
+    sim->mapped = 0;
+    /* 映射期间的访问不经过模拟器, 按至少访问过一次处理 */
+    if (sim->mapped_cmd != 0) {
+        sim->cread = 1;
+        sim->cread_cmd = sim->mapped_cmd;
+    }
+    pthread_mutex_unlock(&sim->mutex);
+
+    return SPIF_SUCCESS;
+}
+
+/* 控制器自动轮询: 直接把时间推进到匹配或超时 */
+static int _sim_qspi_autopoll(sim_dev_t *sim, const spif_port_qspi_cmd_t *cmd, uint8_t mask, uint8_t match, uint32_t interval_us, uint32_t timeout_ms)
+{
+    int ret = SPIF_SUCCESS;
+    uint8_t status[2] = {0};
+    uint64_t deadline = 0;
+
+    pthread_mutex_lock(&sim->mutex);
+
+    deadline = sim->now_ns + (uint64_t)timeout_ms * 1000000;
+
+    /* 双片时两片的状态都要匹配 */
+    while (1) {
+        ret = _sim_qspi_execute(sim, cmd, NULL, 0, status, sim->dies);
+        if ((ret != SPIF_SUCCESS) ||
+            (((status[0] & mask) == match) && ((sim->dies == 1) || ((status[1] & mask) == match)))) {
+            break;
+        }
+
+        if (sim->now_ns >= deadline) {
+            ret = SPIF_TIMEOUT;
+            break;
+        }
+
+        sim->now_ns += (uint64_t)interval_us * 1000;
+    }
+
+    pthread_mutex_unlock(&sim->mutex);
+
+    return ret;
+}
+
+static void *_sim_worker(void *arg)
+{
+    sim_dev_t *sim = (sim_dev_t *)arg;
+    spif_port_done_cb_t done = NULL;
+    void *done_arg = NULL;
+    uint64_t seen_ns = 0;
+    struct timespec ts;
+
+    pthread_mutex_lock(&sim->mutex);
+
+    while (1) {
+        while (!sim->job_pending && !sim->worker_exit) {
+            pthread_cond_wait(&sim->cond, &sim->mutex);
+        }
+
+        if (sim->worker_exit) {
+            break;
+        }
+
+        /**
+         * 调用方在 delay_us 里等待时虚拟时钟才会前进; 调用方不调用任何接口空转等待标志时,
+         * 时钟停住不动, 这时真实时间等待一段后直接把时钟拨到传输结束, 空转的 CPU 本来也是在等
+         */
+        while ((sim->now_ns < sim->job_done_ns) && !sim->worker_exit) {
+            seen_ns = sim->now_ns;
+            _sim_deadline(&ts, SIM_JOB_IDLE_MS);
+            if ((pthread_cond_timedwait(&sim->cond, &sim->mutex, &ts) == ETIMEDOUT) && (sim->now_ns == seen_ns)) {
+                sim->now_ns = sim->job_done_ns;
+            }
+        }
+
+        done = sim->job_done;
+        done_arg = sim->job_arg;
+        sim->job_pending = 0;
+        sim->job_calling = 1;
+
+        /* 回调中可能再次发起异步传输, 不能持锁 */
+        pthread_mutex_unlock(&sim->mutex);
+        done(sim->job_result, done_arg);
+        pthread_mutex_lock(&sim->mutex);
+
+        sim->job_calling = 0;
+        pthread_cond_broadcast(&sim->cond);
+    }
+
+    pthread_mutex_unlock(&sim->mutex);
+
+    return NULL;
+}
+
+static int _sim_qspi_command_async(sim_dev_t *sim, const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size,
+                                   spif_port_done_cb_t done, void *arg)
+{
+    int ret = SPIF_SUCCESS;
+    uint64_t cpu_ns = 0;
+
+    pthread_mutex_lock(&sim->mutex);
+
+    if (sim->job_pending) {
+        ret = SPIF_FAIL;
+    } else {
+        /* 传输从提交时开始, 只推进传输自己的时间线 */
+        cpu_ns = sim->now_ns;
+        sim->job_result = _sim_qspi_execute(sim, cmd, tx_buf, tx_size, rx_buf, rx_size);
+        sim->job_done_ns = sim->now_ns;
+        sim->now_ns = cpu_ns;
+
+        sim->job_done = done;
+        sim->job_arg = arg;
+        sim->job_pending = 1;
+        pthread_cond_signal(&sim->cond);
+    }
+
+    pthread_mutex_unlock(&sim->mutex);
+
+    return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------- */
+
+/* port 接口不带上下文, 每个模拟设备一组转发函数 */
+#define SIM_TRAMPOLINES(n)                                                                                                          \
+static void _sim_delay_us_##n(uint32_t us) { _sim_delay_us(&s_sim_dev[n], us); }                                                    \
+static void _sim_delay_ms_##n(uint32_t ms) { _sim_delay_ms(&s_sim_dev[n], ms); }                                                    \
+static uint64_t _sim_timestamp_##n(void) { return _sim_timestamp(&s_sim_dev[n]); }                                                  \
+static int _sim_spi_init_##n(void) { return _sim_spi_init(&s_sim_dev[n]); }                                                         \
+static int _sim_spi_deinit_##n(void) { return _sim_spi_deinit(&s_sim_dev[n]); }                                                     \
+static int _sim_spi_lock_##n(uint32_t ms) { return _sim_spi_lock(&s_sim_dev[n], ms); }                                             \
+static int _sim_spi_trylock_##n(void) { return _sim_spi_trylock(&s_sim_dev[n]); }                                                   \
+static void _sim_spi_unlock_##n(void) { _sim_spi_unlock(&s_sim_dev[n]); }                                                           \
+static int _sim_spi_send_##n(const uint8_t *tx_buf, uint32_t tx_size)                                                               \
+{ return _sim_spi_send(&s_sim_dev[n], tx_buf, tx_size); }                                                                           \
+static int _sim_spi_recv_##n(uint8_t *rx_buf, uint32_t rx_size)                                                                     \
+{ return _sim_spi_recv(&s_sim_dev[n], rx_buf, rx_size); }                                                                           \
+static int _sim_spi_transfer_##n(const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)                        \
+{ return _sim_spi_transfer(&s_sim_dev[n], tx_buf, tx_size, rx_buf, rx_size); }                                                      \
+static int _sim_spi_transfer_iov_##n(const spif_port_iov_t *iov, uint32_t iov_count)                                             \
+{ return _sim_spi_transfer_iov(&s_sim_dev[n], iov, iov_count); }                                                                    \
+static int _sim_qspi_transfer_##n(uint8_t cmd, uint32_t addr, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size) \
+{ return _sim_qspi_transfer(&s_sim_dev[n], cmd, addr, tx_buf, tx_size, rx_buf, rx_size); }                                          \
+static int _sim_qspi_command_##n(const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size) \
+{ return _sim_qspi_command(&s_sim_dev[n], cmd, tx_buf, tx_size, rx_buf, rx_size); }                                                 \
+static int _sim_qspi_mmap_##n(const spif_port_qspi_cmd_t *cmd, const uint8_t **base) { return _sim_qspi_mmap(&s_sim_dev[n], cmd, base); } \
+static int _sim_qspi_munmap_##n(void) { return _sim_qspi_munmap(&s_sim_dev[n]); }                                                   \
+static int _sim_qspi_autopoll_##n(const spif_port_qspi_cmd_t *cmd, uint8_t mask, uint8_t match, uint32_t interval_us, uint32_t timeout_ms) \
+{ return _sim_qspi_autopoll(&s_sim_dev[n], cmd, mask, match, interval_us, timeout_ms); }                                            \
+static int _sim_qspi_command_async_##n(const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size,                    \
+                                       uint8_t *rx_buf, uint32_t rx_size, spif_port_done_cb_t done, void *arg)                      \
+{ return _sim_qspi_command_async(&s_sim_dev[n], cmd, tx_buf, tx_size, rx_buf, rx_size, done, arg); }
+
+#define SIM_OPS(n)                                                                                                                  \
+    {                                                                                                                               \
+        _sim_delay_us_##n, _sim_delay_ms_##n, _sim_timestamp_##n, _sim_spi_init_##n, _sim_spi_deinit_##n,                                            \
+        _sim_spi_lock_##n, _sim_spi_trylock_##n, _sim_spi_unlock_##n,                                                               \
+        _sim_spi_send_##n, _sim_spi_recv_##n, _sim_spi_transfer_##n, _sim_spi_transfer_iov_##n,                                        \
+        _sim_qspi_transfer_##n, _sim_qspi_command_##n,                                                                              \
+        _sim_qspi_mmap_##n, _sim_qspi_munmap_##n, _sim_qspi_autopoll_##n, _sim_qspi_command_async_##n,                              \
+    }
+
+typedef struct {
+    void (*delay_us)(uint32_t us);
+    void (*delay_ms)(uint32_t ms);
+    uint64_t (*timestamp)(void);
+    int (*spi_init)(void);
+    int (*spi_deinit)(void);
+    int (*spi_lock)(uint32_t ms);
+    int (*spi_trylock)(void);
+    void (*spi_unlock)(void);
+    int (*spi_send)(const uint8_t *tx_buf, uint32_t tx_size);
+    int (*spi_recv)(uint8_t *rx_buf, uint32_t rx_size);
+    int (*spi_transfer)(const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size);
+    int (*spi_transfer_iov)(const spif_port_iov_t *iov, uint32_t iov_count);
+    int (*qspi_transfer)(uint8_t cmd, uint32_t addr, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size);
+    int (*qspi_command)(const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size);
+    int (*qspi_mmap)(const spif_port_qspi_cmd_t *cmd, const uint8_t **base);
+    int (*qspi_munmap)(void);
+    int (*qspi_autopoll)(const spif_port_qspi_cmd_t *cmd, uint8_t mask, uint8_t match, uint32_t interval_us, uint32_t timeout_ms);
+    int (*qspi_command_async)(const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size,
+                              spif_port_done_cb_t done, void *arg);
+} sim_ops_t;
+
+#if (SPIF_PORT_SIM_DEVICES != 2)
+#error "spif_port_sim: one SIM_TRAMPOLINES() / SIM_OPS() per device"
+#endif
+
+SIM_TRAMPOLINES(0)
+SIM_TRAMPOLINES(1)
+
+static const sim_ops_t s_sim_ops[SPIF_PORT_SIM_DEVICES] = {
+    SIM_OPS(0),
+    SIM_OPS(1),
+};
+
+/* ---------------------------------------------------------------------------------------------- */
+
+void spif_port_sim_config_default(spif_port_sim_config_t *config)
+{
+    if (config == NULL) {
+        return;
+    }
+
+    memset(config, 0, sizeof(spif_port_sim_config_t));
+
+    config->image = NULL;
+    config->size = 16 * 1024 * 1024;
+    config->jedec_id[0] = 0xEF;
+    config->jedec_id[1] = 0x40;
+    config->jedec_id[2] = 0x18;
+    config->clock_hz = 40 * 1000 * 1000;
+
+    config->t_pp_us = 400;
+    config->t_se_us = 45 * 1000;
+    config->t_be32_us = 120 * 1000;
+    config->t_be64_us = 150 * 1000;
+    config->t_ce_ms = 40 * 1000;
+    config->t_w_us = 10 * 1000;
+    config->t_sus_us = 20;
+}
+
+int spif_port_sim_open(uint8_t id, const spif_port_sim_config_t *config)
+{
+    sim_dev_t *sim = NULL;
+    struct stat st;
+    int fresh = 1;
+
+    if ((id >= SPIF_PORT_SIM_DEVICES) || (config == NULL) || s_sim_dev[id].used) {
+        return SPIF_FAIL;
+    }
+
+    if ((config->size == 0) || (config->size % (64 * 1024) != 0) || (config->clock_hz == 0)) {
+        return SPIF_FAIL;
+    }
+
+    sim = &s_sim_dev[id];
+    memset(sim, 0, sizeof(sim_dev_t));
+    sim->config = *config;
+    sim->dies = config->dual ? 2 : 1;
+    sim->size = config->size * sim->dies;
+    sim->fd = -1;
+
+    if (config->image != NULL) {
+        sim->fd = open(config->image, O_RDWR | O_CREAT, 0644);
+        if (sim->fd < 0) {
+            return SPIF_FAIL;
+        }
+
+        if ((fstat(sim->fd, &st) == 0) && (st.st_size == (off_t)sim->size)) {
+            fresh = 0;
+        } else if (ftruncate(sim->fd, sim->size) != 0) {
+            close(sim->fd);
+            return SPIF_FAIL;
+        }
+
+        sim->mem = mmap(NULL, sim->size, PROT_READ | PROT_WRITE, MAP_SHARED, sim->fd, 0);
+    } else {
+        sim->mem = mmap(NULL, sim->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (sim->mem == MAP_FAILED) {
+        if (sim->fd >= 0) {
+            close(sim->fd);
+        }
+        return SPIF_FAIL;
+    }
+
+    /* 新镜像是出厂状态, 全部擦除 */
+    if (fresh) {
+        memset(sim->mem, 0xFF, sim->size);
+    }
+
+    sim->erase_count = calloc(sim->size / SIM_SECTOR_SIZE, sizeof(uint32_t));
+    if (sim->erase_count == NULL) {
+        munmap(sim->mem, sim->size);
+        if (sim->fd >= 0) {
+            close(sim->fd);
+        }
+        return SPIF_FAIL;
+    }
+
+    _sim_sfdp_build(sim);
+
+    pthread_mutex_init(&sim->mutex, NULL);
+    pthread_mutex_init(&sim->bus_lock, NULL);
+    pthread_cond_init(&sim->cond, NULL);
+
+    if (pthread_create(&sim->worker, NULL, _sim_worker, sim) != 0) {
+        free(sim->erase_count);
+        munmap(sim->mem, sim->size);
+        if (sim->fd >= 0) {
+            close(sim->fd);
+        }
+        return SPIF_FAIL;
+    }
+
+    sim->used = 1;
+
+    return SPIF_SUCCESS;
+}
+
+int spif_port_sim_close(uint8_t id)
+{
+    sim_dev_t *sim = NULL;
+
+    if ((id >= SPIF_PORT_SIM_DEVICES) || !s_sim_dev[id].used) {
+        return SPIF_FAIL;
+    }
+
+    sim = &s_sim_dev[id];
+
+    pthread_mutex_lock(&sim->mutex);
+    sim->worker_exit = 1;
+    pthread_cond_signal(&sim->cond);
+    pthread_mutex_unlock(&sim->mutex);
+    pthread_join(sim->worker, NULL);
+
+    pthread_cond_destroy(&sim->cond);
+    pthread_mutex_destroy(&sim->bus_lock);
+    pthread_mutex_destroy(&sim->mutex);
+
+    if (sim->fd >= 0) {
+        msync(sim->mem, sim->size, MS_SYNC);
+    }
+    munmap(sim->mem, sim->size);
+    if (sim->fd >= 0) {
+        close(sim->fd);
+    }
+    free(sim->erase_count);
+
+    sim->used = 0;
+
+    return SPIF_SUCCESS;
+}
+
+static void _sim_ops_common(uint8_t id, spif_port_spi_ops_t *ops)
+{
+    memset(ops, 0, sizeof(spif_port_spi_ops_t));
+
+    ops->spi_init = s_sim_ops[id].spi_init;
+    ops->spi_deinit = s_sim_ops[id].spi_deinit;
+    ops->spi_lock = s_sim_ops[id].spi_lock;
+    ops->spi_trylock = s_sim_ops[id].spi_trylock;
+    ops->spi_unlock = s_sim_ops[id].spi_unlock;
+}
+
+void spif_port_sim_spi_get(uint8_t id, spif_port_spi_ops_t *ops)
+{
+    if ((ops == NULL) || (id >= SPIF_PORT_SIM_DEVICES)) {
+        return;
+    }
+
+    _sim_ops_common(id, ops);
+
+    ops->ops.spi.spi_send = s_sim_ops[id].spi_send;
+    ops->ops.spi.spi_recv = s_sim_ops[id].spi_recv;
+    ops->ops.spi.spi_transfer = s_sim_ops[id].spi_transfer;
+    ops->ops.spi.spi_transfer_iov = s_sim_ops[id].spi_transfer_iov;
+
+    ops->ops_mode = SPIF_SPI_OPS_SPI;
+}
+
+void spif_port_sim_qspi_get(uint8_t id, spif_port_spi_ops_t *ops)
+{
+    if ((ops == NULL) || (id >= SPIF_PORT_SIM_DEVICES)) {
+        return;
+    }
+
+    _sim_ops_common(id, ops);
+
+    ops->ops.qspi.qspi_transfer = s_sim_ops[id].qspi_transfer;
+    ops->ops.qspi.qspi_command = s_sim_ops[id].qspi_command;
+    ops->ops.qspi.qspi_mmap = s_sim_ops[id].qspi_mmap;
+    ops->ops.qspi.qspi_munmap = s_sim_ops[id].qspi_munmap;
+    ops->ops.qspi.qspi_autopoll = s_sim_ops[id].qspi_autopoll;
+    ops->ops.qspi.qspi_command_async = s_sim_ops[id].qspi_command_async;
+
+    ops->ops_mode = SPIF_SPI_OPS_QSPI;
+    ops->caps = SPIF_PORT_CAP_QSPI_DDR | SPIF_PORT_CAP_QSPI_SIOO;
+    if (s_sim_dev[id].dies > 1) {
+        ops->caps |= SPIF_PORT_CAP_QSPI_DUAL;
+    }
+}
+
+void spif_port_sim_plat_get(uint8_t id, spif_port_plat_ops_t *ops)
+{
+    if ((ops == NULL) || (id >= SPIF_PORT_SIM_DEVICES)) {
+        return;
+    }
+
+    ops->log = _sim_log;
+    ops->delay_us = s_sim_ops[id].delay_us;
+    ops->delay_ms = s_sim_ops[id].delay_ms;
+    ops->timestamp = s_sim_ops[id].timestamp;
+    ops->timestamp_hz = 1000000000;
+}
+
+uint64_t spif_port_sim_time_ns(uint8_t id)
+{
+    if ((id >= SPIF_PORT_SIM_DEVICES) || !s_sim_dev[id].used) {
+        return 0;
+    }
+
+    return _sim_timestamp(&s_sim_dev[id]);
+}
+
+int spif_port_sim_stats_get(uint8_t id, spif_port_sim_stats_t *stats)
+{
+    if ((id >= SPIF_PORT_SIM_DEVICES) || !s_sim_dev[id].used || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    pthread_mutex_lock(&s_sim_dev[id].mutex);
+    *stats = s_sim_dev[id].stats;
+    pthread_mutex_unlock(&s_sim_dev[id].mutex);
+
+    return SPIF_SUCCESS;
+}
+
+void spif_port_sim_stats_reset(uint8_t id)
+{
+    if ((id >= SPIF_PORT_SIM_DEVICES) || !s_sim_dev[id].used) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_sim_dev[id].mutex);
+    memset(&s_sim_dev[id].stats, 0, sizeof(spif_port_sim_stats_t));
+    pthread_mutex_unlock(&s_sim_dev[id].mutex);
+}
+
+uint32_t spif_port_sim_erase_count(uint8_t id, uint32_t addr)
+{
+    uint32_t count = 0;
+
+    if ((id >= SPIF_PORT_SIM_DEVICES) || !s_sim_dev[id].used || (addr >= s_sim_dev[id].size)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&s_sim_dev[id].mutex);
+    count = s_sim_dev[id].erase_count[addr / SIM_SECTOR_SIZE];
+    pthread_mutex_unlock(&s_sim_dev[id].mutex);
+
+    return count;
+}
+
+int spif_port_sim_power_cut(uint8_t id, uint32_t commands)
+{
+    if ((id >= SPIF_PORT_SIM_DEVICES) || !s_sim_dev[id].used) {
+        return SPIF_FAIL;
+    }
+
+    pthread_mutex_lock(&s_sim_dev[id].mutex);
+    s_sim_dev[id].cut_countdown = commands;
+    pthread_mutex_unlock(&s_sim_dev[id].mutex);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_port_sim_power_on(uint8_t id)
+{
+    sim_dev_t *sim = NULL;
+
+    if ((id >= SPIF_PORT_SIM_DEVICES) || !s_sim_dev[id].used) {
+        return SPIF_FAIL;
+    }
+
+    sim = &s_sim_dev[id];
+
+    pthread_mutex_lock(&sim->mutex);
+
+    /* 上电复位: 易失的状态回到默认, 阵列和非易失的状态寄存器位保留 */
+    sim->cut_countdown = 0;
+    sim->cut_tearing = 0;
+    sim->off = 0;
+    sim->wel = 0;
+    sim->qpi = 0;
+    sim->cread = 0;
+    sim->mapped = 0;
+    sim->sr2 &= ~SIM_SR2_SUS;
+    sim->busy_until_ns = sim->now_ns;
+    sim->busy_skew_ns = 0;
+    sim->busy_cmd = 0;
+    sim->busy_size = 0;
+    sim->suspend_left_ns = 0;
+
+    pthread_mutex_unlock(&sim->mutex);
+
+    return SPIF_SUCCESS;
+}
@@ -13,10 +13,52 @@
 
 #include "spif.h"
 #include "spif_port.h"
+#include "spif_port_lock.h"
 
 #define SPIF_QSPI_FLASH_SIZE    (POSITION_VAL(0x1000000))
 
+/**
+ * 双片模式: BK1 和 BK2 各接一片相同的 flash, 共用 CLK 和 NCS, 字节 2n 在 BK1, 2n + 1 在 BK2,
+ * 控制器把地址除以 2 发给两片. STM32L475 的 QUADSPI 没有 BK2 (没有 DFM 位), 只能在有 BK2 的型号上打开,
+ * 并用 STM32L4XX_QSPI_BK2_GPIO / STM32L4XX_QSPI_BK2_PINS / STM32L4XX_QSPI_BK2_AF 给出 BK2_IO0 ~ IO3 的引脚
+ */
+#ifndef STM32L4XX_QSPI_DUAL_FLASH
+#define STM32L4XX_QSPI_DUAL_FLASH     0
+#endif
+
+#if STM32L4XX_QSPI_DUAL_FLASH
+#if !defined(QUADSPI_CR_DFM)
+#error "spif_port_stm32l4xx: this QUADSPI has no dual-flash mode"
+#endif
+#if !defined(STM32L4XX_QSPI_BK2_GPIO) || !defined(STM32L4XX_QSPI_BK2_PINS) || !defined(STM32L4XX_QSPI_BK2_AF)
+#error "spif_port_stm32l4xx: dual-flash needs STM32L4XX_QSPI_BK2_GPIO / STM32L4XX_QSPI_BK2_PINS / STM32L4XX_QSPI_BK2_AF"
+#endif
+#endif
+
 static QSPI_HandleTypeDef s_qspi_handler;
+static DMA_HandleTypeDef s_qspi_dma_handler;
+
+/* 异步传输完成回调, 非 NULL 表示 DMA 传输进行中 */
+static spif_port_done_cb_t volatile s_qspi_done_cb = NULL;
+static void *s_qspi_done_arg = NULL;
+
+/* 自动轮询状态 */
+#define STM32L4XX_QSPI_POLL_PENDING   0
+#define STM32L4XX_QSPI_POLL_MATCH     1
+#define STM32L4XX_QSPI_POLL_ERROR     2
+
+static volatile uint8_t s_qspi_poll_state = STM32L4XX_QSPI_POLL_MATCH;
+
+/**
+ * 总线锁的天花板优先级: 所有使用 flash 的中断/任务中最高的那个 (数值最小), 只在抢锁时屏蔽;
+ * 必须低于 QSPI/DMA 中断 (2). 在中断中使用 flash 时 SysTick (0x0F, 最低) 不会走,
+ * 所以延时和超时都用 DWT 计数, 不能依赖 HAL_GetTick
+ */
+#ifndef STM32L4XX_QSPI_LOCK_PRIORITY
+#define STM32L4XX_QSPI_LOCK_PRIORITY  3
+#endif
+
+static spif_port_lock_t s_qspi_lock;
 
 static int _stm32l4xx_log(const char *format, ...)
 {
@@ -29,20 +71,60 @@ static int _stm32l4xx_log(const char *format, ...)
     return 0;
 }
 
+static void _stm32l4xx_delay_us(uint32_t us)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint32_t ticks = us * (SystemCoreClock / 1000000);
+
+    while ((DWT->CYCCNT - start) < ticks) {
+    }
+}
+
+/* 在中断中调用时 SysTick 不走, HAL_Delay 不会返回 */
 static void _stm32l4xx_delay_ms(uint32_t ms)
 {
-    HAL_Delay(ms * 1000);
+    while (ms--) {
+        _stm32l4xx_delay_us(1000);
+    }
 }
 
-static void _stm32l4xx_delay_us(uint32_t us)
+/**
+ * DWT 周期计数器扩展到 64 位, 两次调用的间隔必须小于一次回绕 (80 MHz 约 53 s);
+ * 等锁时会在不同的上下文中调用, 更新 last/high 时关中断
+ */
+static uint64_t _stm32l4xx_timestamp(void)
 {
-    HAL_Delay(us);
+    static uint32_t last = 0;
+    static uint32_t high = 0;
+
+    uint32_t primask = __get_PRIMASK();
+    uint32_t now = 0;
+    uint64_t stamp = 0;
+
+    __disable_irq();
+
+    now = DWT->CYCCNT;
+    if (now < last) {
+        high++;
+    }
+    last = now;
+    stamp = ((uint64_t)high << 32) | now;
+
+    __set_PRIMASK(primask);
+
+    return stamp;
 }
 
 static int _stm32l4xx_qspi_init(void)
 {
     GPIO_InitTypeDef GPIO_InitStruct;
 
+    /* delay_us 使用 DWT 周期计数器 */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    spif_port_lock_init(&s_qspi_lock, STM32L4XX_QSPI_LOCK_PRIORITY << (8 - __NVIC_PRIO_BITS), _stm32l4xx_delay_us);
+
     __HAL_RCC_QSPI_CLK_ENABLE();
     __HAL_RCC_GPIOE_CLK_ENABLE();
 
@@ -62,6 +144,13 @@ static int _stm32l4xx_qspi_init(void)
 
     HAL_GPIO_Init(GPIOE, &GPIO_InitStruct);
 
+#if STM32L4XX_QSPI_DUAL_FLASH
+    /* BK2 的 GPIO 时钟由应用打开 */
+    GPIO_InitStruct.Pin = STM32L4XX_QSPI_BK2_PINS;
+    GPIO_InitStruct.Alternate = STM32L4XX_QSPI_BK2_AF;
+    HAL_GPIO_Init(STM32L4XX_QSPI_BK2_GPIO, &GPIO_InitStruct);
+#endif
+
     s_qspi_handler.Instance = QUADSPI;
     /**
      * QPSI 分频比
@@ -70,10 +159,15 @@ static int _stm32l4xx_qspi_init(void)
     s_qspi_handler.Init.ClockPrescaler = 0;
     /* QSPI FIFO = 4 Byte */
     s_qspi_handler.Init.FifoThreshold = 4;
-    /* 采样移位半个周期 (DDR 模式下, 必须设置为 0) */
+    /* 采样移位半个周期 (DDR 模式下必须为 0, 由 _stm32l4xx_qspi_sample_shift() 按指令切换) */
     s_qspi_handler.Init.SampleShifting = QSPI_SAMPLE_SHIFTING_HALFCYCLE;
-    /* SPI FLASH 大小 */
+    /* SPI FLASH 大小, 双片时是两片合计 */
+#if STM32L4XX_QSPI_DUAL_FLASH
+    s_qspi_handler.Init.FlashSize = SPIF_QSPI_FLASH_SIZE;
+    s_qspi_handler.Init.DualFlash = QSPI_DUALFLASH_ENABLE;
+#else
     s_qspi_handler.Init.FlashSize = SPIF_QSPI_FLASH_SIZE - 1;
+#endif
     /* 片选高电平时间为 4 个时钟 (12.5 * 4 = 50 ns), tSHSL = 50 ns */
     s_qspi_handler.Init.ChipSelectHighTime = QSPI_CS_HIGH_TIME_4_CYCLE;
     /* 模式 0 */
@@ -83,6 +177,34 @@ static int _stm32l4xx_qspi_init(void)
         return SPIF_FAIL;
     }
 
+    /**
+     * QUADSPI DMA: DMA1 Channel 5, Request 5
+     * 传输方向由 HAL_QSPI_Transmit_DMA / HAL_QSPI_Receive_DMA 设置
+     */
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    s_qspi_dma_handler.Instance = DMA1_Channel5;
+    s_qspi_dma_handler.Init.Request = DMA_REQUEST_5;
+    s_qspi_dma_handler.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    s_qspi_dma_handler.Init.PeriphInc = DMA_PINC_DISABLE;
+    s_qspi_dma_handler.Init.MemInc = DMA_MINC_ENABLE;
+    s_qspi_dma_handler.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    s_qspi_dma_handler.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    s_qspi_dma_handler.Init.Mode = DMA_NORMAL;
+    s_qspi_dma_handler.Init.Priority = DMA_PRIORITY_HIGH;
+
+    if (HAL_DMA_Init(&s_qspi_dma_handler) != HAL_OK) {
+        return SPIF_FAIL;
+    }
+
+    __HAL_LINKDMA(&s_qspi_handler, hdma, s_qspi_dma_handler);
+
+    HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+
+    HAL_NVIC_SetPriority(QUADSPI_IRQn, 2, 1);
+    HAL_NVIC_EnableIRQ(QUADSPI_IRQn);
+
     return SPIF_SUCCESS;
 }
 
@@ -92,55 +214,106 @@ static int _stm32l4xx_qspi_deinit(void)
     return SPIF_SUCCESS;
 }
 
-static void _stm32l4xx_qspi_lock(uint32_t ms)
+static int _stm32l4xx_qspi_lock(uint32_t timeout_ms)
 {
-    // TODO
+    return spif_port_lock_take(&s_qspi_lock, timeout_ms);
+}
+
+static int _stm32l4xx_qspi_trylock(void)
+{
+    return spif_port_lock_try(&s_qspi_lock);
 }
 
 static void _stm32l4xx_qspi_unlock(void)
 {
-    // TODO
+    spif_port_lock_give(&s_qspi_lock);
 }
 
-int _stm32l4xx_qspi_transfer(uint8_t cmd, uint32_t addr, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+static uint32_t _stm32l4xx_qspi_lines(uint8_t lines, uint32_t none, uint32_t line1, uint32_t line2, uint32_t line4)
 {
-    QSPI_CommandTypeDef qspi_cmd = {0};
+    switch (lines) {
+    case SPIF_QSPI_LINES_1: return line1;
+    case SPIF_QSPI_LINES_2: return line2;
+    case SPIF_QSPI_LINES_4: return line4;
+    default: return none;
+    }
+}
+
+/**
+ * SSHIFT 只能在 BUSY = 0 时修改, DDR 指令要求不移位, SDR 指令保持半周期移位;
+ * 只在模式变化时写寄存器, 连续的同类指令没有额外开销
+ */
+static void _stm32l4xx_qspi_sample_shift(uint8_t ddr)
+{
+    uint32_t shift = ddr ? QSPI_SAMPLE_SHIFTING_NONE : QSPI_SAMPLE_SHIFTING_HALFCYCLE;
+
+    if (s_qspi_handler.Init.SampleShifting == shift) {
+        return;
+    }
 
-    qspi_cmd.Instruction = cmd;
-    qspi_cmd.InstructionMode = QSPI_INSTRUCTION_1_LINE;
+    while (__HAL_QSPI_GET_FLAG(&s_qspi_handler, QSPI_FLAG_BUSY) != RESET) {
+    }
+
+    MODIFY_REG(s_qspi_handler.Instance->CR, QUADSPI_CR_SSHIFT, shift);
+    s_qspi_handler.Init.SampleShifting = shift;
+}
+
+static void _stm32l4xx_qspi_cmd_fill(const spif_port_qspi_cmd_t *cmd, uint32_t data_size, QSPI_CommandTypeDef *qspi_cmd_p)
+{
+    QSPI_CommandTypeDef qspi_cmd = {0};
 
-    qspi_cmd.AlternateByteMode = QSPI_ALTERNATE_BYTES_NONE;
-    
-    qspi_cmd.DdrMode = QSPI_DDR_MODE_DISABLE;
-    qspi_cmd.SIOOMode = QSPI_SIOO_INST_EVERY_CMD;
+    qspi_cmd.Instruction = cmd->instruction;
+    qspi_cmd.InstructionMode = _stm32l4xx_qspi_lines(cmd->instruction_lines, QSPI_INSTRUCTION_NONE,
+                                                     QSPI_INSTRUCTION_1_LINE, QSPI_INSTRUCTION_2_LINES, QSPI_INSTRUCTION_4_LINES);
 
-    if (addr != SPIF_SPI_INVALID_ADDR) {
-        qspi_cmd.Address = addr;
-        qspi_cmd.AddressMode = QSPI_ADDRESS_1_LINE;
+    if (cmd->addr != SPIF_SPI_INVALID_ADDR) {
+        qspi_cmd.Address = cmd->addr;
+        qspi_cmd.AddressMode = _stm32l4xx_qspi_lines(cmd->addr_lines, QSPI_ADDRESS_NONE,
+                                                     QSPI_ADDRESS_1_LINE, QSPI_ADDRESS_2_LINES, QSPI_ADDRESS_4_LINES);
         qspi_cmd.AddressSize = QSPI_ADDRESS_24_BITS;
     } else {
         qspi_cmd.AddressMode = QSPI_ADDRESS_NONE;
     }
 
-    if (rx_size > 0) {
-        qspi_cmd.DataMode = QSPI_DATA_1_LINE;
-        qspi_cmd.NbData   = rx_size;
-    } else if (tx_size > 0) {
-        qspi_cmd.DataMode = QSPI_DATA_1_LINE;
-        qspi_cmd.NbData   = tx_size;
+    /* 0xEB 等指令的 mode bits 通过 alternate byte 发送 */
+    qspi_cmd.AlternateBytes = cmd->alt;
+    qspi_cmd.AlternateBytesSize = QSPI_ALTERNATE_BYTES_8_BITS;
+    qspi_cmd.AlternateByteMode = _stm32l4xx_qspi_lines(cmd->alt_lines, QSPI_ALTERNATE_BYTES_NONE,
+                                                       QSPI_ALTERNATE_BYTES_1_LINE, QSPI_ALTERNATE_BYTES_2_LINES, QSPI_ALTERNATE_BYTES_4_LINES);
+
+    /* DDR 只作用于地址, alternate 和数据阶段, 指令阶段始终是 SDR; L475 没有 DHHC, 使用模拟延时 */
+    qspi_cmd.DdrMode = cmd->ddr ? QSPI_DDR_MODE_ENABLE : QSPI_DDR_MODE_DISABLE;
+    qspi_cmd.DdrHoldHalfCycle = QSPI_DDR_HHC_ANALOG_DELAY;
+    /* 内存映射 + 连续读模式: 指令只在第一次访问时发送, 之后的访问从地址开始 */
+    qspi_cmd.SIOOMode = cmd->sioo ? QSPI_SIOO_INST_ONLY_FIRST_CMD : QSPI_SIOO_INST_EVERY_CMD;
+
+    if (data_size > 0) {
+        qspi_cmd.DataMode = _stm32l4xx_qspi_lines(cmd->data_lines, QSPI_DATA_1_LINE,
+                                                  QSPI_DATA_1_LINE, QSPI_DATA_2_LINES, QSPI_DATA_4_LINES);
+        qspi_cmd.NbData   = data_size;
     } else {
         qspi_cmd.DataMode = QSPI_DATA_NONE;
         qspi_cmd.NbData   = 0;
     }
 
-    qspi_cmd.DummyCycles = 0;
+    qspi_cmd.DummyCycles = cmd->dummy_cycles;
+
+    *qspi_cmd_p = qspi_cmd;
+}
+
+static int _stm32l4xx_qspi_command(const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    QSPI_CommandTypeDef qspi_cmd;
+
+    _stm32l4xx_qspi_sample_shift(cmd->ddr);
+    _stm32l4xx_qspi_cmd_fill(cmd, (rx_size > 0) ? rx_size : tx_size, &qspi_cmd);
 
     if (HAL_QSPI_Command(&s_qspi_handler, &qspi_cmd, 5000) != HAL_OK) {
         return SPIF_FAIL;
     }
 
     if (tx_size > 0) {
-        if (HAL_QSPI_Transmit(&s_qspi_handler, tx_buf, 5000) != HAL_OK) {
+        if (HAL_QSPI_Transmit(&s_qspi_handler, (uint8_t *)tx_buf, 5000) != HAL_OK) {
             return SPIF_FAIL;
         }
     }
@@ -154,6 +327,201 @@ int _stm32l4xx_qspi_transfer(uint8_t cmd, uint32_t addr, const uint8_t *tx_buf,
     return SPIF_SUCCESS;
 }
 
+static void _stm32l4xx_qspi_async_done(int result)
+{
+    spif_port_done_cb_t done = s_qspi_done_cb;
+
+    s_qspi_done_cb = NULL;
+
+    if (done != NULL) {
+        done(result, s_qspi_done_arg);
+    }
+}
+
+static int _stm32l4xx_qspi_command_async(const spif_port_qspi_cmd_t *cmd, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size,
+                                         spif_port_done_cb_t done, void *arg)
+{
+    HAL_StatusTypeDef status = HAL_OK;
+    QSPI_CommandTypeDef qspi_cmd;
+
+    if (s_qspi_done_cb != NULL) {
+        return SPIF_FAIL;
+    }
+
+    /* 没有数据阶段, 直接同步完成 */
+    if ((tx_size == 0) && (rx_size == 0)) {
+        if (_stm32l4xx_qspi_command(cmd, NULL, 0, NULL, 0) != SPIF_SUCCESS) {
+            return SPIF_FAIL;
+        }
+
+        done(SPIF_SUCCESS, arg);
+        return SPIF_SUCCESS;
+    }
+
+    _stm32l4xx_qspi_sample_shift(cmd->ddr);
+    _stm32l4xx_qspi_cmd_fill(cmd, (rx_size > 0) ? rx_size : tx_size, &qspi_cmd);
+
+    /* 指令和地址阶段很短, 阻塞发送; 数据阶段交给 DMA */
+    if (HAL_QSPI_Command(&s_qspi_handler, &qspi_cmd, 5000) != HAL_OK) {
+        return SPIF_FAIL;
+    }
+
+    s_qspi_done_arg = arg;
+    s_qspi_done_cb = done;
+
+    if (tx_size > 0) {
+        status = HAL_QSPI_Transmit_DMA(&s_qspi_handler, (uint8_t *)tx_buf);
+    } else {
+        status = HAL_QSPI_Receive_DMA(&s_qspi_handler, rx_buf);
+    }
+
+    if (status != HAL_OK) {
+        s_qspi_done_cb = NULL;
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+void HAL_QSPI_RxCpltCallback(QSPI_HandleTypeDef *hqspi)
+{
+    _stm32l4xx_qspi_async_done(SPIF_SUCCESS);
+}
+
+void HAL_QSPI_TxCpltCallback(QSPI_HandleTypeDef *hqspi)
+{
+    _stm32l4xx_qspi_async_done(SPIF_SUCCESS);
+}
+
+void HAL_QSPI_ErrorCallback(QSPI_HandleTypeDef *hqspi)
+{
+    if (s_qspi_poll_state == STM32L4XX_QSPI_POLL_PENDING) {
+        s_qspi_poll_state = STM32L4XX_QSPI_POLL_ERROR;
+        return;
+    }
+
+    _stm32l4xx_qspi_async_done(SPIF_FAIL);
+}
+
+void HAL_QSPI_StatusMatchCallback(QSPI_HandleTypeDef *hqspi)
+{
+    s_qspi_poll_state = STM32L4XX_QSPI_POLL_MATCH;
+}
+
+void QUADSPI_IRQHandler(void)
+{
+    HAL_QSPI_IRQHandler(&s_qspi_handler);
+}
+
+void DMA1_Channel5_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&s_qspi_dma_handler);
+}
+
+static int _stm32l4xx_qspi_autopoll(const spif_port_qspi_cmd_t *cmd, uint8_t mask, uint8_t match, uint32_t interval_us, uint32_t timeout_ms)
+{
+    QSPI_CommandTypeDef qspi_cmd;
+    QSPI_AutoPollingTypeDef poll_cfg = {0};
+
+    uint32_t start = DWT->CYCCNT;
+    uint32_t interval = interval_us * (HAL_RCC_GetHCLKFreq() / 1000000) / (s_qspi_handler.Init.ClockPrescaler + 1);
+
+    /* 指令线数由上层决定, QPI 模式下读状态寄存器也走 4 线 */
+    _stm32l4xx_qspi_sample_shift(cmd->ddr);
+    _stm32l4xx_qspi_cmd_fill(cmd, 1, &qspi_cmd);
+
+    /* 双片时每片回一个字节, 两片都匹配才算匹配 */
+#if STM32L4XX_QSPI_DUAL_FLASH
+    poll_cfg.Match = match | ((uint32_t)match << 8);
+    poll_cfg.Mask = mask | ((uint32_t)mask << 8);
+    poll_cfg.StatusBytesSize = 2;
+#else
+    poll_cfg.Match = match;
+    poll_cfg.Mask = mask;
+    poll_cfg.StatusBytesSize = 1;
+#endif
+    poll_cfg.MatchMode = QSPI_MATCH_MODE_AND;
+    /* 间隔单位是 QSPI 时钟周期, 最大 0xFFFF */
+    poll_cfg.Interval = (interval > 0xFFFF) ? 0xFFFF : interval;
+    poll_cfg.AutomaticStop = QSPI_AUTOMATIC_STOP_ENABLE;
+
+    s_qspi_poll_state = STM32L4XX_QSPI_POLL_PENDING;
+
+    if (HAL_QSPI_AutoPolling_IT(&s_qspi_handler, &qspi_cmd, &poll_cfg) != HAL_OK) {
+        s_qspi_poll_state = STM32L4XX_QSPI_POLL_ERROR;
+        return SPIF_FAIL;
+    }
+
+    /**
+     * 匹配前 CPU 进入睡眠, 由 QUADSPI 中断唤醒, SysTick 每 1 ms 也会唤醒一次, 用于检查超时;
+     * 在中断中或调用者屏蔽了中断时 SysTick 无法唤醒, 只能忙等. 超时用 DWT 按毫秒计, 不受回绕影响
+     */
+    while (s_qspi_poll_state == STM32L4XX_QSPI_POLL_PENDING) {
+        if ((DWT->CYCCNT - start) >= (SystemCoreClock / 1000)) {
+            start += SystemCoreClock / 1000;
+            if (timeout_ms-- == 0) {
+                (void)HAL_QSPI_Abort(&s_qspi_handler);
+                s_qspi_poll_state = STM32L4XX_QSPI_POLL_ERROR;
+                return SPIF_TIMEOUT;
+            }
+        }
+
+        if ((__get_IPSR() == 0) && (__get_BASEPRI() == 0) && (__get_PRIMASK() == 0)) {
+            __WFI();
+        }
+    }
+
+    return (s_qspi_poll_state == STM32L4XX_QSPI_POLL_MATCH) ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+static int _stm32l4xx_qspi_mmap(const spif_port_qspi_cmd_t *cmd, const uint8_t **base)
+{
+    QSPI_CommandTypeDef qspi_cmd;
+    QSPI_MemoryMappedTypeDef mmap_cfg = {0};
+
+    /* 数据阶段必须存在, 长度由 AHB 访问决定 */
+    _stm32l4xx_qspi_sample_shift(cmd->ddr);
+    _stm32l4xx_qspi_cmd_fill(cmd, 1, &qspi_cmd);
+    qspi_cmd.NbData = 0;
+
+    /* 不释放片选, 连续地址的访问不需要重新发送指令 */
+    mmap_cfg.TimeOutActivation = QSPI_TIMEOUT_COUNTER_DISABLE;
+    mmap_cfg.TimeOutPeriod = 0;
+
+    if (HAL_QSPI_MemoryMapped(&s_qspi_handler, &qspi_cmd, &mmap_cfg) != HAL_OK) {
+        return SPIF_FAIL;
+    }
+
+    *base = (const uint8_t *)QSPI_BASE;
+
+    return SPIF_SUCCESS;
+}
+
+static int _stm32l4xx_qspi_munmap(void)
+{
+    /* Abort 会清除 BUSY, 之后可以重新使用间接模式 */
+    if (HAL_QSPI_Abort(&s_qspi_handler) != HAL_OK) {
+        return SPIF_FAIL;
+    }
+
+    return SPIF_SUCCESS;
+}
+
+int _stm32l4xx_qspi_transfer(uint8_t cmd, uint32_t addr, const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    spif_port_qspi_cmd_t qspi_cmd = {0};
+
+    qspi_cmd.instruction = cmd;
+    qspi_cmd.instruction_lines = SPIF_QSPI_LINES_1;
+    qspi_cmd.addr = addr;
+    qspi_cmd.addr_lines = SPIF_QSPI_LINES_1;
+    qspi_cmd.alt_lines = SPIF_QSPI_LINES_NONE;
+    qspi_cmd.dummy_cycles = 0;
+    qspi_cmd.data_lines = SPIF_QSPI_LINES_1;
+
+    return _stm32l4xx_qspi_command(&qspi_cmd, tx_buf, tx_size, rx_buf, rx_size);
+}
+
 void spif_port_stm32l4xx_qspi_get(spif_port_spi_ops_t *ops)
 {
     if (ops == NULL) {
@@ -163,11 +531,29 @@ void spif_port_stm32l4xx_qspi_get(spif_port_spi_ops_t *ops)
     ops->spi_init = _stm32l4xx_qspi_init;
     ops->spi_deinit = _stm32l4xx_qspi_deinit;
     ops->spi_lock = _stm32l4xx_qspi_lock;
+    ops->spi_trylock = _stm32l4xx_qspi_trylock;
     ops->spi_unlock = _stm32l4xx_qspi_unlock;
 
     ops->ops.qspi.qspi_transfer = _stm32l4xx_qspi_transfer;
+    ops->ops.qspi.qspi_command = _stm32l4xx_qspi_command;
+    ops->ops.qspi.qspi_mmap = _stm32l4xx_qspi_mmap;
+    ops->ops.qspi.qspi_munmap = _stm32l4xx_qspi_munmap;
+    ops->ops.qspi.qspi_command_async = _stm32l4xx_qspi_command_async;
+    ops->ops.qspi.qspi_autopoll = _stm32l4xx_qspi_autopoll;
 
     ops->ops_mode = SPIF_SPI_OPS_QSPI;
+    ops->caps = SPIF_PORT_CAP_QSPI_DDR | SPIF_PORT_CAP_QSPI_SIOO;
+#if STM32L4XX_QSPI_DUAL_FLASH
+    ops->caps |= SPIF_PORT_CAP_QSPI_DUAL;
+#endif
+}
+
+/**
+ * 在 RTOS 下用互斥量代替自旋锁, NULL 恢复自旋锁; 在 spif_init() 之前调用
+ */
+void spif_port_stm32l4xx_lock_rtos_set(const spif_port_lock_rtos_t *rtos)
+{
+    spif_port_lock_rtos_set(&s_qspi_lock, rtos);
 }
 
 void spif_port_stm32l4xx_plat_get(spif_port_plat_ops_t *ops)
@@ -179,4 +565,6 @@ void spif_port_stm32l4xx_plat_get(spif_port_plat_ops_t *ops)
     ops->log = _stm32l4xx_log;
     ops->delay_us = _stm32l4xx_delay_us;
     ops->delay_ms = _stm32l4xx_delay_ms;
+    ops->timestamp = _stm32l4xx_timestamp;
+    ops->timestamp_hz = SystemCoreClock;
 }
@@ -0,0 +1,388 @@
+/*
+ * spif_port_stm32l4xx_spi.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "stm32l475xx.h"
+#include "stm32l4xx_hal.h"
+
+#include "spif.h"
+#include "spif_port.h"
+#include "spif_port_lock.h"
+
+/**
+ * 普通 SPI 接 NOR flash (SPIF_SPI_OPS_SPI), 平台接口使用 spif_port_stm32l4xx_plat_get();
+ * 默认 SPI1: PA5 SCK, PA6 MISO, PA7 MOSI, 片选 PA4 用 GPIO 控制, 整条指令期间保持低电平.
+ * DMA: SPI1_RX DMA1 Channel 2, SPI1_TX DMA1 Channel 3, Request 1; 换成 SPI3 时要同时修改时钟和 DMA
+ */
+#ifndef STM32L4XX_SPI_GPIO
+#define STM32L4XX_SPI_GPIO            GPIOA
+#define STM32L4XX_SPI_PINS            (GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_7)
+#define STM32L4XX_SPI_AF              GPIO_AF5_SPI1
+#endif
+
+#ifndef STM32L4XX_SPI_CS_GPIO
+#define STM32L4XX_SPI_CS_GPIO         GPIOA
+#define STM32L4XX_SPI_CS_PIN          GPIO_PIN_4
+#endif
+
+/* SPI1 在 APB2 上, 80 / 2 = 40 MHz */
+#ifndef STM32L4XX_SPI_PRESCALER
+#define STM32L4XX_SPI_PRESCALER       SPI_BAUDRATEPRESCALER_2
+#endif
+
+/**
+ * 小于这个长度的传输用轮询: 指令, 地址, 状态寄存器这些几个字节的传输,
+ * 配置两个 DMA 通道加上等中断的时间比直接收发还长
+ */
+#ifndef STM32L4XX_SPI_DMA_MIN
+#define STM32L4XX_SPI_DMA_MIN         32
+#endif
+
+/* 接收时 MOSI 上发送的 0xFF, 同时是 TX DMA 的源地址; 超过这个长度的接收分段进行, 片选一直保持 */
+#ifndef STM32L4XX_SPI_DUMMY_SIZE
+#define STM32L4XX_SPI_DUMMY_SIZE      512
+#endif
+
+/* 一次 DMA 传输的超时 */
+#define STM32L4XX_SPI_TIMEOUT_MS      100
+
+/* 总线锁的天花板优先级, 必须低于 SPI DMA 中断 (2), 见 spif_port_stm32l4xx.c */
+#ifndef STM32L4XX_SPI_LOCK_PRIORITY
+#define STM32L4XX_SPI_LOCK_PRIORITY   3
+#endif
+
+static SPI_HandleTypeDef s_spi_handler;
+static DMA_HandleTypeDef s_spi_dma_rx_handler;
+static DMA_HandleTypeDef s_spi_dma_tx_handler;
+
+static uint8_t s_spi_dummy[STM32L4XX_SPI_DUMMY_SIZE];
+
+static spif_port_lock_t s_spi_lock;
+
+/* 在中断中使用 flash 时 SysTick 不走, 等锁和超时都用 DWT 计数 */
+static void _stm32l4xx_spi_delay_us(uint32_t us)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint32_t ticks = us * (SystemCoreClock / 1000000);
+
+    while ((DWT->CYCCNT - start) < ticks) {
+    }
+}
+
+static void _stm32l4xx_spi_cs_set(uint8_t level)
+{
+    HAL_GPIO_WritePin(STM32L4XX_SPI_CS_GPIO, STM32L4XX_SPI_CS_PIN, (level == 1) ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+static int _stm32l4xx_spi_dma_init(DMA_HandleTypeDef *hdma, DMA_Channel_TypeDef *channel, uint32_t direction)
+{
+    hdma->Instance = channel;
+    hdma->Init.Request = DMA_REQUEST_1;
+    hdma->Init.Direction = direction;
+    hdma->Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma->Init.MemInc = DMA_MINC_ENABLE;
+    hdma->Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma->Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma->Init.Mode = DMA_NORMAL;
+    hdma->Init.Priority = DMA_PRIORITY_HIGH;
+
+    return (HAL_DMA_Init(hdma) == HAL_OK) ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+static int _stm32l4xx_spi_init(void)
+{
+    GPIO_InitTypeDef GPIO_InitStruct;
+
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    spif_port_lock_init(&s_spi_lock, STM32L4XX_SPI_LOCK_PRIORITY << (8 - __NVIC_PRIO_BITS), _stm32l4xx_spi_delay_us);
+
+    memset(s_spi_dummy, 0xFF, sizeof(s_spi_dummy));
+
+    __HAL_RCC_SPI1_CLK_ENABLE();
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    /* 先拉高片选再配置成输出, 避免上电时出现一个片选脉冲 */
+    _stm32l4xx_spi_cs_set(1);
+    GPIO_InitStruct.Pin = STM32L4XX_SPI_CS_PIN;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+    GPIO_InitStruct.Alternate = 0;
+    HAL_GPIO_Init(STM32L4XX_SPI_CS_GPIO, &GPIO_InitStruct);
+
+    GPIO_InitStruct.Pin = STM32L4XX_SPI_PINS;
+    GPIO_InitStruct.Mode = GPIO_MODE_AF_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Alternate = STM32L4XX_SPI_AF;
+    HAL_GPIO_Init(STM32L4XX_SPI_GPIO, &GPIO_InitStruct);
+
+    s_spi_handler.Instance = SPI1;
+    s_spi_handler.Init.Mode = SPI_MODE_MASTER;
+    s_spi_handler.Init.Direction = SPI_DIRECTION_2LINES;
+    s_spi_handler.Init.DataSize = SPI_DATASIZE_8BIT;
+    /* 模式 0 */
+    s_spi_handler.Init.CLKPolarity = SPI_POLARITY_LOW;
+    s_spi_handler.Init.CLKPhase = SPI_PHASE_1EDGE;
+    s_spi_handler.Init.NSS = SPI_NSS_SOFT;
+    s_spi_handler.Init.BaudRatePrescaler = STM32L4XX_SPI_PRESCALER;
+    s_spi_handler.Init.FirstBit = SPI_FIRSTBIT_MSB;
+    s_spi_handler.Init.TIMode = SPI_TIMODE_DISABLE;
+    s_spi_handler.Init.CRCCalculation = SPI_CRCCALCULATION_DISABLE;
+    s_spi_handler.Init.CRCPolynomial = 7;
+    s_spi_handler.Init.CRCLength = SPI_CRC_LENGTH_DATASIZE;
+    s_spi_handler.Init.NSSPMode = SPI_NSS_PULSE_DISABLE;
+
+    if (HAL_SPI_Init(&s_spi_handler) != HAL_OK) {
+        return SPIF_FAIL;
+    }
+
+    if ((_stm32l4xx_spi_dma_init(&s_spi_dma_rx_handler, DMA1_Channel2, DMA_PERIPH_TO_MEMORY) != SPIF_SUCCESS) ||
+        (_stm32l4xx_spi_dma_init(&s_spi_dma_tx_handler, DMA1_Channel3, DMA_MEMORY_TO_PERIPH) != SPIF_SUCCESS)) {
+        return SPIF_FAIL;
+    }
+
+    __HAL_LINKDMA(&s_spi_handler, hdmarx, s_spi_dma_rx_handler);
+    __HAL_LINKDMA(&s_spi_handler, hdmatx, s_spi_dma_tx_handler);
+
+    HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+    HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 2, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+    HAL_NVIC_SetPriority(SPI1_IRQn, 2, 1);
+    HAL_NVIC_EnableIRQ(SPI1_IRQn);
+
+    return SPIF_SUCCESS;
+}
+
+static int _stm32l4xx_spi_deinit(void)
+{
+    int ret = SPIF_SUCCESS;
+
+    HAL_NVIC_DisableIRQ(SPI1_IRQn);
+    HAL_NVIC_DisableIRQ(DMA1_Channel2_IRQn);
+    HAL_NVIC_DisableIRQ(DMA1_Channel3_IRQn);
+
+    if (HAL_SPI_DeInit(&s_spi_handler) != HAL_OK) {
+        ret = SPIF_FAIL;
+    }
+
+    if ((HAL_DMA_DeInit(&s_spi_dma_rx_handler) != HAL_OK) || (HAL_DMA_DeInit(&s_spi_dma_tx_handler) != HAL_OK)) {
+        ret = SPIF_FAIL;
+    }
+
+    /* DMA1 的时钟 QSPI 也在用, 不关闭 */
+    __HAL_RCC_SPI1_CLK_DISABLE();
+
+    /* 引脚恢复为模拟输入, 片选最后释放, 之前一直保持高电平 */
+    HAL_GPIO_DeInit(STM32L4XX_SPI_GPIO, STM32L4XX_SPI_PINS);
+    HAL_GPIO_DeInit(STM32L4XX_SPI_CS_GPIO, STM32L4XX_SPI_CS_PIN);
+
+    return ret;
+}
+
+static int _stm32l4xx_spi_lock(uint32_t timeout_ms)
+{
+    return spif_port_lock_take(&s_spi_lock, timeout_ms);
+}
+
+static int _stm32l4xx_spi_trylock(void)
+{
+    return spif_port_lock_try(&s_spi_lock);
+}
+
+static void _stm32l4xx_spi_unlock(void)
+{
+    spif_port_lock_give(&s_spi_lock);
+}
+
+void DMA1_Channel2_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&s_spi_dma_rx_handler);
+}
+
+void DMA1_Channel3_IRQHandler(void)
+{
+    HAL_DMA_IRQHandler(&s_spi_dma_tx_handler);
+}
+
+void SPI1_IRQHandler(void)
+{
+    HAL_SPI_IRQHandler(&s_spi_handler);
+}
+
+/**
+ * DMA 完成后 HAL 在中断里把状态改回 READY; 在中断中使用 flash 时 SysTick 不走, HAL_GetTick 不动,
+ * 所以这里用 DWT 计超时, 轮询接口也只能用 HAL_MAX_DELAY
+ */
+static int _stm32l4xx_spi_dma_wait(void)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint32_t timeout_ms = STM32L4XX_SPI_TIMEOUT_MS;
+
+    while (HAL_SPI_GetState(&s_spi_handler) != HAL_SPI_STATE_READY) {
+        if ((DWT->CYCCNT - start) >= (SystemCoreClock / 1000)) {
+            start += SystemCoreClock / 1000;
+            if (timeout_ms-- == 0) {
+                (void)HAL_SPI_Abort(&s_spi_handler);
+                return SPIF_TIMEOUT;
+            }
+        }
+    }
+
+    return (HAL_SPI_GetError(&s_spi_handler) == HAL_SPI_ERROR_NONE) ? SPIF_SUCCESS : SPIF_FAIL;
+}
+
+/**
+ * 一段传输, tx_buf 为 NULL 时发送 s_spi_dummy (0xFF), rx_buf 为 NULL 时丢弃收到的数据 (HAL 在结束时清除接收溢出);
+ * 主机模式下接收必须同时发送才有时钟, HAL_SPI_Receive_DMA 会把接收缓冲区当作发送数据,
+ * 所以接收时总是 RX 和 TX 两个 DMA 通道同时工作
+ */
+static int _stm32l4xx_spi_segment(const uint8_t *tx_buf, uint8_t *rx_buf, uint32_t size)
+{
+    int ret = SPIF_SUCCESS;
+    HAL_StatusTypeDef status = HAL_OK;
+    const uint8_t *src = NULL;
+    uint32_t chunk = 0;
+
+    for (uint32_t offset = 0; (offset < size) && (ret == SPIF_SUCCESS); offset += chunk) {
+        if (tx_buf != NULL) {
+            src = &tx_buf[offset];
+            chunk = ((size - offset) < 0xFFFF) ? (size - offset) : 0xFFFF;
+        } else {
+            src = s_spi_dummy;
+            chunk = ((size - offset) < STM32L4XX_SPI_DUMMY_SIZE) ? (size - offset) : STM32L4XX_SPI_DUMMY_SIZE;
+        }
+
+        if (chunk < STM32L4XX_SPI_DMA_MIN) {
+            if (rx_buf != NULL) {
+                status = HAL_SPI_TransmitReceive(&s_spi_handler, src, &rx_buf[offset], chunk, HAL_MAX_DELAY);
+            } else {
+                status = HAL_SPI_Transmit(&s_spi_handler, src, chunk, HAL_MAX_DELAY);
+            }
+            ret = (status == HAL_OK) ? SPIF_SUCCESS : SPIF_FAIL;
+            continue;
+        }
+
+        if (rx_buf != NULL) {
+            status = HAL_SPI_TransmitReceive_DMA(&s_spi_handler, src, &rx_buf[offset], chunk);
+        } else {
+            status = HAL_SPI_Transmit_DMA(&s_spi_handler, src, chunk);
+        }
+
+        ret = (status == HAL_OK) ? _stm32l4xx_spi_dma_wait() : SPIF_FAIL;
+    }
+
+    return ret;
+}
+
+static int _stm32l4xx_spi_send(const uint8_t *tx_buf, uint32_t tx_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((tx_buf == NULL) || (tx_size == 0)) {
+        return SPIF_FAIL;
+    }
+
+    _stm32l4xx_spi_cs_set(0);
+    ret = _stm32l4xx_spi_segment(tx_buf, NULL, tx_size);
+    _stm32l4xx_spi_cs_set(1);
+
+    return ret;
+}
+
+static int _stm32l4xx_spi_recv(uint8_t *rx_buf, uint32_t rx_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((rx_buf == NULL) || (rx_size == 0)) {
+        return SPIF_FAIL;
+    }
+
+    _stm32l4xx_spi_cs_set(0);
+    ret = _stm32l4xx_spi_segment(NULL, rx_buf, rx_size);
+    _stm32l4xx_spi_cs_set(1);
+
+    return ret;
+}
+
+/* 指令 (+ 地址 + 数据) 和读到的数据在同一个片选周期内 */
+static int _stm32l4xx_spi_transfer(const uint8_t *tx_buf, uint32_t tx_size, uint8_t *rx_buf, uint32_t rx_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((tx_buf == NULL) || (tx_size == 0) || ((rx_buf == NULL) && (rx_size > 0))) {
+        return SPIF_FAIL;
+    }
+
+    _stm32l4xx_spi_cs_set(0);
+
+    ret = _stm32l4xx_spi_segment(tx_buf, NULL, tx_size);
+    if ((ret == SPIF_SUCCESS) && (rx_size > 0)) {
+        ret = _stm32l4xx_spi_segment(NULL, rx_buf, rx_size);
+    }
+
+    _stm32l4xx_spi_cs_set(1);
+
+    return ret;
+}
+
+/**
+ * 各段依次传输, 片选一直保持; L4 的 DMA 没有链表描述符, 每段单独启动一次,
+ * 段之间的间隔是一次 DMA 配置的时间, 短的段 (指令 + 地址) 直接轮询
+ */
+static int _stm32l4xx_spi_transfer_iov(const spif_port_iov_t *iov, uint32_t iov_count)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((iov == NULL) || (iov_count == 0)) {
+        return SPIF_FAIL;
+    }
+
+    _stm32l4xx_spi_cs_set(0);
+
+    for (uint32_t i = 0; (i < iov_count) && (ret == SPIF_SUCCESS); i++) {
+        ret = _stm32l4xx_spi_segment(iov[i].tx_buf, iov[i].rx_buf, iov[i].size);
+    }
+
+    _stm32l4xx_spi_cs_set(1);
+
+    return ret;
+}
+
+void spif_port_stm32l4xx_spi_get(spif_port_spi_ops_t *ops)
+{
+    if (ops == NULL) {
+        return;
+    }
+
+    ops->spi_init = _stm32l4xx_spi_init;
+    ops->spi_deinit = _stm32l4xx_spi_deinit;
+    ops->spi_lock = _stm32l4xx_spi_lock;
+    ops->spi_trylock = _stm32l4xx_spi_trylock;
+    ops->spi_unlock = _stm32l4xx_spi_unlock;
+
+    ops->ops.spi.spi_send = _stm32l4xx_spi_send;
+    ops->ops.spi.spi_recv = _stm32l4xx_spi_recv;
+    ops->ops.spi.spi_transfer = _stm32l4xx_spi_transfer;
+    ops->ops.spi.spi_transfer_iov = _stm32l4xx_spi_transfer_iov;
+
+    ops->ops_mode = SPIF_SPI_OPS_SPI;
+    ops->caps = 0;
+}
+
+/**
+ * 在 RTOS 下用互斥量代替自旋锁, NULL 恢复自旋锁; 在 spif_init() 之前调用
+ */
+void spif_port_stm32l4xx_spi_lock_rtos_set(const spif_port_lock_rtos_t *rtos)
+{
+    spif_port_lock_rtos_set(&s_spi_lock, rtos);
+}
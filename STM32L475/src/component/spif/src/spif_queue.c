@@ -0,0 +1,473 @@
+/*
+ * spif_queue.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif.h"
+#include "spif_queue.h"
+
+#define SPIF_QUEUE_ADDR_ANY    0xFFFFFFFF
+
+/**
+ * the inbox is all that submit shares with poll, guarded by the bus lock of the device. it is held
+ * for a few pointer updates only and never across a spif call, which takes the same lock
+ */
+static int _spif_queue_lock(spif_queue_t *queue)
+{
+    spif_dev_t *dev = queue->config.dev;
+
+    if (dev->spi_ops.spi_lock == NULL) {
+        return SPIF_SUCCESS;
+    }
+
+    return dev->spi_ops.spi_lock(SPIF_LOCK_TIMEOUT_MS);
+}
+
+static void _spif_queue_unlock(spif_queue_t *queue)
+{
+    spif_dev_t *dev = queue->config.dev;
+
+    if (dev->spi_ops.spi_unlock != NULL) {
+        dev->spi_ops.spi_unlock();
+    }
+}
+
+/* move the inbox to the tails of the classes, in the order of submission */
+static void _spif_queue_take(spif_queue_t *queue)
+{
+    spif_req_t *req = NULL;
+
+    if (_spif_queue_lock(queue) != SPIF_SUCCESS) {
+        return; /* tried again by the next poll */
+    }
+
+    req = queue->in_head;
+    queue->in_head = NULL;
+    queue->in_tail = NULL;
+
+    _spif_queue_unlock(queue);
+
+    while (req != NULL) {
+        spif_req_t *next = req->next;
+
+        req->next = NULL;
+        if (queue->tail[req->prio] == NULL) {
+            queue->head[req->prio] = req;
+        } else {
+            queue->tail[req->prio]->next = req;
+        }
+        queue->tail[req->prio] = req;
+
+        req = next;
+    }
+}
+
+static void _spif_queue_remove(spif_queue_t *queue, spif_req_t *req)
+{
+    spif_req_t *prev = NULL;
+
+    for (spif_req_t *cur = queue->head[req->prio]; cur != NULL; prev = cur, cur = cur->next) {
+        if (cur != req) {
+            continue;
+        }
+
+        if (prev == NULL) {
+            queue->head[req->prio] = req->next;
+        } else {
+            prev->next = req->next;
+        }
+
+        if (queue->tail[req->prio] == req) {
+            queue->tail[req->prio] = prev;
+        }
+
+        req->next = NULL;
+        return;
+    }
+}
+
+/* req must be out of its list already */
+static void _spif_queue_complete(spif_queue_t *queue, spif_req_t *req, int result)
+{
+    spif_async_cb_t cb = req->cb;
+
+    if (result == SPIF_SUCCESS) {
+        queue->stats.completed++;
+    } else {
+        queue->stats.failed++;
+    }
+
+    req->result = result;
+    req->state = SPIF_ASYNC_DONE;
+
+    if (cb != NULL) {
+        cb(result, req->arg);
+    }
+}
+
+/**
+ * first read of the classes above prio_end that can be served now (starting at addr unless
+ * SPIF_QUEUE_ADDR_ANY). a read never passes a write/erase of its own class, and stays out of
+ * the block of the erase in flight, which reads undefined while suspended
+ */
+static spif_req_t *_spif_queue_read_next(spif_queue_t *queue, uint8_t prio_end, uint32_t addr)
+{
+    spif_req_t *req = NULL;
+
+    for (uint8_t prio = 0; prio < prio_end; prio++) {
+        for (req = queue->head[prio]; (req != NULL) && (req->op == SPIF_REQ_READ); req = req->next) {
+            if ((queue->active != NULL) && (queue->active->op == SPIF_REQ_ERASE) &&
+                (req->addr < queue->step_addr + queue->step_size) && (req->addr + req->size > queue->step_addr)) {
+                continue;
+            }
+
+            if ((addr == SPIF_QUEUE_ADDR_ANY) || (req->addr == addr)) {
+                return req;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* one flash read for first and every queued read continuing it, up to the merge buffer */
+static void _spif_queue_read_serve(spif_queue_t *queue, spif_req_t *first, uint8_t prio_end)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = queue->config.dev;
+    spif_req_t *last = first;
+    spif_req_t *req = NULL;
+    uint32_t base = 0;
+    uint32_t end = first->addr + first->size;
+
+    _spif_queue_remove(queue, first);
+
+    while (first->size < SPIF_QUEUE_MERGE_BUF_SIZE) {
+        req = _spif_queue_read_next(queue, prio_end, end);
+        if ((req == NULL) || (end + req->size - first->addr > SPIF_QUEUE_MERGE_BUF_SIZE)) {
+            break;
+        }
+
+        _spif_queue_remove(queue, req);
+        last->next = req;
+        last = req;
+        end += req->size;
+        queue->stats.merged++;
+    }
+
+    queue->stats.reads++;
+
+    if (first == last) {
+        ret = spif_fast_read(dev, first->addr, first->buf, first->size);
+        _spif_queue_complete(queue, first, ret);
+        return;
+    }
+
+    base = first->addr;
+    ret = spif_fast_read(dev, base, queue->buf, end - base);
+
+    while (first != NULL) {
+        req = first;
+        first = req->next;
+        req->next = NULL;
+
+        if (ret == SPIF_SUCCESS) {
+            memcpy(req->buf, queue->buf + (req->addr - base), req->size);
+        }
+
+        _spif_queue_complete(queue, req, ret);
+    }
+}
+
+static int _spif_queue_step_start(spif_queue_t *queue, spif_req_t *req)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = queue->config.dev;
+    uint32_t addr = req->addr + req->done;
+    uint32_t left = req->size - req->done;
+    uint32_t size = 0;
+
+    if (req->op == SPIF_REQ_WRITE) {
+        size = dev->flash.page_size - (addr % dev->flash.page_size);
+        if (size > left) {
+            size = left;
+        }
+
+        ret = spif_page_program_async(dev, addr, req->buf + req->done, size, &queue->token, NULL, NULL);
+    } else {
+        /* largest erase that fits, the plan of spif_erase_range() minus the split of sub-blocks */
+        for (int i = SPIF_ERASE_TYPE_MAX - 1; i >= 0; i--) {
+            uint32_t erase_size = dev->flash.erase[i].size;
+            if ((erase_size != 0) && (erase_size <= left) && (addr % erase_size == 0)) {
+                size = erase_size;
+                break;
+            }
+        }
+
+        if (size == 0) {
+            return SPIF_FAIL;
+        }
+
+        ret = spif_erase_async(dev, addr, size, &queue->token, NULL, NULL);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    queue->active = req;
+    queue->step_addr = addr;
+    queue->step_size = size;
+    queue->step_suspends = 0;
+
+    return SPIF_SUCCESS;
+}
+
+static void _spif_queue_step_poll(spif_queue_t *queue)
+{
+    spif_req_t *req = queue->active;
+
+    if ((req == NULL) || queue->suspended) {
+        return;
+    }
+
+    if (spif_async_poll(queue->config.dev, &queue->token) != SPIF_ASYNC_DONE) {
+        return;
+    }
+
+    queue->active = NULL;
+
+    if (queue->token.result != SPIF_SUCCESS) {
+        _spif_queue_remove(queue, req);
+        _spif_queue_complete(queue, req, queue->token.result);
+        return;
+    }
+
+    /* the request stays at the head of its class until its last step, so higher classes get in between */
+    req->done += queue->step_size;
+    if (req->done == req->size) {
+        _spif_queue_remove(queue, req);
+        _spif_queue_complete(queue, req, SPIF_SUCCESS);
+    }
+}
+
+static void _spif_queue_resume(spif_queue_t *queue)
+{
+    if (spif_erase_resume(queue->config.dev) != SPIF_SUCCESS) {
+        return; /* tried again by the next poll */
+    }
+
+    queue->suspended = 0;
+    queue->resume_stamp = spif_now_us(queue->config.dev);
+}
+
+static int _spif_queue_suspend_allowed(spif_queue_t *queue)
+{
+    spif_queue_config_t *config = &queue->config;
+
+    if ((config->suspend_max != 0) && (queue->step_suspends >= config->suspend_max)) {
+        return 0;
+    }
+
+    /* the erase must get some time between two suspends, or reads could hold it forever */
+    if ((config->resume_min_us != 0) && (queue->step_suspends != 0) &&
+        (spif_now_us(queue->config.dev) - queue->resume_stamp < config->resume_min_us)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/* reads of a higher class than the erase in flight suspend it */
+static void _spif_queue_preempt(spif_queue_t *queue)
+{
+    spif_req_t *erase = queue->active;
+    spif_req_t *req = NULL;
+
+    if ((erase == NULL) || (erase->op != SPIF_REQ_ERASE) || queue->suspended ||
+        !queue->config.erase_suspend || (queue->config.dev->flash.suspend_cmd == 0)) {
+        return;
+    }
+
+    if (_spif_queue_read_next(queue, erase->prio, SPIF_QUEUE_ADDR_ANY) == NULL) {
+        return;
+    }
+
+    if (!_spif_queue_suspend_allowed(queue)) {
+        queue->stats.suspend_denied++;
+        return;
+    }
+
+    if (spif_erase_suspend(queue->config.dev) != SPIF_SUCCESS) {
+        return;
+    }
+
+    queue->suspended = 1;
+    queue->step_suspends++;
+    queue->stats.suspends++;
+
+    /* everything that arrived meanwhile is served in this one suspend */
+    while ((req = _spif_queue_read_next(queue, erase->prio, SPIF_QUEUE_ADDR_ANY)) != NULL) {
+        _spif_queue_read_serve(queue, req, erase->prio);
+    }
+
+    _spif_queue_resume(queue);
+}
+
+int spif_queue_init(spif_queue_t *queue, const spif_queue_config_t *config)
+{
+    if ((queue == NULL) || (config == NULL) || (config->dev == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    memset(queue, 0, sizeof(spif_queue_t));
+    queue->config = *config;
+
+    return SPIF_SUCCESS;
+}
+
+int spif_queue_submit(spif_queue_t *queue, spif_req_t *req)
+{
+    spif_flash_info_t *info = NULL;
+
+    if ((queue == NULL) || (req == NULL) || (req->op > SPIF_REQ_ERASE) || (req->prio >= SPIF_REQ_PRIO_MAX) ||
+        (req->size == 0)) {
+        return SPIF_FAIL;
+    }
+
+    info = &queue->config.dev->flash;
+
+    if (((uint64_t)req->addr + req->size > info->chip_size) || ((req->op != SPIF_REQ_ERASE) && (req->buf == NULL))) {
+        return SPIF_FAIL;
+    }
+
+    if ((req->op == SPIF_REQ_ERASE) && ((req->addr % info->erase[0].size != 0) || (req->size % info->erase[0].size != 0))) {
+        return SPIF_FAIL;
+    }
+
+    req->result = SPIF_SUCCESS;
+    req->done = 0;
+    req->next = NULL;
+
+    if (_spif_queue_lock(queue) != SPIF_SUCCESS) {
+        return SPIF_TIMEOUT;
+    }
+
+    req->state = SPIF_ASYNC_RUNNING;
+
+    if (queue->in_tail == NULL) {
+        queue->in_head = req;
+    } else {
+        queue->in_tail->next = req;
+    }
+    queue->in_tail = req;
+
+    queue->stats.submitted++;
+
+    _spif_queue_unlock(queue);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_queue_poll(spif_queue_t *queue)
+{
+    int ret = SPIF_SUCCESS;
+    int pending = 0;
+
+    spif_req_t *req = NULL;
+
+    _spif_queue_take(queue);
+
+    if (queue->suspended) {
+        _spif_queue_resume(queue);
+    }
+
+    _spif_queue_step_poll(queue);
+
+    _spif_queue_preempt(queue);
+
+    /* nothing in flight: serve the reads in front, start the next write/erase step */
+    while ((queue->active == NULL) && !queue->suspended) {
+        req = NULL;
+        for (uint8_t prio = 0; (prio < SPIF_REQ_PRIO_MAX) && (req == NULL); prio++) {
+            req = queue->head[prio];
+        }
+
+        if (req == NULL) {
+            break;
+        }
+
+        if (req->op == SPIF_REQ_READ) {
+            _spif_queue_read_serve(queue, req, SPIF_REQ_PRIO_MAX);
+            continue;
+        }
+
+        ret = _spif_queue_step_start(queue, req);
+        if (ret != SPIF_SUCCESS) {
+            _spif_queue_remove(queue, req);
+            _spif_queue_complete(queue, req, ret);
+            continue;
+        }
+
+        /* without an asynchronous port the step is already done */
+        _spif_queue_step_poll(queue);
+    }
+
+    /* what came in meanwhile is pending too */
+    _spif_queue_take(queue);
+
+    for (uint8_t prio = 0; prio < SPIF_REQ_PRIO_MAX; prio++) {
+        for (req = queue->head[prio]; req != NULL; req = req->next) {
+            pending++;
+        }
+    }
+
+    return pending;
+}
+
+int spif_queue_wait(spif_queue_t *queue, spif_req_t *req, uint32_t timeout_ms)
+{
+    uint32_t elapsed_us = 0;
+
+    if ((req == NULL) || (req->state == SPIF_ASYNC_IDLE)) {
+        return SPIF_FAIL;
+    }
+
+    while (1) {
+        (void)spif_queue_poll(queue);
+
+        if (req->state == SPIF_ASYNC_DONE) {
+            break;
+        }
+
+        /* only the delays are counted, like spif_async_wait() */
+        if ((elapsed_us / 1000) >= timeout_ms) {
+            return SPIF_TIMEOUT;
+        }
+
+        queue->config.dev->plat_ops.delay_us(10);
+        elapsed_us += 10;
+    }
+
+    return req->result;
+}
+
+int spif_queue_stats_get(spif_queue_t *queue, spif_queue_stats_t *stats)
+{
+    if ((queue == NULL) || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *stats = queue->stats;
+
+    return SPIF_SUCCESS;
+}
+
+void spif_queue_stats_reset(spif_queue_t *queue)
+{
+    memset(&queue->stats, 0, sizeof(spif_queue_stats_t));
+}
@@ -0,0 +1,227 @@
+/*
+ * spif_sfdp.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif.h"
+#include "spif_sfdp.h"
+
+#define SPIF_SFDP_SIGNATURE        0x50444653 /* "SFDP" */
+
+#define SPIF_SFDP_HEADER_SIZE      8
+#define SPIF_SFDP_PARAM_HEADER_SIZE 8
+
+#define SPIF_SFDP_BFPT_ID_LSB      0x00
+#define SPIF_SFDP_BFPT_ID_MSB      0xFF
+#define SPIF_SFDP_BFPT_DWORDS_MIN  9  /* JESD216 */
+#define SPIF_SFDP_BFPT_DWORDS_MAX  16 /* nothing used past DWORD 16 */
+
+/* DWORD n of the BFPT, counted from 1 like the standard does */
+#define SPIF_SFDP_DW(n)            (bfpt[(n) - 1])
+
+#define SPIF_SFDP_BITS(v, hi, lo)  (((v) >> (lo)) & ((1UL << ((hi) - (lo) + 1)) - 1))
+
+static uint32_t _spif_sfdp_le32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+/* DWORD 10, erase type i (0 based) typical time */
+static uint32_t _spif_sfdp_erase_typ_ms(uint32_t dw, int i)
+{
+    static const uint32_t unit_ms[] = {1, 16, 128, 1000};
+
+    uint32_t count = SPIF_SFDP_BITS(dw, 8 + 7 * i, 4 + 7 * i);
+    uint32_t unit = SPIF_SFDP_BITS(dw, 10 + 7 * i, 9 + 7 * i);
+
+    return (count + 1) * unit_ms[unit];
+}
+
+static void _spif_sfdp_erase_sort(spif_sfdp_erase_t *erase)
+{
+    spif_sfdp_erase_t tmp;
+    int n = 0;
+
+    /* drop unused types, then insertion sort by size */
+    for (int i = 0; i < SPIF_SFDP_ERASE_TYPE_MAX; i++) {
+        if (erase[i].size != 0) {
+            erase[n++] = erase[i];
+        }
+    }
+
+    for (int i = n; i < SPIF_SFDP_ERASE_TYPE_MAX; i++) {
+        memset(&erase[i], 0, sizeof(spif_sfdp_erase_t));
+    }
+
+    for (int i = 1; i < n; i++) {
+        tmp = erase[i];
+        int j = i - 1;
+        for (; (j >= 0) && (erase[j].size > tmp.size); j--) {
+            erase[j + 1] = erase[j];
+        }
+        erase[j + 1] = tmp;
+    }
+}
+
+static void _spif_sfdp_bfpt_parse(const uint32_t *bfpt, uint8_t dwords, spif_sfdp_info_t *info)
+{
+    static const uint32_t ce_unit_ms[] = {16, 256, 4000, 64000};
+    static const uint32_t sus_unit_ns[] = {128, 1000, 8000, 64000};
+
+    uint32_t dw = 0;
+    uint32_t mult = 0;
+
+    /* DWORD 1: address bytes, fast read modes */
+    dw = SPIF_SFDP_DW(1);
+    info->addr_bytes = SPIF_SFDP_BITS(dw, 18, 17);
+
+    if (dw & (1UL << 22)) {
+        info->quad_out_cmd = SPIF_SFDP_BITS(SPIF_SFDP_DW(3), 31, 24);
+        info->quad_out_dummy = SPIF_SFDP_BITS(SPIF_SFDP_DW(3), 20, 16);
+        info->quad_out_mode = SPIF_SFDP_BITS(SPIF_SFDP_DW(3), 23, 21);
+    }
+
+    if (dw & (1UL << 21)) {
+        info->quad_io_cmd = SPIF_SFDP_BITS(SPIF_SFDP_DW(3), 15, 8);
+        info->quad_io_dummy = SPIF_SFDP_BITS(SPIF_SFDP_DW(3), 4, 0);
+        info->quad_io_mode = SPIF_SFDP_BITS(SPIF_SFDP_DW(3), 7, 5);
+    }
+
+    info->dtr = (dw & (1UL << 19)) ? 1 : 0;
+
+    /* DWORD 5, 7: 4-4-4 fast read */
+    if (SPIF_SFDP_DW(5) & (1UL << 4)) {
+        info->qpi_cmd = SPIF_SFDP_BITS(SPIF_SFDP_DW(7), 31, 24);
+        info->qpi_dummy = SPIF_SFDP_BITS(SPIF_SFDP_DW(7), 20, 16);
+        info->qpi_mode = SPIF_SFDP_BITS(SPIF_SFDP_DW(7), 23, 21);
+    }
+
+    /* DWORD 2: density in bits, 2^N from N >= 64 is a corrupt table, chip_size 0 rejects it */
+    dw = SPIF_SFDP_DW(2);
+    if (dw & (1UL << 31)) {
+        if ((dw & 0x7FFFFFFF) < 64) {
+            info->chip_size = (1ULL << (dw & 0x7FFFFFFF)) / 8;
+        }
+    } else {
+        info->chip_size = ((uint64_t)dw + 1) / 8;
+    }
+
+    /* DWORD 8 - 9: erase types */
+    for (int i = 0; i < SPIF_SFDP_ERASE_TYPE_MAX; i++) {
+        dw = SPIF_SFDP_DW(8 + i / 2) >> (16 * (i % 2));
+        /* size 2^N, N >= 32 does not fit and is skipped like an unused type */
+        if (((dw & 0xFF) != 0) && ((dw & 0xFF) < 32)) {
+            info->erase[i].size = 1UL << (dw & 0xFF);
+            info->erase[i].cmd = (dw >> 8) & 0xFF;
+        }
+    }
+
+    /* page size and timing came with JESD216A */
+    info->page_size = 256;
+    info->qer = SPIF_SFDP_QER_UNKNOWN;
+
+    if (dwords >= 11) {
+        /* DWORD 10: erase times */
+        dw = SPIF_SFDP_DW(10);
+        mult = 2 * (SPIF_SFDP_BITS(dw, 3, 0) + 1);
+        for (int i = 0; i < SPIF_SFDP_ERASE_TYPE_MAX; i++) {
+            if (info->erase[i].size != 0) {
+                info->erase[i].typ_ms = _spif_sfdp_erase_typ_ms(dw, i);
+                info->erase[i].max_ms = info->erase[i].typ_ms * mult;
+            }
+        }
+
+        /* DWORD 11: page size, page program and chip erase times */
+        dw = SPIF_SFDP_DW(11);
+        info->page_size = 1UL << SPIF_SFDP_BITS(dw, 7, 4);
+        info->pp_typ_us = (SPIF_SFDP_BITS(dw, 12, 8) + 1) * ((dw & (1UL << 13)) ? 64 : 8);
+        info->pp_max_us = info->pp_typ_us * 2 * (SPIF_SFDP_BITS(dw, 3, 0) + 1);
+        info->ce_typ_ms = (SPIF_SFDP_BITS(dw, 28, 24) + 1) * ce_unit_ms[SPIF_SFDP_BITS(dw, 30, 29)];
+        info->ce_max_ms = info->ce_typ_ms * mult;
+    }
+
+    /* DWORD 12 - 13: suspend/resume, bit 31 set means not supported */
+    if ((dwords >= 13) && !(SPIF_SFDP_DW(12) & (1UL << 31))) {
+        dw = SPIF_SFDP_DW(12);
+        info->suspend_max_us = ((SPIF_SFDP_BITS(dw, 28, 24) + 1) * sus_unit_ns[SPIF_SFDP_BITS(dw, 30, 29)] + 999) / 1000;
+        info->suspend_cmd = SPIF_SFDP_BITS(SPIF_SFDP_DW(13), 31, 24);
+        info->resume_cmd = SPIF_SFDP_BITS(SPIF_SFDP_DW(13), 23, 16);
+    }
+
+    if (dwords >= 15) {
+        dw = SPIF_SFDP_DW(15);
+        info->qer = SPIF_SFDP_BITS(dw, 22, 20);
+
+        /* 4-4-4 enable bits 8:4, disable bits 3:0, only the single-opcode sequences */
+        if (dw & (3UL << 4)) {
+            info->qpi_enter_cmd = 0x38; /* bit 4: QE set first, bit 5: QE not needed */
+        } else if (dw & (1UL << 6)) {
+            info->qpi_enter_cmd = 0x35;
+        }
+
+        if (dw & (1UL << 0)) {
+            info->qpi_exit_cmd = 0xFF;
+        } else if (dw & (1UL << 1)) {
+            info->qpi_exit_cmd = 0xF5;
+        }
+    }
+
+    _spif_sfdp_erase_sort(info->erase);
+}
+
+int spif_sfdp_parse(spif_sfdp_read_t read, void *arg, spif_sfdp_info_t *info)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint8_t buf[SPIF_SFDP_BFPT_DWORDS_MAX * 4] = {0};
+    uint32_t bfpt[SPIF_SFDP_BFPT_DWORDS_MAX] = {0};
+    uint32_t ptr = 0;
+    uint8_t dwords = 0;
+
+    if ((read == NULL) || (info == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    memset(info, 0, sizeof(spif_sfdp_info_t));
+
+    /* SFDP header and the first parameter header, which is always the BFPT */
+    ret = read(0, buf, SPIF_SFDP_HEADER_SIZE + SPIF_SFDP_PARAM_HEADER_SIZE, arg);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    if (_spif_sfdp_le32(buf) != SPIF_SFDP_SIGNATURE) {
+        return SPIF_FAIL;
+    }
+
+    info->minor = buf[4];
+    info->major = buf[5];
+
+    if ((buf[8] != SPIF_SFDP_BFPT_ID_LSB) || (buf[15] != SPIF_SFDP_BFPT_ID_MSB) ||
+        (buf[11] < SPIF_SFDP_BFPT_DWORDS_MIN)) {
+        return SPIF_FAIL;
+    }
+
+    dwords = (buf[11] > SPIF_SFDP_BFPT_DWORDS_MAX) ? SPIF_SFDP_BFPT_DWORDS_MAX : buf[11];
+    ptr = _spif_sfdp_le32(&buf[12]) & 0xFFFFFF;
+
+    ret = read(ptr, buf, dwords * 4, arg);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    for (uint8_t i = 0; i < dwords; i++) {
+        bfpt[i] = _spif_sfdp_le32(&buf[i * 4]);
+    }
+
+    info->dwords = dwords;
+    _spif_sfdp_bfpt_parse(bfpt, dwords, info);
+
+    if ((info->chip_size == 0) || (info->erase[0].size == 0)) {
+        return SPIF_FAIL;
+    }
+
+    return ret;
+}
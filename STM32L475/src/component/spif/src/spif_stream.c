@@ -0,0 +1,255 @@
+/*
+ * spif_stream.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif.h"
+#include "spif_stream.h"
+
+static uint8_t *_spif_stream_buf(spif_stream_t *stream, uint8_t index)
+{
+    return &stream->config.buf[index * stream->config.chunk_size];
+}
+
+/* start reading the chunk after the current one into the other buffer */
+static void _spif_stream_ahead(spif_stream_t *stream)
+{
+    uint32_t size = stream->config.size - stream->next;
+
+    if (size > stream->config.chunk_size) {
+        size = stream->config.chunk_size;
+    }
+
+    stream->ahead_size = 0;
+
+    if (size == 0) {
+        return;
+    }
+
+    /* refused (another asynchronous operation in flight): read when the chunk is needed */
+    if (spif_read_async(stream->config.dev, stream->config.addr + stream->next, _spif_stream_buf(stream, !stream->cur), size,
+                        &stream->token, NULL, NULL) == SPIF_SUCCESS) {
+        stream->ahead_size = size;
+        stream->stats.chunks++;
+    }
+}
+
+/* make the read-ahead the current chunk and start the next one, the current chunk must be used up */
+static int _spif_stream_advance(spif_stream_t *stream)
+{
+    int ret = SPIF_SUCCESS;
+
+    spif_dev_t *dev = stream->config.dev;
+    uint32_t size = stream->ahead_size;
+    uint64_t start = 0;
+    uint32_t stall = 0;
+
+    if (size == 0) {
+        size = stream->config.size - stream->next;
+        if (size > stream->config.chunk_size) {
+            size = stream->config.chunk_size;
+        }
+
+        ret = spif_fast_read(dev, stream->config.addr + stream->next, _spif_stream_buf(stream, !stream->cur), size);
+        stream->stats.sync_reads++;
+        stream->stats.chunks++;
+    } else {
+        if (stream->primed && (stream->token.state != SPIF_ASYNC_DONE)) {
+            start = spif_now_us(dev);
+            ret = spif_async_wait(dev, &stream->token);
+            stall = (uint32_t)(spif_now_us(dev) - start);
+
+            stream->stats.stalls++;
+            stream->stats.stall_us += stall;
+            if (stall > stream->stats.stall_us_max) {
+                stream->stats.stall_us_max = stall;
+            }
+        } else {
+            ret = spif_async_wait(dev, &stream->token);
+        }
+
+        stream->ahead_size = 0;
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    stream->cur = !stream->cur;
+    stream->cur_size = size;
+    stream->cur_offset = 0;
+    stream->next += size;
+    stream->primed = 1;
+
+    _spif_stream_ahead(stream);
+
+    return SPIF_SUCCESS;
+}
+
+/* finish the read-ahead in flight, its data is not used */
+static int _spif_stream_drop(spif_stream_t *stream)
+{
+    int ret = SPIF_SUCCESS;
+
+    if (stream->ahead_size > 0) {
+        ret = spif_async_wait(stream->config.dev, &stream->token);
+        stream->ahead_size = 0;
+    }
+
+    return ret;
+}
+
+int spif_stream_open(spif_stream_t *stream, const spif_stream_config_t *config)
+{
+    if ((stream == NULL) || (config == NULL) || (config->dev == NULL) || (config->buf == NULL) || (config->chunk_size == 0)) {
+        return SPIF_FAIL;
+    }
+
+    if ((uint64_t)config->addr + config->size > config->dev->flash.chip_size) {
+        return SPIF_FAIL;
+    }
+
+    memset(stream, 0, sizeof(spif_stream_t));
+    stream->config = *config;
+
+    _spif_stream_ahead(stream);
+
+    return SPIF_SUCCESS;
+}
+
+int spif_stream_get(spif_stream_t *stream, const uint8_t **data, uint32_t *size)
+{
+    int ret = SPIF_SUCCESS;
+
+    if ((stream == NULL) || (data == NULL) || (size == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *size = 0;
+
+    if (stream->cur_offset == stream->cur_size) {
+        if (stream->next >= stream->config.size) {
+            return SPIF_SUCCESS;
+        }
+
+        ret = _spif_stream_advance(stream);
+        if (ret != SPIF_SUCCESS) {
+            return ret;
+        }
+    }
+
+    *data = _spif_stream_buf(stream, stream->cur) + stream->cur_offset;
+    *size = stream->cur_size - stream->cur_offset;
+    stream->cur_offset = stream->cur_size;
+
+    return SPIF_SUCCESS;
+}
+
+int spif_stream_read(spif_stream_t *stream, uint8_t *data, uint32_t size, uint32_t *read_size)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t done = 0;
+    uint32_t n = 0;
+
+    if ((stream == NULL) || ((data == NULL) && (size > 0)) || (read_size == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    while (done < size) {
+        if (stream->cur_offset == stream->cur_size) {
+            if (stream->next >= stream->config.size) {
+                break;
+            }
+
+            ret = _spif_stream_advance(stream);
+            if (ret != SPIF_SUCCESS) {
+                break;
+            }
+        }
+
+        n = stream->cur_size - stream->cur_offset;
+        if (n > size - done) {
+            n = size - done;
+        }
+
+        memcpy(&data[done], _spif_stream_buf(stream, stream->cur) + stream->cur_offset, n);
+        stream->cur_offset += n;
+        done += n;
+    }
+
+    *read_size = done;
+
+    return ret;
+}
+
+int spif_stream_seek(spif_stream_t *stream, uint32_t offset)
+{
+    int ret = SPIF_SUCCESS;
+
+    uint32_t start = 0;
+
+    if ((stream == NULL) || (offset > stream->config.size)) {
+        return SPIF_FAIL;
+    }
+
+    start = stream->next - stream->cur_size;
+
+    if ((offset >= start) && (offset <= stream->next)) {
+        stream->cur_offset = offset - start;
+        return SPIF_SUCCESS;
+    }
+
+    /* a skip forward into the read-ahead keeps it */
+    if ((stream->ahead_size > 0) && (offset > stream->next) && (offset < stream->next + stream->ahead_size)) {
+        stream->cur_offset = stream->cur_size;
+        ret = _spif_stream_advance(stream);
+        if (ret == SPIF_SUCCESS) {
+            stream->cur_offset = offset - (stream->next - stream->cur_size);
+        }
+        return ret;
+    }
+
+    ret = _spif_stream_drop(stream);
+
+    stream->cur_size = 0;
+    stream->cur_offset = 0;
+    stream->next = offset;
+    stream->primed = 0;
+
+    _spif_stream_ahead(stream);
+
+    return ret;
+}
+
+uint32_t spif_stream_tell(spif_stream_t *stream)
+{
+    return stream->next - stream->cur_size + stream->cur_offset;
+}
+
+int spif_stream_close(spif_stream_t *stream)
+{
+    if (stream == NULL) {
+        return SPIF_FAIL;
+    }
+
+    return _spif_stream_drop(stream);
+}
+
+int spif_stream_stats_get(spif_stream_t *stream, spif_stream_stats_t *stats)
+{
+    if ((stream == NULL) || (stats == NULL)) {
+        return SPIF_FAIL;
+    }
+
+    *stats = stream->stats;
+
+    return SPIF_SUCCESS;
+}
+
+void spif_stream_stats_reset(spif_stream_t *stream)
+{
+    memset(&stream->stats, 0, sizeof(spif_stream_stats_t));
+}
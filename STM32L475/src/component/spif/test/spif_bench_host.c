@@ -0,0 +1,114 @@
+/*
+ * spif_bench_host.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+#include "spif_bench.h"
+
+/**
+ * the spif_bench suites on the simulator, the CSV goes to stdout:
+ * spif_bench_host [spi|qspi|dual]...   (no argument: all three)
+ * the times are of the simulated bus and flash, not of the host
+ */
+
+#define BENCH_LOG_SIZE  (64 * 1024)
+
+static spif_test_dev_t s_test;
+static uint8_t s_log[BENCH_LOG_SIZE];
+
+/* a log capture to replay for spif_bench_lz() */
+static uint32_t _bench_log_gen(void)
+{
+    static const char *level[] = {"I", "D", "W", "E"};
+    static const char *msg[] = {"sensor sample ok", "battery level", "link up", "retry send", "flash write done"};
+    uint32_t size = 0;
+    char line[96];
+    int n = 0;
+
+    for (uint32_t i = 0; ; i++) {
+        n = sprintf(line, "[%08u][%s] %s: %u\n", i * 37, level[spif_test_rand() % 4],
+                    msg[spif_test_rand() % 5], spif_test_rand() % 1000);
+        if (size + n > BENCH_LOG_SIZE) {
+            return size;
+        }
+        memcpy(&s_log[size], line, n);
+        size += n;
+    }
+}
+
+static int _bench_mode(spif_test_mode_t mode)
+{
+    spif_bench_config_t config = {0x100000, 0x400000, 64, 7};
+    spif_bench_config_t small = {0x100000, 0x10000, 16, 5};
+    uint32_t size = 0;
+    int ret = SPIF_SUCCESS;
+
+    ret = spif_test_open(&s_test, 0, mode, NULL);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    printf("# mode %s\r\n", spif_test_mode_name[mode]);
+
+    ret = spif_bench_run(&s_test.dev, &small);
+
+    for (uint32_t work_us = 0; (ret == SPIF_SUCCESS) && (work_us <= 40); work_us += 20) {
+        ret = spif_bench_stream(&s_test.dev, &small, 256, work_us);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        spif_test_srand(1);
+        size = _bench_log_gen();
+        ret = spif_bench_lz(&s_test.dev, &config, s_log, size);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = spif_bench_atomic(&s_test.dev, &small);
+    }
+
+    if (ret == SPIF_SUCCESS) {
+        ret = spif_bench_fs(&s_test.dev, &config, 256 * 1024);
+    }
+
+    spif_test_stats_print(&s_test);
+    spif_test_close(&s_test);
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    int mode = 0;
+    int ret = SPIF_SUCCESS;
+
+    if (argc < 2) {
+        for (mode = SPIF_TEST_SPI; (ret == SPIF_SUCCESS) && (mode < SPIF_TEST_MODE_MAX); mode++) {
+            ret = _bench_mode((spif_test_mode_t)mode);
+        }
+    }
+
+    for (int i = 1; (ret == SPIF_SUCCESS) && (i < argc); i++) {
+        for (mode = SPIF_TEST_SPI; mode < SPIF_TEST_MODE_MAX; mode++) {
+            if (strcmp(argv[i], spif_test_mode_name[mode]) == 0) {
+                break;
+            }
+        }
+
+        if (mode == SPIF_TEST_MODE_MAX) {
+            printf("usage: %s [spi|qspi|dual]...\r\n", argv[0]);
+            return 2;
+        }
+
+        ret = _bench_mode((spif_test_mode_t)mode);
+    }
+
+    if (ret != SPIF_SUCCESS) {
+        printf("spif_bench_host failed: %d\r\n", ret);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * spif_test.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+
+const char *spif_test_mode_name[SPIF_TEST_MODE_MAX] = {"spi", "qspi", "dual"};
+
+static uint32_t s_test_seed = 1;
+
+static int _spif_test_init(spif_test_dev_t *t)
+{
+    if (t->mode == SPIF_TEST_SPI) {
+        spif_port_sim_spi_get(t->id, &t->spi_ops);
+    } else {
+        spif_port_sim_qspi_get(t->id, &t->spi_ops);
+    }
+
+    spif_port_sim_plat_get(t->id, &t->plat_ops);
+
+    return spif_init(&t->dev, &t->spi_ops, &t->plat_ops);
+}
+
+int spif_test_open(spif_test_dev_t *t, uint8_t id, spif_test_mode_t mode, const spif_port_sim_config_t *config)
+{
+    int ret = SPIF_SUCCESS;
+    spif_port_sim_config_t sim_config;
+
+    if ((t == NULL) || (mode >= SPIF_TEST_MODE_MAX)) {
+        return SPIF_FAIL;
+    }
+
+    if (config != NULL) {
+        sim_config = *config;
+    } else {
+        spif_port_sim_config_default(&sim_config);
+        sim_config.dual = (mode == SPIF_TEST_DUAL) ? 1 : 0;
+    }
+
+    memset(t, 0, sizeof(spif_test_dev_t));
+    t->id = id;
+    t->mode = mode;
+
+    ret = spif_port_sim_open(id, &sim_config);
+    if (ret != SPIF_SUCCESS) {
+        return ret;
+    }
+
+    ret = _spif_test_init(t);
+    if (ret != SPIF_SUCCESS) {
+        spif_port_sim_close(id);
+    }
+
+    return ret;
+}
+
+void spif_test_close(spif_test_dev_t *t)
+{
+    spif_port_sim_close(t->id);
+}
+
+int spif_test_power_cut(spif_test_dev_t *t, uint32_t commands)
+{
+    return spif_port_sim_power_cut(t->id, commands);
+}
+
+int spif_test_power_restore(spif_test_dev_t *t)
+{
+    spif_port_sim_stats_t stats;
+
+    spif_port_sim_stats_get(t->id, &stats);
+    spif_port_sim_power_cut(t->id, 0);
+
+    if (stats.power_cuts == 0) {
+        return 0;
+    }
+
+    spif_port_sim_stats_reset(t->id);
+    spif_port_sim_power_on(t->id);
+
+    return (_spif_test_init(t) == SPIF_SUCCESS) ? 1 : SPIF_FAIL;
+}
+
+double spif_test_time_us(spif_test_dev_t *t)
+{
+    return spif_port_sim_time_ns(t->id) / 1000.0;
+}
+
+void spif_test_stats_print(spif_test_dev_t *t)
+{
+    spif_port_sim_stats_t stats;
+
+    spif_port_sim_stats_get(t->id, &stats);
+
+    printf("sim%u %s: commands %u, reads %u (%llu B), programs %u (%llu B), erases 4K/32K/64K %u/%u/%u, "
+           "polls %u, suspends %u, overwrites %u, violations %u\r\n",
+           t->id, spif_test_mode_name[t->mode], stats.commands,
+           stats.reads, (unsigned long long)stats.read_bytes, stats.programs, (unsigned long long)stats.program_bytes,
+           stats.erases_4k, stats.erases_32k, stats.erases_64k,
+           stats.status_polls, stats.suspends, stats.overwrites, stats.violations);
+}
+
+void spif_test_srand(uint32_t seed)
+{
+    s_test_seed = (seed != 0) ? seed : 1;
+}
+
+/* xorshift32 */
+uint32_t spif_test_rand(void)
+{
+    s_test_seed ^= s_test_seed << 13;
+    s_test_seed ^= s_test_seed >> 17;
+    s_test_seed ^= s_test_seed << 5;
+
+    return s_test_seed;
+}
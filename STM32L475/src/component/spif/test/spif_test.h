@@ -0,0 +1,77 @@
+/*
+ * spif_test.h
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#ifndef __SPIF_TEST_H__
+#define __SPIF_TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "spif.h"
+#include "spif_port_sim.h"
+
+/**
+ * host tests on the simulated flash (spif_port_sim), built by test/CMakeLists.txt;
+ * a failed check prints where and exits with 1, ctest reports the test as failed
+ */
+#define SPIF_TEST_CHECK(cond)                                                        \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            printf("%s:%d: check failed: %s\r\n", __FILE__, __LINE__, #cond);        \
+            exit(1);                                                                 \
+        }                                                                            \
+    } while (0)
+
+/* how spif talks to the simulated device */
+typedef enum {
+    SPIF_TEST_SPI = 0, /* SPI ops mode, 1-1-1 only */
+    SPIF_TEST_QSPI,    /* QSPI ops mode */
+    SPIF_TEST_DUAL,    /* QSPI ops mode, two chips in dual-flash mode */
+    SPIF_TEST_MODE_MAX,
+} spif_test_mode_t;
+
+typedef struct {
+    uint8_t id;                  /* simulated device, 0 ~ SPIF_PORT_SIM_DEVICES - 1 */
+    spif_test_mode_t mode;
+    spif_port_spi_ops_t spi_ops;
+    spif_port_plat_ops_t plat_ops;
+    spif_dev_t dev;
+} spif_test_dev_t;
+
+extern const char *spif_test_mode_name[SPIF_TEST_MODE_MAX];
+
+/**
+ * @brief open the simulated device and spif_init() it
+ * @param config NULL: spif_port_sim_config_default(), dual set by the mode
+ * @return see SPIF status code
+ */
+int spif_test_open(spif_test_dev_t *t, uint8_t id, spif_test_mode_t mode, const spif_port_sim_config_t *config);
+
+void spif_test_close(spif_test_dev_t *t);
+
+/**
+ * @brief cut the power during the commands-th command from now, see spif_port_sim_power_cut()
+ * @return see SPIF status code
+ */
+int spif_test_power_cut(spif_test_dev_t *t, uint32_t commands);
+
+/**
+ * @brief whether the armed cut happened, then disarm it, power on and spif_init() again if it did
+ * @return 1: the power was cut, 0: the operation ran to the end, SPIF_FAIL: spif_init() failed
+ */
+int spif_test_power_restore(spif_test_dev_t *t);
+
+/* virtual time of the device, unit: us */
+double spif_test_time_us(spif_test_dev_t *t);
+
+/* simulator counters since open or the last reset */
+void spif_test_stats_print(spif_test_dev_t *t);
+
+/* deterministic pseudo random numbers, the same on every host */
+void spif_test_srand(uint32_t seed);
+uint32_t spif_test_rand(void);
+
+#endif /* __SPIF_TEST_H__ */
@@ -0,0 +1,152 @@
+/*
+ * test_atomic.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+#include "spif_atomic.h"
+#include "spif_bench.h"
+
+#define TEST_ROUNDS     12
+#define TEST_DATA_MAX   8192
+
+static spif_test_dev_t s_test;
+static spif_atomic_t s_atomic;
+static spif_atomic_config_t s_config;
+
+static uint8_t s_old[TEST_DATA_MAX];
+static uint8_t s_new[TEST_DATA_MAX];
+static uint8_t s_buf[TEST_DATA_MAX];
+
+/* the update of this round: the whole slot, a short range, a long range; round 5 writes 0xFF */
+static void _test_change(uint32_t round, uint32_t size, uint32_t *offset, uint32_t *len)
+{
+    *offset = 0;
+    *len = size;
+
+    if (round % 3 != 0) {
+        *offset = spif_test_rand() % size;
+        *len = 1 + spif_test_rand() % (size - *offset);
+        if ((round % 3 == 1) && (*len > 300)) {
+            *len = 300;
+        }
+    }
+
+    memcpy(s_new, s_old, size);
+    for (uint32_t i = 0; i < *len; i++) {
+        s_new[*offset + i] = (uint8_t)spif_test_rand();
+    }
+
+    if (round == 5) {
+        memset(s_new + *offset, 0xFF, *len);
+    }
+}
+
+/**
+ * every update is cut at its 1st, 2nd, ... command until one runs to the end; after each cut
+ * the reopened slot holds exactly the old or the new data and takes the next update
+ */
+static void test_atomic_power_cut(spif_test_mode_t mode, uint8_t verify)
+{
+    spif_atomic_t check;
+    spif_atomic_stats_t stats;
+    uint32_t size = 0;
+    uint32_t offset = 0;
+    uint32_t len = 0;
+    uint32_t cuts = 0;
+    uint32_t olds = 0;
+    int is_old = 0;
+    int is_new = 0;
+    int cut = 0;
+    int ret = SPIF_SUCCESS;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, mode, NULL) == SPIF_SUCCESS);
+
+    s_config.dev = &s_test.dev;
+    s_config.addr = 3 * s_test.dev.flash.sector_size;
+    s_config.verify = verify;
+    SPIF_TEST_CHECK(spif_atomic_open(&s_atomic, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(s_atomic.valid == 0);
+
+    size = spif_atomic_size(&s_atomic);
+    SPIF_TEST_CHECK((size > 300) && (size <= TEST_DATA_MAX));
+    spif_test_srand(mode * 10 + verify + 1);
+
+    for (uint32_t round = 0; round < TEST_ROUNDS; round++) {
+        SPIF_TEST_CHECK(spif_atomic_read(&s_atomic, 0, s_old, size) == SPIF_SUCCESS);
+        _test_change(round, size, &offset, &len);
+
+        for (uint32_t n = 1;; n++) {
+            SPIF_TEST_CHECK(spif_test_power_cut(&s_test, n) == SPIF_SUCCESS);
+            ret = spif_atomic_update(&s_atomic, offset, s_new + offset, len);
+
+            cut = spif_test_power_restore(&s_test);
+            SPIF_TEST_CHECK(cut != SPIF_FAIL);
+            if (cut == 0) {
+                SPIF_TEST_CHECK(ret == SPIF_SUCCESS);
+                break;
+            }
+
+            SPIF_TEST_CHECK(spif_atomic_open(&s_atomic, &s_config) == SPIF_SUCCESS);
+            SPIF_TEST_CHECK(spif_atomic_read(&s_atomic, 0, s_buf, size) == SPIF_SUCCESS);
+            is_old = (memcmp(s_buf, s_old, size) == 0);
+            is_new = (memcmp(s_buf, s_new, size) == 0);
+            SPIF_TEST_CHECK(is_old || is_new);
+
+            olds += is_old;
+            cuts++;
+
+            /* the update went through before the cut, the next try rewrites the same data */
+            if (is_new) {
+                memcpy(s_old, s_new, size);
+            }
+        }
+
+        SPIF_TEST_CHECK(spif_atomic_read(&s_atomic, 0, s_buf, size) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(memcmp(s_buf, s_new, size) == 0);
+
+        /* recovery picks the copy just committed */
+        SPIF_TEST_CHECK(spif_atomic_open(&check, &s_config) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK((check.seq == s_atomic.seq) && (check.cur == s_atomic.cur));
+    }
+
+    SPIF_TEST_CHECK(spif_atomic_stats_get(&s_atomic, &stats) == SPIF_SUCCESS);
+    printf("%-4s verify %u: %u cuts, old %u new %u, updates %u, programs %u, copied %u\r\n",
+           spif_test_mode_name[mode], verify, cuts, olds, cuts - olds, stats.updates, stats.programs, stats.copied);
+
+    SPIF_TEST_CHECK(cuts > TEST_ROUNDS);
+    SPIF_TEST_CHECK(olds > 0);
+    SPIF_TEST_CHECK(olds < cuts);
+
+    spif_test_close(&s_test);
+}
+
+/* the update cost over a raw erase and rewrite of the sector */
+static void test_atomic_bench(void)
+{
+    spif_bench_config_t config = {0, 64 * 1024, 16, 5};
+    spif_port_sim_stats_t stats;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, SPIF_TEST_QSPI, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_bench_atomic(&s_test.dev, &config) == SPIF_SUCCESS);
+
+    spif_port_sim_stats_get(s_test.id, &stats);
+    SPIF_TEST_CHECK(stats.violations == 0);
+    spif_test_close(&s_test);
+}
+
+int main(void)
+{
+    for (int mode = SPIF_TEST_SPI; mode < SPIF_TEST_MODE_MAX; mode++) {
+        test_atomic_power_cut((spif_test_mode_t)mode, 0);
+        test_atomic_power_cut((spif_test_mode_t)mode, 1);
+    }
+
+    test_atomic_bench();
+
+    printf("test_atomic ok\r\n");
+
+    return 0;
+}
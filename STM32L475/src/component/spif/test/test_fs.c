@@ -0,0 +1,389 @@
+/*
+ * test_fs.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+#include "spif_fs.h"
+
+#define TEST_FILES      4
+#define TEST_FILE_MAX   40000
+#define TEST_BIG        300000
+#define TEST_CUT_ROUNDS 1500
+
+enum {
+    TEST_OP_OVERWRITE = 0, /* a range at a random offset, may extend the file, committed by the close */
+    TEST_OP_APPEND,        /* up to 6 appends, each synced */
+    TEST_OP_TRUNC,         /* creates the file if needed */
+    TEST_OP_REMOVE,
+    TEST_OP_CHECKPOINT,
+};
+
+static spif_test_dev_t s_test;
+static spif_fs_bd_t s_bd;
+static spif_fs_t s_fs;
+static spif_fs_config_t s_config;
+
+/* what the files hold, and what the file of the op in flight may hold once it is done */
+static uint8_t s_model[TEST_FILES][TEST_FILE_MAX];
+static uint32_t s_size[TEST_FILES];
+static uint8_t s_exist[TEST_FILES];
+static uint8_t s_after[TEST_FILE_MAX];
+static uint32_t s_after_size[7];  /* sizes it may have after the op, an append can stop after any sync */
+static uint8_t s_after_sizes;
+static uint8_t s_after_exist;
+
+static uint8_t s_buf[TEST_BIG];
+static uint8_t s_big[TEST_BIG];
+
+static const char *_test_name(int i)
+{
+    static char name[32];
+
+    sprintf(name, "/d%d/file%d", i % 2, i);
+
+    return name;
+}
+
+/* @return 1 and the content in s_buf if file i exists */
+static int _test_load(int i, uint32_t *size)
+{
+    spif_fs_info_t info;
+    spif_fs_file_t file;
+    uint32_t done = 0;
+    uint32_t n = 0;
+
+    if (spif_fs_stat(&s_fs, _test_name(i), &info) != SPIF_SUCCESS) {
+        *size = 0;
+        return 0;
+    }
+
+    SPIF_TEST_CHECK(info.size <= TEST_FILE_MAX);
+    SPIF_TEST_CHECK(spif_fs_open(&s_fs, &file, _test_name(i), SPIF_FS_O_READ) == SPIF_SUCCESS);
+    while (done < info.size) {
+        SPIF_TEST_CHECK(spif_fs_read(&s_fs, &file, s_buf + done, 1 + spif_test_rand() % 5000, &n) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(n > 0);
+        done += n;
+    }
+    SPIF_TEST_CHECK(done == info.size);
+    SPIF_TEST_CHECK(spif_fs_close(&s_fs, &file) == SPIF_SUCCESS);
+
+    *size = info.size;
+
+    return 1;
+}
+
+static void _test_verify(void)
+{
+    uint32_t size = 0;
+
+    for (int i = 0; i < TEST_FILES; i++) {
+        SPIF_TEST_CHECK(_test_load(i, &size) == s_exist[i]);
+        SPIF_TEST_CHECK((size == s_size[i]) && (memcmp(s_buf, s_model[i], size) == 0));
+    }
+}
+
+/* every block is in the chain of one file or free, a file chain holds its size plus at most one block */
+static void _test_leak_check(void)
+{
+    uint32_t used = 0;
+    uint32_t need = 0;
+    uint32_t n = 0;
+
+    for (int i = 0; i < SPIF_FS_INODES_MAX; i++) {
+        if (s_fs.inode[i].type != SPIF_FS_TYPE_FILE) {
+            continue;
+        }
+
+        n = 0;
+        for (uint16_t block = s_fs.inode[i].first; block < s_bd.block_count; block = s_fs.fat[block]) {
+            n++;
+        }
+
+        need = (s_fs.inode[i].size + s_bd.block_size - 1) / s_bd.block_size;
+        SPIF_TEST_CHECK((n >= need) && (n <= need + 1));
+        used += n;
+    }
+
+    SPIF_TEST_CHECK(used + spif_fs_free_blocks(&s_fs) == s_bd.block_count - s_fs.data_start);
+}
+
+/* s_after is file i once the op is done, the fs calls stop at the first failure */
+static int _test_op(int op, int i)
+{
+    spif_fs_file_t file;
+    uint32_t pos = 0;
+    uint32_t len = 0;
+    uint32_t n = 0;
+    int ret = SPIF_SUCCESS;
+
+    memcpy(s_after, s_model[i], s_size[i]);
+    s_after_size[0] = s_size[i];
+    s_after_sizes = 1;
+    s_after_exist = s_exist[i];
+
+    switch (op) {
+    case TEST_OP_OVERWRITE:
+        pos = spif_test_rand() % (s_size[i] + 1);
+        len = 1 + spif_test_rand() % 9000;
+        len = (pos + len > TEST_FILE_MAX) ? TEST_FILE_MAX - pos : len;
+        for (uint32_t k = 0; k < len; k++) {
+            s_after[pos + k] = (uint8_t)spif_test_rand();
+        }
+        s_after_size[0] = (pos + len > s_size[i]) ? pos + len : s_size[i];
+
+        ret = spif_fs_open(&s_fs, &file, _test_name(i), SPIF_FS_O_READ | SPIF_FS_O_WRITE);
+        ret = (ret == SPIF_SUCCESS) ? spif_fs_seek(&s_fs, &file, pos) : ret;
+        for (uint32_t done = 0; (ret == SPIF_SUCCESS) && (done < len); done += n) {
+            n = 1 + spif_test_rand() % 1500;
+            n = (n > len - done) ? len - done : n;
+            ret = spif_fs_write(&s_fs, &file, s_after + pos + done, n);
+        }
+        return (ret == SPIF_SUCCESS) ? spif_fs_close(&s_fs, &file) : ret;
+
+    case TEST_OP_APPEND:
+        s_after_sizes = 0;
+        ret = spif_fs_open(&s_fs, &file, _test_name(i), SPIF_FS_O_WRITE | SPIF_FS_O_APPEND);
+        for (pos = s_size[i]; s_after_sizes < 6; pos += len) {
+            len = 1 + spif_test_rand() % 300;
+            if (pos + len > TEST_FILE_MAX) {
+                break;
+            }
+            for (uint32_t k = 0; k < len; k++) {
+                s_after[pos + k] = (uint8_t)spif_test_rand();
+            }
+            s_after_size[++s_after_sizes] = pos + len;
+
+            ret = (ret == SPIF_SUCCESS) ? spif_fs_write(&s_fs, &file, s_after + pos, len) : ret;
+            ret = (ret == SPIF_SUCCESS) ? spif_fs_sync(&s_fs, &file) : ret;
+        }
+        s_after_size[0] = s_after_size[s_after_sizes];
+        return (ret == SPIF_SUCCESS) ? spif_fs_close(&s_fs, &file) : ret;
+
+    case TEST_OP_TRUNC:
+        s_after_size[0] = 0;
+        s_after_exist = 1;
+        ret = spif_fs_open(&s_fs, &file, _test_name(i), SPIF_FS_O_WRITE | SPIF_FS_O_CREATE | SPIF_FS_O_TRUNC);
+        return (ret == SPIF_SUCCESS) ? spif_fs_close(&s_fs, &file) : ret;
+
+    case TEST_OP_REMOVE:
+        s_after_size[0] = 0;
+        s_after_exist = 0;
+        return spif_fs_remove(&s_fs, _test_name(i));
+
+    default:
+        return spif_fs_checkpoint(&s_fs);
+    }
+}
+
+/* after a cut file i holds what it held before the op or one of the states s_after allows */
+static void _test_settle(int i)
+{
+    uint32_t size = 0;
+    int exist = _test_load(i, &size);
+
+    if ((exist == s_exist[i]) && (size == s_size[i]) && (memcmp(s_buf, s_model[i], size) == 0)) {
+        return;
+    }
+
+    SPIF_TEST_CHECK(exist == s_after_exist);
+    for (int k = 0; k <= s_after_sizes; k++) {
+        if ((size == s_after_size[k]) && (memcmp(s_buf, s_after, size) == 0)) {
+            memcpy(s_model[i], s_after, size);
+            s_size[i] = size;
+            s_exist[i] = (uint8_t)exist;
+            return;
+        }
+    }
+
+    SPIF_TEST_CHECK(0);
+}
+
+/* directories, big files, seek, synced appends, a fast mount of the whole 16 MB, filling up */
+static void test_fs_basic(void)
+{
+    spif_fs_file_t file;
+    spif_fs_dir_t dir;
+    spif_fs_info_t info;
+    spif_fs_stats_t stats;
+    char line[32];
+    uint32_t free_blocks = 0;
+    uint32_t total = 0;
+    uint32_t n = 0;
+    double t0 = 0;
+    double mount_us = 0;
+    int entries = 0;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, SPIF_TEST_QSPI, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_bd_init(&s_bd, &s_test.dev, 0, s_test.dev.flash.chip_size) == SPIF_SUCCESS);
+    s_config.bd = &s_bd;
+    s_config.journal_blocks = 0;
+
+    SPIF_TEST_CHECK(spif_fs_mount(&s_fs, &s_config) != SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_format(&s_fs, &s_config) == SPIF_SUCCESS);
+
+    SPIF_TEST_CHECK(spif_fs_mkdir(&s_fs, "/cal") == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_mkdir(&s_fs, "/cal") != SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_mkdir(&s_fs, "/x/y") != SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_mkdir(&s_fs, "/logs") == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_mkdir(&s_fs, "/logs/old") == SPIF_SUCCESS);
+
+    for (uint32_t i = 0; i < TEST_BIG; i++) {
+        s_big[i] = (uint8_t)spif_test_rand();
+    }
+
+    SPIF_TEST_CHECK(spif_fs_open(&s_fs, &file, "/cal/a.bin", SPIF_FS_O_READ) != SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_open(&s_fs, &file, "/cal/a.bin", SPIF_FS_O_WRITE | SPIF_FS_O_CREATE) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_write(&s_fs, &file, s_big, TEST_BIG) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_size(&s_fs, &file) == TEST_BIG);
+    SPIF_TEST_CHECK(spif_fs_close(&s_fs, &file) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_stat(&s_fs, "cal/a.bin", &info) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK((info.size == TEST_BIG) && (info.type == SPIF_FS_TYPE_FILE));
+
+    /* overwrite in the middle, read across it, no seek past the end */
+    SPIF_TEST_CHECK(spif_fs_open(&s_fs, &file, "/cal/a.bin", SPIF_FS_O_READ | SPIF_FS_O_WRITE) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_read(&s_fs, &file, s_buf, TEST_BIG, &n) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK((n == TEST_BIG) && (memcmp(s_buf, s_big, TEST_BIG) == 0));
+    SPIF_TEST_CHECK(spif_fs_seek(&s_fs, &file, 5000) == SPIF_SUCCESS);
+    memset(s_big + 5000, 0x5A, 10000);
+    SPIF_TEST_CHECK(spif_fs_write(&s_fs, &file, s_big + 5000, 10000) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_seek(&s_fs, &file, 4000) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_read(&s_fs, &file, s_buf, 20000, &n) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK((n == 20000) && (memcmp(s_buf, s_big + 4000, 20000) == 0));
+    SPIF_TEST_CHECK(spif_fs_seek(&s_fs, &file, TEST_BIG + 1) != SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_close(&s_fs, &file) == SPIF_SUCCESS);
+
+    SPIF_TEST_CHECK(spif_fs_open(&s_fs, &file, "/logs/l.txt", SPIF_FS_O_WRITE | SPIF_FS_O_CREATE | SPIF_FS_O_APPEND) == SPIF_SUCCESS);
+    for (int i = 0; i < 200; i++) {
+        n = (uint32_t)sprintf(line, "line %d\n", i);
+        SPIF_TEST_CHECK(spif_fs_write(&s_fs, &file, line, n) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(spif_fs_sync(&s_fs, &file) == SPIF_SUCCESS);
+    }
+    SPIF_TEST_CHECK(spif_fs_close(&s_fs, &file) == SPIF_SUCCESS);
+
+    SPIF_TEST_CHECK(spif_fs_dir_open(&s_fs, &dir, "/") == SPIF_SUCCESS);
+    for (;;) {
+        SPIF_TEST_CHECK(spif_fs_dir_read(&s_fs, &dir, &info) == SPIF_SUCCESS);
+        if (info.type == SPIF_FS_TYPE_NONE) {
+            break;
+        }
+        SPIF_TEST_CHECK(info.type == SPIF_FS_TYPE_DIR);
+        entries++;
+    }
+    SPIF_TEST_CHECK(entries == 2);
+    SPIF_TEST_CHECK(spif_fs_remove(&s_fs, "/logs") != SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_stats_get(&s_fs, &stats) == SPIF_SUCCESS);
+
+    /* the mount reads a checkpoint and the journal, not the 16 MB */
+    t0 = spif_test_time_us(&s_test);
+    SPIF_TEST_CHECK(spif_fs_mount(&s_fs, &s_config) == SPIF_SUCCESS);
+    mount_us = spif_test_time_us(&s_test) - t0;
+
+    SPIF_TEST_CHECK(spif_fs_open(&s_fs, &file, "/cal/a.bin", SPIF_FS_O_READ) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_read(&s_fs, &file, s_buf, TEST_BIG, &n) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK((n == TEST_BIG) && (memcmp(s_buf, s_big, TEST_BIG) == 0));
+    SPIF_TEST_CHECK(spif_fs_close(&s_fs, &file) == SPIF_SUCCESS);
+
+    SPIF_TEST_CHECK(spif_fs_stat(&s_fs, "/logs/l.txt", &info) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_open(&s_fs, &file, "/logs/l.txt", SPIF_FS_O_READ) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_read(&s_fs, &file, s_buf, info.size, &n) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK((n == info.size) && (memcmp(s_buf, "line 0\nline 1\n", 14) == 0));
+    SPIF_TEST_CHECK(spif_fs_close(&s_fs, &file) == SPIF_SUCCESS);
+
+    free_blocks = spif_fs_free_blocks(&s_fs);
+    SPIF_TEST_CHECK(spif_fs_remove(&s_fs, "/cal/a.bin") == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_free_blocks(&s_fs) == free_blocks + (TEST_BIG + s_bd.block_size - 1) / s_bd.block_size);
+    SPIF_TEST_CHECK(spif_fs_checkpoint(&s_fs) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_mount(&s_fs, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_stat(&s_fs, "/cal/a.bin", &info) != SPIF_SUCCESS);
+
+    /* a full file system fails the write, not the mount */
+    SPIF_TEST_CHECK(spif_fs_open(&s_fs, &file, "/cal/fill", SPIF_FS_O_WRITE | SPIF_FS_O_CREATE) == SPIF_SUCCESS);
+    while (spif_fs_write(&s_fs, &file, s_big, 65536) == SPIF_SUCCESS) {
+        total += 65536;
+    }
+    SPIF_TEST_CHECK(total > s_test.dev.flash.chip_size / 2);
+    SPIF_TEST_CHECK(spif_fs_mount(&s_fs, &s_config) == SPIF_SUCCESS);
+
+    printf("basic: %u blocks, mount %.1f us, filled %u bytes, commits %u, checkpoints %u\r\n",
+           s_bd.block_count, mount_us, total, stats.commits, stats.checkpoints);
+    SPIF_TEST_CHECK(mount_us < 10000);
+
+    spif_test_close(&s_test);
+}
+
+/**
+ * random overwrites, synced appends, truncates, removes and checkpoints over 4 files in 2 directories,
+ * the power fails within the first 600 commands of an op; after the remount every file holds its old
+ * or its new content and no block leaks
+ */
+static void test_fs_power_cut(spif_test_mode_t mode)
+{
+    uint32_t cuts = 0;
+    int op = 0;
+    int i = 0;
+    int cut = 0;
+    int ret = SPIF_SUCCESS;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, mode, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_bd_init(&s_bd, &s_test.dev, 16 * s_test.dev.flash.sector_size, 72 * s_test.dev.flash.sector_size) == SPIF_SUCCESS);
+    s_config.bd = &s_bd;
+    s_config.journal_blocks = 1;
+
+    SPIF_TEST_CHECK(spif_fs_format(&s_fs, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_mkdir(&s_fs, "/d0") == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_fs_mkdir(&s_fs, "d1") == SPIF_SUCCESS);
+    memset(s_exist, 0, sizeof(s_exist));
+    memset(s_size, 0, sizeof(s_size));
+    spif_test_srand(mode + 11);
+
+    for (uint32_t round = 0; round < TEST_CUT_ROUNDS; round++) {
+        op = spif_test_rand() % 10;
+        op = (op < 4) ? TEST_OP_OVERWRITE : (op < 7) ? TEST_OP_APPEND : (op < 8) ? TEST_OP_TRUNC : (op < 9) ? TEST_OP_REMOVE : TEST_OP_CHECKPOINT;
+        i = spif_test_rand() % TEST_FILES;
+        if (!s_exist[i] && (op != TEST_OP_CHECKPOINT)) {
+            op = TEST_OP_TRUNC;
+        }
+
+        SPIF_TEST_CHECK(spif_test_power_cut(&s_test, 1 + spif_test_rand() % 600) == SPIF_SUCCESS);
+        ret = _test_op(op, i);
+
+        cut = spif_test_power_restore(&s_test);
+        SPIF_TEST_CHECK(cut != SPIF_FAIL);
+        if (cut == 0) {
+            SPIF_TEST_CHECK(ret == SPIF_SUCCESS);
+            memcpy(s_model[i], s_after, s_after_size[0]);
+            s_size[i] = s_after_size[0];
+            s_exist[i] = s_after_exist;
+        } else {
+            SPIF_TEST_CHECK(spif_fs_mount(&s_fs, &s_config) == SPIF_SUCCESS);
+            _test_settle(i);
+            cuts++;
+        }
+
+        _test_leak_check();
+        _test_verify();
+    }
+
+    printf("%-4s power cut: %u rounds, %u cut, free blocks %u\r\n",
+           spif_test_mode_name[mode], TEST_CUT_ROUNDS, cuts, spif_fs_free_blocks(&s_fs));
+    SPIF_TEST_CHECK(cuts > TEST_CUT_ROUNDS / 4);
+
+    spif_test_close(&s_test);
+}
+
+int main(void)
+{
+    spif_test_srand(5);
+    test_fs_basic();
+
+    for (int mode = SPIF_TEST_SPI; mode < SPIF_TEST_MODE_MAX; mode++) {
+        test_fs_power_cut((spif_test_mode_t)mode);
+    }
+
+    printf("test_fs ok\r\n");
+
+    return 0;
+}
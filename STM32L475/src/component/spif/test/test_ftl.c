@@ -0,0 +1,160 @@
+/*
+ * test_ftl.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+#include "spif_ftl.h"
+
+#define TEST_BASE       0x100000
+#define TEST_SIZE       (1024 * 1024)
+#define TEST_SECTOR     4096
+#define TEST_LSN_MAX    256
+
+#define TEST_WRITES     30000
+#define TEST_CUT_ROUNDS 400
+
+static spif_test_dev_t s_test;
+static spif_ftl_t s_ftl;
+static spif_ftl_config_t s_config;
+static uint32_t s_logical;
+
+static uint8_t s_ref[TEST_LSN_MAX][TEST_SECTOR];
+static uint8_t s_prev[TEST_SECTOR];
+static uint8_t s_buf[TEST_SECTOR];
+
+static void _test_fill(uint8_t *buf, uint32_t value)
+{
+    for (uint32_t i = 0; i < TEST_SECTOR; i++) {
+        buf[i] = (uint8_t)(value * 131 + i * 7 + (i >> 8));
+    }
+}
+
+/* every sector reads back as written, lsn in_flight may also hold prev (its write was cut) */
+static void _test_verify(int in_flight)
+{
+    for (uint32_t lsn = 0; lsn < s_logical; lsn++) {
+        SPIF_TEST_CHECK(spif_ftl_read(&s_ftl, lsn, 0, s_buf, TEST_SECTOR) == SPIF_SUCCESS);
+        if (memcmp(s_buf, s_ref[lsn], TEST_SECTOR) != 0) {
+            SPIF_TEST_CHECK((int)lsn == in_flight);
+            SPIF_TEST_CHECK(memcmp(s_buf, s_prev, TEST_SECTOR) == 0);
+            memcpy(s_ref[lsn], s_prev, TEST_SECTOR);
+        }
+    }
+}
+
+/* 30000 writes, 3/4 of them to lsn 0, the rest to lsn 1..39, the other sectors stay cold */
+static void test_ftl_wear(void)
+{
+    spif_ftl_stats_t stats;
+    uint32_t pool_start = 0;
+    uint32_t ec = 0;
+    uint32_t ec_min = UINT32_MAX;
+    uint32_t ec_max = 0;
+    uint32_t lsn = 0;
+
+    SPIF_TEST_CHECK(spif_ftl_mount(&s_ftl, &s_config) != SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_ftl_format(&s_ftl, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_ftl_mount(&s_ftl, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_ftl_stats_get(&s_ftl, &stats) == SPIF_SUCCESS);
+
+    s_logical = stats.logical_sectors;
+    SPIF_TEST_CHECK((s_logical > 40) && (s_logical <= TEST_LSN_MAX));
+    memset(s_ref, 0xFF, sizeof(s_ref));
+
+    for (uint32_t i = 0; i < TEST_WRITES; i++) {
+        if (i < s_logical) {
+            lsn = i;
+        } else {
+            lsn = (spif_test_rand() % 4 == 0) ? spif_test_rand() % 40 : 0;
+        }
+
+        _test_fill(s_ref[lsn], i);
+        SPIF_TEST_CHECK(spif_ftl_write(&s_ftl, lsn, s_ref[lsn]) == SPIF_SUCCESS);
+
+        if (i % 50 == 0) {
+            SPIF_TEST_CHECK(spif_ftl_gc(&s_ftl, 2) == SPIF_SUCCESS);
+        }
+
+        if (i % 5000 == 4999) {
+            SPIF_TEST_CHECK(spif_ftl_mount(&s_ftl, &s_config) == SPIF_SUCCESS);
+            _test_verify(-1);
+        }
+    }
+
+    _test_verify(-1);
+
+    /* the erase counts the simulator saw over the data pool */
+    pool_start = TEST_BASE + (2 * s_ftl.ckpt_sectors + s_config.journal_sectors) * TEST_SECTOR;
+    for (uint32_t addr = pool_start; addr < TEST_BASE + TEST_SIZE; addr += TEST_SECTOR) {
+        ec = spif_port_sim_erase_count(s_test.id, addr);
+        ec_min = (ec < ec_min) ? ec : ec_min;
+        ec_max = (ec > ec_max) ? ec : ec_max;
+    }
+
+    SPIF_TEST_CHECK(spif_ftl_stats_get(&s_ftl, &stats) == SPIF_SUCCESS);
+    printf("wear: %u writes over %u logical sectors, pool erase counts %u..%u (ftl %u..%u), wl moves %u, checkpoints %u\r\n",
+           TEST_WRITES, s_logical, ec_min, ec_max, stats.ec_min, stats.ec_max, stats.wl_moves, stats.checkpoints);
+
+    /* static wear leveling keeps the spread near wl_threshold although most sectors are cold */
+    SPIF_TEST_CHECK(ec_min > 0);
+    SPIF_TEST_CHECK(ec_max - ec_min <= 2 * s_config.wl_threshold);
+}
+
+/* the power fails within the first 40 commands of a write (and gc), the remount sees the old or the new data */
+static void test_ftl_power_cut(void)
+{
+    uint32_t cuts = 0;
+    uint32_t lsn = 0;
+    int ret = SPIF_SUCCESS;
+
+    for (uint32_t round = 0; round < TEST_CUT_ROUNDS; round++) {
+        lsn = (round % 3 != 0) ? 0 : spif_test_rand() % s_logical;
+        memcpy(s_prev, s_ref[lsn], TEST_SECTOR);
+        _test_fill(s_ref[lsn], 100000 + round);
+
+        SPIF_TEST_CHECK(spif_test_power_cut(&s_test, 1 + spif_test_rand() % 40) == SPIF_SUCCESS);
+        ret = spif_ftl_write(&s_ftl, lsn, s_ref[lsn]);
+        if ((ret == SPIF_SUCCESS) && (round % 7 == 0)) {
+            ret = spif_ftl_gc(&s_ftl, 3);
+        }
+
+        ret = spif_test_power_restore(&s_test);
+        SPIF_TEST_CHECK(ret != SPIF_FAIL);
+        cuts += ret;
+
+        SPIF_TEST_CHECK(spif_ftl_mount(&s_ftl, &s_config) == SPIF_SUCCESS);
+        _test_verify(lsn);
+    }
+
+    printf("power cut: %u rounds, %u cut\r\n", TEST_CUT_ROUNDS, cuts);
+    SPIF_TEST_CHECK(cuts > TEST_CUT_ROUNDS / 2);
+}
+
+int main(void)
+{
+    spif_port_sim_stats_t stats;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, SPIF_TEST_QSPI, NULL) == SPIF_SUCCESS);
+
+    s_config.dev = &s_test.dev;
+    s_config.addr = TEST_BASE;
+    s_config.size = TEST_SIZE;
+    s_config.spare_sectors = 4;
+    s_config.journal_sectors = 2;
+    s_config.wl_threshold = 20;
+
+    spif_test_srand(7);
+    test_ftl_wear();
+    test_ftl_power_cut();
+
+    spif_port_sim_stats_get(s_test.id, &stats);
+    SPIF_TEST_CHECK(stats.violations == 0);
+    spif_test_close(&s_test);
+
+    printf("test_ftl ok\r\n");
+
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+ * test_kv.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+#include "spif_kv.h"
+
+#define TEST_BASE       0x200000
+#define TEST_KEYS       60
+#define TEST_VALUE_MAX  300
+#define TEST_ABSENT     0xFFFF
+
+#define TEST_OPS        20000
+#define TEST_CUT_ROUNDS 3000
+
+static spif_test_dev_t s_test;
+static spif_kv_t s_kv;
+static spif_kv_config_t s_config;
+
+/* what the store must hold, and what it held before the operation in flight */
+static uint8_t s_ref[TEST_KEYS][TEST_VALUE_MAX];
+static uint16_t s_ref_len[TEST_KEYS];
+static uint8_t s_prev[TEST_KEYS][TEST_VALUE_MAX];
+static uint16_t s_prev_len[TEST_KEYS];
+
+static void _test_key(int k, char *key)
+{
+    sprintf(key, "key_%d", k);
+}
+
+static void _test_gen(int k, uint32_t value)
+{
+    s_ref_len[k] = (uint16_t)((k * 37 + value) % 290 + 1);
+    for (uint16_t i = 0; i < s_ref_len[k]; i++) {
+        s_ref[k][i] = (uint8_t)(value * 13 + i + k);
+    }
+}
+
+static int _test_match(int r, const uint8_t *value, uint16_t len, const uint8_t *ref, uint16_t ref_len)
+{
+    if (ref_len == TEST_ABSENT) {
+        return r != SPIF_SUCCESS;
+    }
+
+    return (r == SPIF_SUCCESS) && (len == ref_len) && (memcmp(value, ref, len) == 0);
+}
+
+/**
+ * every key reads back as written; the keys lo..hi of the operation in flight hold either all
+ * the new values or all the old ones, a torn batch fails
+ */
+static void _test_verify(int lo, int hi)
+{
+    char key[SPIF_KV_KEY_MAX + 1];
+    uint8_t value[TEST_VALUE_MAX];
+    uint16_t len = 0;
+    int old = -1;
+    int r = SPIF_SUCCESS;
+
+    for (int k = 0; k < TEST_KEYS; k++) {
+        _test_key(k, key);
+        r = spif_kv_get(&s_kv, key, value, sizeof(value), &len);
+
+        if (_test_match(r, value, len, s_ref[k], s_ref_len[k])) {
+            if ((k >= lo) && (k <= hi) && !_test_match(r, value, len, s_prev[k], s_prev_len[k])) {
+                SPIF_TEST_CHECK(old != 1);
+                old = 0;
+            }
+            continue;
+        }
+
+        SPIF_TEST_CHECK((k >= lo) && (k <= hi));
+        SPIF_TEST_CHECK(_test_match(r, value, len, s_prev[k], s_prev_len[k]));
+        SPIF_TEST_CHECK(old != 0);
+        old = 1;
+        memcpy(s_ref[k], s_prev[k], TEST_VALUE_MAX);
+        s_ref_len[k] = s_prev_len[k];
+    }
+}
+
+static uint32_t _test_keys(void)
+{
+    uint32_t keys = 0;
+
+    for (int k = 0; k < TEST_KEYS; k++) {
+        keys += (s_ref_len[k] != TEST_ABSENT) ? 1 : 0;
+    }
+
+    return keys;
+}
+
+/* a batch of count keys from lo on, value NULL deletes */
+static int _test_commit(int lo, int count, uint32_t value)
+{
+    spif_kv_item_t items[4];
+    char keys[4][SPIF_KV_KEY_MAX + 1];
+
+    for (int i = 0; i < count; i++) {
+        _test_key(lo + i, keys[i]);
+        _test_gen(lo + i, value);
+        items[i].key = keys[i];
+        items[i].value = s_ref[lo + i];
+        items[i].size = s_ref_len[lo + i];
+    }
+
+    return spif_kv_commit(&s_kv, items, count);
+}
+
+/* sets, deletes and batches with compaction and remounts, the index and the log stay in step */
+static void test_kv_ops(void)
+{
+    spif_kv_stats_t stats;
+    char key[SPIF_KV_KEY_MAX + 1];
+    uint32_t ec = 0;
+    uint32_t ec_min = UINT32_MAX;
+    uint32_t ec_max = 0;
+    int k = 0;
+
+    SPIF_TEST_CHECK(spif_kv_format(&s_kv, &s_config) == SPIF_SUCCESS);
+    memset(s_ref_len, 0xFF, sizeof(s_ref_len));
+
+    for (uint32_t i = 0; i < TEST_OPS; i++) {
+        k = spif_test_rand() % TEST_KEYS;
+        _test_key(k, key);
+
+        if (spif_test_rand() % 10 == 0) {
+            SPIF_TEST_CHECK(spif_kv_delete(&s_kv, key) == SPIF_SUCCESS);
+            s_ref_len[k] = TEST_ABSENT;
+        } else if (spif_test_rand() % 10 == 0) {
+            SPIF_TEST_CHECK(_test_commit(spif_test_rand() % (TEST_KEYS - 4), 4, i) == SPIF_SUCCESS);
+        } else {
+            _test_gen(k, i);
+            SPIF_TEST_CHECK(spif_kv_set(&s_kv, key, s_ref[k], s_ref_len[k]) == SPIF_SUCCESS);
+        }
+
+        SPIF_TEST_CHECK(spif_kv_stats_get(&s_kv, &stats) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(stats.keys == _test_keys());
+
+        if (i % 97 == 0) {
+            SPIF_TEST_CHECK(spif_kv_gc(&s_kv, 5) == SPIF_SUCCESS);
+        }
+
+        if (i % 3000 == 2999) {
+            SPIF_TEST_CHECK(spif_kv_mount(&s_kv, &s_config) == SPIF_SUCCESS);
+            _test_verify(-1, -1);
+        }
+    }
+
+    _test_verify(-1, -1);
+
+    /* after a sync the mount replays nothing */
+    SPIF_TEST_CHECK(spif_kv_sync(&s_kv) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_kv_mount(&s_kv, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_kv_stats_get(&s_kv, &stats) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(stats.replayed == 0);
+    _test_verify(-1, -1);
+
+    for (uint32_t addr = TEST_BASE + 2 * s_kv.snapshot_sectors * 4096; addr < TEST_BASE + s_config.size; addr += 4096) {
+        ec = spif_port_sim_erase_count(s_test.id, addr);
+        ec_min = (ec < ec_min) ? ec : ec_min;
+        ec_max = (ec > ec_max) ? ec : ec_max;
+    }
+
+    printf("ops: %u ops, %u keys, log sectors %u, log erase counts %u..%u\r\n",
+           TEST_OPS, stats.keys, stats.log_sectors, ec_min, ec_max);
+
+    /* the circular log wears evenly */
+    SPIF_TEST_CHECK(ec_max - ec_min <= 2);
+}
+
+/* the power fails in a third of the rounds, the remount sees the old or the new value of the keys touched */
+static void test_kv_power_cut(void)
+{
+    char key[SPIF_KV_KEY_MAX + 1];
+    uint32_t cuts = 0;
+    int lo = 0;
+    int hi = 0;
+    int ret = SPIF_SUCCESS;
+
+    for (uint32_t round = 0; round < TEST_CUT_ROUNDS; round++) {
+        memcpy(s_prev, s_ref, sizeof(s_prev));
+        memcpy(s_prev_len, s_ref_len, sizeof(s_prev_len));
+
+        if (spif_test_rand() % 3 == 0) {
+            SPIF_TEST_CHECK(spif_test_power_cut(&s_test, 1 + spif_test_rand() % 8) == SPIF_SUCCESS);
+        }
+
+        if (round % 3 == 0) {
+            lo = spif_test_rand() % (TEST_KEYS - 3);
+            hi = lo + 2;
+            (void)_test_commit(lo, 3, 50000 + round);
+        } else {
+            lo = hi = spif_test_rand() % TEST_KEYS;
+            _test_key(lo, key);
+            if (round % 5 == 0) {
+                (void)spif_kv_delete(&s_kv, key);
+                s_ref_len[lo] = TEST_ABSENT;
+            } else {
+                _test_gen(lo, 50000 + round);
+                (void)spif_kv_set(&s_kv, key, s_ref[lo], s_ref_len[lo]);
+            }
+        }
+
+        if (round % 4 == 0) {
+            (void)spif_kv_gc(&s_kv, 3);
+        }
+
+        if (round % 50 == 0) {
+            (void)spif_kv_sync(&s_kv);
+        }
+
+        ret = spif_test_power_restore(&s_test);
+        SPIF_TEST_CHECK(ret != SPIF_FAIL);
+        cuts += ret;
+
+        SPIF_TEST_CHECK(spif_kv_mount(&s_kv, &s_config) == SPIF_SUCCESS);
+        _test_verify(lo, hi);
+    }
+
+    printf("power cut: %u rounds, %u cut\r\n", TEST_CUT_ROUNDS, cuts);
+    SPIF_TEST_CHECK(cuts > TEST_CUT_ROUNDS / 4);
+}
+
+int main(void)
+{
+    spif_port_sim_stats_t stats;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, SPIF_TEST_SPI, NULL) == SPIF_SUCCESS);
+
+    s_config.dev = &s_test.dev;
+    s_config.addr = TEST_BASE;
+    s_config.size = 16 * 4096;
+    s_config.snapshot_interval = 4;
+
+    spif_test_srand(3);
+    test_kv_ops();
+    test_kv_power_cut();
+
+    spif_port_sim_stats_get(s_test.id, &stats);
+    SPIF_TEST_CHECK(stats.violations == 0);
+    spif_test_close(&s_test);
+
+    printf("test_kv ok\r\n");
+
+    return 0;
+}
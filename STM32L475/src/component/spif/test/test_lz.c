@@ -0,0 +1,244 @@
+/*
+ * test_lz.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+#include "spif_lz.h"
+
+#define TEST_BASE      0x10000
+#define TEST_REGION    (512 * 1024)
+#define TEST_DATA      (600 * 1024)
+
+static spif_test_dev_t s_test;
+static spif_lz_t s_lz;
+static spif_lz_t s_lz2;
+static spif_lz_config_t s_config;
+
+static uint8_t s_ref[TEST_DATA];
+static uint8_t s_buf[8192];
+
+/* log-like text, with noise one line in 8 is binary */
+static void _test_gen(int noise)
+{
+    static const char *words[] = {"INFO", "WARN", "sensor", "temp=", "ok", "retry", "flash", "ms", " ", "\n", "id="};
+    char line[128];
+    uint32_t pos = 0;
+    uint32_t len = 0;
+
+    while (pos < TEST_DATA) {
+        if (noise && (spif_test_rand() % 8 == 0)) {
+            len = 1 + spif_test_rand() % 100;
+            for (uint32_t i = 0; i < len; i++) {
+                line[i] = (char)spif_test_rand();
+            }
+        } else {
+            len = snprintf(line, sizeof(line), "[%08u] %s %s%u %s %s\n", pos,
+                           words[spif_test_rand() % 3], words[3 + spif_test_rand() % 4], spif_test_rand() % 100,
+                           words[7 + spif_test_rand() % 4], words[spif_test_rand() % 11]);
+        }
+
+        len = (pos + len > TEST_DATA) ? TEST_DATA - pos : len;
+        memcpy(s_ref + pos, line, len);
+        pos += len;
+    }
+}
+
+/* random reads against the reference, past the end gives 0 bytes */
+static void _test_check(spif_lz_t *lz, uint32_t size, int reads)
+{
+    uint32_t offset = 0;
+    uint32_t want = 0;
+    uint32_t got = 0;
+    uint32_t expect = 0;
+
+    SPIF_TEST_CHECK(spif_lz_size(lz) == size);
+
+    for (int i = 0; i < reads; i++) {
+        offset = spif_test_rand() % (size + 10);
+        want = spif_test_rand() % 5000;
+        SPIF_TEST_CHECK(spif_lz_read(lz, offset, s_buf, want, &got) == SPIF_SUCCESS);
+
+        expect = (offset >= size) ? 0 : ((size - offset < want) ? size - offset : want);
+        SPIF_TEST_CHECK(got == expect);
+        SPIF_TEST_CHECK(memcmp(s_buf, s_ref + offset, got) == 0);
+    }
+}
+
+static uint32_t _test_append(spif_lz_t *lz, uint32_t written, int count, uint32_t max)
+{
+    uint32_t size = 0;
+
+    for (int i = 0; i < count; i++) {
+        size = 1 + spif_test_rand() % max;
+        SPIF_TEST_CHECK(spif_lz_write(lz, s_ref + written, size) == SPIF_SUCCESS);
+        written += size;
+    }
+
+    return written;
+}
+
+/* 256 KB of text a line at a time, one page program per 256 B of compressed data instead of per 256 B of log */
+static void test_lz_ratio(void)
+{
+    spif_lz_stats_t stats;
+    uint32_t written = 0;
+    uint32_t size = 0;
+    double start_us = 0;
+    double lz_us = 0;
+    double raw_us = 0;
+
+    SPIF_TEST_CHECK(spif_lz_format(&s_lz, &s_config) == SPIF_SUCCESS);
+
+    start_us = spif_test_time_us(&s_test);
+    while (written < 256 * 1024) {
+        size = (uint32_t)((uint8_t *)memchr(s_ref + written, '\n', TEST_DATA - written) - (s_ref + written)) + 1;
+        SPIF_TEST_CHECK(spif_lz_write(&s_lz, s_ref + written, size) == SPIF_SUCCESS);
+        written += size;
+    }
+    SPIF_TEST_CHECK(spif_lz_flush(&s_lz) == SPIF_SUCCESS);
+    lz_us = spif_test_time_us(&s_test) - start_us;
+    _test_check(&s_lz, written, 100);
+
+    /* the same bytes programmed as they are */
+    SPIF_TEST_CHECK(spif_erase_range(&s_test.dev, TEST_BASE + TEST_REGION, 0x50000, NULL) == SPIF_SUCCESS);
+    start_us = spif_test_time_us(&s_test);
+    SPIF_TEST_CHECK(spif_write(&s_test.dev, TEST_BASE + TEST_REGION, s_ref, written, SPIF_WRITE_MODE_PROGRAM) == SPIF_SUCCESS);
+    raw_us = spif_test_time_us(&s_test) - start_us;
+
+    SPIF_TEST_CHECK(spif_lz_stats_get(&s_lz, &stats) == SPIF_SUCCESS);
+    printf("ratio: raw %llu B, compressed %llu B (%.0f%%), page programs %u (raw %u), write %.1f ms (raw %.1f ms)\r\n",
+           (unsigned long long)stats.raw_bytes, (unsigned long long)stats.comp_bytes,
+           100.0 * stats.comp_bytes / stats.raw_bytes, stats.programs, (written + 255) / 256,
+           lz_us / 1000, raw_us / 1000);
+
+    /* the random fields make this text compress worse than real logs */
+    SPIF_TEST_CHECK(stats.comp_bytes * 10 < stats.raw_bytes * 6);
+    SPIF_TEST_CHECK(lz_us * 10 < raw_us * 6);
+}
+
+/* small appends with flushes, the stream reads back while written and after a remount */
+static uint32_t test_lz_append(void)
+{
+    spif_lz_stats_t stats;
+    uint32_t written = 0;
+
+    SPIF_TEST_CHECK(spif_lz_format(&s_lz, &s_config) == SPIF_SUCCESS);
+
+    while (written < 300000) {
+        written = _test_append(&s_lz, written, 1, 300);
+
+        if (spif_test_rand() % 40 == 0) {
+            SPIF_TEST_CHECK(spif_lz_flush(&s_lz) == SPIF_SUCCESS);
+        }
+
+        if (spif_test_rand() % 50 == 0) {
+            _test_check(&s_lz, written, 5);
+        }
+    }
+
+    _test_check(&s_lz, written, 300);
+    SPIF_TEST_CHECK(spif_lz_flush(&s_lz) == SPIF_SUCCESS);
+
+    SPIF_TEST_CHECK(spif_lz_mount(&s_lz2, &s_config) == SPIF_SUCCESS);
+    _test_check(&s_lz2, written, 300);
+
+    SPIF_TEST_CHECK(spif_lz_stats_get(&s_lz, &stats) == SPIF_SUCCESS);
+    printf("append: raw %llu B, compressed %llu B (%.0f%%), blocks %u (%u stored), page programs %u (raw %u)\r\n",
+           (unsigned long long)stats.raw_bytes, (unsigned long long)stats.comp_bytes,
+           100.0 * stats.comp_bytes / stats.raw_bytes, stats.blocks, stats.stored_blocks,
+           stats.programs, (uint32_t)(stats.raw_bytes / 256));
+    SPIF_TEST_CHECK(stats.programs < stats.raw_bytes / 256);
+
+    return written;
+}
+
+/* lost RAM and torn programs: the mount finds the end of the last complete block */
+static void test_lz_recover(uint32_t written)
+{
+    uint8_t junk[40];
+    uint32_t flushed = written;
+    uint32_t addr = 0;
+
+    /* blocks completed without a flush survive, the buffered tail is lost */
+    written = _test_append(&s_lz2, written, 30, 300);
+    SPIF_TEST_CHECK(spif_lz_mount(&s_lz, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK((s_lz.raw_end >= flushed) && (s_lz.raw_end <= s_lz2.raw_end));
+    written = s_lz.raw_end;
+    _test_check(&s_lz, written, 200);
+
+    /* garbage with a block magic right after the end */
+    memset(junk, 0x5A, sizeof(junk));
+    junk[0] = 0x42;
+    junk[1] = 0x4B;
+    addr = s_lz.fill_addr;
+    if ((addr % SPIF_LZ_SECTOR_SIZE) + sizeof(junk) > SPIF_LZ_SECTOR_SIZE) {
+        addr = (addr + SPIF_LZ_SECTOR_SIZE - 1) & ~(SPIF_LZ_SECTOR_SIZE - 1);
+    }
+    SPIF_TEST_CHECK(spif_write(&s_test.dev, addr, junk, sizeof(junk), SPIF_WRITE_MODE_PROGRAM) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_lz_mount(&s_lz, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(s_lz.raw_end == written);
+    _test_check(&s_lz, written, 100);
+
+    /* the same in the middle of a unit after a flush, the stream goes on in the next sector */
+    written = _test_append(&s_lz, written, 40, 300);
+    SPIF_TEST_CHECK(spif_lz_flush(&s_lz) == SPIF_SUCCESS);
+    addr = s_lz.fill_addr;
+    SPIF_TEST_CHECK((addr % SPIF_LZ_SECTOR_SIZE) != 0);
+    SPIF_TEST_CHECK(spif_write(&s_test.dev, addr, junk, 8, SPIF_WRITE_MODE_PROGRAM) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_lz_mount(&s_lz, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(s_lz.raw_end == written);
+    _test_check(&s_lz, written, 100);
+
+    written = _test_append(&s_lz, written, 100, 1000);
+    SPIF_TEST_CHECK(spif_lz_flush(&s_lz) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_lz_mount(&s_lz2, &s_config) == SPIF_SUCCESS);
+    _test_check(&s_lz2, written, 500);
+}
+
+/* the region fills up, the flush still programs every complete block, only the partial one is lost */
+static void test_lz_full(void)
+{
+    while (spif_lz_write(&s_lz2, s_ref, 2000) == SPIF_SUCCESS) {
+    }
+
+    SPIF_TEST_CHECK(s_lz2.raw_fill > 0);
+    SPIF_TEST_CHECK(spif_lz_flush(&s_lz2) == SPIF_FAIL);
+    SPIF_TEST_CHECK(s_lz2.end <= s_lz2.capacity);
+
+    SPIF_TEST_CHECK(spif_lz_mount(&s_lz, &s_config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_lz_size(&s_lz) == s_lz2.raw_end);
+    SPIF_TEST_CHECK(spif_lz_size(&s_lz2) - spif_lz_size(&s_lz) <= SPIF_LZ_BLOCK_SIZE);
+    printf("full: %u B in a %u B region\r\n", spif_lz_size(&s_lz), TEST_REGION);
+}
+
+int main(void)
+{
+    spif_port_sim_stats_t stats;
+    uint32_t written = 0;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, SPIF_TEST_QSPI, NULL) == SPIF_SUCCESS);
+
+    s_config.dev = &s_test.dev;
+    s_config.addr = TEST_BASE;
+    s_config.size = TEST_REGION;
+
+    spif_test_srand(3);
+    _test_gen(0);
+    test_lz_ratio();
+
+    _test_gen(1);
+    written = test_lz_append();
+    test_lz_recover(written);
+    test_lz_full();
+
+    spif_port_sim_stats_get(s_test.id, &stats);
+    SPIF_TEST_CHECK(stats.violations == 0);
+    spif_test_close(&s_test);
+
+    printf("test_lz ok\r\n");
+
+    return 0;
+}
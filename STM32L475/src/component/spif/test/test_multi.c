@@ -0,0 +1,312 @@
+/*
+ * test_multi.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include <pthread.h>
+#include "spif_test.h"
+#include "spif_ftl.h"
+#include "spif_kv.h"
+
+#define TEST_KEYS       24
+#define TEST_LSNS       16
+#define TEST_SECTOR     4096
+#define TEST_THREAD_OPS 3000
+
+/**
+ * two stores on one flash and one on the other, each with its own handle:
+ * | sim0, QSPI, W25Q128JV | KV a | KV b | FTL a |
+ * | sim1, SPI, from SFDP  | FTL b | KV c |
+ */
+typedef struct {
+    spif_kv_t kv;
+    spif_kv_config_t config;
+    uint32_t value[TEST_KEYS]; /* 0: absent */
+} test_kv_t;
+
+typedef struct {
+    spif_ftl_t ftl;
+    spif_ftl_config_t config;
+    uint32_t value[TEST_LSNS]; /* 0: never written */
+} test_ftl_t;
+
+typedef struct {
+    spif_test_dev_t *test;
+    test_kv_t *kv[2];
+    test_ftl_t *ftl;
+    uint32_t seed;
+} test_side_t;
+
+static spif_test_dev_t s_dev[2];
+static test_kv_t s_kv_a;
+static test_kv_t s_kv_b;
+static test_kv_t s_kv_c;
+static test_ftl_t s_ftl_a;
+static test_ftl_t s_ftl_b;
+
+static void _test_key(int k, char *key)
+{
+    sprintf(key, "cfg/%d", k);
+}
+
+static void _test_fill(uint8_t *buf, uint32_t value)
+{
+    for (uint32_t i = 0; i < TEST_SECTOR; i += 4) {
+        memcpy(&buf[i], &value, 4);
+        value = value * 1103515245 + 12345;
+    }
+}
+
+static void _test_kv_format(test_kv_t *t, spif_dev_t *dev, uint32_t addr)
+{
+    t->config.dev = dev;
+    t->config.addr = addr;
+    t->config.size = 16 * TEST_SECTOR;
+    t->config.snapshot_interval = 4;
+    memset(t->value, 0, sizeof(t->value));
+
+    SPIF_TEST_CHECK(spif_kv_format(&t->kv, &t->config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_kv_mount(&t->kv, &t->config) == SPIF_SUCCESS);
+}
+
+static void _test_ftl_format(test_ftl_t *t, spif_dev_t *dev, uint32_t addr)
+{
+    t->config.dev = dev;
+    t->config.addr = addr;
+    t->config.size = 64 * TEST_SECTOR;
+    t->config.spare_sectors = 4;
+    t->config.journal_sectors = 2;
+    t->config.wl_threshold = 20;
+    memset(t->value, 0, sizeof(t->value));
+
+    SPIF_TEST_CHECK(spif_ftl_format(&t->ftl, &t->config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_ftl_mount(&t->ftl, &t->config) == SPIF_SUCCESS);
+}
+
+static int _test_kv_set(test_kv_t *t, int k, uint32_t value)
+{
+    char key[16];
+
+    _test_key(k, key);
+    t->value[k] = value;
+
+    return spif_kv_set(&t->kv, key, &value, sizeof(value));
+}
+
+static int _test_ftl_write(test_ftl_t *t, uint32_t lsn, uint32_t value)
+{
+    uint8_t buf[TEST_SECTOR];
+
+    _test_fill(buf, value);
+    t->value[lsn] = value;
+
+    return spif_ftl_write(&t->ftl, lsn, buf);
+}
+
+/* every key holds the last value written to this store, never one of another store */
+static void _test_kv_verify(test_kv_t *t)
+{
+    char key[16];
+    uint32_t value = 0;
+    uint16_t len = 0;
+    int ret = SPIF_SUCCESS;
+
+    for (int k = 0; k < TEST_KEYS; k++) {
+        _test_key(k, key);
+        ret = spif_kv_get(&t->kv, key, &value, sizeof(value), &len);
+        if (t->value[k] == 0) {
+            SPIF_TEST_CHECK(ret != SPIF_SUCCESS);
+        } else {
+            SPIF_TEST_CHECK(ret == SPIF_SUCCESS);
+            SPIF_TEST_CHECK((len == sizeof(value)) && (value == t->value[k]));
+        }
+    }
+}
+
+static void _test_ftl_verify(test_ftl_t *t)
+{
+    uint8_t buf[TEST_SECTOR];
+    uint8_t ref[TEST_SECTOR];
+
+    for (uint32_t lsn = 0; lsn < TEST_LSNS; lsn++) {
+        SPIF_TEST_CHECK(spif_ftl_read(&t->ftl, lsn, 0, buf, TEST_SECTOR) == SPIF_SUCCESS);
+        if (t->value[lsn] == 0) {
+            memset(ref, 0xFF, TEST_SECTOR);
+        } else {
+            _test_fill(ref, t->value[lsn]);
+        }
+        SPIF_TEST_CHECK(memcmp(buf, ref, TEST_SECTOR) == 0);
+    }
+}
+
+static void _test_remount_verify(void)
+{
+    test_kv_t *kv[] = {&s_kv_a, &s_kv_b, &s_kv_c};
+    test_ftl_t *ftl[] = {&s_ftl_a, &s_ftl_b};
+
+    for (int i = 0; i < 3; i++) {
+        SPIF_TEST_CHECK(spif_kv_mount(&kv[i]->kv, &kv[i]->config) == SPIF_SUCCESS);
+        _test_kv_verify(kv[i]);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        SPIF_TEST_CHECK(spif_ftl_mount(&ftl[i]->ftl, &ftl[i]->config) == SPIF_SUCCESS);
+        _test_ftl_verify(ftl[i]);
+    }
+}
+
+/* the same keys and sectors in every store, interleaved from one thread */
+static void test_multi_interleaved(void)
+{
+    for (uint32_t i = 1; i <= 600; i++) {
+        SPIF_TEST_CHECK(_test_kv_set(&s_kv_a, i % TEST_KEYS, 0xA0000000 | i) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(_test_kv_set(&s_kv_b, i % TEST_KEYS, 0xB0000000 | i) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(_test_kv_set(&s_kv_c, (i * 7) % TEST_KEYS, 0xC0000000 | i) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(_test_ftl_write(&s_ftl_a, i % TEST_LSNS, 0xA0000000 | i) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(_test_ftl_write(&s_ftl_b, (i * 3) % TEST_LSNS, 0xB0000000 | i) == SPIF_SUCCESS);
+    }
+
+    _test_remount_verify();
+}
+
+/* one thread per flash, the devices share no state and need no common lock */
+static void *_test_side_run(void *arg)
+{
+    test_side_t *side = (test_side_t *)arg;
+    uint32_t r = 0;
+
+    for (uint32_t i = 1; i <= TEST_THREAD_OPS; i++) {
+        side->seed = side->seed * 1103515245 + 12345;
+        r = side->seed >> 8;
+
+        if (r % 4 == 0) {
+            SPIF_TEST_CHECK(_test_ftl_write(side->ftl, r % TEST_LSNS, side->seed | 1) == SPIF_SUCCESS);
+        } else {
+            SPIF_TEST_CHECK(_test_kv_set(side->kv[r % 2], r % TEST_KEYS, side->seed | 1) == SPIF_SUCCESS);
+        }
+
+        if (i % 100 == 0) {
+            SPIF_TEST_CHECK(spif_kv_gc(&side->kv[0]->kv, 4) == SPIF_SUCCESS);
+            SPIF_TEST_CHECK(spif_ftl_gc(&side->ftl->ftl, 2) == SPIF_SUCCESS);
+        }
+    }
+
+    return NULL;
+}
+
+static void test_multi_threads(void)
+{
+    pthread_t thread[2];
+    test_side_t side[2] = {
+        {&s_dev[0], {&s_kv_a, &s_kv_b}, &s_ftl_a, 1},
+        {&s_dev[1], {&s_kv_c, &s_kv_c}, &s_ftl_b, 2},
+    };
+
+    for (int i = 0; i < 2; i++) {
+        SPIF_TEST_CHECK(pthread_create(&thread[i], NULL, _test_side_run, &side[i]) == 0);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        SPIF_TEST_CHECK(pthread_join(thread[i], NULL) == 0);
+    }
+
+    _test_remount_verify();
+}
+
+/* the power fails on sim1 only, the stores of sim0 go on and lose nothing */
+static void test_multi_power_cut(void)
+{
+    uint32_t cuts = 0;
+    uint32_t prev = 0;
+    uint32_t lsn = 0;
+    int ret = SPIF_SUCCESS;
+
+    for (uint32_t round = 1; round <= 100; round++) {
+        lsn = round % TEST_LSNS;
+        prev = s_ftl_b.value[lsn];
+
+        if (round % 3 != 0) {
+            SPIF_TEST_CHECK(spif_test_power_cut(&s_dev[1], 1 + (round * 7) % 60) == SPIF_SUCCESS);
+        }
+        (void)_test_ftl_write(&s_ftl_b, lsn, 0xD0000000 | round);
+        (void)_test_kv_set(&s_kv_c, round % TEST_KEYS, 0xD0000000 | round);
+
+        SPIF_TEST_CHECK(_test_kv_set(&s_kv_a, round % TEST_KEYS, 0xE0000000 | round) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(_test_ftl_write(&s_ftl_a, lsn, 0xE0000000 | round) == SPIF_SUCCESS);
+
+        ret = spif_test_power_restore(&s_dev[1]);
+        SPIF_TEST_CHECK(ret != SPIF_FAIL);
+        if (ret == 0) {
+            continue;
+        }
+        cuts++;
+
+        /* the write cut short left the old or the new data, the KV set did not run or was lost */
+        SPIF_TEST_CHECK(spif_ftl_mount(&s_ftl_b.ftl, &s_ftl_b.config) == SPIF_SUCCESS);
+        if (spif_ftl_read(&s_ftl_b.ftl, lsn, 0, (uint8_t *)&s_ftl_b.value[lsn], 4) == SPIF_SUCCESS) {
+            if (s_ftl_b.value[lsn] == 0xFFFFFFFF) {
+                s_ftl_b.value[lsn] = 0;
+            } else if (s_ftl_b.value[lsn] != (0xD0000000 | round)) {
+                SPIF_TEST_CHECK(s_ftl_b.value[lsn] == prev);
+            }
+        }
+
+        SPIF_TEST_CHECK(spif_kv_mount(&s_kv_c.kv, &s_kv_c.config) == SPIF_SUCCESS);
+        {
+            char key[16];
+            uint32_t value = 0;
+
+            _test_key(round % TEST_KEYS, key);
+            if (spif_kv_get(&s_kv_c.kv, key, &value, sizeof(value), NULL) == SPIF_SUCCESS) {
+                s_kv_c.value[round % TEST_KEYS] = value;
+            } else {
+                s_kv_c.value[round % TEST_KEYS] = 0;
+            }
+        }
+
+        _test_kv_verify(&s_kv_a);
+        _test_ftl_verify(&s_ftl_a);
+    }
+
+    printf("power cut on sim1: %u of 100 rounds\r\n", cuts);
+    SPIF_TEST_CHECK(cuts > 50);
+
+    _test_remount_verify();
+}
+
+int main(void)
+{
+    spif_port_sim_config_t config;
+    spif_port_sim_stats_t stats;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_dev[0], 0, SPIF_TEST_QSPI, NULL) == SPIF_SUCCESS);
+
+    spif_port_sim_config_default(&config);
+    config.jedec_id[2] = 0x17;
+    config.size = 8 * 1024 * 1024;
+    SPIF_TEST_CHECK(spif_test_open(&s_dev[1], 1, SPIF_TEST_SPI, &config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(s_dev[1].dev.flash.chip_size == config.size);
+
+    _test_kv_format(&s_kv_a, &s_dev[0].dev, 0x100000);
+    _test_kv_format(&s_kv_b, &s_dev[0].dev, 0x140000);
+    _test_ftl_format(&s_ftl_a, &s_dev[0].dev, 0x200000);
+    _test_ftl_format(&s_ftl_b, &s_dev[1].dev, 0x100000);
+    _test_kv_format(&s_kv_c, &s_dev[1].dev, 0x300000);
+
+    test_multi_interleaved();
+    test_multi_threads();
+    test_multi_power_cut();
+
+    for (int i = 0; i < 2; i++) {
+        spif_test_stats_print(&s_dev[i]);
+        spif_port_sim_stats_get(s_dev[i].id, &stats);
+        SPIF_TEST_CHECK(stats.violations == 0);
+        spif_test_close(&s_dev[i]);
+    }
+
+    printf("test_multi ok\r\n");
+
+    return 0;
+}
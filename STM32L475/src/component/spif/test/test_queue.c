@@ -0,0 +1,331 @@
+/*
+ * test_queue.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include <pthread.h>
+#include "spif_test.h"
+#include "spif_queue.h"
+
+#define TEST_DATA        0x100000 /* read by the HIGH requests */
+#define TEST_ERASE       0x200000 /* erased by the LOW requests */
+#define TEST_ERASES      8
+#define TEST_READS       300
+#define TEST_READ_SIZE   256
+#define TEST_PERIOD_US   3000
+#define TEST_PRODUCERS   4
+#define TEST_REQS_EACH   200
+
+static spif_test_dev_t s_test;
+
+static uint8_t s_pattern[4096];
+static spif_req_t s_read[TEST_READS];
+static uint8_t s_read_buf[TEST_READS][TEST_READ_SIZE];
+static double s_submit_us[TEST_READS];
+static double s_done_us[TEST_READS];
+
+typedef struct {
+    spif_queue_t *queue;
+    int id;
+    spif_req_t req[TEST_REQS_EACH];
+    uint8_t buf[TEST_REQS_EACH][64];
+} test_producer_t;
+
+static test_producer_t s_producer[TEST_PRODUCERS];
+static volatile int s_producer_done;
+static volatile int s_producer_go;
+
+static void _test_read_done(int result, void *arg)
+{
+    int i = (int)(intptr_t)arg;
+
+    SPIF_TEST_CHECK(result == SPIF_SUCCESS);
+    s_done_us[i] = spif_test_time_us(&s_test);
+}
+
+/* callbacks run in the polling thread only */
+static void _test_producer_done(int result, void *arg)
+{
+    (void)arg;
+
+    SPIF_TEST_CHECK(result == SPIF_SUCCESS);
+    s_producer_done++;
+}
+
+static int _test_cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+static void _test_req(spif_req_t *req, uint8_t op, uint8_t prio, uint32_t addr, uint8_t *buf, uint32_t size)
+{
+    memset(req, 0, sizeof(spif_req_t));
+    req->op = op;
+    req->prio = prio;
+    req->addr = addr;
+    req->buf = buf;
+    req->size = size;
+}
+
+/**
+ * 8 x 64K LOW erases and a LOW write in the background, a HIGH 256 B read every 3 ms;
+ * with erase suspend the reads wait for tSUS, without it for the rest of the 64K erase
+ * @return p99 read latency, unit: us
+ */
+static double test_queue_latency(spif_test_mode_t mode, uint8_t suspend)
+{
+    static spif_req_t erase[TEST_ERASES];
+    static spif_req_t write;
+    static spif_req_t low_read;
+    static spif_req_t merged[4];
+    static uint8_t low_buf[16];
+    static uint8_t merged_buf[4][64];
+    static uint8_t check[3000];
+    double latency[TEST_READS];
+    spif_queue_t queue;
+    spif_queue_config_t config = {0};
+    spif_queue_stats_t stats;
+    spif_port_sim_stats_t sim_stats;
+    uint32_t offset = 0;
+    double next_us = 0;
+    int n = 0;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, mode, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_erase_range(&s_test.dev, TEST_DATA, 0x10000, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_write(&s_test.dev, TEST_DATA, s_pattern, sizeof(s_pattern), SPIF_WRITE_MODE_PROGRAM) == SPIF_SUCCESS);
+
+    config.dev = &s_test.dev;
+    config.erase_suspend = suspend;
+    config.suspend_max = 0;
+    config.resume_min_us = 500;
+    SPIF_TEST_CHECK(spif_queue_init(&queue, &config) == SPIF_SUCCESS);
+
+    for (int i = 0; i < TEST_ERASES; i++) {
+        _test_req(&erase[i], SPIF_REQ_ERASE, SPIF_REQ_PRIO_LOW, TEST_ERASE + i * 0x10000, NULL, 0x10000);
+        SPIF_TEST_CHECK(spif_queue_submit(&queue, &erase[i]) == SPIF_SUCCESS);
+    }
+
+    _test_req(&write, SPIF_REQ_WRITE, SPIF_REQ_PRIO_LOW, TEST_ERASE + 0x100, s_pattern, sizeof(check));
+    SPIF_TEST_CHECK(spif_queue_submit(&queue, &write) == SPIF_SUCCESS);
+
+    /* FIFO inside a class: this read follows the erase of its range */
+    _test_req(&low_read, SPIF_REQ_READ, SPIF_REQ_PRIO_LOW, TEST_ERASE, low_buf, sizeof(low_buf));
+    SPIF_TEST_CHECK(spif_queue_submit(&queue, &low_read) == SPIF_SUCCESS);
+
+    next_us = spif_test_time_us(&s_test);
+    while ((n < TEST_READS) || (spif_queue_poll(&queue) > 0)) {
+        if ((n < TEST_READS) && (spif_test_time_us(&s_test) >= next_us)) {
+            offset = (spif_test_rand() % 15) * TEST_READ_SIZE;
+            _test_req(&s_read[n], SPIF_REQ_READ, SPIF_REQ_PRIO_HIGH, TEST_DATA + offset, s_read_buf[n], TEST_READ_SIZE);
+            s_read[n].cb = _test_read_done;
+            s_read[n].arg = (void *)(intptr_t)n;
+            s_submit_us[n] = spif_test_time_us(&s_test);
+            SPIF_TEST_CHECK(spif_queue_submit(&queue, &s_read[n]) == SPIF_SUCCESS);
+            n++;
+            next_us += TEST_PERIOD_US;
+
+            /* contiguous NORMAL reads submitted together take one flash read */
+            if (n == 50) {
+                for (int k = 0; k < 4; k++) {
+                    _test_req(&merged[k], SPIF_REQ_READ, SPIF_REQ_PRIO_NORMAL, TEST_DATA + 64 * k, merged_buf[k], 64);
+                    SPIF_TEST_CHECK(spif_queue_submit(&queue, &merged[k]) == SPIF_SUCCESS);
+                }
+            }
+        }
+
+        spif_queue_poll(&queue);
+        s_test.plat_ops.delay_us(50);
+    }
+
+    for (int i = 0; i < TEST_READS; i++) {
+        SPIF_TEST_CHECK(s_read[i].state == SPIF_ASYNC_DONE);
+        offset = s_read[i].addr - TEST_DATA;
+        SPIF_TEST_CHECK(memcmp(s_read_buf[i], s_pattern + offset, TEST_READ_SIZE) == 0);
+        latency[i] = s_done_us[i] - s_submit_us[i];
+    }
+
+    for (int k = 0; k < 4; k++) {
+        SPIF_TEST_CHECK(memcmp(merged_buf[k], s_pattern + 64 * k, 64) == 0);
+    }
+
+    for (uint32_t i = 0; i < sizeof(low_buf); i++) {
+        SPIF_TEST_CHECK(low_buf[i] == 0xFF);
+    }
+
+    for (int i = 0; i < TEST_ERASES; i++) {
+        SPIF_TEST_CHECK((erase[i].state == SPIF_ASYNC_DONE) && (erase[i].result == SPIF_SUCCESS));
+    }
+
+    SPIF_TEST_CHECK(spif_read(&s_test.dev, TEST_ERASE + 0x100, check, sizeof(check)) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(memcmp(check, s_pattern, sizeof(check)) == 0);
+
+    qsort(latency, TEST_READS, sizeof(double), _test_cmp);
+    spif_queue_stats_get(&queue, &stats);
+    spif_port_sim_stats_get(s_test.id, &sim_stats);
+
+    printf("%-4s suspend %u: read latency us min %.1f, p50 %.1f, p99 %.1f, max %.1f; reads %u, merged %u, suspends %u, denied %u\r\n",
+           spif_test_mode_name[mode], suspend, latency[0], latency[TEST_READS / 2],
+           latency[(TEST_READS * 99 + 99) / 100 - 1], latency[TEST_READS - 1],
+           stats.reads, stats.merged, stats.suspends, stats.suspend_denied);
+
+    SPIF_TEST_CHECK(stats.merged >= 3);
+    SPIF_TEST_CHECK(stats.failed == 0);
+    SPIF_TEST_CHECK(sim_stats.violations == 0);
+    SPIF_TEST_CHECK((suspend == 0) || (stats.suspends > 0));
+
+    spif_test_close(&s_test);
+
+    return latency[(TEST_READS * 99 + 99) / 100 - 1];
+}
+
+/* producer 0 writes its pages at LOW, the others read HIGH and NORMAL, all submitting at once */
+static void *_test_producer_run(void *arg)
+{
+    test_producer_t *p = (test_producer_t *)arg;
+    spif_req_t *req = NULL;
+
+    /* all start together, so the submits run into each other */
+    while (!s_producer_go) {
+    }
+
+    for (int i = 0; i < TEST_REQS_EACH; i++) {
+        req = &p->req[i];
+        if (p->id == 0) {
+            memcpy(p->buf[i], s_pattern + (i % 64) * 64, 64);
+            _test_req(req, SPIF_REQ_WRITE, SPIF_REQ_PRIO_LOW, TEST_ERASE + i * 64, p->buf[i], 64);
+        } else {
+            _test_req(req, SPIF_REQ_READ, (uint8_t)(p->id % 2), TEST_DATA + ((i * 7 + p->id) % 64) * 64, p->buf[i], 64);
+        }
+        req->cb = _test_producer_done;
+        SPIF_TEST_CHECK(spif_queue_submit(p->queue, req) == SPIF_SUCCESS);
+    }
+
+    return NULL;
+}
+
+/**
+ * several threads submit while the main thread polls; every request is done exactly once, with
+ * the right data, and the counters add up
+ */
+static void test_queue_producers(void)
+{
+    static uint8_t check[TEST_REQS_EACH * 64];
+    pthread_t thread[TEST_PRODUCERS];
+    spif_queue_t queue;
+    spif_queue_config_t config = {0};
+    spif_queue_stats_t stats;
+    int total = TEST_PRODUCERS * TEST_REQS_EACH;
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, SPIF_TEST_QSPI, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_erase_range(&s_test.dev, TEST_DATA, 0x10000, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_write(&s_test.dev, TEST_DATA, s_pattern, sizeof(s_pattern), SPIF_WRITE_MODE_PROGRAM) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_erase_range(&s_test.dev, TEST_ERASE, 0x10000, NULL) == SPIF_SUCCESS);
+
+    config.dev = &s_test.dev;
+    SPIF_TEST_CHECK(spif_queue_init(&queue, &config) == SPIF_SUCCESS);
+
+    s_producer_done = 0;
+    s_producer_go = 0;
+    for (int i = 0; i < TEST_PRODUCERS; i++) {
+        s_producer[i].queue = &queue;
+        s_producer[i].id = i;
+        SPIF_TEST_CHECK(pthread_create(&thread[i], NULL, _test_producer_run, &s_producer[i]) == 0);
+    }
+    s_producer_go = 1;
+
+    while (s_producer_done < total) {
+        spif_queue_poll(&queue);
+    }
+
+    for (int i = 0; i < TEST_PRODUCERS; i++) {
+        SPIF_TEST_CHECK(pthread_join(thread[i], NULL) == 0);
+    }
+
+    SPIF_TEST_CHECK(spif_queue_poll(&queue) == 0);
+
+    for (int p = 0; p < TEST_PRODUCERS; p++) {
+        for (int i = 0; i < TEST_REQS_EACH; i++) {
+            spif_req_t *req = &s_producer[p].req[i];
+            SPIF_TEST_CHECK((req->state == SPIF_ASYNC_DONE) && (req->result == SPIF_SUCCESS));
+            SPIF_TEST_CHECK(memcmp(s_producer[p].buf[i], s_pattern + (req->addr & 0xFFF), 64) == 0);
+        }
+    }
+
+    SPIF_TEST_CHECK(spif_read(&s_test.dev, TEST_ERASE, check, sizeof(check)) == SPIF_SUCCESS);
+    for (int i = 0; i < TEST_REQS_EACH; i++) {
+        SPIF_TEST_CHECK(memcmp(check + i * 64, s_pattern + (i % 64) * 64, 64) == 0);
+    }
+
+    spif_queue_stats_get(&queue, &stats);
+    printf("producers %d: submitted %u, completed %u, reads %u, merged %u\r\n",
+           TEST_PRODUCERS, stats.submitted, stats.completed, stats.reads, stats.merged);
+
+    SPIF_TEST_CHECK((stats.submitted == (uint32_t)total) && (stats.completed == (uint32_t)total));
+
+    spif_test_close(&s_test);
+}
+
+/* a wait shorter than the 64K erase gives up and leaves it queued, a longer one sees it done */
+static void test_queue_wait(void)
+{
+    spif_queue_t queue;
+    spif_queue_config_t config = {0};
+    spif_req_t erase;
+    spif_req_t read;
+    uint8_t buf[16];
+
+    SPIF_TEST_CHECK(spif_test_open(&s_test, 0, SPIF_TEST_QSPI, NULL) == SPIF_SUCCESS);
+
+    config.dev = &s_test.dev;
+    SPIF_TEST_CHECK(spif_queue_init(&queue, &config) == SPIF_SUCCESS);
+
+    _test_req(&erase, SPIF_REQ_ERASE, SPIF_REQ_PRIO_LOW, TEST_ERASE, NULL, 0x10000);
+    _test_req(&read, SPIF_REQ_READ, SPIF_REQ_PRIO_LOW, TEST_ERASE, buf, sizeof(buf));
+    SPIF_TEST_CHECK(spif_queue_wait(&queue, &erase, 100) == SPIF_FAIL);
+    SPIF_TEST_CHECK(spif_queue_submit(&queue, &erase) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_queue_submit(&queue, &read) == SPIF_SUCCESS);
+
+    SPIF_TEST_CHECK(spif_queue_wait(&queue, &read, 1) == SPIF_TIMEOUT);
+    SPIF_TEST_CHECK((erase.state == SPIF_ASYNC_RUNNING) && (read.state == SPIF_ASYNC_RUNNING));
+
+    SPIF_TEST_CHECK(spif_queue_wait(&queue, &read, 5000) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK((erase.state == SPIF_ASYNC_DONE) && (erase.result == SPIF_SUCCESS));
+    for (uint32_t i = 0; i < sizeof(buf); i++) {
+        SPIF_TEST_CHECK(buf[i] == 0xFF);
+    }
+
+    SPIF_TEST_CHECK(spif_queue_poll(&queue) == 0);
+
+    spif_test_close(&s_test);
+}
+
+int main(void)
+{
+    double p99 = 0;
+
+    for (uint32_t i = 0; i < sizeof(s_pattern); i++) {
+        s_pattern[i] = (uint8_t)(i * 31 + 7);
+    }
+
+    for (int mode = SPIF_TEST_SPI; mode <= SPIF_TEST_QSPI; mode++) {
+        spif_test_srand(1);
+        p99 = test_queue_latency((spif_test_mode_t)mode, 0);
+        SPIF_TEST_CHECK(p99 > 10000);
+
+        spif_test_srand(1);
+        p99 = test_queue_latency((spif_test_mode_t)mode, 1);
+        SPIF_TEST_CHECK(p99 < 1000);
+    }
+
+    test_queue_producers();
+    test_queue_wait();
+
+    printf("test_queue ok\r\n");
+
+    return 0;
+}
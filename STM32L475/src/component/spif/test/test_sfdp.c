@@ -0,0 +1,121 @@
+/*
+ * test_sfdp.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+#include "spif_sfdp.h"
+
+#define TEST_BFPT_PTR    0x30
+
+static uint8_t s_table[256];
+
+static int _test_sfdp_read(uint32_t addr, uint8_t *buf, uint32_t size, void *arg)
+{
+    (void)arg;
+
+    if (addr + size > sizeof(s_table)) {
+        return SPIF_FAIL;
+    }
+
+    memcpy(buf, &s_table[addr], size);
+
+    return SPIF_SUCCESS;
+}
+
+static void _test_sfdp_put(uint32_t offset, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        s_table[offset + i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+/* SFDP 1.6 header, a 9 DWORD BFPT with the given density (DWORD 2) and erase types 1, 2 (DWORD 8) */
+static void _test_sfdp_make(uint32_t density, uint32_t erase)
+{
+    memset(s_table, 0, sizeof(s_table));
+    memcpy(s_table, "SFDP", 4);
+    s_table[4] = 6;
+    s_table[5] = 1;
+
+    s_table[11] = 9;
+    _test_sfdp_put(12, 0xFF000000 | TEST_BFPT_PTR);
+
+    _test_sfdp_put(TEST_BFPT_PTR + 4, density);
+    _test_sfdp_put(TEST_BFPT_PTR + 28, erase);
+}
+
+static void test_sfdp_table(void)
+{
+    spif_sfdp_info_t info;
+
+    /* 128 Mbit, 4K 0x20 and 32K 0x52 */
+    _test_sfdp_make(0x07FFFFFF, 0x520F200C);
+    SPIF_TEST_CHECK(spif_sfdp_parse(_test_sfdp_read, NULL, &info) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(info.chip_size == 16 * 1024 * 1024);
+    SPIF_TEST_CHECK(info.erase[0].size == 4096);
+    SPIF_TEST_CHECK(info.erase[0].cmd == 0x20);
+    SPIF_TEST_CHECK(info.erase[1].size == 32768);
+    SPIF_TEST_CHECK(info.erase[1].cmd == 0x52);
+
+    /* density 2^N bits: N = 63 is the largest shift, N = 64 and up is corrupt */
+    _test_sfdp_make(0x8000003F, 0x520F200C);
+    SPIF_TEST_CHECK(spif_sfdp_parse(_test_sfdp_read, NULL, &info) == SPIF_SUCCESS);
+    _test_sfdp_make(0x80000040, 0x520F200C);
+    SPIF_TEST_CHECK(spif_sfdp_parse(_test_sfdp_read, NULL, &info) == SPIF_FAIL);
+    _test_sfdp_make(0xFFFFFFFF, 0x520F200C);
+    SPIF_TEST_CHECK(spif_sfdp_parse(_test_sfdp_read, NULL, &info) == SPIF_FAIL);
+
+    /* an erase size of 2^40 is dropped like an unused type */
+    _test_sfdp_make(0x07FFFFFF, 0x5228200C);
+    SPIF_TEST_CHECK(spif_sfdp_parse(_test_sfdp_read, NULL, &info) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(info.erase[0].size == 4096);
+    SPIF_TEST_CHECK(info.erase[1].size == 0);
+
+    /* no usable erase type at all */
+    _test_sfdp_make(0x07FFFFFF, 0x52FF0020);
+    SPIF_TEST_CHECK(spif_sfdp_parse(_test_sfdp_read, NULL, &info) == SPIF_FAIL);
+
+    /* bad signature, BFPT too short */
+    _test_sfdp_make(0x07FFFFFF, 0x520F200C);
+    s_table[0] = 'X';
+    SPIF_TEST_CHECK(spif_sfdp_parse(_test_sfdp_read, NULL, &info) == SPIF_FAIL);
+    _test_sfdp_make(0x07FFFFFF, 0x520F200C);
+    s_table[11] = 8;
+    SPIF_TEST_CHECK(spif_sfdp_parse(_test_sfdp_read, NULL, &info) == SPIF_FAIL);
+}
+
+/* a JEDEC ID missing from the static table is identified from the SFDP of the simulator */
+static void test_sfdp_sim(void)
+{
+    spif_test_dev_t t;
+    spif_port_sim_config_t config;
+
+    spif_port_sim_config_default(&config);
+    config.jedec_id[2] = 0x17;
+    config.size = 8 * 1024 * 1024;
+
+    for (int mode = SPIF_TEST_SPI; mode <= SPIF_TEST_QSPI; mode++) {
+        SPIF_TEST_CHECK(spif_test_open(&t, 0, (spif_test_mode_t)mode, &config) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(t.dev.flash.chip_size == config.size);
+        SPIF_TEST_CHECK(t.dev.flash.sector_size == 4096);
+        SPIF_TEST_CHECK(t.dev.flash.page_size == 256);
+        SPIF_TEST_CHECK(t.dev.flash.suspend_cmd == 0x75);
+        SPIF_TEST_CHECK(t.dev.flash.resume_cmd == 0x7A);
+
+        SPIF_TEST_CHECK(spif_erase_range(&t.dev, config.size - 0x10000, 0x10000, NULL) == SPIF_SUCCESS);
+        spif_test_close(&t);
+    }
+}
+
+int main(void)
+{
+    test_sfdp_table();
+    test_sfdp_sim();
+
+    printf("test_sfdp ok\r\n");
+
+    return 0;
+}
@@ -0,0 +1,222 @@
+/*
+ * test_spif.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+
+#define TEST_BASE    0x10000
+#define TEST_SIZE    9000
+
+static uint8_t s_pattern[TEST_SIZE];
+static uint8_t s_buf[TEST_SIZE];
+
+static void test_read_write(spif_dev_t *dev)
+{
+    uint32_t sector = dev->flash.sector_size;
+    uint8_t a = 0xF0;
+    uint8_t b = 0x0F;
+
+    SPIF_TEST_CHECK(spif_erase_range(dev, TEST_BASE, 0x10000, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_read(dev, TEST_BASE, s_buf, TEST_SIZE) == SPIF_SUCCESS);
+    for (uint32_t i = 0; i < TEST_SIZE; i++) {
+        SPIF_TEST_CHECK(s_buf[i] == 0xFF);
+    }
+
+    SPIF_TEST_CHECK(spif_write(dev, TEST_BASE, s_pattern, TEST_SIZE, SPIF_WRITE_MODE_PROGRAM) == SPIF_SUCCESS);
+    memset(s_buf, 0, TEST_SIZE);
+    SPIF_TEST_CHECK(spif_read(dev, TEST_BASE, s_buf, TEST_SIZE) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(memcmp(s_buf, s_pattern, TEST_SIZE) == 0);
+    memset(s_buf, 0, TEST_SIZE);
+    SPIF_TEST_CHECK(spif_fast_read(dev, TEST_BASE + 3, s_buf, TEST_SIZE - 3) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(memcmp(s_buf, s_pattern + 3, TEST_SIZE - 3) == 0);
+
+    /* NOR: a program only clears bits */
+    SPIF_TEST_CHECK(spif_page_program(dev, TEST_BASE + 0xF000, &a, 1) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_page_program(dev, TEST_BASE + 0xF000, &b, 1) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_read(dev, TEST_BASE + 0xF000, s_buf, 1) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(s_buf[0] == 0x00);
+
+    /* read-modify-write keeps the rest of the sector */
+    SPIF_TEST_CHECK(spif_write(dev, TEST_BASE + 16, s_pattern + 1000, 100, SPIF_WRITE_MODE_ERASE) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_read(dev, TEST_BASE, s_buf, sector) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(memcmp(s_buf, s_pattern, 16) == 0);
+    SPIF_TEST_CHECK(memcmp(s_buf + 16, s_pattern + 1000, 100) == 0);
+    SPIF_TEST_CHECK(memcmp(s_buf + 116, s_pattern + 116, sector - 116) == 0);
+    SPIF_TEST_CHECK(spif_write(dev, TEST_BASE + 16, s_pattern + 16, 100, SPIF_WRITE_MODE_ERASE) == SPIF_SUCCESS);
+}
+
+static void test_write_diff(spif_dev_t *dev)
+{
+    spif_write_stats_t stats;
+    uint32_t page = dev->flash.page_size;
+
+    /* unchanged pages are skipped, 1 -> 0 only needs no erase */
+    spif_write_stats_reset(dev);
+    SPIF_TEST_CHECK(spif_write(dev, TEST_BASE, s_pattern, TEST_SIZE, SPIF_WRITE_MODE_DIFF) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_write_stats_get(dev, &stats) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(stats.pages_programmed == 0);
+    SPIF_TEST_CHECK(stats.erases == 0);
+    SPIF_TEST_CHECK(stats.pages_skipped >= TEST_SIZE / page);
+
+    memcpy(s_buf, s_pattern, TEST_SIZE);
+    s_buf[page + 5] &= 0x0F;
+    spif_write_stats_reset(dev);
+    SPIF_TEST_CHECK(spif_write(dev, TEST_BASE, s_buf, TEST_SIZE, SPIF_WRITE_MODE_DIFF) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_write_stats_get(dev, &stats) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(stats.pages_programmed == 1);
+    SPIF_TEST_CHECK(stats.erases == 0);
+
+    /* 0 -> 1 erases the sector */
+    spif_write_stats_reset(dev);
+    SPIF_TEST_CHECK(spif_write(dev, TEST_BASE, s_pattern, TEST_SIZE, SPIF_WRITE_MODE_DIFF) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_write_stats_get(dev, &stats) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(stats.erases == 1);
+
+    SPIF_TEST_CHECK(spif_read(dev, TEST_BASE, s_buf, TEST_SIZE) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(memcmp(s_buf, s_pattern, TEST_SIZE) == 0);
+}
+
+static void test_async(spif_dev_t *dev)
+{
+    spif_async_t token;
+    spif_async_t erase;
+    uint32_t addr = 0x40000;
+
+    memset(s_buf, 0, TEST_SIZE);
+    SPIF_TEST_CHECK(spif_read_async(dev, TEST_BASE, s_buf, 4096, &token, NULL, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_async_wait(dev, &token) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(memcmp(s_buf, s_pattern, 4096) == 0);
+
+    SPIF_TEST_CHECK(spif_sector_erase(dev, addr) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_page_program_async(dev, addr, s_pattern, dev->flash.page_size, &token, NULL, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_async_wait(dev, &token) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_read(dev, addr, s_buf, dev->flash.page_size) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(memcmp(s_buf, s_pattern, dev->flash.page_size) == 0);
+
+    if (dev->flash.suspend_cmd == 0) {
+        return;
+    }
+
+    /* a suspended erase lets reads in, waiting on it is refused until it is resumed */
+    SPIF_TEST_CHECK(spif_erase_async(dev, addr, 0x10000, &erase, NULL, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_erase_suspend(dev) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_read(dev, TEST_BASE, s_buf, 256) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(memcmp(s_buf, s_pattern, 256) == 0);
+    SPIF_TEST_CHECK(spif_async_wait(dev, &erase) == SPIF_BUSY);
+    SPIF_TEST_CHECK(spif_erase_resume(dev) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_async_wait(dev, &erase) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_read(dev, addr, s_buf, 256) == SPIF_SUCCESS);
+    for (uint32_t i = 0; i < 256; i++) {
+        SPIF_TEST_CHECK(s_buf[i] == 0xFF);
+    }
+}
+
+/* an erase slower than the maximum time of its type times out and stays in flight */
+static void test_async_timeout(void)
+{
+    spif_test_dev_t t;
+    spif_port_sim_config_t config;
+    spif_async_t token;
+
+    spif_port_sim_config_default(&config);
+    config.t_se_us = 600000; /* tSE max of the W25Q128JV is 400 ms */
+
+    SPIF_TEST_CHECK(spif_test_open(&t, 0, SPIF_TEST_QSPI, &config) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_erase_async(&t.dev, 0x40000, 4096, &token, NULL, NULL) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_async_wait(&t.dev, &token) == SPIF_TIMEOUT);
+    SPIF_TEST_CHECK(spif_sector_erase(&t.dev, 0x50000) == SPIF_BUSY);
+    SPIF_TEST_CHECK(spif_async_wait(&t.dev, &token) == SPIF_SUCCESS);
+    spif_test_close(&t);
+}
+
+static void test_read_modes(spif_dev_t *dev)
+{
+    const uint8_t *base = NULL;
+    int ret = SPIF_SUCCESS;
+
+    for (int mode = SPIF_READ_MODE_NORMAL; mode <= SPIF_READ_MODE_QPI; mode++) {
+        ret = spif_set_read_mode(dev, (spif_read_mode_t)mode);
+        if (ret != SPIF_SUCCESS) {
+            /* not supported by the ops mode or the flash */
+            continue;
+        }
+
+        memset(s_buf, 0, TEST_SIZE);
+        SPIF_TEST_CHECK(spif_read(dev, TEST_BASE + 1, s_buf, TEST_SIZE - 1) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(memcmp(s_buf, s_pattern + 1, TEST_SIZE - 1) == 0);
+    }
+
+    if (spif_mmap(dev, &base) == SPIF_SUCCESS) {
+        SPIF_TEST_CHECK(memcmp(base + TEST_BASE, s_pattern, TEST_SIZE) == 0);
+
+        /* spif_read() through the window stays inside the flash */
+        SPIF_TEST_CHECK(spif_read(dev, TEST_BASE, s_buf, TEST_SIZE) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(memcmp(s_buf, s_pattern, TEST_SIZE) == 0);
+        SPIF_TEST_CHECK(spif_read(dev, dev->flash.chip_size - 16, s_buf, 32) == SPIF_FAIL);
+        SPIF_TEST_CHECK(spif_read(dev, dev->flash.chip_size + 16, s_buf, 16) == SPIF_FAIL);
+        SPIF_TEST_CHECK(spif_read(dev, 0xFFFFFFF0, s_buf, 32) == SPIF_FAIL);
+
+        SPIF_TEST_CHECK(spif_munmap(dev) == SPIF_SUCCESS);
+    }
+}
+
+int main(void)
+{
+    spif_test_dev_t t;
+    spif_port_sim_stats_t stats;
+    spif_port_sim_config_t config;
+
+    for (uint32_t i = 0; i < TEST_SIZE; i++) {
+        s_pattern[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+
+    for (int mode = SPIF_TEST_SPI; mode < SPIF_TEST_MODE_MAX; mode++) {
+        SPIF_TEST_CHECK(spif_test_open(&t, 0, (spif_test_mode_t)mode, NULL) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(t.dev.flash.chip_size != 0);
+
+        test_read_write(&t.dev);
+        test_write_diff(&t.dev);
+        test_async(&t.dev);
+        test_read_modes(&t.dev);
+
+        spif_test_stats_print(&t);
+        spif_port_sim_stats_get(t.id, &stats);
+        SPIF_TEST_CHECK(stats.violations == 0);
+        spif_test_close(&t);
+    }
+
+    /* W25Q128JV-IM with DTR fast read from the table, a flash configured from SFDP with QPI */
+    for (int i = 0; i < 2; i++) {
+        spif_port_sim_config_default(&config);
+        if (i == 0) {
+            config.jedec_id[1] = 0x70;
+            config.dtr = 1;
+        } else {
+            config.jedec_id[2] = 0x17;
+            config.size = 8 * 1024 * 1024;
+            config.qpi = 1;
+        }
+
+        SPIF_TEST_CHECK(spif_test_open(&t, 0, SPIF_TEST_QSPI, &config) == SPIF_SUCCESS);
+        test_read_write(&t.dev);
+        test_read_modes(&t.dev);
+        SPIF_TEST_CHECK(spif_set_read_mode(&t.dev, (i == 0) ? SPIF_READ_MODE_QUAD_IO_DTR : SPIF_READ_MODE_QPI) == SPIF_SUCCESS);
+        test_read_write(&t.dev);
+        test_write_diff(&t.dev);
+        test_async(&t.dev);
+
+        spif_test_stats_print(&t);
+        spif_port_sim_stats_get(t.id, &stats);
+        SPIF_TEST_CHECK(stats.violations == 0);
+        spif_test_close(&t);
+    }
+
+    test_async_timeout();
+
+    printf("test_spif ok\r\n");
+
+    return 0;
+}
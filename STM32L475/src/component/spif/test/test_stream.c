@@ -0,0 +1,159 @@
+/*
+ * test_stream.c
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ * SPDX-FileCopyrightText: 2025 Zeepunt
+ */
+#include <string.h>
+#include "spif_test.h"
+#include "spif_stream.h"
+
+#define TEST_SIZE       (256 * 1024)
+#define TEST_OFFSET     1000 /* stream start, not aligned to anything */
+#define TEST_CHUNK_MAX  4096
+#define TEST_OPS        3000
+
+#define TEST_PIECE      64
+#define TEST_WORK_US    3
+
+static spif_test_dev_t s_test;
+
+static uint8_t s_ref[TEST_SIZE];
+static uint8_t s_buf[TEST_SIZE];
+static uint8_t s_stream_buf[2 * TEST_CHUNK_MAX];
+
+/* random read, get and seek against the reference, for chunks of 16 B to 4 KB */
+static void test_stream_random(spif_dev_t *dev)
+{
+    spif_stream_t stream;
+    spif_stream_config_t config;
+    const uint8_t *data = NULL;
+    uint32_t pos = 0;
+    uint32_t want = 0;
+    uint32_t got = 0;
+    uint32_t op = 0;
+
+    for (uint32_t chunk = 16; chunk <= TEST_CHUNK_MAX; chunk *= 4) {
+        config.dev = dev;
+        config.addr = TEST_OFFSET;
+        config.size = TEST_SIZE - 3 * TEST_OFFSET;
+        config.buf = s_stream_buf;
+        config.chunk_size = chunk;
+        SPIF_TEST_CHECK(spif_stream_open(&stream, &config) == SPIF_SUCCESS);
+        pos = 0;
+
+        for (int i = 0; i < TEST_OPS; i++) {
+            op = spif_test_rand() % 10;
+
+            if (op <= 1) {
+                /* far seek, or a short skip forward */
+                if (op == 0) {
+                    pos = spif_test_rand() % (config.size + 1);
+                } else {
+                    pos += spif_test_rand() % (2 * chunk);
+                    pos = (pos > config.size) ? config.size : pos;
+                }
+
+                SPIF_TEST_CHECK(spif_stream_seek(&stream, pos) == SPIF_SUCCESS);
+            } else if (op == 2) {
+                SPIF_TEST_CHECK(spif_stream_get(&stream, &data, &got) == SPIF_SUCCESS);
+                SPIF_TEST_CHECK(memcmp(data, s_ref + TEST_OFFSET + pos, got) == 0);
+                SPIF_TEST_CHECK((got > 0) || (pos == config.size));
+                pos += got;
+            } else {
+                want = spif_test_rand() % (3 * chunk);
+                SPIF_TEST_CHECK(spif_stream_read(&stream, s_buf, want, &got) == SPIF_SUCCESS);
+                SPIF_TEST_CHECK(got == ((config.size - pos < want) ? config.size - pos : want));
+                SPIF_TEST_CHECK(memcmp(s_buf, s_ref + TEST_OFFSET + pos, got) == 0);
+                pos += got;
+            }
+
+            SPIF_TEST_CHECK(spif_stream_tell(&stream) == pos);
+        }
+
+        /* close waits for the read-ahead, the device is free again */
+        SPIF_TEST_CHECK(spif_stream_close(&stream) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(spif_read(dev, 0, s_buf, 16) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(memcmp(s_buf, s_ref, 16) == 0);
+    }
+}
+
+/**
+ * 256 KB in 64 B pieces with 3 us of work per piece: spif_fast_read() per piece against a stream,
+ * the read-ahead overlaps the work with the transfer
+ * @return time of the stream over the time of the fast reads
+ */
+static double test_stream_overlap(spif_dev_t *dev, uint32_t chunk)
+{
+    spif_stream_t stream;
+    spif_stream_config_t config;
+    spif_stream_stats_t stats;
+    double start_us = 0;
+    double direct_us = 0;
+    double stream_us = 0;
+    uint32_t got = 0;
+
+    start_us = spif_test_time_us(&s_test);
+    for (uint32_t pos = 0; pos < TEST_SIZE; pos += TEST_PIECE) {
+        SPIF_TEST_CHECK(spif_fast_read(dev, pos, s_buf + pos, TEST_PIECE) == SPIF_SUCCESS);
+        dev->plat_ops.delay_us(TEST_WORK_US);
+    }
+    direct_us = spif_test_time_us(&s_test) - start_us;
+    SPIF_TEST_CHECK(memcmp(s_buf, s_ref, TEST_SIZE) == 0);
+
+    config.dev = dev;
+    config.addr = 0;
+    config.size = TEST_SIZE;
+    config.buf = s_stream_buf;
+    config.chunk_size = chunk;
+
+    memset(s_buf, 0, TEST_SIZE);
+    start_us = spif_test_time_us(&s_test);
+    SPIF_TEST_CHECK(spif_stream_open(&stream, &config) == SPIF_SUCCESS);
+    for (uint32_t pos = 0; pos < TEST_SIZE; pos += got) {
+        SPIF_TEST_CHECK(spif_stream_read(&stream, s_buf + pos, TEST_PIECE, &got) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(got == TEST_PIECE);
+        dev->plat_ops.delay_us(TEST_WORK_US);
+    }
+    SPIF_TEST_CHECK(spif_stream_stats_get(&stream, &stats) == SPIF_SUCCESS);
+    SPIF_TEST_CHECK(spif_stream_close(&stream) == SPIF_SUCCESS);
+    stream_us = spif_test_time_us(&s_test) - start_us;
+    SPIF_TEST_CHECK(memcmp(s_buf, s_ref, TEST_SIZE) == 0);
+
+    printf("%s, chunk %u: fast reads %.1f ms, stream %.1f ms; chunks %u, sync reads %u, stalls %u\r\n",
+           spif_test_mode_name[s_test.mode], chunk, direct_us / 1000, stream_us / 1000,
+           stats.chunks, stats.sync_reads, stats.stalls);
+
+    return stream_us / direct_us;
+}
+
+int main(void)
+{
+    for (int mode = SPIF_TEST_SPI; mode < SPIF_TEST_MODE_MAX; mode++) {
+        SPIF_TEST_CHECK(spif_test_open(&s_test, 0, (spif_test_mode_t)mode, NULL) == SPIF_SUCCESS);
+
+        spif_test_srand(mode + 7);
+        for (uint32_t i = 0; i < TEST_SIZE; i++) {
+            s_ref[i] = (uint8_t)spif_test_rand();
+        }
+
+        SPIF_TEST_CHECK(spif_erase_range(&s_test.dev, 0, TEST_SIZE, NULL) == SPIF_SUCCESS);
+        SPIF_TEST_CHECK(spif_write(&s_test.dev, 0, s_ref, TEST_SIZE, SPIF_WRITE_MODE_PROGRAM) == SPIF_SUCCESS);
+
+        test_stream_random(&s_test.dev);
+
+        /* only the QSPI ops mode reads asynchronously, on SPI the stream costs about what plain reads do */
+        if (mode != SPIF_TEST_SPI) {
+            SPIF_TEST_CHECK(test_stream_overlap(&s_test.dev, 1024) < 0.6);
+            SPIF_TEST_CHECK(test_stream_overlap(&s_test.dev, 256) < 0.6);
+        } else {
+            SPIF_TEST_CHECK(test_stream_overlap(&s_test.dev, 1024) < 1.1);
+        }
+
+        spif_test_close(&s_test);
+    }
+
+    printf("test_stream ok\r\n");
+
+    return 0;
+}